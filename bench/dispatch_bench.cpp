@@ -0,0 +1,194 @@
+// standard
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+// internal
+#include "driver.h"
+#include "tinyc_to_cpp_converter.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TINYCPLUS_HAS_WAIT_STATUS
+#include <sys/wait.h>
+#endif
+
+/** Runtime cost of the object model emitted by the transpiler.
+
+    Every TinyC+ kernel in the kernels directory is transpiled, converted to C++ by the tinycToCpp converter, compiled by the host C++ compiler and timed. Kernels are named after the dispatch kind they exercise and declare their iterations count in the first line ("// iterations: N").
+    With --emit=cpp the kernels are emitted as C++ with native classes instead (see CppEmitter), so both object models can be compared on the same kernels.
+
+    Usage: dispatch-bench [--kernels=<dir>] [--cxx=<compiler>] [--cxx-flags=<flags>] [--runs=<n>] [--emit=tinyc|cpp]
+ */
+
+#ifndef TINYCPLUS_DISPATCH_KERNELS_DIR
+#define TINYCPLUS_DISPATCH_KERNELS_DIR "bench/dispatch"
+#endif
+
+#ifndef TINYCPLUS_HOST_CXX
+#define TINYCPLUS_HOST_CXX "c++"
+#endif
+
+namespace {
+
+    namespace fs = std::filesystem;
+
+    struct Kernel {
+        std::string kind;
+        fs::path source;
+        size_t iterations = 0;
+    };
+
+    struct Measurement {
+        bool isSuccess = false;
+        std::string error;
+        double milliseconds = 0;
+    };
+
+    size_t readIterations(fs::path const & source) {
+        std::ifstream input{source};
+        std::string line;
+        std::getline(input, line);
+        auto prefix = std::string{"// iterations:"};
+        if (line.rfind(prefix, 0) != 0) {
+            throw std::runtime_error(STR("kernel " << source << " does not declare its iterations count"));
+        }
+        return std::stoul(line.substr(prefix.size()));
+    }
+
+    /** Runs the command, returns true if it exited normally with a status the kernels use (0 or 1).
+     */
+    bool runCommand(std::string const & command) {
+        int status = std::system(command.c_str());
+#ifdef TINYCPLUS_HAS_WAIT_STATUS
+        return status != -1 && WIFEXITED(status) && WEXITSTATUS(status) <= 1;
+#else
+        return status == 0 || status == 1;
+#endif
+    }
+
+    std::string quote(fs::path const & path) {
+        return "\"" + path.string() + "\"";
+    }
+
+    Measurement measure(Kernel const & kernel, fs::path const & workDirectory, std::string const & cxx, std::string const & cxxFlags, size_t runs, tinycplus::Backend backend) {
+        Measurement result;
+        auto tinycPath = workDirectory / (kernel.kind + ".tc");
+        auto cppPath = workDirectory / (kernel.kind + ".cpp");
+        auto binaryPath = workDirectory / kernel.kind;
+        // * TinyC+ -> TinyC, or directly C++
+        tinycplus::CompileOptions options;
+        options.backend = backend;
+        try {
+            std::ofstream output{backend == tinycplus::Backend::Cpp ? cppPath : tinycPath};
+            tinycplus::compileFile(kernel.source.string(), output, options);
+        } catch (std::exception & exception) {
+            result.error = "transpile " + tinycplus::describeError(exception);
+            return result;
+        }
+        // * TinyC -> C++
+        if (backend == tinycplus::Backend::TinyC) {
+            std::ofstream cpp{cppPath};
+            tinycToCpp::execute(tinycPath.string(), cpp);
+        }
+        // * C++ -> binary
+        auto compileCommand = cxx + " " + cxxFlags + " " + quote(cppPath) + " " + quote(workDirectory / "opaque.cpp") + " -o " + quote(binaryPath);
+        if (!runCommand(compileCommand)) {
+            result.error = "compile failed: " + compileCommand;
+            return result;
+        }
+        // * best of the runs, the least disturbed one
+        double best = 0;
+        for (size_t i = 0; i < runs; ++i) {
+            auto start = std::chrono::steady_clock::now();
+            if (!runCommand(quote(binaryPath))) {
+                result.error = "run failed: " + binaryPath.string();
+                return result;
+            }
+            auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            best = i == 0 ? milliseconds : std::min(best, milliseconds);
+        }
+        result.milliseconds = best;
+        result.isSuccess = true;
+        return result;
+    }
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) {
+    fs::path kernelsDirectory{TINYCPLUS_DISPATCH_KERNELS_DIR};
+    std::string cxx{TINYCPLUS_HOST_CXX};
+    std::string cxxFlags{"-O2 -w"};
+    size_t runs = 3;
+    auto backend = tinycplus::Backend::TinyC;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--kernels=", 0) == 0) {
+            kernelsDirectory = value;
+        } else if (arg.rfind("--cxx=", 0) == 0) {
+            cxx = value;
+        } else if (arg.rfind("--cxx-flags=", 0) == 0) {
+            cxxFlags = value;
+        } else if (arg.rfind("--runs=", 0) == 0) {
+            runs = std::max<size_t>(1, std::stoul(value));
+        } else if (arg == "--emit=cpp") {
+            backend = tinycplus::Backend::Cpp;
+        } else if (arg == "--emit=tinyc") {
+            backend = tinycplus::Backend::TinyC;
+        } else {
+            std::cerr << "[dispatch] unknown argument " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Kernel> kernels;
+    try {
+        for (auto & entry : fs::directory_iterator{kernelsDirectory}) {
+            if (entry.path().extension() != ".tcp") continue;
+            kernels.push_back(Kernel{entry.path().stem().string(), entry.path(), readIterations(entry.path())});
+        }
+    } catch (std::exception & exception) {
+        std::cerr << "[dispatch] " << exception.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::sort(kernels.begin(), kernels.end(), [](Kernel const & a, Kernel const & b) { return a.kind < b.kind; });
+
+    auto workDirectory = fs::temp_directory_path() / "tinycplus_dispatch";
+    fs::create_directories(workDirectory);
+    {
+        // kernels get their inputs through a function the compiler cannot see into
+        std::ofstream opaque{workDirectory / "opaque.cpp"};
+        opaque << "int opaque(int value) { return value; }\n";
+    }
+
+    std::cout << "[dispatch] compiler: " << cxx << " " << cxxFlags << ", best of " << runs << " runs"
+        << ", emitted as " << (backend == tinycplus::Backend::Cpp ? "cpp" : "tinyc") << std::endl;
+    std::cout << std::left << std::setw(20) << "kind"
+        << std::right << std::setw(14) << "iterations"
+        << std::setw(12) << "ms"
+        << std::setw(12) << "ns/op"
+        << std::endl;
+    bool isFailed = false;
+    for (auto & kernel : kernels) {
+        auto result = measure(kernel, workDirectory, cxx, cxxFlags, runs, backend);
+        std::cout << std::left << std::setw(20) << kernel.kind << std::right;
+        if (!result.isSuccess) {
+            std::cout << "  " << result.error << std::endl;
+            isFailed = true;
+            continue;
+        }
+        std::cout << std::setw(14) << kernel.iterations
+            << std::fixed << std::setprecision(1)
+            << std::setw(12) << result.milliseconds
+            << std::setprecision(3)
+            << std::setw(12) << result.milliseconds * 1e6 / kernel.iterations
+            << std::endl;
+    }
+    return isFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,278 @@
+#pragma once
+
+// standard
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+
+namespace tinycplus {
+
+    /** Shape of a generated TinyC+ program.
+     */
+    struct GeneratorParams {
+        size_t classesCount = 100;
+        /** Length of each inheritance chain, 1 means every class inherits only the default object class.
+         */
+        size_t hierarchyDepth = 4;
+        size_t interfacesPerClass = 1;
+        size_t methodsPerClass = 4;
+        size_t fieldsPerClass = 2;
+        /** Number of statements in every function and method body.
+         */
+        size_t bodySize = 4;
+        /** Depth of nested calls in generated expressions.
+         */
+        size_t expressionNesting = 3;
+        uint64_t seed = 1;
+    };
+
+    /** Deterministic generator of valid TinyC+ programs for benchmarks.
+        The same parameters always produce the same program, so results are comparable between runs and machines.
+
+        Generated program consists of:
+            * pool of interfaces with one method each,
+            * classes organized into inheritance chains of the given depth, where the chain roots declare virtual methods and the derived classes override them,
+            * a function per class which calls class methods, interface methods and classcasts,
+            * the main function.
+     */
+    class ProgramGenerator {
+    private:
+        GeneratorParams params_;
+        uint64_t state_;
+        std::stringstream output_;
+        size_t declarationsCount_ = 0;
+    public:
+        ProgramGenerator(GeneratorParams const & params)
+            : params_{params}
+            , state_{params.seed * 6364136223846793005ull + 1442695040888963407ull} {
+        }
+
+        /** Generates the whole program.
+         */
+        std::string generate() {
+            output_.str("");
+            declarationsCount_ = 0;
+            printHelpers();
+            size_t interfacesCount = getInterfacesCount();
+            for (size_t i = 0; i < interfacesCount; ++i) {
+                printInterface(i);
+            }
+            std::vector<std::set<size_t>> chainInterfaces;
+            std::vector<std::set<size_t>> classInterfaces;
+            for (size_t c = 0; c < params_.classesCount; ++c) {
+                if (getDepth(c) == 0) chainInterfaces.clear();
+                chainInterfaces.push_back(pickInterfaces(interfacesCount));
+                classInterfaces.push_back(chainInterfaces.back());
+                printClass(c, chainInterfaces);
+            }
+            for (size_t c = 0; c < params_.classesCount; ++c) {
+                printUseFunction(c, classInterfaces[c]);
+            }
+            printMain();
+            return output_.str();
+        }
+
+        /** Number of declarations (functions, methods, fields, types) in the last generated program.
+         */
+        size_t declarationsCount() const {
+            return declarationsCount_;
+        }
+
+        /** Approximate number of declarations generated for the parameters, used to pick the class count for a target scale.
+         */
+        static size_t DeclarationsPerClass(GeneratorParams const & params) {
+            // class, its fields, methods, interface methods and its use function
+            return 1 + params.fieldsPerClass + params.methodsPerClass + params.interfacesPerClass + 1;
+        }
+
+    private:
+        uint64_t next() {
+            // LCG constants from Knuth's MMIX
+            state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+            return state_ >> 33;
+        }
+
+        size_t nextBelow(size_t limit) {
+            return limit == 0 ? 0 : static_cast<size_t>(next() % limit);
+        }
+
+        size_t getDepth(size_t classIndex) const {
+            return params_.hierarchyDepth <= 1 ? 0 : classIndex % params_.hierarchyDepth;
+        }
+
+        size_t getInterfacesCount() const {
+            return params_.interfacesPerClass == 0 ? 0 : params_.interfacesPerClass * 4;
+        }
+
+        std::set<size_t> pickInterfaces(size_t interfacesCount) {
+            std::set<size_t> result;
+            size_t wanted = std::min(params_.interfacesPerClass, interfacesCount);
+            while (result.size() < wanted) {
+                result.insert(nextBelow(interfacesCount));
+            }
+            return result;
+        }
+
+        void printHelpers() {
+            output_ << "int mix(int a, int b) {\n"
+                << "    return a * 3 + b;\n"
+                << "}\n\n";
+            ++declarationsCount_;
+        }
+
+        void printInterface(size_t index) {
+            output_ << "interface I" << index << " {\n"
+                << "    int i" << index << "_call(int a);\n"
+                << "};\n\n";
+            declarationsCount_ += 2;
+        }
+
+        /** Prints an int expression over the given variables with calls nested to the given depth.
+         */
+        void printExpression(std::vector<std::string> const & variables, size_t nesting) {
+            auto & variable = variables[nextBelow(variables.size())];
+            if (nesting == 0) {
+                switch (nextBelow(3)) {
+                    case 0: output_ << variable << " + " << nextBelow(100); break;
+                    case 1: output_ << variable << " * " << (1 + nextBelow(9)); break;
+                    default: output_ << variable; break;
+                }
+                return;
+            }
+            output_ << "mix(";
+            printExpression(variables, nesting - 1);
+            output_ << ", " << variable << " - " << nextBelow(10) << ")";
+        }
+
+        void printBody(std::vector<std::string> variables, std::string const & indent) {
+            size_t firstLocal = variables.size();
+            for (size_t s = 0; s < params_.bodySize; ++s) {
+                std::string name = "v" + std::to_string(s);
+                switch (s < 1 ? 0 : nextBelow(4)) {
+                    case 0:
+                    case 1:
+                        output_ << indent << "int " << name << " = ";
+                        printExpression(variables, params_.expressionNesting);
+                        output_ << ";\n";
+                        variables.push_back(name);
+                        break;
+                    case 2: {
+                        auto & local = variables[firstLocal + nextBelow(variables.size() - firstLocal)];
+                        output_ << indent << "if (" << local << " < " << nextBelow(1000) << ") {\n"
+                            << indent << "    " << local << " = " << local << " + 1;\n"
+                            << indent << "} else {\n"
+                            << indent << "    " << local << " = " << local << " - 1;\n"
+                            << indent << "}\n";
+                        break;
+                    }
+                    default: {
+                        auto & local = variables[firstLocal + nextBelow(variables.size() - firstLocal)];
+                        output_ << indent << "while (" << local << " > " << (1000 + nextBelow(1000)) << ") {\n"
+                            << indent << "    " << local << " = " << local << " / 2;\n"
+                            << indent << "}\n";
+                        break;
+                    }
+                }
+            }
+            output_ << indent << "return ";
+            if (variables.size() > firstLocal) {
+                output_ << variables.back();
+            } else {
+                printExpression(variables, params_.expressionNesting);
+            }
+            output_ << ";\n";
+        }
+
+        void printMethod(std::string const & name, char const * virtuality, std::vector<std::string> const & fields) {
+            output_ << "    public int " << name << "(int a) " << virtuality << " {\n";
+            std::vector<std::string> variables{"a"};
+            for (auto & field : fields) {
+                variables.push_back("this->" + field);
+            }
+            printBody(variables, "        ");
+            output_ << "    }\n";
+            ++declarationsCount_;
+        }
+
+        void printClass(size_t index, std::vector<std::set<size_t>> const & chainInterfaces) {
+            size_t depth = getDepth(index);
+            auto & interfaces = chainInterfaces.back();
+            output_ << "class C" << index;
+            if (depth > 0 || !interfaces.empty()) {
+                output_ << " :";
+            }
+            if (depth > 0) {
+                output_ << " C" << (index - 1);
+            }
+            if (!interfaces.empty()) {
+                output_ << " :";
+                bool isFirst = true;
+                for (auto i : interfaces) {
+                    output_ << (isFirst ? " I" : ", I") << i;
+                    isFirst = false;
+                }
+            }
+            output_ << " {\n";
+            ++declarationsCount_;
+            // * own fields, names are unique in the whole program
+            std::vector<std::string> fields;
+            for (size_t f = 0; f < params_.fieldsPerClass; ++f) {
+                fields.push_back("f" + std::to_string(index) + "_" + std::to_string(f));
+                output_ << "    public int " << fields.back() << ";\n";
+                ++declarationsCount_;
+            }
+            // * methods, introduced by chain root and overridden by its descendants
+            for (size_t m = 0; m < params_.methodsPerClass; ++m) {
+                printMethod("m" + std::to_string(m), depth == 0 ? "virtual" : "override", fields);
+            }
+            // * interface methods, introduced by the first class in the chain which implements the interface
+            for (auto i : interfaces) {
+                bool isInherited = false;
+                for (size_t c = 0; c + 1 < chainInterfaces.size(); ++c) {
+                    isInherited |= chainInterfaces[c].count(i) > 0;
+                }
+                printMethod("i" + std::to_string(i) + "_call", isInherited ? "override" : "virtual", fields);
+            }
+            output_ << "};\n\n";
+        }
+
+        void printUseFunction(size_t index, std::set<size_t> const & interfaces) {
+            output_ << "int use" << index << "(C" << index << " * p, int a) {\n";
+            std::vector<std::string> variables{"a"};
+            if (params_.methodsPerClass > 0) {
+                output_ << "    int r = p->m" << nextBelow(params_.methodsPerClass) << "(a);\n";
+                variables.push_back("r");
+            }
+            if (!interfaces.empty()) {
+                auto interfaceIndex = *interfaces.begin();
+                output_ << "    I" << interfaceIndex << " * view = classcast<I" << interfaceIndex << "*>(p);\n"
+                    << "    int q = view->i" << interfaceIndex << "_call(a);\n";
+                variables.push_back("q");
+            }
+            size_t depth = getDepth(index);
+            if (depth > 0) {
+                output_ << "    C" << (index - depth) << " * root = classcast<C" << (index - depth) << "*>(p);\n";
+            }
+            printBody(variables, "    ");
+            output_ << "}\n\n";
+            ++declarationsCount_;
+        }
+
+        void printMain() {
+            output_ << "int main() {\n"
+                << "    int result = 0;\n";
+            if (params_.classesCount > 0) {
+                // the constructor call initializes the vtable, a plain declaration would leave it null
+                output_ << "    C0 c = C0();\n"
+                    << "    result = use0(&c, 1);\n";
+            }
+            output_ << "    return result;\n"
+                << "}\n";
+            ++declarationsCount_;
+        }
+    };
+
+} // namespace tinycplus
@@ -0,0 +1,342 @@
+// standard
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <algorithm>
+#include <cstdint>
+
+// external
+#include "common/helpers.h"
+
+// internal
+#include "driver.h"
+#include "profiling.h"
+
+/** Performance regression gate of the transpiler, registered as the perf-check test.
+
+    Transpiles every program of the committed corpus and compares its time, allocated memory and output size against the stored baseline. Times are stored relative to a fixed calibration workload shaped like the transpiler and measured alternately with each program, so the baseline stays usable across machines of different speed and the load of the machine affects both alike.
+
+    Usage: perf-check [--record] [--corpus=<dir>] [--baseline=<file>] [--time-tolerance=<ratio>] [--memory-tolerance=<ratio>] [--output-tolerance=<ratio>]
+        --record    measures the corpus and rewrites the baseline instead of checking it
+
+    Memory is checked as the bytes allocated by each program, which is deterministic, and as the peak resident size of the whole run.
+    Fails when any metric grows more than its tolerance allows.
+ */
+
+#ifndef TINYCPLUS_PERF_CORPUS_DIR
+#define TINYCPLUS_PERF_CORPUS_DIR "bench/corpus"
+#endif
+
+#ifndef TINYCPLUS_PERF_BASELINE
+#define TINYCPLUS_PERF_BASELINE "bench/perf_baseline.txt"
+#endif
+
+namespace {
+
+    namespace fs = std::filesystem;
+
+    /** Discards everything, only counts the bytes written.
+     */
+    class CountingBuffer : public std::streambuf {
+    public:
+        size_t count = 0;
+    protected:
+        int overflow(int c) override {
+            if (c != traits_type::eof()) ++count;
+            return c;
+        }
+        std::streamsize xsputn(char const *, std::streamsize n) override {
+            count += static_cast<size_t>(n);
+            return n;
+        }
+    };
+
+    struct Metrics {
+        /** Wall time of a single transpilation divided by the calibration time.
+         */
+        double relativeTime = 0;
+        size_t allocatedBytes = 0;
+        size_t outputBytes = 0;
+    };
+
+    /** Single sample is at least this long, so that small programs are not measured at the clock resolution.
+     */
+    constexpr double MinSampleMilliseconds = 20;
+    constexpr size_t SamplesCount = 9;
+    /** Times over the tolerance are measured again before failing, a busy machine should not fail the check.
+     */
+    constexpr size_t RetriesCount = 2;
+
+    /** Time of the given work, in milliseconds per repetition.
+     */
+    template<typename WORK>
+    double measureOnce(WORK && work, size_t repetitions) {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t r = 0; r < repetitions; ++r) {
+            work();
+        }
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / repetitions;
+    }
+
+    /** Repetitions of the work which take at least the minimal sample time.
+     */
+    template<typename WORK>
+    size_t sampleRepetitions(WORK && work) {
+        return std::max<size_t>(1, static_cast<size_t>(MinSampleMilliseconds / std::max(measureOnce(work, 1), 0.001)));
+    }
+
+    /** Calibration workload shaped like the transpiler: short strings hashed into a table, a tree of small heap nodes walked by virtual calls on random branches and text streamed out.
+        A workload of plain arithmetic, such as sorting numbers, does not scale with the machine like the allocation and branch heavy transpilation does.
+     */
+    namespace calibration {
+
+        struct Node {
+            virtual ~Node() = default;
+            virtual int64_t evaluate(std::ostream & output) const = 0;
+        };
+
+        struct Leaf : Node {
+            std::string name;
+            int64_t value;
+            Leaf(std::string name, int64_t value): name{std::move(name)}, value{value} {}
+            int64_t evaluate(std::ostream & output) const override {
+                output << name;
+                return value;
+            }
+        };
+
+        struct Binary : Node {
+            char op;
+            std::unique_ptr<Node> left;
+            std::unique_ptr<Node> right;
+            Binary(char op, std::unique_ptr<Node> left, std::unique_ptr<Node> right): op{op}, left{std::move(left)}, right{std::move(right)} {}
+            int64_t evaluate(std::ostream & output) const override {
+                output << '(';
+                int64_t lhs = left->evaluate(output);
+                output << ' ' << op << ' ';
+                int64_t rhs = right->evaluate(output);
+                output << ')';
+                switch (op) {
+                    case '+': return lhs + rhs;
+                    case '-': return lhs - rhs;
+                    case '*': return lhs * (rhs & 7);
+                    default: return lhs ^ rhs;
+                }
+            }
+        };
+
+        class Builder {
+        private:
+            uint64_t state_ = 1;
+            std::unordered_map<std::string, int64_t> symbols_;
+        public:
+            uint32_t next() {
+                state_ = state_ * 6364136223846793005ull + 1442695040888963407ull;
+                return static_cast<uint32_t>(state_ >> 33);
+            }
+            std::unique_ptr<Node> build(int depth) {
+                if (depth == 0 || next() % 8 == 0) {
+                    auto name = "v" + std::to_string(next() % 4096);
+                    auto value = symbols_.insert(std::make_pair(name, static_cast<int64_t>(symbols_.size()))).first->second;
+                    return std::make_unique<Leaf>(std::move(name), value);
+                }
+                static char const ops[] = {'+', '-', '*', '^'};
+                auto left = build(depth - 1);
+                auto right = build(depth - 1);
+                return std::make_unique<Binary>(ops[next() % 4], std::move(left), std::move(right));
+            }
+        };
+
+    } // namespace calibration
+
+    void calibrate() {
+        calibration::Builder builder;
+        auto tree = builder.build(15);
+        std::stringstream output;
+        output << tree->evaluate(output);
+    }
+
+    /** Median of the program to calibration time ratios, each measured right after the other, so that both see the same state of the machine.
+     */
+    template<typename WORK>
+    double measureRelative(WORK && work, size_t repetitions, size_t calibrationRepetitions) {
+        std::vector<double> ratios;
+        for (size_t s = 0; s < SamplesCount; ++s) {
+            double calibrationMilliseconds = measureOnce(calibrate, calibrationRepetitions);
+            ratios.push_back(measureOnce(work, repetitions) / calibrationMilliseconds);
+        }
+        std::nth_element(ratios.begin(), ratios.begin() + ratios.size() / 2, ratios.end());
+        return ratios[ratios.size() / 2];
+    }
+
+    Metrics measureProgram(fs::path const & program, size_t calibrationRepetitions) {
+        Metrics result;
+        auto transpile = [&]() {
+            CountingBuffer buffer;
+            std::ostream output{&buffer};
+            tinycplus::compileFile(program.string(), output, tinycplus::CompileOptions{});
+            result.outputBytes = buffer.count;
+        };
+        // * first run warms up the caches and gives the memory and output size, which are deterministic
+        tinycplus::profiling::beginAllocationCounting();
+        size_t allocatedBefore = tinycplus::profiling::threadAllocatedBytes();
+        transpile();
+        result.allocatedBytes = tinycplus::profiling::threadAllocatedBytes() - allocatedBefore;
+        tinycplus::profiling::endAllocationCounting();
+        result.relativeTime = measureRelative(transpile, sampleRepetitions(transpile), calibrationRepetitions);
+        return result;
+    }
+
+    /** Baseline entry with the peak resident size of the whole run, in its allocated bytes column.
+     */
+    char const * const PeakResidentEntry = "peak-resident";
+
+    std::map<std::string, Metrics> readBaseline(fs::path const & path) {
+        std::ifstream input{path};
+        if (!input.good()) {
+            throw std::runtime_error(STR("baseline " << path << " not found, record it with --record"));
+        }
+        std::map<std::string, Metrics> result;
+        std::string line;
+        while (std::getline(input, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::stringstream stream{line};
+            std::string name;
+            Metrics metrics;
+            if (!(stream >> name >> metrics.relativeTime >> metrics.allocatedBytes >> metrics.outputBytes)) {
+                throw std::runtime_error(STR("malformed baseline line: " << line));
+            }
+            result[name] = metrics;
+        }
+        return result;
+    }
+
+    void writeBaseline(fs::path const & path, std::map<std::string, Metrics> const & measured) {
+        std::ofstream output{path};
+        output << "# perf-check baseline, rewritten by `perf-check --record`\n"
+            << "# program relative-time allocated-bytes output-bytes\n";
+        for (auto & it : measured) {
+            output << it.first << " " << std::fixed << std::setprecision(4) << it.second.relativeTime
+                << " " << it.second.allocatedBytes
+                << " " << it.second.outputBytes << "\n";
+        }
+    }
+
+    /** Compares a measured value with its baseline, returns false when it grew over the tolerance.
+     */
+    bool checkMetric(std::string const & program, char const * metric, double measured, double baseline, double tolerance) {
+        double ratio = baseline > 0 ? measured / baseline : 1;
+        if (ratio > 1 + tolerance) {
+            std::cerr << "[perf-check] " << program << ": " << metric << " regressed " << std::fixed << std::setprecision(2) << ratio << "x (tolerance " << 1 + tolerance << "x)" << std::endl;
+            return false;
+        }
+        if (ratio < 1 - tolerance) {
+            std::cout << "[perf-check] " << program << ": " << metric << " improved " << std::setprecision(2) << ratio << "x, consider recording a new baseline" << std::endl;
+        }
+        return true;
+    }
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) {
+    bool isRecord = false;
+    fs::path corpusDirectory{TINYCPLUS_PERF_CORPUS_DIR};
+    fs::path baselinePath{TINYCPLUS_PERF_BASELINE};
+    double timeTolerance = 0.25;
+    double memoryTolerance = 0.10;
+    double outputTolerance = 0.05;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg == "--record") {
+            isRecord = true;
+        } else if (arg.rfind("--corpus=", 0) == 0) {
+            corpusDirectory = value;
+        } else if (arg.rfind("--baseline=", 0) == 0) {
+            baselinePath = value;
+        } else if (arg.rfind("--time-tolerance=", 0) == 0) {
+            timeTolerance = std::stod(value);
+        } else if (arg.rfind("--memory-tolerance=", 0) == 0) {
+            memoryTolerance = std::stod(value);
+        } else if (arg.rfind("--output-tolerance=", 0) == 0) {
+            outputTolerance = std::stod(value);
+        } else {
+            std::cerr << "[perf-check] unknown argument " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    try {
+        std::vector<fs::path> programs;
+        for (auto & entry : fs::directory_iterator{corpusDirectory}) {
+            if (entry.path().extension() == ".tcp") programs.push_back(entry.path());
+        }
+        std::sort(programs.begin(), programs.end());
+        std::map<std::string, Metrics> baseline;
+        if (!isRecord) baseline = readBaseline(baselinePath);
+
+        size_t calibrationRepetitions = sampleRepetitions(calibrate);
+        double calibrationMilliseconds = measureOnce(calibrate, calibrationRepetitions);
+        std::cout << "[perf-check] calibration " << std::fixed << std::setprecision(2) << calibrationMilliseconds << " ms" << std::endl;
+        std::cout << std::left << std::setw(24) << "program"
+            << std::right << std::setw(12) << "ms"
+            << std::setw(12) << "relative"
+            << std::setw(14) << "alloc KB"
+            << std::setw(12) << "out KB"
+            << std::endl;
+        std::map<std::string, Metrics> measured;
+        bool isRegressed = false;
+        auto check = [&](std::string const & name, Metrics const & metrics) {
+            auto it = baseline.find(name);
+            if (it == baseline.end()) {
+                std::cout << "[perf-check] " << name << ": no baseline, record it with --record" << std::endl;
+                return;
+            }
+            isRegressed |= !checkMetric(name, "time", metrics.relativeTime, it->second.relativeTime, timeTolerance);
+            isRegressed |= !checkMetric(name, "allocated memory", metrics.allocatedBytes, it->second.allocatedBytes, memoryTolerance);
+            isRegressed |= !checkMetric(name, "output size", metrics.outputBytes, it->second.outputBytes, outputTolerance);
+        };
+        for (auto & program : programs) {
+            auto name = program.filename().string();
+            auto metrics = measureProgram(program, calibrationRepetitions);
+            auto it = baseline.find(name);
+            // recorded times are the best of all attempts too, so that a noisy recording does not loosen the check
+            auto isRetried = [&]() {
+                return isRecord || (it != baseline.end() && metrics.relativeTime > it->second.relativeTime * (1 + timeTolerance));
+            };
+            for (size_t r = 0; r < RetriesCount && isRetried(); ++r) {
+                metrics.relativeTime = std::min(metrics.relativeTime, measureProgram(program, calibrationRepetitions).relativeTime);
+            }
+            measured[name] = metrics;
+            std::cout << std::left << std::setw(24) << name << std::right << std::fixed
+                << std::setprecision(3) << std::setw(12) << metrics.relativeTime * calibrationMilliseconds
+                << std::setw(12) << metrics.relativeTime
+                << std::setprecision(1) << std::setw(14) << metrics.allocatedBytes / 1024.0
+                << std::setw(12) << metrics.outputBytes / 1024.0
+                << std::endl;
+            if (!isRecord) check(name, metrics);
+        }
+        // * peak resident size only grows, so it is checked once for the whole corpus
+        Metrics peak;
+        peak.allocatedBytes = tinycplus::profiling::peakResidentKilobytes() * 1024;
+        measured[PeakResidentEntry] = peak;
+        std::cout << "[perf-check] peak resident " << peak.allocatedBytes / 1024 << " KB" << std::endl;
+        if (!isRecord) check(PeakResidentEntry, peak);
+        if (isRecord) {
+            writeBaseline(baselinePath, measured);
+            std::cout << "[perf-check] baseline written to " << baselinePath.string() << std::endl;
+        }
+        return isRegressed ? EXIT_FAILURE : EXIT_SUCCESS;
+    } catch (std::exception & exception) {
+        std::cerr << "[perf-check] " << tinycplus::describeError(exception) << std::endl;
+        return EXIT_FAILURE;
+    }
+}
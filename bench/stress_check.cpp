@@ -0,0 +1,324 @@
+// standard
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <functional>
+#include <exception>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+// internal
+#include "driver.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TINYCPLUS_HAS_PTHREAD_STACK
+#include <pthread.h>
+#endif
+
+/** Complexity guard of the transpiler over pathological input shapes, registered as the stress-check test.
+
+    Every shape is generated at doubling sizes and transpiled. Time is compared per byte of input and output, so shapes whose output is inherently larger than their input (deep hierarchies repeat inherited fields in every class) are not reported. The transpilation runs on a thread with a painted stack, the untouched part of which gives the stack use.
+
+    Usage: stress-check [--quick] [--max-growth=<ratio>] [--shape=<name>]
+        --quick          runs only the smaller sizes
+        --max-growth     allowed growth of time per byte between the smallest and the largest size (default: 3)
+        --shape          runs only the given shape
+
+    Fails when a shape scales super-linearly in time or when its stack use grows with the size, or when parentheses nested deeper than the parser allows are not rejected.
+ */
+
+namespace {
+
+    namespace fs = std::filesystem;
+
+    /** Discards everything, only counts the bytes written.
+     */
+    class CountingBuffer : public std::streambuf {
+    public:
+        size_t count = 0;
+    protected:
+        int overflow(int c) override {
+            if (c != traits_type::eof()) ++count;
+            return c;
+        }
+        std::streamsize xsputn(char const *, std::streamsize n) override {
+            count += static_cast<size_t>(n);
+            return n;
+        }
+    };
+
+    struct Shape {
+        char const * name;
+        std::function<std::string(size_t)> generate;
+        /** Sizes are doubled from this one.
+         */
+        size_t firstSize;
+    };
+
+    struct Result {
+        size_t size;
+        size_t bytes;
+        double milliseconds;
+        size_t stackBytes;
+    };
+
+    /** Growth of the stack use which is still considered constant, covers the noise of the allocator and the standard library.
+     */
+    constexpr size_t StackSlackBytes = 64 * 1024;
+    constexpr size_t StackSize = 64 * 1024 * 1024;
+    constexpr unsigned char StackPaint = 0xa5;
+    constexpr size_t RunsCount = 3;
+
+    // * shapes
+
+    std::string generateElseIfChain(size_t size) {
+        std::stringstream s;
+        s << "int main() {\n    int x = 3;\n    int r = 0;\n    if (x == 0) {\n        r = 0;\n    }";
+        for (size_t i = 1; i < size; ++i) {
+            s << " else if (x == " << i << ") {\n        r = " << i << ";\n    }";
+        }
+        s << " else {\n        r = 1;\n    }\n    return r;\n}\n";
+        return s.str();
+    }
+
+    std::string generateMemberChain(size_t size) {
+        std::stringstream s;
+        s << "struct Node {\n    Node * next;\n    int value;\n};\n\n"
+            << "int main() {\n    Node node;\n    node.next = &node;\n    node.value = 1;\n    Node * p = &node;\n    return p";
+        for (size_t i = 0; i < size; ++i) {
+            s << "->next";
+        }
+        s << "->value;\n}\n";
+        return s.str();
+    }
+
+    /** Deepest nesting of parentheses the parser accepts, see Parser::MaxParenthesesDepth.
+     */
+    constexpr size_t MaxParenthesesDepth = 256;
+
+    std::string nestedParentheses(size_t depth) {
+        std::stringstream s;
+        s << std::string(depth, '(') << "x";
+        for (size_t i = 0; i < depth; ++i) {
+            s << " + 1)";
+        }
+        return s.str();
+    }
+
+    std::string generateNestedParentheses(size_t size) {
+        std::stringstream s;
+        s << "int main() {\n    int x = 1;\n    int r = 0;\n";
+        for (size_t i = 0; i < size; ++i) {
+            s << "    r = r + " << nestedParentheses(MaxParenthesesDepth) << ";\n";
+        }
+        s << "    return r;\n}\n";
+        return s.str();
+    }
+
+    std::string generateWideClass(size_t size) {
+        std::stringstream s;
+        s << "class Wide {\n";
+        for (size_t i = 0; i < size; ++i) {
+            s << "    public int f" << i << ";\n";
+        }
+        s << "    public void reset() {\n";
+        for (size_t i = 0; i < size; ++i) {
+            s << "        this->f" << i << " = " << i << ";\n";
+        }
+        s << "    }\n};\n\nint main() {\n    Wide wide;\n    wide.reset();\n    return wide.f0;\n}\n";
+        return s.str();
+    }
+
+    std::string generateDeepHierarchy(size_t size) {
+        std::stringstream s;
+        s << "class C0 {\n    public int f0;\n    public int get() virtual {\n        return this->f0;\n    }\n};\n\n";
+        for (size_t i = 1; i < size; ++i) {
+            s << "class C" << i << " : C" << (i - 1) << " {\n"
+                << "    public int f" << i << ";\n"
+                << "    public int get() override {\n        return this->f" << i << ";\n    }\n};\n\n";
+        }
+        s << "int main() {\n    C" << (size - 1) << " last;\n    C0 * root = classcast<C0*>(&last);\n    return last.f0;\n}\n";
+        return s.str();
+    }
+
+    // * measurement
+
+    /** Runs the work on a thread with a painted stack, returns the number of stack bytes it touched.
+     */
+    size_t runMeasuringStack(std::function<void()> const & work) {
+#ifdef TINYCPLUS_HAS_PTHREAD_STACK
+        struct Context {
+            std::function<void()> const * work;
+            std::exception_ptr error;
+        };
+        void * stack = nullptr;
+        if (posix_memalign(&stack, 4096, StackSize) != 0) {
+            throw std::runtime_error("cannot allocate the measured stack");
+        }
+        std::memset(stack, StackPaint, StackSize);
+        Context context{&work, nullptr};
+        pthread_attr_t attributes;
+        pthread_attr_init(&attributes);
+        pthread_attr_setstack(&attributes, stack, StackSize);
+        pthread_t thread;
+        int status = pthread_create(&thread, &attributes, [](void * argument) -> void * {
+            auto * context = static_cast<Context *>(argument);
+            try {
+                (*context->work)();
+            } catch (...) {
+                context->error = std::current_exception();
+            }
+            return nullptr;
+        }, &context);
+        pthread_attr_destroy(&attributes);
+        if (status != 0) {
+            std::free(stack);
+            throw std::runtime_error("cannot start the measured thread");
+        }
+        pthread_join(thread, nullptr);
+        // the stack grows down, the lowest touched byte gives the depth
+        auto * bytes = static_cast<unsigned char *>(stack);
+        size_t untouched = 0;
+        while (untouched < StackSize && bytes[untouched] == StackPaint) ++untouched;
+        std::free(stack);
+        if (context.error) std::rethrow_exception(context.error);
+        return StackSize - untouched;
+#else
+        work();
+        return 0;
+#endif
+    }
+
+    Result runShape(Shape const & shape, size_t size) {
+        auto source = shape.generate(size);
+        auto inputFilepath = fs::temp_directory_path() / ("tinycplus_stress_" + std::string{shape.name} + ".tcp");
+        {
+            std::ofstream input{inputFilepath};
+            input << source;
+        }
+        Result result{size, source.size(), 0, 0};
+        result.stackBytes = runMeasuringStack([&]() {
+            for (size_t r = 0; r < RunsCount; ++r) {
+                CountingBuffer buffer;
+                std::ostream output{&buffer};
+                auto start = std::chrono::steady_clock::now();
+                tinycplus::compileFile(inputFilepath.string(), output, tinycplus::CompileOptions{});
+                auto milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                result.milliseconds = r == 0 ? milliseconds : std::min(result.milliseconds, milliseconds);
+                result.bytes = source.size() + buffer.count;
+            }
+        });
+        fs::remove(inputFilepath);
+        return result;
+    }
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) {
+    bool isQuick = false;
+    double maxGrowth = 3.0;
+    std::string onlyShape;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg == "--quick") {
+            isQuick = true;
+        } else if (arg.rfind("--max-growth=", 0) == 0) {
+            maxGrowth = std::stod(value);
+        } else if (arg.rfind("--shape=", 0) == 0) {
+            onlyShape = value;
+        } else {
+            std::cerr << "[stress] unknown argument " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::vector<Shape> const shapes{
+        {"else-if-chain", generateElseIfChain, 500},
+        {"member-chain", generateMemberChain, 500},
+        // as deep as the parser allows, which bounds the stack of the recursive passes
+        {"nested-parentheses", generateNestedParentheses, 16},
+        {"wide-class", generateWideClass, 500},
+        // every class repeats the inherited fields, the output is quadratic in the depth
+        {"deep-hierarchy", generateDeepHierarchy, 125},
+    };
+    size_t doublingsCount = isQuick ? 3 : 4;
+
+    bool isFailed = false;
+    std::cout << std::left << std::setw(20) << "shape"
+        << std::right << std::setw(8) << "size"
+        << std::setw(12) << "KB"
+        << std::setw(12) << "ms"
+        << std::setw(12) << "ns/byte"
+        << std::setw(12) << "stack KB"
+        << std::endl;
+    for (auto & shape : shapes) {
+        if (!onlyShape.empty() && onlyShape != shape.name) continue;
+        std::vector<Result> results;
+        try {
+            for (size_t i = 0, size = shape.firstSize; i < doublingsCount; ++i, size *= 2) {
+                results.push_back(runShape(shape, size));
+                auto & result = results.back();
+                std::cout << std::left << std::setw(20) << shape.name
+                    << std::right << std::fixed << std::setprecision(1)
+                    << std::setw(8) << result.size
+                    << std::setw(12) << result.bytes / 1024.0
+                    << std::setw(12) << result.milliseconds
+                    << std::setw(12) << result.milliseconds * 1e6 / result.bytes
+                    << std::setw(12) << result.stackBytes / 1024.0
+                    << std::endl;
+            }
+        } catch (std::exception & exception) {
+            std::cerr << "[stress] " << shape.name << " failed: " << tinycplus::describeError(exception) << std::endl;
+            isFailed = true;
+            continue;
+        }
+        // * time per byte must stay roughly constant
+        auto & smallest = results.front();
+        auto & largest = results.back();
+        auto growth = (largest.milliseconds / largest.bytes) / (smallest.milliseconds / smallest.bytes);
+        if (growth > maxGrowth) {
+            std::cerr << "[stress] " << shape.name << " scales super-linearly, time per byte grew " << std::setprecision(2) << growth << "x (> " << maxGrowth << "x)" << std::endl;
+            isFailed = true;
+        }
+        // * stack use must be constant
+        size_t stackLimit = smallest.stackBytes + StackSlackBytes;
+        if (largest.stackBytes > stackLimit) {
+            std::cerr << "[stress] " << shape.name << " stack use grows with size, " << largest.stackBytes / 1024 << " KB at " << largest.size
+                << " (limit " << stackLimit / 1024 << " KB)" << std::endl;
+            isFailed = true;
+        }
+    }
+    // * deeper nesting is rejected before it reaches the recursive passes
+    if (onlyShape.empty() || onlyShape == "nested-parentheses") {
+        auto depth = MaxParenthesesDepth * 16;
+        auto inputFilepath = fs::temp_directory_path() / "tinycplus_stress_too_deep.tcp";
+        {
+            std::ofstream input{inputFilepath};
+            input << "int main() {\n    int x = 1;\n    return " << nestedParentheses(depth) << ";\n}\n";
+        }
+        std::string error;
+        size_t stackBytes = runMeasuringStack([&]() {
+            try {
+                CountingBuffer buffer;
+                std::ostream output{&buffer};
+                tinycplus::compileFile(inputFilepath.string(), output, tinycplus::CompileOptions{});
+            } catch (std::exception & exception) {
+                error = tinycplus::describeError(exception);
+            }
+        });
+        fs::remove(inputFilepath);
+        std::cout << std::left << std::setw(20) << "too-deep-parentheses" << std::right << std::setw(8) << depth
+            << std::setw(48) << std::fixed << std::setprecision(1) << stackBytes / 1024.0 << std::endl;
+        if (error.find("nested deeper") == std::string::npos) {
+            std::cerr << "[stress] parentheses nested " << depth << " levels deep were not rejected" << std::endl;
+            isFailed = true;
+        }
+    }
+    return isFailed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
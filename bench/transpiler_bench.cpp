@@ -0,0 +1,178 @@
+// standard
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// internal
+#include "driver.h"
+#include "profiling.h"
+#include "generator.h"
+
+/** Throughput benchmark of the transpiler pipeline over generated programs.
+
+    Usage: transpiler-bench [--quick] [--max-growth=<ratio>] [--<shape>=<n> ...]
+        --quick          runs only the smaller scales
+        --max-growth     allowed growth of per-declaration time of a pass between the smallest and the largest scale (default: 3)
+        --depth, --interfaces, --methods, --fields, --body, --nesting, --seed
+                         shape of the generated programs, see GeneratorParams
+
+    Exits with failure when a pass scales worse than allowed, so super-linear regressions in the parser, type checker or transpiler are caught.
+ */
+
+namespace {
+
+    /** Discards everything, only counts the bytes written.
+     */
+    class CountingBuffer : public std::streambuf {
+    public:
+        size_t count = 0;
+    protected:
+        int overflow(int c) override {
+            if (c != traits_type::eof()) ++count;
+            return c;
+        }
+        std::streamsize xsputn(char const *, std::streamsize n) override {
+            count += static_cast<size_t>(n);
+            return n;
+        }
+    };
+
+    struct Scale {
+        char const * name;
+        size_t declarations;
+    };
+
+    struct Result {
+        size_t declarations;
+        size_t sourceBytes;
+        size_t outputBytes;
+        tinycplus::PassTimings timings;
+    };
+
+    double findPassMilliseconds(tinycplus::PassTimings const & timings, std::string const & name) {
+        for (auto & pass : timings.passes()) {
+            if (pass.name == name) return pass.wallMilliseconds;
+        }
+        return 0;
+    }
+
+    Result runScale(Scale const & scale, tinycplus::GeneratorParams params) {
+        params.classesCount = std::max<size_t>(1, scale.declarations / tinycplus::ProgramGenerator::DeclarationsPerClass(params));
+        tinycplus::ProgramGenerator generator{params};
+        auto source = generator.generate();
+        auto inputFilepath = std::filesystem::temp_directory_path() / ("tinycplus_bench_" + std::string{scale.name} + ".tcp");
+        {
+            std::ofstream input{inputFilepath};
+            input << source;
+        }
+        Result result;
+        result.declarations = generator.declarationsCount();
+        result.sourceBytes = source.size();
+        CountingBuffer buffer;
+        std::ostream output{&buffer};
+        tinycplus::CompileOptions options;
+        options.timings = &result.timings;
+        tinycplus::compileFile(inputFilepath.string(), output, options);
+        result.outputBytes = buffer.count;
+        std::filesystem::remove(inputFilepath);
+        return result;
+    }
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) {
+    bool isQuick = false;
+    double maxGrowth = 3.0;
+    tinycplus::GeneratorParams params;
+    std::vector<std::pair<std::string, size_t *>> const shapeArgs{
+        {"--depth=", &params.hierarchyDepth},
+        {"--interfaces=", &params.interfacesPerClass},
+        {"--methods=", &params.methodsPerClass},
+        {"--fields=", &params.fieldsPerClass},
+        {"--body=", &params.bodySize},
+        {"--nesting=", &params.expressionNesting},
+    };
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        auto value = arg.substr(arg.find('=') + 1);
+        bool isShapeArg = false;
+        for (auto & shapeArg : shapeArgs) {
+            if (arg.rfind(shapeArg.first, 0) == 0) {
+                *shapeArg.second = std::stoul(value);
+                isShapeArg = true;
+            }
+        }
+        if (isShapeArg) {
+            continue;
+        } else if (arg == "--quick") {
+            isQuick = true;
+        } else if (arg.rfind("--max-growth=", 0) == 0) {
+            maxGrowth = std::stod(value);
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            params.seed = std::stoull(value);
+        } else {
+            std::cerr << "[bench] unknown argument " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::vector<Scale> scales{
+        {"1k", 1000},
+        {"10k", 10000},
+        {"100k", 100000},
+    };
+    if (isQuick) scales.pop_back();
+
+    std::vector<std::string> const passes{"lex", "parse", "typecheck", "emit"};
+    std::vector<Result> results;
+    std::cout << std::left << std::setw(8) << "scale"
+        << std::right << std::setw(10) << "decls"
+        << std::setw(12) << "src KB"
+        << std::setw(12) << "out KB";
+    for (auto & pass : passes) {
+        std::cout << std::setw(14) << (pass + " ms");
+    }
+    std::cout << std::setw(14) << "decls/s" << std::setw(12) << "peak KB" << std::endl;
+    for (auto & scale : scales) {
+        try {
+            results.push_back(runScale(scale, params));
+        } catch (std::exception & exception) {
+            std::cerr << "[bench] scale " << scale.name << " failed: " << tinycplus::describeError(exception) << std::endl;
+            return EXIT_FAILURE;
+        }
+        auto & result = results.back();
+        auto totalMilliseconds = findPassMilliseconds(result.timings, "total");
+        std::cout << std::left << std::setw(8) << scale.name
+            << std::right << std::fixed << std::setprecision(1)
+            << std::setw(10) << result.declarations
+            << std::setw(12) << result.sourceBytes / 1024.0
+            << std::setw(12) << result.outputBytes / 1024.0;
+        for (auto & pass : passes) {
+            std::cout << std::setw(14) << findPassMilliseconds(result.timings, pass);
+        }
+        // peak RSS of the process only grows, scales therefore run from the smallest one
+        std::cout << std::setw(14) << std::setprecision(0) << result.declarations / (totalMilliseconds / 1000.0)
+            << std::setw(12) << tinycplus::profiling::peakResidentKilobytes()
+            << std::endl;
+    }
+
+    // * scaling check, time per declaration of every pass must stay roughly constant
+    bool isRegressed = false;
+    auto & smallest = results.front();
+    auto & largest = results.back();
+    for (auto & pass : passes) {
+        auto smallestPerDeclaration = findPassMilliseconds(smallest.timings, pass) / smallest.declarations;
+        auto largestPerDeclaration = findPassMilliseconds(largest.timings, pass) / largest.declarations;
+        if (smallestPerDeclaration <= 0) continue;
+        auto growth = largestPerDeclaration / smallestPerDeclaration;
+        std::cout << "[bench] " << pass << " per-declaration growth " << scales.front().name << " -> " << scales.back().name
+            << ": " << std::setprecision(2) << growth << "x" << std::endl;
+        if (growth > maxGrowth) {
+            std::cerr << "[bench] " << pass << " scales super-linearly (" << growth << "x > " << maxGrowth << "x)" << std::endl;
+            isRegressed = true;
+        }
+    }
+    return isRegressed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
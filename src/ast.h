@@ -1,6 +1,7 @@
 #pragma once
 
 // standard
+#include <algorithm>
 #include <unordered_map>
 #include <memory>
 #include <optional>
@@ -147,6 +148,9 @@ namespace tinycplus {
     class ASTIdentifier : public AST {
     public:
         Symbol name;
+        /** Set by the type checker on the declaration and the uses of an array variable of a soa class, which is lowered to one array per field.
+         */
+        bool isStructOfArrays = false;
 
         ASTIdentifier(Token const & t):
             AST{t},
@@ -429,6 +433,12 @@ namespace tinycplus {
             std::vector<std::unique_ptr<ASTIdentifier>> args;
             Symbol getName() const { return name->as<ASTNamedType>()->name; }
         };
+        /** Type parameter of a generic function, "T" or "T : Interface".
+         */
+        struct TypeParameter {
+            Symbol name;
+            std::optional<Symbol> bound;
+        };
         enum class Virtuality {
             None,
             Virtual,
@@ -444,6 +454,8 @@ namespace tinycplus {
         std::unique_ptr<AST> body;
         std::optional<Symbol> name;
         std::optional<Base> base;
+        std::vector<TypeParameter> typeParameters; // of generic functions, see Parser::GENERIC_FUN_DECL
+        bool isConstexpr = false; // see Parser::CONSTEXPR_FUN_DECL
     public:
         ASTFunDecl(Token const & t, std::unique_ptr<ASTType> type)
             :ASTPartialDecl{t}
@@ -458,6 +470,7 @@ namespace tinycplus {
         bool isVirtual() const { return virtuality == Virtuality::Virtual; }
         bool isOverride() const { return virtuality == Virtuality::Override; }
         bool isVirtualized() const { return isVirtual() || isOverride() || isAbstract(); }
+        bool isGeneric() const { return !typeParameters.empty(); }
 
         void print(ASTPrettyPrinter & p) const override {
             switch (virtuality)
@@ -466,6 +479,7 @@ namespace tinycplus {
                 case Virtuality::Virtual: p << "virtual"; break;
                 case Virtuality::Override: p << "override"; break;
             }
+            if (isConstexpr) p << "constexpr";
             p << " ";
             switch (kind)
             {
@@ -478,6 +492,14 @@ namespace tinycplus {
             p.newline();
             p.indent();
             {
+                if (isGeneric()) {
+                    p << "type parameters:";
+                    for (auto & it : typeParameters) {
+                        p << " " << it.name.name();
+                        if (it.bound.has_value()) p << " : " << it.bound->name();
+                    }
+                    p.newline();
+                }
                 p << "return type: "; typeDecl->print(p); p.newline();
                 if (base) {
                     p << "base ("; base->name->print(p); p << "):";
@@ -600,17 +622,28 @@ namespace tinycplus {
         std::vector<std::unique_ptr<ASTVarDecl>> fields;
         std::vector<std::unique_ptr<ASTFunDecl>> methods;
         std::vector<std::unique_ptr<ASTFunDecl>> constructors;
+        std::vector<Symbol> attributes; // see symbols::isClassAttribute
     public:
         ASTClassDecl(Token const & t, Symbol name):
             ASTPartialDecl{t},
             name{name} {
         }
+        bool hasAttribute(Symbol const & attribute) const {
+            return std::find(attributes.begin(), attributes.end(), attribute) != attributes.end();
+        }
     public:
         void print(ASTPrettyPrinter & p) const override {
             p << "class (" << name.name() << "):";
             p.newline();
             p.indent();
             {
+                if (attributes.size() > 0) {
+                    p << "attributes:";
+                    for (auto & it : attributes) {
+                        p << " " << it.name();
+                    }
+                    p.newline();
+                }
                 if (baseClass) {
                     p << "base: "; baseClass->print(p); p.newline();
                 }
@@ -682,6 +715,17 @@ namespace tinycplus {
         ASTIf(Token const & t):
             AST{t} {
         }
+        /** Else-if chains are released iteratively, the default destructor would recurse once per chain link.
+         */
+        ~ASTIf() override {
+            std::unique_ptr<AST> next{std::move(falseCase)};
+            while (next != nullptr) {
+                auto * nextIf = next->as<ASTIf>();
+                if (nextIf == nullptr) break;
+                std::unique_ptr<AST> afterNext{std::move(nextIf->falseCase)};
+                next = std::move(afterNext);
+            }
+        }
     public:
         void print(ASTPrettyPrinter & p) const override {
             p << "if:";
@@ -866,6 +910,28 @@ namespace tinycplus {
 
 
 
+    /** Returns the instance behind the pointer to the pool of its class, see the pooled class attribute.
+     */
+    class ASTDelete : public AST {
+    public:
+        std::unique_ptr<AST> target;
+    public:
+        ASTDelete(Token const & t, std::unique_ptr<AST> target):
+            AST{t},
+            target{std::move(target)} {
+        }
+    public:
+        void print(ASTPrettyPrinter & p) const override {
+            p << "delete ";
+            target->print(p);
+        }
+    protected:
+        void accept(ASTVisitor * v) override;
+    };
+
+
+
+
     class ASTBinaryOp : public AST {
     public:
         Symbol op;
@@ -1099,11 +1165,36 @@ namespace tinycplus {
             base{std::move(base)},
             member{std::move(member)} {
         }
+        /** Member chains (a->b->c) are released iteratively, the default destructor would recurse once per access.
+         */
+        ~ASTMember() override {
+            std::unique_ptr<AST> next{std::move(base)};
+            while (next != nullptr) {
+                auto * nextMember = next->as<ASTMember>();
+                if (nextMember == nullptr) break;
+                std::unique_ptr<AST> afterNext{std::move(nextMember->base)};
+                next = std::move(afterNext);
+            }
+        }
     public:
         /** If the base has address, then its element must have address too.
          */
         bool hasAddress() const override {
-            return base->hasAddress();
+            AST const * innermost = base.get();
+            while (auto * member = dynamic_cast<ASTMember const *>(innermost)) {
+                innermost = member->base.get();
+            }
+            return innermost->hasAddress();
+        }
+        /** The soa array when the access reads a field of its element (a[i].x), nullptr otherwise.
+         */
+        ASTIdentifier * getStructOfArrays() const {
+            auto * index = base->as<ASTIndex>();
+            auto * array = index != nullptr ? index->base->as<ASTIdentifier>() : nullptr;
+            if (array == nullptr || !array->isStructOfArrays || member->as<ASTIdentifier>() == nullptr) {
+                return nullptr;
+            }
+            return array;
         }
         void print(ASTPrettyPrinter & p) const override {
             p << "access (" << op.name() << ")";
@@ -1126,6 +1217,9 @@ namespace tinycplus {
     public:
         std::unique_ptr<AST> function;
         std::vector<std::unique_ptr<AST>> args;
+        ASTFunDecl * generic = nullptr; // the called generic function, set by the type checker
+        std::vector<Type *> typeArguments; // inferred from the arguments, type parameters of the enclosing generic function included
+        ASTFunDecl * constexprFunction = nullptr; // the called constexpr function, set by the type checker
     public:
         ASTCall(Token const & t, std::unique_ptr<AST> function):
             AST{t},
@@ -1160,6 +1254,28 @@ namespace tinycplus {
 
 
 
+    /** Allocates an instance of a pooled class and runs the constructor on it, the value is a pointer to the instance.
+     */
+    class ASTNew : public AST {
+    public:
+        std::unique_ptr<ASTCall> constructor;
+    public:
+        ASTNew(Token const & t, std::unique_ptr<ASTCall> constructor):
+            AST{t},
+            constructor{std::move(constructor)} {
+        }
+    public:
+        void print(ASTPrettyPrinter & p) const override {
+            p << "new ";
+            constructor->print(p);
+        }
+    protected:
+        void accept(ASTVisitor * v) override;
+    };
+
+
+
+
     class ASTCast : public AST {
     public:
         std::unique_ptr<AST> value;
@@ -1229,6 +1345,7 @@ namespace tinycplus {
         virtual void visit(ASTBreak * ast) = 0;
         virtual void visit(ASTContinue * ast) = 0;
         virtual void visit(ASTReturn * ast) = 0;
+        virtual void visit(ASTDelete * ast) = 0;
         virtual void visit(ASTBinaryOp * ast) = 0;
         virtual void visit(ASTAssignment * ast) = 0;
         virtual void visit(ASTUnaryOp * ast) = 0;
@@ -1238,6 +1355,7 @@ namespace tinycplus {
         virtual void visit(ASTIndex * ast) = 0;
         virtual void visit(ASTMember * ast) = 0;
         virtual void visit(ASTCall * ast) = 0;
+        virtual void visit(ASTNew * ast) = 0;
         virtual void visit(ASTCast * ast) = 0;
     protected:
         void visitChild(AST * child) {
@@ -1272,6 +1390,7 @@ namespace tinycplus {
     inline void ASTBreak::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTContinue::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTReturn::accept(ASTVisitor * v) { v->visit(this); }
+    inline void ASTDelete::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTBinaryOp::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTAssignment::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTUnaryOp::accept(ASTVisitor * v) { v->visit(this); }
@@ -1281,6 +1400,7 @@ namespace tinycplus {
     inline void ASTIndex::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTMember::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTCall::accept(ASTVisitor * v) { v->visit(this); }
+    inline void ASTNew::accept(ASTVisitor * v) { v->visit(this); }
     inline void ASTCast::accept(ASTVisitor * v) { v->visit(this); }
 
 } // namespace tinycplus
\ No newline at end of file
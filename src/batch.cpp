@@ -0,0 +1,127 @@
+// standard
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <thread>
+
+// internal
+#include "batch.h"
+#include "shared.h"
+
+namespace tinycplus {
+
+    std::vector<std::string> BatchCompiler::ParseInputList(std::string const & list) {
+        std::vector<std::string> result;
+        if (list.size() > 0 && list[0] == '@') {
+            auto responseFilepath = list.substr(1);
+            std::ifstream response{responseFilepath};
+            if (!response) {
+                throw std::runtime_error(STR("Cannot open response file at path: " << responseFilepath));
+            }
+            std::string line;
+            while (std::getline(response, line)) {
+                // trims whitespace (including '\r' of windows line endings)
+                auto begin = line.find_first_not_of(" \t\r");
+                if (begin == std::string::npos) continue;
+                auto end = line.find_last_not_of(" \t\r");
+                line = line.substr(begin, end - begin + 1);
+                if (line[0] == '#') continue;
+                result.push_back(line);
+            }
+        } else {
+            size_t begin = 0;
+            while (begin <= list.size()) {
+                auto end = list.find(',', begin);
+                if (end == std::string::npos) end = list.size();
+                if (end > begin) {
+                    result.push_back(list.substr(begin, end - begin));
+                }
+                begin = end + 1;
+            }
+        }
+        return result;
+    }
+
+    std::string BatchCompiler::getOutputFilepath(std::string const & inputFilepath) const {
+        std::filesystem::path output{inputFilepath};
+        output.replace_extension(options_.backend == Backend::Cpp ? ".cpp" : ".tc");
+        if (!outputDirectory_.empty()) {
+            output = std::filesystem::path{outputDirectory_} / output.filename();
+        }
+        return output.string();
+    }
+
+    BatchCompiler::Report BatchCompiler::compileOne(std::string const & inputFilepath) const {
+        Report report;
+        report.inputFilepath = inputFilepath;
+        report.outputFilepath = getOutputFilepath(inputFilepath);
+        auto start = std::chrono::steady_clock::now();
+        try {
+            if (!std::filesystem::exists(inputFilepath)) {
+                throw std::runtime_error(STR("Input file does not exist: " << inputFilepath));
+            }
+            std::ofstream output{report.outputFilepath};
+            if (!output) {
+                throw std::runtime_error(STR("Cannot open output file at path: " << report.outputFilepath));
+            }
+            // * every output gets its own source map next to it
+            auto options = options_;
+            if (!options.sourceMapPath.empty()) {
+                options.sourceMapPath = report.outputFilepath + ".map";
+            }
+            compileFile(inputFilepath, output, options);
+            report.isSuccess = true;
+        } catch (std::exception & exception) {
+            report.error = describeError(exception);
+        }
+        auto end = std::chrono::steady_clock::now();
+        report.milliseconds = std::chrono::duration<double, std::milli>(end - start).count();
+        return report;
+    }
+
+    std::vector<BatchCompiler::Report> BatchCompiler::run(std::vector<std::string> const & inputs) const {
+        std::vector<Report> reports(inputs.size());
+        if (!outputDirectory_.empty()) {
+            std::filesystem::create_directories(outputDirectory_);
+        }
+        // workers take the next not yet taken input until none are left
+        std::atomic<size_t> next{0};
+        auto worker = [&]() {
+            for (size_t i = next++; i < inputs.size(); i = next++) {
+                reports[i] = compileOne(inputs[i]);
+            }
+        };
+        auto threadsCount = std::min(threadsCount_, inputs.size());
+        if (threadsCount <= 1) {
+            worker();
+            return reports;
+        }
+        std::vector<std::thread> threads;
+        threads.reserve(threadsCount);
+        for (size_t i = 0; i < threadsCount; i++) {
+            threads.emplace_back(worker);
+        }
+        for (auto & thread : threads) {
+            thread.join();
+        }
+        return reports;
+    }
+
+    void BatchCompiler::PrintReports(std::ostream & output, std::vector<Report> const & reports, double totalMilliseconds) {
+        size_t failedCount = 0;
+        for (auto & report : reports) {
+            output << "[batch] " << std::fixed << std::setprecision(2) << std::setw(10) << report.milliseconds << " ms  ";
+            if (report.isSuccess) {
+                output << report.inputFilepath << " -> " << report.outputFilepath << "\n";
+            } else {
+                failedCount++;
+                output << report.inputFilepath << " FAILED\n" << "    " << report.error << "\n";
+            }
+        }
+        output << "[batch] " << reports.size() << " files, " << failedCount << " failed, "
+            << std::fixed << std::setprecision(2) << totalMilliseconds << " ms total\n";
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,57 @@
+#pragma once
+
+// standard
+#include <string>
+#include <vector>
+
+// internal
+#include "driver.h"
+
+namespace tinycplus {
+
+    /** Transpiles many TinyC+ files inside one process.
+        Files are distributed over a pool of worker threads, each file gets its own output file and own compilation contexts.
+     */
+    class BatchCompiler {
+    public:
+        struct Report {
+            std::string inputFilepath;
+            std::string outputFilepath;
+            bool isSuccess = false;
+            std::string error;
+            double milliseconds = 0;
+        };
+    private:
+        CompileOptions options_;
+        size_t threadsCount_;
+        std::string outputDirectory_;
+    public:
+        BatchCompiler(CompileOptions const & options, size_t threadsCount, std::string outputDirectory)
+            :options_{options}
+            ,threadsCount_{threadsCount == 0 ? 1 : threadsCount}
+            ,outputDirectory_{std::move(outputDirectory)}
+        { }
+    public:
+        /** Parses list of inputs.
+            The list is either comma separated filepaths, or "@filepath" of a response file with one input filepath per line.
+            Empty lines and lines starting with '#' are skipped in response files.
+         */
+        static std::vector<std::string> ParseInputList(std::string const & list);
+
+        /** Output filepath of the input: same name with ".tc" extension, placed into the output directory when set.
+         */
+        std::string getOutputFilepath(std::string const & inputFilepath) const;
+
+        /** Transpiles all inputs and returns report per input in the order of inputs.
+            Never throws on compilation errors, those are stored in reports.
+         */
+        std::vector<Report> run(std::vector<std::string> const & inputs) const;
+
+        /** Prints per file timing and the summary.
+         */
+        static void PrintReports(std::ostream & output, std::vector<Report> const & reports, double totalMilliseconds);
+    private:
+        Report compileOne(std::string const & inputFilepath) const;
+    }; // class BatchCompiler
+
+} // namespace tinycplus
@@ -0,0 +1,198 @@
+#pragma once
+
+// standard
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// internal
+#include "ast.h"
+
+namespace tinycplus {
+
+    /** Instructions of the register bytecode run by --run, see BytecodeCompiler and VirtualMachine.
+        Operands a, b and c are registers of the current frame, immediates, offsets or indices into the tables of the program, as noted per instruction.
+        Registers hold int and char values sign-extended to 64 bits, doubles, addresses into the memory of the machine (0 is null) and interface views, whose low 48 bits are the target and high 16 bits the impl.
+        Int instructions wrap to 32 bits, chars are only truncated when stored, passed, returned or cast, like the C++ the output converts to.
+     */
+    #define TINYCPLUS_BYTECODE_OPCODES(X) \
+        X(LoadInt)         /* a = b */ \
+        X(LoadConst)       /* a = constants[b] */ \
+        X(Move)            /* a = b */ \
+        X(AddI)            /* a = b + c */ \
+        X(SubI)            /* a = b - c */ \
+        X(MulI)            /* a = b * c */ \
+        X(DivI)            /* a = b / c */ \
+        X(ModI)            /* a = b % c */ \
+        X(ShlI)            /* a = b << c */ \
+        X(ShrI)            /* a = b >> c */ \
+        X(BitAndI)         /* a = b & c */ \
+        X(BitOrI)          /* a = b | c */ \
+        X(BitXorI)         /* a = b ^ c */ \
+        X(AddIImm)         /* a = b + immediate c */ \
+        X(NegI)            /* a = -b */ \
+        X(BitNotI)         /* a = ~b */ \
+        X(AddL)            /* a = address b + c */ \
+        X(SubL)            /* a = address b - c */ \
+        X(MulLImm)         /* a = b * immediate c, element offsets */ \
+        X(AddLImm)         /* a = address b + immediate c */ \
+        X(AddD)            /* a = b + c */ \
+        X(SubD)            /* a = b - c */ \
+        X(MulD)            /* a = b * c */ \
+        X(DivD)            /* a = b / c */ \
+        X(NegD)            /* a = -b */ \
+        X(EqI)             /* a = b == c, also addresses */ \
+        X(NeI)             /* a = b != c */ \
+        X(LtI)             /* a = b < c */ \
+        X(LeI)             /* a = b <= c */ \
+        X(GtI)             /* a = b > c */ \
+        X(GeI)             /* a = b >= c */ \
+        X(EqD)             /* a = b == c */ \
+        X(NeD)             /* a = b != c */ \
+        X(LtD)             /* a = b < c */ \
+        X(LeD)             /* a = b <= c */ \
+        X(GtD)             /* a = b > c */ \
+        X(GeD)             /* a = b >= c */ \
+        X(NotI)            /* a = !b */ \
+        X(NotD)            /* a = !b */ \
+        X(TestI)           /* a = b != 0 */ \
+        X(TestD)           /* a = b != 0.0 */ \
+        X(IntToDouble)     /* a = (double)b */ \
+        X(DoubleToInt)     /* a = (int)b */ \
+        X(TruncChar)       /* a = (char)b */ \
+        X(TruncInt)        /* a = (int)b */ \
+        X(ViewTarget)      /* a = target of the interface view b */ \
+        X(Load8)           /* a = char at address b + c */ \
+        X(Load32)          /* a = int at address b + c */ \
+        X(Load64)          /* a = double, address or view at address b + c */ \
+        X(Store8)          /* char at address b + c = a */ \
+        X(Store32)         /* int at address b + c = a */ \
+        X(Store64)         /* double, address or view at address b + c = a */ \
+        X(LoadFrame8)      /* a = char at frame offset b */ \
+        X(LoadFrame32)     /* a = int at frame offset b */ \
+        X(LoadFrame64)     /* a = 64 bits at frame offset b */ \
+        X(StoreFrame8)     /* char at frame offset b = a */ \
+        X(StoreFrame32)    /* int at frame offset b = a */ \
+        X(StoreFrame64)    /* 64 bits at frame offset b = a */ \
+        X(LoadGlobal8)     /* a = char at global address b */ \
+        X(LoadGlobal32)    /* a = int at global address b */ \
+        X(LoadGlobal64)    /* a = 64 bits at global address b */ \
+        X(StoreGlobal8)    /* char at global address b = a */ \
+        X(StoreGlobal32)   /* int at global address b = a */ \
+        X(StoreGlobal64)   /* 64 bits at global address b = a */ \
+        X(FrameAddr)       /* a = address of frame offset b */ \
+        X(Copy)            /* c bytes from address b to address a */ \
+        X(Zero)            /* b bytes at address a = 0 */ \
+        X(InitHeaders)     /* class headers of headerLists[b] at address a */ \
+        X(Jump)            /* continue at a */ \
+        X(JumpIfZero)      /* continue at b when a == 0 */ \
+        X(JumpIfNotZero)   /* continue at b when a != 0 */ \
+        X(JumpIfEq)        /* continue at c when a == b */ \
+        X(JumpIfNe)        /* continue at c when a != b */ \
+        X(JumpIfLt)        /* continue at c when a < b */ \
+        X(JumpIfLe)        /* continue at c when a <= b */ \
+        X(JumpIfGt)        /* continue at c when a > b */ \
+        X(JumpIfGe)        /* continue at c when a >= b */ \
+        X(JumpIfEqImm)     /* continue at c when a == immediate b */ \
+        X(JumpIfNeImm)     /* continue at c when a != immediate b */ \
+        X(JumpIfLtImm)     /* continue at c when a < immediate b */ \
+        X(JumpIfLeImm)     /* continue at c when a <= immediate b */ \
+        X(JumpIfGtImm)     /* continue at c when a > immediate b */ \
+        X(JumpIfGeImm)     /* continue at c when a >= immediate b */ \
+        X(Switch)          /* continue at the case of a in switches[b] */ \
+        X(Call)            /* a = functions[b] called with the arguments from register c */ \
+        X(CallIndirect)    /* a = function value b called with the arguments from register c */ \
+        X(CallVirtual)     /* a = vtable slot b of the receiver in register c called */ \
+        X(CallInterface)   /* a = impl slot b of the view in register c called with its target */ \
+        X(Return)          /* returns a */ \
+        X(ReturnVoid)      /* returns */ \
+        X(MissingReturn)   /* traps, the function ended without returning a value */ \
+        X(CastToClass)     /* a = address b when its instance is of class c or derived, null otherwise */ \
+        X(CastToInterface) /* a = view of address b through interface c, null when its class does not implement it */ \
+        X(New)             /* a = instance of class b allocated from its pool with headers set, null when the pool is full */ \
+        X(Delete)          /* instance at address a returned to the pool of its class */
+
+    enum class Opcode : uint8_t {
+        #define TINYCPLUS_BYTECODE_ENUM(name) name,
+        TINYCPLUS_BYTECODE_OPCODES(TINYCPLUS_BYTECODE_ENUM)
+        #undef TINYCPLUS_BYTECODE_ENUM
+    };
+
+    struct Instruction {
+        Opcode op;
+        int32_t a = 0;
+        int32_t b = 0;
+        int32_t c = 0;
+    };
+
+    union Value {
+        int64_t i;
+        double d;
+    };
+
+    struct BytecodeFunction {
+        std::string name;
+        std::vector<Instruction> code;
+        std::vector<AST *> sites; // of every instruction, locates the runtime errors
+        uint32_t arguments = 0; // in the first registers, aggregates by address
+        uint32_t registers = 0;
+        uint32_t frameBytes = 0; // locals which have their address taken, aggregates and arrays
+        bool isDefined() const { return !code.empty(); }
+    };
+
+    /** Cases of a switch, dense tables are indexed by the value minus the lowest case.
+     */
+    struct SwitchTable {
+        bool isDense = false;
+        int64_t low = 0;
+        std::vector<int32_t> targets; // dense: per value from low, -1 for the default
+        std::vector<std::pair<int64_t, int32_t>> cases; // sparse: sorted by value
+        int32_t defaultTarget = 0; // the end of the switch when it has no default
+    };
+
+    /** Class header written at an offset of an instance, arrays of instances and fields of class types have one per instance.
+     */
+    struct HeaderSlot {
+        uint32_t offset;
+        uint32_t classIndex;
+    };
+
+    /** Classes are numbered densely, object first. The tables of a class are slices of the shared tables of the program.
+     */
+    struct BytecodeClass {
+        std::string name;
+        uint32_t depth = 0; // object is 0
+        uint32_t ancestors = 0; // classes from object down to the class itself in BytecodeProgram::ancestors, depth + 1 of them
+        uint32_t vtable = 0; // first slot in BytecodeProgram::vtableSlots
+        uint32_t vtableSize = 0;
+        uint32_t size = 0; // of the instance
+        uint32_t headers = 0; // list of the instance in BytecodeProgram::headerLists
+        bool isPooled = false;
+        uint64_t arena = 0; // address of the pool
+    };
+
+    struct BytecodeProgram {
+        /** Bytes at the start of the memory no load or store may touch, so that null and small offsets from it trap.
+         */
+        static constexpr uint32_t NullGuard = 4096;
+
+        std::vector<BytecodeFunction> functions;
+        std::vector<Value> constants;
+        std::vector<SwitchTable> switches;
+        std::vector<std::vector<HeaderSlot>> headerLists;
+        std::vector<BytecodeClass> classes;
+        std::vector<uint32_t> ancestors;
+        std::vector<int32_t> vtableSlots; // function indices, -1 for abstract methods
+        uint32_t interfacesCount = 0;
+        std::vector<std::string> interfaceNames;
+        std::vector<uint32_t> implTable; // impl of every class and interface at [class * interfacesCount + interface], 0 when not implemented
+        std::vector<uint32_t> implOffsets; // first slot of every impl in implSlots, impl 0 is none
+        std::vector<int32_t> implSlots; // function indices in the order of the interface methods
+        uint32_t poolCapacity = 0; // instances per pooled class
+        std::vector<uint8_t> data; // initial memory: the null guard, globals and string literals, the pools follow
+        uint64_t staticBytes = 0; // data and pools, the stack starts after them
+        uint32_t initializer = 0; // function setting the globals, runs before the entry
+        uint32_t entry = 0;
+    };
+
+} // namespace tinycplus
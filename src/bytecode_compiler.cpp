@@ -0,0 +1,1634 @@
+// standard
+#include <algorithm>
+#include <limits>
+#include <cstring>
+
+// internal
+#include "bytecode_compiler.h"
+
+namespace tinycplus {
+
+    namespace {
+        constexpr int64_t Int32Min = std::numeric_limits<int32_t>::min();
+        constexpr int64_t Int32Max = std::numeric_limits<int32_t>::max();
+        // * arrays and frames are addressed by 32-bit offsets
+        constexpr uint64_t MaxDataBytes = Int32Max;
+        constexpr uint32_t MaxArrayElements = 1 << 28;
+
+        bool FitsInt32(int64_t value) {
+            return value >= Int32Min && value <= Int32Max;
+        }
+
+        int64_t WrapInt(int64_t value) {
+            return static_cast<int32_t>(static_cast<uint32_t>(value));
+        }
+
+        uint64_t AlignUp(uint64_t value, uint64_t align) {
+            return (value + align - 1) / align * align;
+        }
+
+        bool IsRelational(Symbol const & op) {
+            return op == Symbol::Eq || op == Symbol::NEq || op == Symbol::Lt || op == Symbol::Gt || op == Symbol::Lte || op == Symbol::Gte;
+        }
+
+        /** Comparison of two registers, negated it jumps when the comparison does not hold.
+         */
+        Opcode JumpOpcode(Symbol const & op, bool isNegated, bool isImmediate) {
+            static Symbol const ops[] = { Symbol::Eq, Symbol::NEq, Symbol::Lt, Symbol::Gte, Symbol::Lte, Symbol::Gt };
+            static Opcode const jumps[] = { Opcode::JumpIfEq, Opcode::JumpIfNe, Opcode::JumpIfLt, Opcode::JumpIfGe, Opcode::JumpIfLe, Opcode::JumpIfGt };
+            static Opcode const immediates[] = { Opcode::JumpIfEqImm, Opcode::JumpIfNeImm, Opcode::JumpIfLtImm, Opcode::JumpIfGeImm, Opcode::JumpIfLeImm, Opcode::JumpIfGtImm };
+            size_t i = 0;
+            while (!(ops[i] == op)) ++i;
+            // * the operators are listed in pairs of negations
+            if (isNegated) i ^= 1;
+            return isImmediate ? immediates[i] : jumps[i];
+        }
+
+        Opcode CompareOpcode(Symbol const & op, bool isDouble) {
+            if (op == Symbol::Eq) return isDouble ? Opcode::EqD : Opcode::EqI;
+            if (op == Symbol::NEq) return isDouble ? Opcode::NeD : Opcode::NeI;
+            if (op == Symbol::Lt) return isDouble ? Opcode::LtD : Opcode::LtI;
+            if (op == Symbol::Lte) return isDouble ? Opcode::LeD : Opcode::LeI;
+            if (op == Symbol::Gt) return isDouble ? Opcode::GtD : Opcode::GtI;
+            return isDouble ? Opcode::GeD : Opcode::GeI;
+        }
+
+        std::optional<int64_t> IntegerLiteral(AST * ast) {
+            if (auto * integer = ast->as<ASTInteger>()) return WrapInt(integer->value);
+            if (auto * character = ast->as<ASTChar>()) return static_cast<int64_t>(static_cast<signed char>(character->value));
+            return std::nullopt;
+        }
+    } // anonymous namespace
+
+    BytecodeProgram BytecodeCompiler::compile(AST * ast) {
+        auto * program = ast->as<ASTProgram>();
+        assert(program != nullptr && "the lowering expects the whole program");
+        program_ = BytecodeProgram{};
+        program_.poolCapacity = static_cast<uint32_t>(poolCapacity_);
+        program_.data.assign(BytecodeProgram::NullGuard, 0);
+        declareClasses(program);
+        declareFunctions(program);
+        declareGlobals(program);
+        buildDispatchTables();
+        compileInitializer(program);
+        for (auto & it : program->body) {
+            if (auto * funDecl = it->as<ASTFunDecl>()) {
+                if (funDecl->body != nullptr && !funDecl->isGeneric()) {
+                    compileFunction(functions_.at(funDecl->name.value()), funDecl, nullptr, nullptr);
+                }
+            } else if (auto * classDecl = it->as<ASTClassDecl>(); classDecl != nullptr && classDecl->isDefinition) {
+                auto * classType = classDecl->getType()->as<Type::Class>();
+                for (auto & method : classDecl->methods) {
+                    if (method->body != nullptr) compileFunction(methods_.at(method.get()), method.get(), classType, nullptr);
+                }
+                for (auto & constructor : classDecl->constructors) {
+                    if (constructor->body != nullptr) compileFunction(methods_.at(constructor.get()), constructor.get(), classType, nullptr);
+                }
+            }
+        }
+        for (auto & it : types_.genericInstances()) {
+            compileFunction(genericInstances_.at(it.get()), it->function, nullptr, it.get());
+        }
+        auto entry = functions_.find(symbols::Entry);
+        if (entry == functions_.end() || !program_.functions[entry->second].isDefined()) throw ParserError{
+            STR("RUN: program has no " << symbols::Entry.name() << " function to run"),
+            program->location()
+        };
+        if (program_.functions[entry->second].arguments != 0) throw ParserError{
+            STR("RUN: " << symbols::Entry.name() << " cannot take arguments when run"),
+            program->location()
+        };
+        program_.entry = entry->second;
+        buildPools();
+        return std::move(program_);
+    }
+
+    // ---------------------------------------------------------------- program tables
+
+    void BytecodeCompiler::declareClasses(ASTProgram * program) {
+        for (auto & it : program->body) {
+            if (auto * classDecl = it->as<ASTClassDecl>(); classDecl != nullptr && classDecl->isDefinition) {
+                classDecls_[classDecl->getType()->as<Type::Class>()] = classDecl;
+            }
+        }
+        // * dense indices in the order of declaration, object first
+        std::vector<Type::Class *> classes;
+        types_.findEachClassType(classes);
+        std::sort(classes.begin(), classes.end(), [this](Type::Class * a, Type::Class * b) {
+            if ((a == types_.defaultClassType) != (b == types_.defaultClassType)) return a == types_.defaultClassType;
+            return a->getId() < b->getId();
+        });
+        std::vector<Type::Interface *> interfaces;
+        for (auto * classType : classes) {
+            classIndices_[classType] = static_cast<uint32_t>(program_.classes.size());
+            program_.classes.push_back(BytecodeClass{classType->name.name()});
+            for (auto & it : classType->interfaces) {
+                if (interfaceIndices_.insert({it.second, 0}).second) interfaces.push_back(it.second);
+            }
+        }
+        std::sort(interfaces.begin(), interfaces.end(), [](Type::Interface * a, Type::Interface * b) { return a->getId() < b->getId(); });
+        for (auto * interfaceType : interfaces) {
+            interfaceIndices_[interfaceType] = static_cast<uint32_t>(program_.interfaceNames.size());
+            program_.interfaceNames.push_back(interfaceType->name.name());
+        }
+        program_.interfacesCount = static_cast<uint32_t>(interfaces.size());
+        // * ancestors and vtable layouts are built from the root down, bases before the classes derived from them
+        for (auto * classType : classes) {
+            auto hierarchy = classType->getHierarchy();
+            auto & info = program_.classes[classIndex(classType)];
+            info.depth = static_cast<uint32_t>(hierarchy.size() - 1);
+            info.ancestors = static_cast<uint32_t>(program_.ancestors.size());
+            for (auto it = hierarchy.rbegin(); it != hierarchy.rend(); ++it) {
+                auto * ancestor = const_cast<Type::Class *>(*it);
+                program_.ancestors.push_back(classIndex(ancestor));
+                if (vtableLayouts_.find(ancestor) != vtableLayouts_.end()) continue;
+                std::vector<Symbol> layout;
+                if (auto * base = ancestor->getBase()) layout = vtableLayouts_.at(base);
+                if (auto decl = classDecls_.find(ancestor); decl != classDecls_.end()) {
+                    for (auto & method : decl->second->methods) {
+                        auto name = method->name.value();
+                        if (method->isVirtualized() && std::find(layout.begin(), layout.end(), name) == layout.end()) {
+                            layout.push_back(name);
+                        }
+                    }
+                }
+                vtableLayouts_.insert({ancestor, std::move(layout)});
+            }
+        }
+    }
+
+    void BytecodeCompiler::declareFunctions(ASTProgram * program) {
+        for (auto & it : program->body) {
+            if (auto * funDecl = it->as<ASTFunDecl>()) {
+                if (funDecl->isGeneric()) continue;
+                auto name = funDecl->name.value();
+                if (functions_.find(name) == functions_.end()) {
+                    functions_.insert({name, addFunction(name.name())});
+                }
+            } else if (auto * classDecl = it->as<ASTClassDecl>(); classDecl != nullptr && classDecl->isDefinition) {
+                auto * classType = classDecl->getType()->as<Type::Class>();
+                for (auto & method : classDecl->methods) {
+                    methods_.insert({method.get(), addFunction(STR(classDecl->name.name() << "." << method->name.value().name()))});
+                }
+                for (auto & constructor : classDecl->constructors) {
+                    auto index = addFunction(STR(classDecl->name.name() << "." << classDecl->name.name()));
+                    methods_.insert({constructor.get(), index});
+                    constructors_[classType][constructor->getType()->as<Type::Function>()] = index;
+                }
+            }
+        }
+        for (auto & it : types_.genericInstances()) {
+            genericInstances_.insert({it.get(), addFunction(it->name.name())});
+        }
+        program_.initializer = addFunction("<globals>");
+    }
+
+    void BytecodeCompiler::declareGlobals(ASTProgram * program) {
+        for (auto & it : program->body) {
+            auto * varDecl = it->as<ASTVarDecl>();
+            if (varDecl == nullptr) continue;
+            auto * type = resolve(varDecl->getType());
+            auto * arrayType = varDecl->type->as<ASTArrayType>();
+            uint32_t count = arrayType != nullptr ? arraySize(arrayType) : 0;
+            uint32_t size = count > 0 ? elementSize(type, varDecl) * count : sizeOf(type, varDecl);
+            auto address = allocateData(size, alignOf(count > 0 ? type->as<Type::Pointer>()->base() : type, varDecl));
+            // * the headers of global instances are a part of the initial memory
+            for (auto & header : program_.headerLists[headerList(type, count)]) {
+                uint64_t classIndex = header.classIndex;
+                std::memcpy(program_.data.data() + address + header.offset, &classIndex, sizeof(classIndex));
+            }
+            globals_[varDecl->name->name] = Place{Storage::Global, 0, static_cast<int64_t>(address), type, count};
+        }
+    }
+
+    void BytecodeCompiler::buildDispatchTables() {
+        for (auto & it : classIndices_) {
+            auto * classType = it.first;
+            auto & info = program_.classes[it.second];
+            auto & layout = vtableLayouts_.at(classType);
+            info.vtable = static_cast<uint32_t>(program_.vtableSlots.size());
+            info.vtableSize = static_cast<uint32_t>(layout.size());
+            for (auto & name : layout) {
+                auto method = classType->getMethodInfo(name);
+                bool isCallable = method.has_value() && !method->ast->isAbstract();
+                program_.vtableSlots.push_back(isCallable ? static_cast<int32_t>(methods_.at(method->ast)) : -1);
+            }
+        }
+        program_.implTable.assign(program_.classes.size() * program_.interfacesCount, 0);
+        program_.implOffsets.push_back(0); // impl 0 is none
+        for (auto & it : classIndices_) {
+            auto * classType = it.first;
+            std::vector<Type::Interface *> interfaces;
+            for (auto & implemented : classType->interfaces) interfaces.push_back(implemented.second);
+            std::sort(interfaces.begin(), interfaces.end(), [this](Type::Interface * a, Type::Interface * b) { return interfaceIndex(a) < interfaceIndex(b); });
+            for (auto * interfaceType : interfaces) {
+                auto impl = static_cast<uint32_t>(program_.implOffsets.size());
+                if (impl > MaxImpls) throw std::runtime_error(STR("RUN: more than " << MaxImpls << " interface implementations"));
+                program_.implOffsets.push_back(static_cast<uint32_t>(program_.implSlots.size()));
+                for (auto & name : interfaceMethods(interfaceType)) {
+                    auto info = classType->getMethodInfo(name);
+                    bool isCallable = info.has_value() && !info->ast->isAbstract();
+                    program_.implSlots.push_back(isCallable ? static_cast<int32_t>(methods_.at(info->ast)) : -1);
+                }
+                program_.implTable[it.second * program_.interfacesCount + interfaceIndex(interfaceType)] = impl;
+            }
+        }
+    }
+
+    void BytecodeCompiler::buildPools() {
+        // * pools follow the data, so that the string literals found while compiling the functions stay in the data
+        uint64_t top = AlignUp(program_.data.size(), 8);
+        for (auto & it : classIndices_) {
+            auto & info = program_.classes[it.second];
+            if (it.first != types_.defaultClassType) {
+                info.size = recordOf(it.first, nullptr).size;
+                info.headers = headerList(it.first, 0);
+            }
+            if (!it.first->isPooled()) continue;
+            info.isPooled = true;
+            info.arena = top;
+            top += AlignUp(static_cast<uint64_t>(info.size) * program_.poolCapacity, 8);
+        }
+        program_.staticBytes = top;
+    }
+
+    uint32_t BytecodeCompiler::classIndex(Type::Class * type) const {
+        return classIndices_.at(type);
+    }
+
+    uint32_t BytecodeCompiler::interfaceIndex(Type::Interface * type) const {
+        return interfaceIndices_.at(type);
+    }
+
+    uint32_t BytecodeCompiler::vtableSlot(Type::Class * type, Symbol method) const {
+        auto & layout = vtableLayouts_.at(type);
+        return static_cast<uint32_t>(std::find(layout.begin(), layout.end(), method) - layout.begin());
+    }
+
+    uint32_t BytecodeCompiler::interfaceSlot(Type::Interface * type, Symbol method, AST * ast) {
+        auto & methods = interfaceMethods(type);
+        auto it = std::find(methods.begin(), methods.end(), method);
+        if (it == methods.end()) fail(STR("interface " << type->name.name() << " has no method " << method.name()), ast);
+        return static_cast<uint32_t>(it - methods.begin());
+    }
+
+    std::vector<Symbol> const & BytecodeCompiler::interfaceMethods(Type::Interface * type) {
+        if (auto it = interfaceMethods_.find(type); it != interfaceMethods_.end()) return it->second;
+        // * impls list the methods in the order of the fields of the interface vtable, like the impl structs of the transpiler
+        std::vector<FieldInfo> fields;
+        type->vtable->collectFieldsOrdered(fields);
+        std::vector<Symbol> methods;
+        for (auto & field : fields) methods.push_back(field.name);
+        return interfaceMethods_.insert({type, std::move(methods)}).first->second;
+    }
+
+    uint32_t BytecodeCompiler::headerList(Type * type, uint32_t count) {
+        auto key = std::make_pair(type, count);
+        if (auto it = headerLists_.find(key); it != headerLists_.end()) return it->second;
+        std::vector<HeaderSlot> headers;
+        if (count > 0) {
+            auto * element = type->as<Type::Pointer>()->base();
+            uint32_t size = sizeOf(element, nullptr);
+            for (uint32_t i = 0; i < count; ++i) collectHeaders(element, i * size, headers);
+        } else {
+            collectHeaders(type, 0, headers);
+        }
+        auto index = static_cast<uint32_t>(program_.headerLists.size());
+        program_.headerLists.push_back(std::move(headers));
+        headerLists_.insert({key, index});
+        return index;
+    }
+
+    void BytecodeCompiler::collectHeaders(Type * type, uint32_t offset, std::vector<HeaderSlot> & result) {
+        auto * complex = type->as<Type::Complex>();
+        if (complex == nullptr || type->as<Type::Interface>() != nullptr) return;
+        if (auto * classType = type->as<Type::Class>()) {
+            result.push_back(HeaderSlot{offset, classIndex(classType)});
+        }
+        for (auto & it : recordOf(complex, nullptr).fields) {
+            auto & field = it.second;
+            if (field.count == 0) {
+                collectHeaders(field.type, offset + field.offset, result);
+                continue;
+            }
+            auto * element = field.type->as<Type::Pointer>()->base();
+            uint32_t size = sizeOf(element, nullptr);
+            for (uint32_t i = 0; i < field.count; ++i) collectHeaders(element, offset + field.offset + i * size, result);
+        }
+    }
+
+    uint32_t BytecodeCompiler::addFunction(std::string name) {
+        program_.functions.push_back(BytecodeFunction{std::move(name)});
+        return static_cast<uint32_t>(program_.functions.size() - 1);
+    }
+
+    uint32_t BytecodeCompiler::addConstant(Value value) {
+        auto [it, isNew] = constants_.insert({value.i, static_cast<uint32_t>(program_.constants.size())});
+        if (isNew) program_.constants.push_back(value);
+        return it->second;
+    }
+
+    uint64_t BytecodeCompiler::allocateData(uint32_t size, uint32_t align) {
+        uint64_t address = AlignUp(program_.data.size(), align);
+        if (address + size > MaxDataBytes) throw std::runtime_error("RUN: globals and string literals do not fit the memory of the machine");
+        program_.data.resize(address + size, 0);
+        return address;
+    }
+
+    // ---------------------------------------------------------------- types
+
+    Type * BytecodeCompiler::resolve(Type * type) const {
+        if (type == nullptr) return nullptr;
+        if (instance_ != nullptr) type = types_.substitute(type, instance_->typeArguments);
+        while (auto * alias = type->as<Type::Alias>()) type = alias->base();
+        return type;
+    }
+
+    Type * BytecodeCompiler::typeOf(AST * ast) const {
+        return resolve(ast->getType());
+    }
+
+    bool BytecodeCompiler::isDouble(Type * type) const {
+        return type == types_.getTypeDouble();
+    }
+
+    bool BytecodeCompiler::isChar(Type * type) const {
+        return type == types_.getTypeChar();
+    }
+
+    bool BytecodeCompiler::isAggregate(Type * type) const {
+        return type->as<Type::Struct>() != nullptr || type->as<Type::Class>() != nullptr;
+    }
+
+    bool BytecodeCompiler::IsView(Type * type) {
+        return type->unwrap<Type::Interface>() != nullptr;
+    }
+
+    uint32_t BytecodeCompiler::sizeOf(Type * type, AST * ast) {
+        if (type == types_.getTypeChar()) return 1;
+        if (type == types_.getTypeInt()) return 4;
+        if (type == types_.getTypeDouble()) return 8;
+        if (type->as<Type::Pointer>() != nullptr || type->as<Type::Interface>() != nullptr) return 8;
+        if (auto * complex = type->as<Type::Complex>(); complex != nullptr && type->as<Type::VTable>() == nullptr) {
+            return recordOf(complex, ast).size;
+        }
+        fail(STR("values of type " << type->toString() << " have no size"), ast);
+    }
+
+    uint32_t BytecodeCompiler::alignOf(Type * type, AST * ast) {
+        if (auto * complex = type->as<Type::Complex>(); complex != nullptr && type->as<Type::Interface>() == nullptr) {
+            return recordOf(complex, ast).align;
+        }
+        return sizeOf(type, ast);
+    }
+
+    uint32_t BytecodeCompiler::elementSize(Type * pointer, AST * ast) {
+        auto * base = pointer->as<Type::Pointer>()->base();
+        // * void pointers step by bytes
+        if (base == types_.getTypeVoid()) return 1;
+        return sizeOf(resolve(base), ast);
+    }
+
+    BytecodeCompiler::Record const & BytecodeCompiler::recordOf(Type::Complex * type, AST * ast) {
+        if (auto it = records_.find(type); it != records_.end()) return it->second;
+        bool isClass = type->as<Type::Class>() != nullptr;
+        Record record;
+        // * classes start with the header holding their class index
+        uint64_t offset = isClass ? 8 : 0;
+        record.align = isClass ? 8 : 1;
+        std::vector<FieldInfo> fields;
+        type->collectFieldsOrdered(fields);
+        for (auto & it : fields) {
+            Field field{0, it.type, fieldCount(it)};
+            auto * element = field.count > 0 ? field.type->as<Type::Pointer>()->base() : field.type;
+            uint32_t align = alignOf(element, it.ast);
+            offset = AlignUp(offset, align);
+            field.offset = static_cast<uint32_t>(offset);
+            offset += static_cast<uint64_t>(sizeOf(element, it.ast)) * std::max<uint32_t>(field.count, 1);
+            if (offset > MaxDataBytes) fail(STR("instances of " << type->toString() << " do not fit the memory of the machine"), it.ast);
+            record.align = std::max(record.align, align);
+            record.fields.insert({it.name, field});
+        }
+        record.size = static_cast<uint32_t>(std::max<uint64_t>(AlignUp(offset, record.align), 1));
+        return records_.insert({type, std::move(record)}).first->second;
+    }
+
+    uint32_t BytecodeCompiler::arraySize(ASTArrayType * type) {
+        if (type->base->as<ASTArrayType>() != nullptr) fail("arrays of arrays cannot be run", type);
+        auto * size = type->size.get();
+        std::optional<int64_t> count = IntegerLiteral(size);
+        if (!count.has_value()) {
+            if (auto * call = size->as<ASTCall>(); call != nullptr && call->constexprFunction != nullptr) {
+                if (auto value = evaluator_.evaluate(call); value.has_value()) count = value->integer;
+            }
+        }
+        if (!count.has_value()) fail("array size must be a literal or a constexpr call with constant arguments", size);
+        if (count.value() <= 0 || count.value() > MaxArrayElements) fail(STR("array size " << count.value() << " is out of range"), size);
+        return static_cast<uint32_t>(count.value());
+    }
+
+    uint32_t BytecodeCompiler::fieldCount(FieldInfo const & field) {
+        auto * varDecl = field.ast != nullptr ? field.ast->as<ASTVarDecl>() : nullptr;
+        auto * arrayType = varDecl != nullptr ? varDecl->type->as<ASTArrayType>() : nullptr;
+        return arrayType != nullptr ? arraySize(arrayType) : 0;
+    }
+
+    // ---------------------------------------------------------------- functions
+
+    void BytecodeCompiler::beginFunction(uint32_t index) {
+        function_ = &program_.functions[index];
+        scopes_.clear();
+        scopes_.emplace_back();
+        addressed_.clear();
+        loops_.clear();
+        nextRegister_ = 0;
+        frameTop_ = 0;
+    }
+
+    void BytecodeCompiler::endFunction() {
+        function_->frameBytes = static_cast<uint32_t>(AlignUp(function_->frameBytes, 8));
+        function_ = nullptr;
+        instance_ = nullptr;
+        returnType_ = nullptr;
+        isEntry_ = false;
+        site_ = nullptr;
+    }
+
+    void BytecodeCompiler::compileFunction(uint32_t index, ASTFunDecl * ast, Type::Class * classType, GenericInstance const * instance) {
+        beginFunction(index);
+        instance_ = instance;
+        site_ = ast;
+        auto * functionType = ast->getType()->as<Type::Function>();
+        returnType_ = ast->isClassConstructor() ? types_.getTypeVoid() : resolve(functionType->returnType());
+        isEntry_ = ast->isPureFunction() && instance == nullptr && ast->name.value() == symbols::Entry;
+        collectAddressed(ast->body.get());
+        // * this comes first, the arguments follow it in their registers
+        std::vector<std::pair<Symbol, Type *>> arguments;
+        if (classType != nullptr) arguments.push_back({symbols::KwThis, types_.getOrCreatePointerType(classType)});
+        for (auto & it : ast->args) arguments.push_back({it->name->name, resolve(it->type->getType())});
+        for (size_t i = 0; i < arguments.size(); ++i) allocateRegister();
+        function_->arguments = static_cast<uint32_t>(arguments.size());
+        for (size_t i = 0; i < arguments.size(); ++i) {
+            bindArgument(static_cast<int32_t>(i), arguments[i].first, arguments[i].second, ast);
+        }
+        if (classType != nullptr && classType->getBase() != nullptr) {
+            auto base = scopes_.back().at(symbols::KwThis);
+            base.type = types_.getOrCreatePointerType(classType->getBase());
+            scopes_.back()[symbols::KwBase] = base;
+        }
+        // * constructors initialize the base first
+        if (ast->isClassConstructor() && ast->base.has_value()) {
+            auto & base = ast->base.value();
+            auto * baseType = classType->getBase();
+            auto constructors = constructors_.find(baseType);
+            auto * baseConstructorType = base.name->getType()->as<Type::Function>();
+            if (constructors != constructors_.end() && constructors->second.find(baseConstructorType) != constructors->second.end()) {
+                int32_t argBase = nextRegister_;
+                nextRegister_ += static_cast<int32_t>(1 + base.args.size());
+                function_->registers = std::max<uint32_t>(function_->registers, nextRegister_);
+                emit(Opcode::Move, argBase, load(scopes_.back().at(symbols::KwThis), -1));
+                for (size_t i = 0; i < base.args.size(); ++i) {
+                    int32_t slot = argBase + 1 + static_cast<int32_t>(i);
+                    int32_t value = compileIdentifier(base.args[i].get(), slot);
+                    if (value != slot) emit(Opcode::Move, slot, value);
+                }
+                nextRegister_ = argBase;
+                emit(Opcode::Call, argBase, static_cast<int32_t>(constructors->second.at(baseConstructorType)), argBase);
+            }
+        }
+        compileStatement(ast->body.get());
+        if (returnType_ == types_.getTypeVoid()) {
+            emit(Opcode::ReturnVoid);
+        } else if (isEntry_) {
+            // * like in C++, the entry returns 0 when it ends without a return
+            emit(Opcode::Return, loadInteger(0, -1));
+        } else {
+            emit(Opcode::MissingReturn);
+        }
+        endFunction();
+    }
+
+    void BytecodeCompiler::compileInitializer(ASTProgram * program) {
+        beginFunction(program_.initializer);
+        for (auto & it : program->body) {
+            auto * varDecl = it->as<ASTVarDecl>();
+            if (varDecl == nullptr || varDecl->value == nullptr) continue;
+            site_ = varDecl;
+            compileVarDecl(varDecl, true);
+        }
+        emit(Opcode::ReturnVoid);
+        endFunction();
+    }
+
+    void BytecodeCompiler::bindArgument(int32_t reg, Symbol name, Type * type, AST * ast) {
+        Place place{Storage::Register, reg, 0, type};
+        if (isAggregate(type)) {
+            // * aggregates are passed by address, the callee copies them into its frame
+            place = allocateLocal(type, 0, true, ast);
+            emit(Opcode::Copy, addressOf(place), reg, static_cast<int32_t>(sizeOf(type, ast)));
+        } else if (addressed_.find(name) != addressed_.end()) {
+            place = allocateLocal(type, 0, true, ast);
+            store(place, reg);
+        }
+        scopes_.back()[name] = place;
+        nextRegister_ = function_->arguments;
+    }
+
+    void BytecodeCompiler::collectAddressed(AST * ast) {
+        if (ast == nullptr) return;
+        if (auto * address = ast->as<ASTAddress>()) {
+            if (auto * identifier = address->target->as<ASTIdentifier>()) addressed_.insert(identifier->name);
+            collectAddressed(address->target.get());
+        } else if (auto * sequence = ast->as<ASTSequence>()) {
+            for (auto & it : sequence->body) collectAddressed(it.get());
+        } else if (auto * varDecl = ast->as<ASTVarDecl>()) {
+            collectAddressed(varDecl->value.get());
+        } else if (auto * ifAst = ast->as<ASTIf>()) {
+            collectAddressed(ifAst->cond.get());
+            collectAddressed(ifAst->trueCase.get());
+            collectAddressed(ifAst->falseCase.get());
+        } else if (auto * switchAst = ast->as<ASTSwitch>()) {
+            collectAddressed(switchAst->cond.get());
+            for (auto & it : switchAst->cases) collectAddressed(it.second.get());
+            collectAddressed(switchAst->defaultCase.get());
+        } else if (auto * whileAst = ast->as<ASTWhile>()) {
+            collectAddressed(whileAst->cond.get());
+            collectAddressed(whileAst->body.get());
+        } else if (auto * doWhile = ast->as<ASTDoWhile>()) {
+            collectAddressed(doWhile->body.get());
+            collectAddressed(doWhile->cond.get());
+        } else if (auto * forAst = ast->as<ASTFor>()) {
+            collectAddressed(forAst->init.get());
+            collectAddressed(forAst->cond.get());
+            collectAddressed(forAst->increment.get());
+            collectAddressed(forAst->body.get());
+        } else if (auto * returnAst = ast->as<ASTReturn>()) {
+            collectAddressed(returnAst->value.get());
+        } else if (auto * deleteAst = ast->as<ASTDelete>()) {
+            collectAddressed(deleteAst->target.get());
+        } else if (auto * binaryOp = ast->as<ASTBinaryOp>()) {
+            collectAddressed(binaryOp->left.get());
+            collectAddressed(binaryOp->right.get());
+        } else if (auto * assignment = ast->as<ASTAssignment>()) {
+            collectAddressed(assignment->lvalue.get());
+            collectAddressed(assignment->value.get());
+        } else if (auto * unaryOp = ast->as<ASTUnaryOp>()) {
+            collectAddressed(unaryOp->arg.get());
+        } else if (auto * postOp = ast->as<ASTUnaryPostOp>()) {
+            collectAddressed(postOp->arg.get());
+        } else if (auto * deref = ast->as<ASTDeref>()) {
+            collectAddressed(deref->target.get());
+        } else if (auto * index = ast->as<ASTIndex>()) {
+            collectAddressed(index->base.get());
+            collectAddressed(index->index.get());
+        } else if (auto * member = ast->as<ASTMember>()) {
+            collectAddressed(member->base.get());
+            collectAddressed(member->member.get());
+        } else if (auto * call = ast->as<ASTCall>()) {
+            collectAddressed(call->function.get());
+            for (auto & it : call->args) collectAddressed(it.get());
+        } else if (auto * newAst = ast->as<ASTNew>()) {
+            collectAddressed(newAst->constructor.get());
+        } else if (auto * cast = ast->as<ASTCast>()) {
+            collectAddressed(cast->value.get());
+        }
+    }
+
+    // ---------------------------------------------------------------- statements
+
+    void BytecodeCompiler::compileStatement(AST * ast) {
+        if (ast == nullptr) return;
+        site_ = ast;
+        if (auto * varDecl = ast->as<ASTVarDecl>()) {
+            // * the variable outlives the statement
+            compileVarDecl(varDecl, false);
+            return;
+        }
+        int32_t registers = nextRegister_;
+        uint32_t frame = frameTop_;
+        if (auto * block = ast->as<ASTBlock>()) {
+            compileBlock(block);
+        } else if (auto * ifAst = ast->as<ASTIf>()) {
+            compileIf(ifAst);
+        } else if (auto * switchAst = ast->as<ASTSwitch>()) {
+            compileSwitch(switchAst);
+        } else if (auto * whileAst = ast->as<ASTWhile>()) {
+            compileWhile(whileAst);
+        } else if (auto * doWhile = ast->as<ASTDoWhile>()) {
+            compileDoWhile(doWhile);
+        } else if (auto * forAst = ast->as<ASTFor>()) {
+            compileFor(forAst);
+        } else if (auto * returnAst = ast->as<ASTReturn>()) {
+            compileReturn(returnAst);
+        } else if (ast->as<ASTBreak>() != nullptr) {
+            if (loops_.empty()) fail("break outside of a loop or switch", ast);
+            loops_.back().breaks.push_back(emit(Opcode::Jump));
+        } else if (ast->as<ASTContinue>() != nullptr) {
+            auto loop = std::find_if(loops_.rbegin(), loops_.rend(), [](Loop const & it) { return !it.isSwitch; });
+            if (loop == loops_.rend()) fail("continue outside of a loop", ast);
+            loop->continues.push_back(emit(Opcode::Jump));
+        } else if (auto * deleteAst = ast->as<ASTDelete>()) {
+            compileDelete(deleteAst);
+        } else {
+            compileEffect(ast);
+        }
+        nextRegister_ = registers;
+        frameTop_ = frame;
+    }
+
+    void BytecodeCompiler::compileEffect(AST * ast) {
+        // * the value of a postfix increment is not needed, the prefix one is cheaper
+        if (auto * postOp = ast->as<ASTUnaryPostOp>()) {
+            site_ = ast;
+            compileIncrement(postOp->arg.get(), postOp->op == Symbol::Inc, false, -1);
+        } else if (auto * sequence = ast->as<ASTSequence>()) {
+            for (auto & it : sequence->body) compileEffect(it.get());
+        } else {
+            compileExpr(ast);
+        }
+    }
+
+    void BytecodeCompiler::compileBlock(ASTSequence * ast) {
+        int32_t registers = nextRegister_;
+        uint32_t frame = frameTop_;
+        scopes_.emplace_back();
+        for (auto & it : ast->body) compileStatement(it.get());
+        scopes_.pop_back();
+        nextRegister_ = registers;
+        frameTop_ = frame;
+    }
+
+    void BytecodeCompiler::compileVarDecl(ASTVarDecl * ast, bool isGlobal) {
+        auto * type = resolve(ast->getType());
+        auto * arrayType = ast->type->as<ASTArrayType>();
+        uint32_t count = arrayType != nullptr ? arraySize(arrayType) : 0;
+        auto name = ast->name->name;
+        Place place;
+        if (isGlobal) {
+            place = globals_.at(name);
+        } else {
+            bool isInMemory = count > 0 || isAggregate(type) || addressed_.find(name) != addressed_.end();
+            place = allocateLocal(type, count, isInMemory, ast);
+        }
+        int32_t registers = nextRegister_;
+        uint32_t frame = frameTop_;
+        auto * construction = ast->value != nullptr ? ast->value->as<ASTCall>() : nullptr;
+        if (construction != nullptr && construction->function->as<ASTNamedType>() != nullptr) {
+            constructAt(construction, addressOf(place));
+        } else if (ast->value != nullptr) {
+            assign(place, ast->value.get());
+        } else if (!isGlobal) {
+            // * the global memory starts zeroed, the locals are zeroed on every declaration
+            initializePlace(place, ast);
+        }
+        nextRegister_ = registers;
+        frameTop_ = frame;
+        // * the variable is visible after its value, like the variable of the same name it may shadow
+        if (!isGlobal) scopes_.back()[name] = place;
+    }
+
+    void BytecodeCompiler::initializePlace(Place const & place, AST * ast) {
+        if (place.storage == Storage::Register) {
+            emit(Opcode::LoadInt, place.reg, 0);
+            return;
+        }
+        uint32_t size = place.count > 0 ? elementSize(place.type, ast) * place.count : sizeOf(place.type, ast);
+        int32_t address = addressOf(place);
+        emit(Opcode::Zero, address, static_cast<int32_t>(size));
+        auto headers = headerList(place.type, place.count);
+        if (!program_.headerLists[headers].empty()) emit(Opcode::InitHeaders, address, static_cast<int32_t>(headers));
+    }
+
+    void BytecodeCompiler::assign(Place const & place, AST * value) {
+        if (isAggregate(place.type)) {
+            int32_t source = compileExpr(value);
+            emit(Opcode::Copy, addressOf(place), source, static_cast<int32_t>(sizeOf(place.type, value)));
+            return;
+        }
+        store(place, compileExpr(value, place.storage == Storage::Register ? place.reg : -1));
+    }
+
+    void BytecodeCompiler::compileIf(ASTIf * ast) {
+        std::vector<size_t> elseJumps;
+        compileBranch(ast->cond.get(), false, elseJumps);
+        compileStatement(ast->trueCase.get());
+        if (ast->falseCase != nullptr) {
+            size_t end = emit(Opcode::Jump);
+            patchAll(elseJumps, here());
+            compileStatement(ast->falseCase.get());
+            patch(end, here());
+        } else {
+            patchAll(elseJumps, here());
+        }
+    }
+
+    void BytecodeCompiler::compileSwitch(ASTSwitch * ast) {
+        int32_t value = decay(compileExpr(ast->cond.get()), typeOf(ast->cond.get()));
+        auto tableIndex = static_cast<int32_t>(program_.switches.size());
+        program_.switches.emplace_back();
+        emit(Opcode::Switch, value, tableIndex);
+        loops_.push_back(Loop{{}, {}, true});
+        // * cases follow one another in the order the transpiler prints them, so that they fall through the same way
+        std::vector<std::pair<int64_t, int32_t>> cases;
+        for (auto & it : ast->cases) {
+            cases.push_back({it.first, static_cast<int32_t>(here())});
+            compileStatement(it.second.get());
+        }
+        std::optional<size_t> defaultTarget;
+        if (ast->defaultCase != nullptr) {
+            defaultTarget = here();
+            compileStatement(ast->defaultCase.get());
+        }
+        patchAll(loops_.back().breaks, here());
+        loops_.pop_back();
+        auto & table = program_.switches[tableIndex];
+        table.defaultTarget = static_cast<int32_t>(defaultTarget.value_or(here()));
+        std::sort(cases.begin(), cases.end());
+        if (!cases.empty()) {
+            int64_t low = cases.front().first;
+            int64_t range = cases.back().first - low + 1;
+            table.isDense = range <= static_cast<int64_t>(cases.size()) * 2 + 8;
+            if (table.isDense) {
+                table.low = low;
+                table.targets.assign(static_cast<size_t>(range), -1);
+                for (auto & it : cases) table.targets[static_cast<size_t>(it.first - low)] = it.second;
+            } else {
+                table.cases = std::move(cases);
+            }
+        }
+    }
+
+    void BytecodeCompiler::compileWhile(ASTWhile * ast) {
+        // * the condition follows the body, a jump enters the loop at it
+        size_t entry = emit(Opcode::Jump);
+        size_t body = here();
+        loops_.emplace_back();
+        compileStatement(ast->body.get());
+        size_t cond = here();
+        patch(entry, cond);
+        std::vector<size_t> again;
+        compileBranch(ast->cond.get(), true, again);
+        patchAll(again, body);
+        patchAll(loops_.back().continues, cond);
+        patchAll(loops_.back().breaks, here());
+        loops_.pop_back();
+    }
+
+    void BytecodeCompiler::compileDoWhile(ASTDoWhile * ast) {
+        size_t body = here();
+        loops_.emplace_back();
+        compileStatement(ast->body.get());
+        size_t cond = here();
+        std::vector<size_t> again;
+        compileBranch(ast->cond.get(), true, again);
+        patchAll(again, body);
+        patchAll(loops_.back().continues, cond);
+        patchAll(loops_.back().breaks, here());
+        loops_.pop_back();
+    }
+
+    void BytecodeCompiler::compileFor(ASTFor * ast) {
+        int32_t registers = nextRegister_;
+        uint32_t frame = frameTop_;
+        scopes_.emplace_back();
+        compileStatement(ast->init.get());
+        size_t entry = emit(Opcode::Jump);
+        size_t body = here();
+        loops_.emplace_back();
+        compileStatement(ast->body.get());
+        size_t increment = here();
+        if (ast->increment != nullptr) {
+            int32_t incrementRegisters = nextRegister_;
+            uint32_t incrementFrame = frameTop_;
+            site_ = ast->increment.get();
+            compileEffect(ast->increment.get());
+            nextRegister_ = incrementRegisters;
+            frameTop_ = incrementFrame;
+        }
+        patch(entry, here());
+        if (ast->cond != nullptr) {
+            std::vector<size_t> again;
+            compileBranch(ast->cond.get(), true, again);
+            patchAll(again, body);
+        } else {
+            patch(emit(Opcode::Jump), body);
+        }
+        patchAll(loops_.back().continues, increment);
+        patchAll(loops_.back().breaks, here());
+        loops_.pop_back();
+        scopes_.pop_back();
+        nextRegister_ = registers;
+        frameTop_ = frame;
+    }
+
+    void BytecodeCompiler::compileReturn(ASTReturn * ast) {
+        if (ast->value == nullptr) {
+            emit(Opcode::ReturnVoid);
+            return;
+        }
+        int32_t value = compileExpr(ast->value.get());
+        if (isChar(returnType_)) {
+            int32_t truncated = allocateRegister();
+            emit(Opcode::TruncChar, truncated, value);
+            value = truncated;
+        }
+        // * aggregates are returned by address, the caller copies them before its next call
+        emit(Opcode::Return, value);
+    }
+
+    void BytecodeCompiler::compileDelete(ASTDelete * ast) {
+        auto * classType = typeOf(ast->target.get())->as<Type::Pointer>()->base()->as<Type::Class>();
+        int32_t instance = compileExpr(ast->target.get());
+        emit(Opcode::Delete, instance, static_cast<int32_t>(classIndex(classType)));
+    }
+
+    void BytecodeCompiler::compileBranch(AST * cond, bool jumpIf, std::vector<size_t> & jumps) {
+        AST * previousSite = site_;
+        site_ = cond;
+        int32_t registers = nextRegister_;
+        if (auto literal = IntegerLiteral(cond); literal.has_value()) {
+            if ((literal.value() != 0) == jumpIf) jumps.push_back(emit(Opcode::Jump));
+        } else if (auto * binaryOp = cond->as<ASTBinaryOp>(); binaryOp != nullptr && (binaryOp->op == Symbol::And || binaryOp->op == Symbol::Or)) {
+            bool isAnd = binaryOp->op == Symbol::And;
+            if (isAnd != jumpIf) {
+                // * either operand decides: a false one for and, a true one for or
+                compileBranch(binaryOp->left.get(), jumpIf, jumps);
+                compileBranch(binaryOp->right.get(), jumpIf, jumps);
+            } else {
+                std::vector<size_t> skip;
+                compileBranch(binaryOp->left.get(), !jumpIf, skip);
+                compileBranch(binaryOp->right.get(), jumpIf, jumps);
+                patchAll(skip, here());
+            }
+        } else if (auto * unaryOp = cond->as<ASTUnaryOp>(); unaryOp != nullptr && unaryOp->op == Symbol::Not) {
+            compileBranch(unaryOp->arg.get(), !jumpIf, jumps);
+        } else if (binaryOp != nullptr && IsRelational(binaryOp->op) && !isDouble(typeOf(binaryOp->left.get())) && !isDouble(typeOf(binaryOp->right.get()))
+            && !isAggregate(typeOf(binaryOp->left.get()))) {
+            // * comparisons of integers and addresses jump on their own, doubles go through a value for their unordered NaNs
+            int32_t left = decay(compileExpr(binaryOp->left.get()), typeOf(binaryOp->left.get()));
+            auto literal = IntegerLiteral(binaryOp->right.get());
+            if (literal.has_value()) {
+                jumps.push_back(emit(JumpOpcode(binaryOp->op, !jumpIf, true), left, static_cast<int32_t>(literal.value())));
+            } else {
+                int32_t right = decay(compileExpr(binaryOp->right.get()), typeOf(binaryOp->right.get()));
+                jumps.push_back(emit(JumpOpcode(binaryOp->op, !jumpIf, false), left, right));
+            }
+        } else {
+            auto * type = typeOf(cond);
+            int32_t value = compileExpr(cond);
+            if (isDouble(type)) {
+                int32_t test = allocateRegister();
+                emit(Opcode::TestD, test, value);
+                value = test;
+            } else {
+                value = decay(value, type);
+            }
+            jumps.push_back(emit(jumpIf ? Opcode::JumpIfNotZero : Opcode::JumpIfZero, value));
+        }
+        nextRegister_ = registers;
+        site_ = previousSite;
+    }
+
+    // ---------------------------------------------------------------- expressions
+
+    int32_t BytecodeCompiler::compileExpr(AST * ast, int32_t hint) {
+        AST * previousSite = site_;
+        site_ = ast;
+        int32_t result;
+        if (auto literal = IntegerLiteral(ast); literal.has_value()) {
+            result = loadInteger(literal.value(), hint);
+        } else if (auto * real = ast->as<ASTDouble>()) {
+            Value value;
+            value.d = real->value;
+            result = target(hint);
+            emit(Opcode::LoadConst, result, static_cast<int32_t>(addConstant(value)));
+        } else if (auto * string = ast->as<ASTString>()) {
+            result = compileString(string, hint);
+        } else if (auto * identifier = ast->as<ASTIdentifier>()) {
+            result = compileIdentifier(identifier, hint);
+        } else if (auto * classCast = ast->as<ASTClassCast>()) {
+            result = compileClassCast(classCast, hint);
+        } else if (auto * cast = ast->as<ASTCast>()) {
+            result = compileCast(cast, hint);
+        } else if (auto * binaryOp = ast->as<ASTBinaryOp>()) {
+            result = compileBinaryOp(binaryOp, hint);
+        } else if (auto * assignment = ast->as<ASTAssignment>()) {
+            result = compileAssignment(assignment, hint);
+        } else if (auto * unaryOp = ast->as<ASTUnaryOp>()) {
+            result = compileUnaryOp(unaryOp, hint);
+        } else if (auto * postOp = ast->as<ASTUnaryPostOp>()) {
+            result = compileIncrement(postOp->arg.get(), postOp->op == Symbol::Inc, true, hint);
+        } else if (auto * address = ast->as<ASTAddress>()) {
+            auto * identifier = address->target->as<ASTIdentifier>();
+            if (identifier != nullptr && findLocal(identifier->name) == nullptr && globals_.find(identifier->name) == globals_.end()) {
+                // * the address of a function is the function itself
+                result = compileIdentifier(identifier, hint);
+            } else {
+                result = addressOf(compilePlace(address->target.get()), hint);
+            }
+        } else if (ast->as<ASTDeref>() != nullptr || ast->as<ASTIndex>() != nullptr) {
+            result = load(compilePlace(ast), hint);
+        } else if (auto * member = ast->as<ASTMember>()) {
+            if (auto * call = member->member->as<ASTCall>()) {
+                result = compileMethodCall(member, call, hint);
+            } else {
+                result = load(compileField(member, member->member->as<ASTIdentifier>()->name), hint);
+            }
+        } else if (auto * call = ast->as<ASTCall>()) {
+            result = compileCall(call, hint);
+        } else if (auto * newAst = ast->as<ASTNew>()) {
+            result = compileNew(newAst, hint);
+        } else if (auto * sequence = ast->as<ASTSequence>(); sequence != nullptr && !sequence->body.empty()) {
+            for (size_t i = 0; i + 1 < sequence->body.size(); ++i) compileEffect(sequence->body[i].get());
+            result = compileExpr(sequence->body.back().get(), hint);
+        } else {
+            fail("expression cannot be run", ast);
+        }
+        site_ = previousSite;
+        return result;
+    }
+
+    int32_t BytecodeCompiler::compileIdentifier(ASTIdentifier * ast, int32_t hint) {
+        if (auto * local = findLocal(ast->name)) return load(*local, hint);
+        if (auto global = globals_.find(ast->name); global != globals_.end()) return load(global->second, hint);
+        if (ast->name == symbols::KwNull) return loadInteger(0, hint);
+        // * function values are their index + 1, so that null is not a function
+        if (auto function = functions_.find(ast->name); function != functions_.end()) return loadInteger(function->second + 1, hint);
+        fail(STR("unknown identifier " << ast->name.name()), ast);
+    }
+
+    int32_t BytecodeCompiler::compileBinaryOp(ASTBinaryOp * ast, int32_t hint) {
+        auto & op = ast->op;
+        if (op == Symbol::And || op == Symbol::Or) return compileLogical(ast, hint);
+        auto * leftType = typeOf(ast->left.get());
+        auto * rightType = typeOf(ast->right.get());
+        int32_t registers = nextRegister_;
+        if (IsRelational(op)) {
+            if (isAggregate(leftType)) fail(STR("values of " << leftType->toString() << " cannot be compared"), ast);
+            bool isReal = isDouble(leftType) || isDouble(rightType);
+            int32_t left = compileExpr(ast->left.get());
+            int32_t right = compileExpr(ast->right.get());
+            if (isReal) {
+                left = convert(left, leftType, types_.getTypeDouble(), -1);
+                right = convert(right, rightType, types_.getTypeDouble(), -1);
+            } else {
+                left = decay(left, leftType);
+                right = decay(right, rightType);
+            }
+            nextRegister_ = registers;
+            int32_t result = target(hint);
+            emit(CompareOpcode(op, isReal), result, left, right);
+            return result;
+        }
+        auto literal = IntegerLiteral(ast->right.get());
+        if ((op == Symbol::Add || op == Symbol::Sub) && leftType->as<Type::Pointer>() != nullptr) {
+            int64_t size = elementSize(leftType, ast);
+            int32_t pointer = compileExpr(ast->left.get());
+            if (literal.has_value() && FitsInt32(literal.value() * size)) {
+                nextRegister_ = registers;
+                int32_t result = target(hint);
+                emit(Opcode::AddLImm, result, pointer, static_cast<int32_t>(op == Symbol::Add ? literal.value() * size : -literal.value() * size));
+                return result;
+            }
+            int32_t index = compileExpr(ast->right.get());
+            if (size != 1) {
+                int32_t scaled = allocateRegister();
+                emit(Opcode::MulLImm, scaled, index, static_cast<int32_t>(size));
+                index = scaled;
+            }
+            nextRegister_ = registers;
+            int32_t result = target(hint);
+            emit(op == Symbol::Add ? Opcode::AddL : Opcode::SubL, result, pointer, index);
+            return result;
+        }
+        auto * resultType = typeOf(ast);
+        if (resultType == nullptr || !(isDouble(resultType) || resultType == types_.getTypeInt() || isChar(resultType))) {
+            fail(STR("operator " << op.name() << " cannot be run on " << leftType->toString() << " and " << rightType->toString()), ast);
+        }
+        if (isDouble(resultType)) {
+            Opcode opcode;
+            if (op == Symbol::Add) opcode = Opcode::AddD;
+            else if (op == Symbol::Sub) opcode = Opcode::SubD;
+            else if (op == Symbol::Mul) opcode = Opcode::MulD;
+            else if (op == Symbol::Div) opcode = Opcode::DivD;
+            else fail(STR("operator " << op.name() << " cannot be run on doubles"), ast);
+            int32_t left = convert(compileExpr(ast->left.get()), leftType, resultType, -1);
+            int32_t right = convert(compileExpr(ast->right.get()), rightType, resultType, -1);
+            nextRegister_ = registers;
+            int32_t result = target(hint);
+            emit(opcode, result, left, right);
+            return result;
+        }
+        if ((op == Symbol::Add || op == Symbol::Sub) && literal.has_value()) {
+            int64_t immediate = op == Symbol::Add ? literal.value() : -literal.value();
+            if (FitsInt32(immediate)) {
+                int32_t left = compileExpr(ast->left.get());
+                nextRegister_ = registers;
+                int32_t result = target(hint);
+                emit(Opcode::AddIImm, result, left, static_cast<int32_t>(immediate));
+                return result;
+            }
+        }
+        Opcode opcode;
+        if (op == Symbol::Add) opcode = Opcode::AddI;
+        else if (op == Symbol::Sub) opcode = Opcode::SubI;
+        else if (op == Symbol::Mul) opcode = Opcode::MulI;
+        else if (op == Symbol::Div) opcode = Opcode::DivI;
+        else if (op == Symbol::Mod) opcode = Opcode::ModI;
+        else if (op == Symbol::ShiftLeft) opcode = Opcode::ShlI;
+        else if (op == Symbol::ShiftRight) opcode = Opcode::ShrI;
+        else if (op == Symbol::BitAnd) opcode = Opcode::BitAndI;
+        else if (op == Symbol::BitOr) opcode = Opcode::BitOrI;
+        else if (op == Symbol::Xor) opcode = Opcode::BitXorI;
+        else fail(STR("operator " << op.name() << " cannot be run"), ast);
+        int32_t left = compileExpr(ast->left.get());
+        int32_t right = compileExpr(ast->right.get());
+        nextRegister_ = registers;
+        int32_t result = target(hint);
+        emit(opcode, result, left, right);
+        return result;
+    }
+
+    int32_t BytecodeCompiler::compileLogical(AST * ast, int32_t hint) {
+        // * the result register is written before the operands are read, so it must not be a variable
+        int32_t result = allocateRegister();
+        emit(Opcode::LoadInt, result, 0);
+        std::vector<size_t> isFalse;
+        compileBranch(ast, false, isFalse);
+        emit(Opcode::LoadInt, result, 1);
+        patchAll(isFalse, here());
+        if (hint >= 0 && hint != result) {
+            emit(Opcode::Move, hint, result);
+            return hint;
+        }
+        return result;
+    }
+
+    int32_t BytecodeCompiler::compileAssignment(ASTAssignment * ast, int32_t hint) {
+        auto * type = typeOf(ast->lvalue.get());
+        if (isAggregate(type)) {
+            int32_t source = compileExpr(ast->value.get());
+            auto place = compilePlace(ast->lvalue.get());
+            int32_t address = addressOf(place);
+            emit(Opcode::Copy, address, source, static_cast<int32_t>(sizeOf(type, ast)));
+            return address;
+        }
+        if (auto * identifier = ast->lvalue->as<ASTIdentifier>()) {
+            // * variables take the value directly into their register
+            auto place = compilePlace(identifier);
+            int32_t value = compileExpr(ast->value.get(), place.storage == Storage::Register ? place.reg : -1);
+            store(place, value);
+            if (place.storage == Storage::Register) return place.reg;
+            if (!isChar(type)) return value;
+            int32_t result = target(hint);
+            emit(Opcode::TruncChar, result, value);
+            return result;
+        }
+        int32_t value = compileExpr(ast->value.get());
+        if (isChar(type)) {
+            int32_t truncated = allocateRegister();
+            emit(Opcode::TruncChar, truncated, value);
+            value = truncated;
+        }
+        store(compilePlace(ast->lvalue.get()), value);
+        return value;
+    }
+
+    int32_t BytecodeCompiler::compileUnaryOp(ASTUnaryOp * ast, int32_t hint) {
+        auto & op = ast->op;
+        if (op == Symbol::Inc || op == Symbol::Dec) return compileIncrement(ast->arg.get(), op == Symbol::Inc, false, hint);
+        if (op == Symbol::Not) {
+            if (isDouble(typeOf(ast->arg.get()))) {
+                int32_t registers = nextRegister_;
+                int32_t value = compileExpr(ast->arg.get());
+                nextRegister_ = registers;
+                int32_t result = target(hint);
+                emit(Opcode::NotD, result, value);
+                return result;
+            }
+            return compileLogical(ast, hint);
+        }
+        auto * type = typeOf(ast->arg.get());
+        int32_t registers = nextRegister_;
+        int32_t value = compileExpr(ast->arg.get());
+        if (op == Symbol::Add) {
+            nextRegister_ = registers;
+            if (hint >= 0 && hint != value) {
+                emit(Opcode::Move, hint, value);
+                return hint;
+            }
+            return value;
+        }
+        nextRegister_ = registers;
+        int32_t result = target(hint);
+        if (op == Symbol::Sub) {
+            emit(isDouble(type) ? Opcode::NegD : Opcode::NegI, result, value);
+        } else if (op == Symbol::Neg) {
+            emit(Opcode::BitNotI, result, value);
+        } else {
+            fail(STR("operator " << op.name() << " cannot be run"), ast);
+        }
+        return result;
+    }
+
+    int32_t BytecodeCompiler::compileIncrement(AST * arg, bool isIncrement, bool isPostfix, int32_t hint) {
+        auto * type = typeOf(arg);
+        auto place = compilePlace(arg);
+        bool isInteger = type == types_.getTypeInt();
+        if (place.storage == Storage::Register && isInteger && !isPostfix) {
+            emit(Opcode::AddIImm, place.reg, place.reg, isIncrement ? 1 : -1);
+            return place.reg;
+        }
+        int32_t value = load(place, -1);
+        int32_t old = value;
+        if (isPostfix && place.storage == Storage::Register) {
+            old = target(hint);
+            emit(Opcode::Move, old, value);
+        }
+        int32_t next = allocateRegister();
+        if (type->as<Type::Pointer>() != nullptr) {
+            int32_t size = static_cast<int32_t>(elementSize(type, arg));
+            emit(Opcode::AddLImm, next, value, isIncrement ? size : -size);
+        } else if (isDouble(type)) {
+            Value one;
+            one.d = isIncrement ? 1.0 : -1.0;
+            int32_t step = allocateRegister();
+            emit(Opcode::LoadConst, step, static_cast<int32_t>(addConstant(one)));
+            emit(Opcode::AddD, next, value, step);
+        } else {
+            emit(Opcode::AddIImm, next, value, isIncrement ? 1 : -1);
+            if (isChar(type)) emit(Opcode::TruncChar, next, next);
+        }
+        store(place, next);
+        if (isPostfix) return old;
+        return place.storage == Storage::Register ? place.reg : next;
+    }
+
+    int32_t BytecodeCompiler::compileCast(ASTCast * ast, int32_t hint) {
+        auto * from = typeOf(ast->value.get());
+        auto * to = typeOf(ast);
+        int32_t registers = nextRegister_;
+        int32_t value = decay(compileExpr(ast->value.get()), from);
+        if (IsView(from)) from = types_.getTypeVoidPtr();
+        nextRegister_ = std::max(registers, value + 1);
+        int32_t result = convert(value, from, to, hint);
+        return result;
+    }
+
+    int32_t BytecodeCompiler::convert(int32_t value, Type * from, Type * to, int32_t hint) {
+        auto finish = [&](Opcode op, int32_t source) {
+            int32_t result = target(hint);
+            emit(op, result, source);
+            return result;
+        };
+        bool isFromReal = isDouble(from);
+        if (isDouble(to)) {
+            if (isFromReal) return hint >= 0 && hint != value ? finish(Opcode::Move, value) : value;
+            return finish(Opcode::IntToDouble, value);
+        }
+        if (isFromReal) {
+            if (!isChar(to)) return finish(Opcode::DoubleToInt, value);
+            int32_t integer = allocateRegister();
+            emit(Opcode::DoubleToInt, integer, value);
+            return finish(Opcode::TruncChar, integer);
+        }
+        if (isChar(to) && !isChar(from)) return finish(Opcode::TruncChar, value);
+        if (to == types_.getTypeInt() && from->as<Type::Pointer>() != nullptr) return finish(Opcode::TruncInt, value);
+        // * the rest keeps the value: char to int, int to pointer and pointer to pointer
+        return hint >= 0 && hint != value ? finish(Opcode::Move, value) : value;
+    }
+
+    int32_t BytecodeCompiler::decay(int32_t value, Type * type) {
+        if (!IsView(type)) return value;
+        int32_t result = allocateRegister();
+        emit(Opcode::ViewTarget, result, value);
+        return result;
+    }
+
+    int32_t BytecodeCompiler::compileClassCast(ASTClassCast * ast, int32_t hint) {
+        auto * from = typeOf(ast->value.get());
+        auto * to = typeOf(ast);
+        int32_t registers = nextRegister_;
+        int32_t value = compileExpr(ast->value.get());
+        if (auto * interfaceType = to->unwrap<Type::Interface>()) {
+            if (from->unwrap<Type::Interface>() == interfaceType) return convert(value, from, from, hint);
+            // * no class implements the interface, the cast always fails
+            if (interfaceIndices_.find(interfaceType) == interfaceIndices_.end()) {
+                nextRegister_ = registers;
+                return loadInteger(0, hint);
+            }
+            value = decay(value, from);
+            nextRegister_ = std::max(registers, value + 1);
+            int32_t result = target(hint);
+            emit(Opcode::CastToInterface, result, value, static_cast<int32_t>(interfaceIndex(interfaceType)));
+            return result;
+        }
+        auto * classType = to->unwrap<Type::Class>();
+        value = decay(value, from);
+        // * upcasts always succeed and keep the address, the base is a prefix of the instance
+        auto * fromPointer = from->as<Type::Pointer>();
+        auto * fromClass = fromPointer != nullptr ? fromPointer->base()->as<Type::Class>() : nullptr;
+        if (fromClass != nullptr && fromClass->inherits(classType)) return convert(value, from, from, hint);
+        nextRegister_ = std::max(registers, value + 1);
+        int32_t result = target(hint);
+        emit(Opcode::CastToClass, result, value, static_cast<int32_t>(classIndex(classType)));
+        return result;
+    }
+
+    int32_t BytecodeCompiler::compileCall(ASTCall * ast, int32_t hint) {
+        if (ast->function->as<ASTNamedType>() != nullptr) return compileConstruction(ast, hint);
+        auto * returnType = typeOf(ast);
+        if (ast->generic != nullptr) {
+            std::vector<Type *> typeArguments;
+            for (auto * it : ast->typeArguments) typeArguments.push_back(resolve(it));
+            auto * instance = types_.findGenericInstance(ast->generic, typeArguments);
+            if (instance == nullptr) fail(STR("no instance of " << ast->generic->name.value().name() << " for the call"), ast);
+            auto * functionType = ast->generic->getType()->as<Type::Function>();
+            std::vector<Type *> parameters;
+            for (size_t i = 0; i < functionType->numArgs(); ++i) {
+                parameters.push_back(types_.substitute(functionType->argType(i), instance->typeArguments));
+            }
+            int32_t argBase = compileArguments(ast->args, parameters, 0);
+            return finishCall(Opcode::Call, static_cast<int32_t>(genericInstances_.at(instance)), argBase, returnType, hint);
+        }
+        // * functions not shadowed by variables are called directly, everything else is a function pointer
+        auto * identifier = ast->function->as<ASTIdentifier>();
+        bool isDirect = identifier != nullptr && findLocal(identifier->name) == nullptr && globals_.find(identifier->name) == globals_.end()
+            && functions_.find(identifier->name) != functions_.end();
+        auto * functionType = typeOf(ast->function.get());
+        if (auto * pointer = functionType->as<Type::Pointer>()) functionType = resolve(pointer->base());
+        auto * signature = functionType->as<Type::Function>();
+        if (signature == nullptr) fail(STR("value of type " << functionType->toString() << " cannot be called"), ast);
+        std::vector<Type *> parameters;
+        for (size_t i = 0; i < signature->numArgs(); ++i) parameters.push_back(resolve(signature->argType(i)));
+        if (isDirect) {
+            int32_t argBase = compileArguments(ast->args, parameters, 0);
+            return finishCall(Opcode::Call, static_cast<int32_t>(functions_.at(identifier->name)), argBase, returnType, hint);
+        }
+        int32_t callee = compileExpr(ast->function.get());
+        if (callee >= nextRegister_) nextRegister_ = callee + 1;
+        int32_t argBase = compileArguments(ast->args, parameters, 0);
+        return finishCall(Opcode::CallIndirect, callee, argBase, returnType, hint);
+    }
+
+    int32_t BytecodeCompiler::compileMethodCall(ASTMember * member, ASTCall * call, int32_t hint) {
+        auto * baseType = typeOf(member->base.get());
+        auto name = call->function->as<ASTIdentifier>()->name;
+        auto * returnType = typeOf(call);
+        auto receiver = [&](int32_t argBase) {
+            int32_t value = compileExpr(member->base.get(), argBase);
+            if (value != argBase) emit(Opcode::Move, argBase, value);
+        };
+        if (auto * classType = baseType->unwrap<Type::Class>()) {
+            auto method = classType->getMethodInfo(name);
+            if (!method.has_value()) fail(STR("class " << classType->name.name() << " has no method " << name.name()), call);
+            std::vector<Type *> parameters;
+            for (size_t i = 1; i < method->type->numArgs(); ++i) parameters.push_back(resolve(method->type->argType(i)));
+            // * the receiver is an address for both -> and ., instances by value have their address
+            int32_t argBase = compileArguments(call->args, parameters, 1, receiver);
+            auto * baseIdentifier = member->base->as<ASTIdentifier>();
+            bool isBaseCall = baseIdentifier != nullptr && baseIdentifier->name == symbols::KwBase;
+            if (method->ast->isVirtualized() && !isBaseCall) {
+                return finishCall(Opcode::CallVirtual, static_cast<int32_t>(vtableSlot(classType, name)), argBase, returnType, hint);
+            }
+            return finishCall(Opcode::Call, static_cast<int32_t>(methods_.at(method->ast)), argBase, returnType, hint);
+        }
+        if (auto * interfaceType = baseType->unwrap<Type::Interface>()) {
+            auto * methodType = interfaceType->methods_.at(name).type;
+            std::vector<Type *> parameters;
+            for (size_t i = 1; i < methodType->numArgs(); ++i) parameters.push_back(resolve(methodType->argType(i)));
+            // * the view is passed whole, the call replaces it by its target
+            int32_t argBase = compileArguments(call->args, parameters, 1, receiver);
+            return finishCall(Opcode::CallInterface, static_cast<int32_t>(interfaceSlot(interfaceType, name, call)), argBase, returnType, hint);
+        }
+        // * function pointer fields
+        int32_t callee = load(compileField(member, name), -1);
+        if (callee >= nextRegister_) nextRegister_ = callee + 1;
+        auto * functionType = typeOf(call->function.get());
+        if (auto * pointer = functionType->as<Type::Pointer>()) functionType = resolve(pointer->base());
+        auto * signature = functionType->as<Type::Function>();
+        if (signature == nullptr) fail(STR("member " << name.name() << " cannot be called"), call);
+        std::vector<Type *> parameters;
+        for (size_t i = 0; i < signature->numArgs(); ++i) parameters.push_back(resolve(signature->argType(i)));
+        int32_t argBase = compileArguments(call->args, parameters, 0);
+        return finishCall(Opcode::CallIndirect, callee, argBase, returnType, hint);
+    }
+
+    int32_t BytecodeCompiler::compileConstruction(ASTCall * call, int32_t hint) {
+        auto * classType = typeOf(call)->as<Type::Class>();
+        int32_t address = allocateTemporary(classType, call);
+        constructAt(call, address);
+        if (hint >= 0 && hint != address) {
+            emit(Opcode::Move, hint, address);
+            return hint;
+        }
+        return address;
+    }
+
+    void BytecodeCompiler::constructAt(ASTCall * call, int32_t address) {
+        auto * classType = typeOf(call)->as<Type::Class>();
+        auto * constructorType = call->function->getType()->as<Type::Function>();
+        int32_t registers = std::max(nextRegister_, address + 1);
+        nextRegister_ = registers;
+        // * the arguments go first, they may read the instance being replaced
+        std::vector<Type *> parameters;
+        for (size_t i = 0; i < constructorType->numArgs(); ++i) parameters.push_back(resolve(constructorType->argType(i)));
+        auto constructors = constructors_.find(classType);
+        bool hasConstructor = constructors != constructors_.end() && constructors->second.find(constructorType) != constructors->second.end();
+        int32_t argBase = compileArguments(call->args, parameters, 1);
+        emit(Opcode::Zero, address, static_cast<int32_t>(sizeOf(classType, call)));
+        auto headers = headerList(classType, 0);
+        if (!program_.headerLists[headers].empty()) emit(Opcode::InitHeaders, address, static_cast<int32_t>(headers));
+        if (hasConstructor) {
+            emit(Opcode::Move, argBase, address);
+            emit(Opcode::Call, argBase, static_cast<int32_t>(constructors->second.at(constructorType)), argBase);
+        }
+        nextRegister_ = registers;
+    }
+
+    int32_t BytecodeCompiler::compileNew(ASTNew * ast, int32_t hint) {
+        auto * call = ast->constructor.get();
+        auto * classType = typeOf(ast)->as<Type::Pointer>()->base()->as<Type::Class>();
+        auto * constructorType = call->function->getType()->as<Type::Function>();
+        // * the instance register is below the arguments, the call does not overwrite it
+        int32_t instance = allocateRegister();
+        std::vector<Type *> parameters;
+        for (size_t i = 0; i < constructorType->numArgs(); ++i) parameters.push_back(resolve(constructorType->argType(i)));
+        int32_t argBase = compileArguments(call->args, parameters, 1);
+        emit(Opcode::New, instance, static_cast<int32_t>(classIndex(classType)));
+        auto constructors = constructors_.find(classType);
+        if (constructors != constructors_.end() && constructors->second.find(constructorType) != constructors->second.end()) {
+            // * a full pool gives null and runs no constructor
+            size_t isFull = emit(Opcode::JumpIfZero, instance);
+            emit(Opcode::Move, argBase, instance);
+            emit(Opcode::Call, argBase, static_cast<int32_t>(constructors->second.at(constructorType)), argBase);
+            patch(isFull, here());
+        }
+        nextRegister_ = instance + 1;
+        if (hint >= 0 && hint != instance) {
+            emit(Opcode::Move, hint, instance);
+            return hint;
+        }
+        return instance;
+    }
+
+    int32_t BytecodeCompiler::compileArguments(std::vector<std::unique_ptr<AST>> const & args, std::vector<Type *> const & parameters, int32_t firstSlot, std::function<void(int32_t)> const & receiver) {
+        int32_t argBase = nextRegister_;
+        nextRegister_ += firstSlot + static_cast<int32_t>(args.size());
+        function_->registers = std::max<uint32_t>(function_->registers, nextRegister_);
+        int32_t top = nextRegister_;
+        if (receiver) {
+            receiver(argBase);
+            nextRegister_ = top;
+        }
+        for (size_t i = 0; i < args.size(); ++i) {
+            int32_t slot = argBase + firstSlot + static_cast<int32_t>(i);
+            int32_t value = compileExpr(args[i].get(), slot);
+            if (i < parameters.size() && isChar(parameters[i])) {
+                // * chars are truncated when passed, like the C++ conversion to the parameter
+                emit(Opcode::TruncChar, slot, value);
+            } else if (value != slot) {
+                emit(Opcode::Move, slot, value);
+            }
+            nextRegister_ = top;
+        }
+        return argBase;
+    }
+
+    int32_t BytecodeCompiler::finishCall(Opcode op, int32_t callee, int32_t argBase, Type * returnType, int32_t hint) {
+        nextRegister_ = argBase;
+        int32_t result = target(hint);
+        emit(op, result, callee, argBase);
+        if (returnType == nullptr || !isAggregate(returnType)) return result;
+        // * the returned address points into the frame of the callee, the next call reuses it
+        int32_t copy = allocateTemporary(returnType, site_);
+        emit(Opcode::Copy, copy, result, static_cast<int32_t>(sizeOf(returnType, site_)));
+        return copy;
+    }
+
+    int32_t BytecodeCompiler::compileString(ASTString * ast, int32_t hint) {
+        auto it = strings_.find(ast->value);
+        if (it == strings_.end()) {
+            auto address = allocateData(static_cast<uint32_t>(ast->value.size() + 1), 1);
+            std::memcpy(program_.data.data() + address, ast->value.data(), ast->value.size());
+            it = strings_.insert({ast->value, address}).first;
+        }
+        return loadInteger(static_cast<int64_t>(it->second), hint);
+    }
+
+    // ---------------------------------------------------------------- places
+
+    BytecodeCompiler::Place BytecodeCompiler::compilePlace(AST * ast) {
+        if (auto * identifier = ast->as<ASTIdentifier>()) {
+            if (auto * local = findLocal(identifier->name)) return *local;
+            if (auto global = globals_.find(identifier->name); global != globals_.end()) return global->second;
+            fail(STR(identifier->name.name() << " is not a variable"), ast);
+        }
+        if (auto * deref = ast->as<ASTDeref>()) {
+            int32_t address = compileExpr(deref->target.get());
+            return Place{Storage::Memory, address, 0, typeOf(ast)};
+        }
+        if (auto * index = ast->as<ASTIndex>()) return compileIndex(index);
+        if (auto * member = ast->as<ASTMember>(); member != nullptr && member->member->as<ASTIdentifier>() != nullptr) {
+            return compileField(member, member->member->as<ASTIdentifier>()->name);
+        }
+        // * aggregates without a place, such as results of calls, live in temporaries
+        auto * type = typeOf(ast);
+        if (type != nullptr && isAggregate(type)) return Place{Storage::Memory, compileExpr(ast), 0, type};
+        fail("expression has no address", ast);
+    }
+
+    BytecodeCompiler::Place BytecodeCompiler::compileIndex(ASTIndex * ast) {
+        auto * baseType = typeOf(ast->base.get());
+        auto * elementType = typeOf(ast);
+        int64_t size = elementSize(baseType, ast);
+        auto literal = IntegerLiteral(ast->index.get());
+        bool isArrayVariable = ast->base->as<ASTIdentifier>() != nullptr || ast->base->as<ASTMember>() != nullptr;
+        int32_t address;
+        if (literal.has_value() && isArrayVariable) {
+            // * constant indices into arrays become offsets of their place
+            auto place = compilePlace(ast->base.get());
+            if (place.count > 0 && literal.value() >= 0 && literal.value() < place.count && place.storage != Storage::Register) {
+                return Place{place.storage, place.reg, place.offset + literal.value() * size, elementType};
+            }
+            address = load(place, -1);
+        } else {
+            address = compileExpr(ast->base.get());
+        }
+        if (literal.has_value() && FitsInt32(literal.value() * size)) {
+            return Place{Storage::Memory, address, literal.value() * size, elementType};
+        }
+        int32_t index = compileExpr(ast->index.get());
+        int32_t element = allocateRegister();
+        if (size != 1) {
+            emit(Opcode::MulLImm, element, index, static_cast<int32_t>(size));
+            emit(Opcode::AddL, element, address, element);
+        } else {
+            emit(Opcode::AddL, element, address, index);
+        }
+        return Place{Storage::Memory, element, 0, elementType};
+    }
+
+    BytecodeCompiler::Place BytecodeCompiler::compileField(ASTMember * ast, Symbol name) {
+        auto * baseType = typeOf(ast->base.get());
+        auto * complex = baseType->unwrap<Type::Complex>();
+        if (complex == nullptr) fail(STR("value of type " << baseType->toString() << " has no fields"), ast);
+        auto & record = recordOf(complex, ast);
+        auto field = record.fields.find(name);
+        if (field == record.fields.end()) fail(STR(baseType->toString() << " has no field " << name.name()), ast);
+        Place place;
+        if (ast->op == Symbol::ArrowR) {
+            place = Place{Storage::Memory, compileExpr(ast->base.get()), 0};
+        } else {
+            place = compilePlace(ast->base.get());
+        }
+        return Place{place.storage, place.reg, place.offset + field->second.offset, field->second.type, field->second.count};
+    }
+
+    int32_t BytecodeCompiler::load(Place const & place, int32_t hint) {
+        if (place.count > 0 || isAggregate(place.type)) return addressOf(place, hint);
+        if (place.storage == Storage::Register) return place.reg;
+        uint32_t size = sizeOf(place.type, site_);
+        int32_t result = target(hint);
+        int width = size == 1 ? 0 : size == 4 ? 1 : 2;
+        if (place.storage == Storage::Frame) {
+            static Opcode const ops[] = { Opcode::LoadFrame8, Opcode::LoadFrame32, Opcode::LoadFrame64 };
+            emit(ops[width], result, static_cast<int32_t>(place.offset));
+        } else if (place.storage == Storage::Global) {
+            static Opcode const ops[] = { Opcode::LoadGlobal8, Opcode::LoadGlobal32, Opcode::LoadGlobal64 };
+            emit(ops[width], result, static_cast<int32_t>(place.offset));
+        } else {
+            static Opcode const ops[] = { Opcode::Load8, Opcode::Load32, Opcode::Load64 };
+            emit(ops[width], result, place.reg, checkedOffset(place.offset));
+        }
+        return result;
+    }
+
+    void BytecodeCompiler::store(Place const & place, int32_t value) {
+        if (place.storage == Storage::Register) {
+            if (isChar(place.type)) emit(Opcode::TruncChar, place.reg, value);
+            else if (value != place.reg) emit(Opcode::Move, place.reg, value);
+            return;
+        }
+        uint32_t size = sizeOf(place.type, site_);
+        int width = size == 1 ? 0 : size == 4 ? 1 : 2;
+        if (place.storage == Storage::Frame) {
+            static Opcode const ops[] = { Opcode::StoreFrame8, Opcode::StoreFrame32, Opcode::StoreFrame64 };
+            emit(ops[width], value, static_cast<int32_t>(place.offset));
+        } else if (place.storage == Storage::Global) {
+            static Opcode const ops[] = { Opcode::StoreGlobal8, Opcode::StoreGlobal32, Opcode::StoreGlobal64 };
+            emit(ops[width], value, static_cast<int32_t>(place.offset));
+        } else {
+            static Opcode const ops[] = { Opcode::Store8, Opcode::Store32, Opcode::Store64 };
+            emit(ops[width], value, place.reg, checkedOffset(place.offset));
+        }
+    }
+
+    int32_t BytecodeCompiler::addressOf(Place const & place, int32_t hint) {
+        switch (place.storage) {
+            case Storage::Register:
+                fail("variable in a register has no address", site_);
+            case Storage::Frame: {
+                int32_t result = target(hint);
+                emit(Opcode::FrameAddr, result, static_cast<int32_t>(place.offset));
+                return result;
+            }
+            case Storage::Global:
+                return loadInteger(place.offset, hint);
+            default:
+                if (place.offset == 0 && (hint < 0 || hint == place.reg)) return place.reg;
+                int32_t result = target(hint);
+                emit(Opcode::AddLImm, result, place.reg, checkedOffset(place.offset));
+                return result;
+        }
+    }
+
+    BytecodeCompiler::Place * BytecodeCompiler::findLocal(Symbol name) {
+        for (auto it = scopes_.rbegin(); it != scopes_.rend(); ++it) {
+            if (auto place = it->find(name); place != it->end()) return &place->second;
+        }
+        return nullptr;
+    }
+
+    BytecodeCompiler::Place BytecodeCompiler::allocateLocal(Type * type, uint32_t count, bool isInMemory, AST * ast) {
+        if (!isInMemory) return Place{Storage::Register, allocateRegister(), 0, type};
+        auto * element = count > 0 ? type->as<Type::Pointer>()->base() : type;
+        uint64_t size = static_cast<uint64_t>(sizeOf(element, ast)) * std::max<uint32_t>(count, 1);
+        uint64_t offset = AlignUp(frameTop_, alignOf(element, ast));
+        if (offset + size > MaxDataBytes) fail("locals of the function do not fit its frame", ast);
+        frameTop_ = static_cast<uint32_t>(offset + size);
+        function_->frameBytes = std::max(function_->frameBytes, frameTop_);
+        return Place{Storage::Frame, 0, static_cast<int64_t>(offset), type, count};
+    }
+
+    int32_t BytecodeCompiler::allocateTemporary(Type * type, AST * ast) {
+        auto place = allocateLocal(type, 0, true, ast);
+        return addressOf(place);
+    }
+
+    // ---------------------------------------------------------------- emission
+
+    size_t BytecodeCompiler::emit(Opcode op, int32_t a, int32_t b, int32_t c) {
+        function_->code.push_back(Instruction{op, a, b, c});
+        function_->sites.push_back(site_);
+        return function_->code.size() - 1;
+    }
+
+    void BytecodeCompiler::patch(size_t jump, size_t target) {
+        auto & instruction = function_->code[jump];
+        auto value = static_cast<int32_t>(target);
+        switch (instruction.op) {
+            case Opcode::Jump:
+                instruction.a = value;
+                break;
+            case Opcode::JumpIfZero:
+            case Opcode::JumpIfNotZero:
+                instruction.b = value;
+                break;
+            default:
+                instruction.c = value;
+                break;
+        }
+    }
+
+    void BytecodeCompiler::patchAll(std::vector<size_t> const & jumps, size_t target) {
+        for (auto jump : jumps) patch(jump, target);
+    }
+
+    size_t BytecodeCompiler::here() const {
+        return function_->code.size();
+    }
+
+    int32_t BytecodeCompiler::allocateRegister() {
+        int32_t result = nextRegister_++;
+        function_->registers = std::max<uint32_t>(function_->registers, nextRegister_);
+        return result;
+    }
+
+    int32_t BytecodeCompiler::target(int32_t hint) {
+        return hint >= 0 ? hint : allocateRegister();
+    }
+
+    int32_t BytecodeCompiler::loadInteger(int64_t value, int32_t hint) {
+        int32_t result = target(hint);
+        if (FitsInt32(value)) {
+            emit(Opcode::LoadInt, result, static_cast<int32_t>(value));
+        } else {
+            Value constant;
+            constant.i = value;
+            emit(Opcode::LoadConst, result, static_cast<int32_t>(addConstant(constant)));
+        }
+        return result;
+    }
+
+    int32_t BytecodeCompiler::checkedOffset(int64_t offset) const {
+        if (!FitsInt32(offset)) fail("offset does not fit an instruction", site_);
+        return static_cast<int32_t>(offset);
+    }
+
+    void BytecodeCompiler::fail(std::string const & message, AST * ast) const {
+        if (ast == nullptr) throw std::runtime_error(STR("RUN: " << message));
+        throw ParserError{STR("RUN: " << message), ast->location()};
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,221 @@
+#pragma once
+
+// standard
+#include <optional>
+#include <functional>
+#include <string>
+#include <map>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cstdint>
+
+// internal
+#include "ast.h"
+#include "contexts.h"
+#include "evaluator.h"
+#include "bytecode.h"
+
+namespace tinycplus {
+
+    /** Lowers the typechecked TinyC+ program to the bytecode of the VirtualMachine (--run).
+        Unlike the transpiler it does not go through TinyC: classes keep a header with their dense class index instead of a vtable pointer, virtual calls index one flat slot table, interface views carry the index of their impl and classcasts compare the ancestor tables of the classes.
+        Scalar locals live in registers unless their address is taken, aggregates and arrays in the memory of the frame. Aggregates are passed and returned by address and copied by the receiver.
+        Throws ParserError "RUN: ..." on programs the machine cannot run, such as arrays without a constant size.
+     */
+    class BytecodeCompiler {
+    public:
+        /** Largest class index and impl index, the impl index is kept in the top 16 bits of an interface view.
+         */
+        static constexpr uint32_t MaxImpls = 0xffff;
+
+        BytecodeCompiler(TypesContext & types)
+            :types_{types}
+            ,evaluator_{types}
+        { }
+
+        /** Number of instances in the pool of every pooled class (--pool-capacity).
+         */
+        void setPoolCapacity(int capacity) {
+            poolCapacity_ = capacity;
+        }
+
+        /** Budget of the constexpr calls giving array sizes (--constexpr-steps).
+         */
+        void setConstexprSteps(int steps) {
+            evaluator_.setStepBudget(steps);
+        }
+
+        BytecodeProgram compile(AST * program);
+
+    private:
+        enum class Storage {
+            Register, // reg
+            Frame,    // frame offset
+            Global,   // absolute address offset
+            Memory,   // address in reg + offset
+        };
+
+        /** Where a value lives. Arrays have the pointer type of their elements and count > 0, their value is their address.
+         */
+        struct Place {
+            Storage storage = Storage::Register;
+            int32_t reg = 0;
+            int64_t offset = 0;
+            Type * type = nullptr;
+            uint32_t count = 0;
+        };
+
+        struct Field {
+            uint32_t offset = 0;
+            Type * type = nullptr;
+            uint32_t count = 0; // of array fields
+        };
+
+        struct Record {
+            uint32_t size = 0;
+            uint32_t align = 1;
+            std::unordered_map<Symbol, Field> fields;
+        };
+
+        struct Loop {
+            std::vector<size_t> breaks;
+            std::vector<size_t> continues;
+            bool isSwitch = false; // takes breaks only
+        };
+
+        using Scope = std::unordered_map<Symbol, Place>;
+
+        // * program tables
+        void declareClasses(ASTProgram * program);
+        void declareFunctions(ASTProgram * program);
+        void declareGlobals(ASTProgram * program);
+        void buildDispatchTables();
+        void buildPools();
+        uint32_t classIndex(Type::Class * type) const;
+        uint32_t interfaceIndex(Type::Interface * type) const;
+        uint32_t vtableSlot(Type::Class * type, Symbol method) const;
+        uint32_t interfaceSlot(Type::Interface * type, Symbol method, AST * ast);
+        std::vector<Symbol> const & interfaceMethods(Type::Interface * type);
+        uint32_t headerList(Type * type, uint32_t count);
+        void collectHeaders(Type * type, uint32_t offset, std::vector<HeaderSlot> & result);
+        uint32_t addFunction(std::string name);
+        uint32_t addConstant(Value value);
+        uint64_t allocateData(uint32_t size, uint32_t align);
+
+        // * types
+        Type * resolve(Type * type) const;
+        Type * typeOf(AST * ast) const;
+        bool isDouble(Type * type) const;
+        bool isChar(Type * type) const;
+        bool isAggregate(Type * type) const;
+        static bool IsView(Type * type);
+        uint32_t sizeOf(Type * type, AST * ast);
+        uint32_t alignOf(Type * type, AST * ast);
+        uint32_t elementSize(Type * pointer, AST * ast);
+        Record const & recordOf(Type::Complex * type, AST * ast);
+        uint32_t arraySize(ASTArrayType * type);
+        uint32_t fieldCount(FieldInfo const & field);
+
+        // * functions
+        void compileFunction(uint32_t index, ASTFunDecl * ast, Type::Class * classType, GenericInstance const * instance);
+        void compileInitializer(ASTProgram * program);
+        void beginFunction(uint32_t index);
+        void endFunction();
+        void bindArgument(int32_t reg, Symbol name, Type * type, AST * ast);
+        void collectAddressed(AST * ast);
+
+        // * statements
+        void compileStatement(AST * ast);
+        void compileEffect(AST * ast);
+        void compileBlock(ASTSequence * ast);
+        void compileVarDecl(ASTVarDecl * ast, bool isGlobal);
+        void compileIf(ASTIf * ast);
+        void compileSwitch(ASTSwitch * ast);
+        void compileWhile(ASTWhile * ast);
+        void compileDoWhile(ASTDoWhile * ast);
+        void compileFor(ASTFor * ast);
+        void compileReturn(ASTReturn * ast);
+        void compileDelete(ASTDelete * ast);
+        void compileBranch(AST * cond, bool jumpIf, std::vector<size_t> & jumps);
+        void initializePlace(Place const & place, AST * ast);
+        void assign(Place const & place, AST * value);
+
+        // * expressions, each returns the register of its value
+        int32_t compileExpr(AST * ast, int32_t hint = -1);
+        int32_t compileIdentifier(ASTIdentifier * ast, int32_t hint);
+        int32_t compileBinaryOp(ASTBinaryOp * ast, int32_t hint);
+        int32_t compileLogical(AST * ast, int32_t hint);
+        int32_t compileAssignment(ASTAssignment * ast, int32_t hint);
+        int32_t compileUnaryOp(ASTUnaryOp * ast, int32_t hint);
+        int32_t compileIncrement(AST * arg, bool isIncrement, bool isPostfix, int32_t hint);
+        int32_t compileCast(ASTCast * ast, int32_t hint);
+        int32_t compileClassCast(ASTClassCast * ast, int32_t hint);
+        int32_t compileCall(ASTCall * ast, int32_t hint);
+        int32_t compileMethodCall(ASTMember * member, ASTCall * call, int32_t hint);
+        int32_t compileConstruction(ASTCall * call, int32_t hint);
+        void constructAt(ASTCall * call, int32_t address);
+        int32_t compileNew(ASTNew * ast, int32_t hint);
+        /** Evaluates the arguments into consecutive registers from the returned one, firstSlot registers before them are left to the receiver.
+         */
+        int32_t compileArguments(std::vector<std::unique_ptr<AST>> const & args, std::vector<Type *> const & parameters, int32_t firstSlot, std::function<void(int32_t)> const & receiver = {});
+        int32_t finishCall(Opcode op, int32_t callee, int32_t argBase, Type * returnType, int32_t hint);
+        int32_t compileString(ASTString * ast, int32_t hint);
+        int32_t convert(int32_t value, Type * from, Type * to, int32_t hint);
+        int32_t decay(int32_t value, Type * type);
+
+        // * places
+        Place compilePlace(AST * ast);
+        Place compileIndex(ASTIndex * ast);
+        Place compileField(ASTMember * ast, Symbol name);
+        int32_t load(Place const & place, int32_t hint);
+        void store(Place const & place, int32_t value);
+        int32_t addressOf(Place const & place, int32_t hint = -1);
+        Place * findLocal(Symbol name);
+        Place allocateLocal(Type * type, uint32_t count, bool isInMemory, AST * ast);
+        int32_t allocateTemporary(Type * type, AST * ast);
+
+        // * emission
+        size_t emit(Opcode op, int32_t a = 0, int32_t b = 0, int32_t c = 0);
+        void patch(size_t jump, size_t target);
+        void patchAll(std::vector<size_t> const & jumps, size_t target);
+        size_t here() const;
+        int32_t allocateRegister();
+        int32_t target(int32_t hint);
+        int32_t loadInteger(int64_t value, int32_t hint);
+        int32_t checkedOffset(int64_t offset) const;
+        [[noreturn]] void fail(std::string const & message, AST * ast) const;
+
+        TypesContext & types_;
+        ConstantEvaluator evaluator_;
+        int poolCapacity_ = 1024;
+        BytecodeProgram program_;
+        // * declarations
+        std::unordered_map<Type::Class *, uint32_t> classIndices_;
+        std::unordered_map<Type::Interface *, uint32_t> interfaceIndices_;
+        std::unordered_map<Type::Class *, ASTClassDecl *> classDecls_;
+        std::unordered_map<Type::Interface *, std::vector<Symbol>> interfaceMethods_; // in the order of their impl slots
+        std::unordered_map<Type::Class *, std::vector<Symbol>> vtableLayouts_; // slot names, root first
+        std::unordered_map<Symbol, uint32_t> functions_; // non-generic functions by name
+        std::unordered_map<ASTFunDecl *, uint32_t> methods_; // methods and constructors
+        std::unordered_map<GenericInstance const *, uint32_t> genericInstances_;
+        std::unordered_map<Symbol, Place> globals_;
+        std::unordered_map<Type *, Record> records_;
+        std::map<std::pair<Type *, uint32_t>, uint32_t> headerLists_; // by type and array size
+        std::unordered_map<Type::Class *, std::unordered_map<Type::Function *, uint32_t>> constructors_;
+        std::unordered_map<std::string, uint64_t> strings_;
+        std::unordered_map<int64_t, uint32_t> constants_; // by bits
+        // * function being compiled
+        BytecodeFunction * function_ = nullptr;
+        GenericInstance const * instance_ = nullptr; // its type arguments replace the type parameters
+        Type * returnType_ = nullptr;
+        bool isEntry_ = false;
+        std::vector<Scope> scopes_;
+        std::unordered_set<Symbol> addressed_; // locals used by &
+        std::vector<Loop> loops_;
+        int32_t nextRegister_ = 0;
+        uint32_t frameTop_ = 0;
+        AST * site_ = nullptr;
+    }; // tinycplus::BytecodeCompiler
+
+} // namespace tinycplus
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <algorithm>
 #include <memory>
 #include <unordered_map>
+#include <unordered_set>
 #include <functional>
+#include <mutex>
+#include <thread>
 
 // internal
 #include "shared.h"
@@ -10,15 +14,36 @@
 
 namespace tinycplus {
 
+    /** Generic function with concrete type arguments, the transpiler prints it as a function of its own.
+     */
+    struct GenericInstance {
+        ASTFunDecl * function;
+        std::vector<Type*> typeArguments; // in the order of the type parameters
+        Symbol name;
+        AST * declaration; // top level declaration which uses the instance first, nullptr when only other instances use it
+        size_t depth; // of instances using one another, the instances used by non-generic code are at depth 0
+    };
+
     /** An information about TinyC+ program types.
      */
     class TypesContext {
     private: // data
         std::unordered_map<std::string, std::unique_ptr<Type>> types_;
+        std::unordered_map<Symbol, Type::Parameter*> typeParameters_; // in scope of the generic function being checked
+        std::vector<std::unique_ptr<GenericInstance>> genericInstances_;
+        std::unordered_map<std::string, GenericInstance*> genericInstanceIndex_;
+        std::unordered_map<ASTFunDecl*, int> genericInstancesCounts_;
         Type * int_;
         Type * double_;
         Type * char_;
         Type * void_;
+        // ids are counted per program (not per process), so output of a file does not depend on what was compiled before it
+        int classesCount_ = 0;
+        int interfacesCount_ = 0;
+        // shared between the typechecking and the emitting thread of the pipelined compilation, see setShared
+        bool isShared_ = false;
+        mutable std::recursive_mutex mutex_;
+        std::thread::id typeParametersOwner_;
     public: // special tinyC+ types
         Type::Alias * castToClassFuncPtrType;
         Type::Alias * getImplFuncPtrType;
@@ -46,6 +71,22 @@ namespace tinycplus {
             defaultClassType = getOrCreateClassType(symbols::KwObject);
         }
 
+        /** Guards the tables of the types by a mutex, so that the emitting thread can look types up while the typechecking thread adds them (--pipeline).
+            Type parameters stay visible only to the thread which checks their generic function.
+         */
+        void setShared(bool isShared) {
+            isShared_ = isShared;
+        }
+
+    private: // locking
+        std::unique_lock<std::recursive_mutex> guard() const {
+            return isShared_ ? std::unique_lock<std::recursive_mutex>{mutex_} : std::unique_lock<std::recursive_mutex>{};
+        }
+
+        bool isTypeParametersOwner() const {
+            return !isShared_ || typeParametersOwner_ == std::this_thread::get_id();
+        }
+
     public: // getters
         Type * getTypeInt() const {
             return int_;
@@ -72,6 +113,10 @@ namespace tinycplus {
         }
 
         Type * getType(Symbol symbol) const {
+            auto lock = guard();
+            if (auto parameter = typeParameters_.find(symbol); parameter != typeParameters_.end() && isTypeParametersOwner()) {
+                return parameter->second;
+            }
             auto i = types_.find(symbol.name());
             if (i == types_.end())
                 return nullptr;
@@ -109,6 +154,7 @@ namespace tinycplus {
     private: // getters
         template<typename T>
         T * getOrCreateNonAliasType(Symbol name, std::function<T*()> maker) {
+            auto lock = guard();
             // struct types can't have aliases
             auto i = types_.find(name.name());
             if (i == types_.end()) {
@@ -130,9 +176,9 @@ namespace tinycplus {
         }
 
         Type::Interface * getOrCreateInterfaceType(Symbol name) {
-            auto maker = [name] () {
+            auto maker = [name, this] () {
                 auto * vtable = new Type::VTable{name};
-                return new Type::Interface{name, vtable};
+                return new Type::Interface{name, vtable, this->interfacesCount_++};
             };
             return getOrCreateNonAliasType<Type::Interface>(name, maker);
         }
@@ -140,7 +186,7 @@ namespace tinycplus {
         Type::Class * getOrCreateClassType(Symbol name) {
             auto maker = [name, this] () {
                 auto * vtable = new Type::VTable{name};
-                auto * classType = new Type::Class{name, vtable};
+                auto * classType = new Type::Class{name, vtable, this->classesCount_++};
                 auto defaultConstructorType = this->getOrCreateFunctionType(
                     std::unique_ptr<Type::Function>{new Type::Function{classType}}
                 );
@@ -151,6 +197,7 @@ namespace tinycplus {
         }
 
         Type::Function * getOrCreateFunctionType(std::unique_ptr<Type::Function> type) {
+            auto lock = guard();
             std::string typeName = type->toString();
             auto i = types_.find(typeName);
             if (i == types_.end())
@@ -162,6 +209,7 @@ namespace tinycplus {
 
         Type::Alias * createTypeAlias(Symbol name, Type * base) {
             // std::cout << "DEBUG: alias with name: " << name << std::endl;
+            auto lock = guard();
             assert(types_.find(name.name()) == types_.end());
             Type::Alias * result = new Type::Alias(name, base);
             types_.insert(std::make_pair(name.name(), std::unique_ptr<Type>{ result }));
@@ -171,6 +219,7 @@ namespace tinycplus {
         /** Returns a pointer type to the given base.
          */
         Type * getOrCreatePointerType(Type * base) {
+            auto lock = guard();
             std::string typeName = base->toString() + "*";
             auto i = types_.find(typeName);
             if (i == types_.end())
@@ -179,6 +228,7 @@ namespace tinycplus {
         }
 
         void findEachClassType(std::vector<Type::Class*> & result) {
+            auto lock = guard();
             for (auto & type : types_) {
                 if (auto * vtable = type.second->as<Type::Class>()) {
                     result.push_back(vtable);
@@ -186,6 +236,102 @@ namespace tinycplus {
             }
         }
 
+        /** Pooled classes derived from the base, the base included, in the order of their ids.
+         */
+        std::vector<Type::Class*> findPooledClasses(Type::Class * baseType) {
+            auto lock = guard();
+            std::vector<Type::Class*> result;
+            for (auto & type : types_) {
+                auto * classType = type.second->as<Type::Class>();
+                if (classType != nullptr && classType->isPooled() && classType->inherits(baseType)) {
+                    result.push_back(classType);
+                }
+            }
+            std::sort(result.begin(), result.end(), [](Type::Class * a, Type::Class * b) { return a->getId() < b->getId(); });
+            return result;
+        }
+
+        /** Creates the type parameter of the generic function, its name refers to it until clearTypeParameters.
+         */
+        Type::Parameter * addTypeParameter(ASTFunDecl * function, Symbol name, Type::Interface * bound) {
+            auto lock = guard();
+            typeParametersOwner_ = std::this_thread::get_id();
+            auto qualifiedName = STR(function->name->name() << "." << name.name());
+            assert(types_.find(qualifiedName) == types_.end());
+            auto * result = new Type::Parameter{Symbol{qualifiedName}, typeParameters_.size(), bound};
+            types_.insert(std::make_pair(qualifiedName, std::unique_ptr<Type>{result}));
+            typeParameters_.insert(std::make_pair(name, result));
+            return result;
+        }
+
+        void clearTypeParameters() {
+            auto lock = guard();
+            typeParameters_.clear();
+        }
+
+        /** Replaces the type parameters in the type by the type arguments, the type itself when it has none.
+         */
+        Type * substitute(Type * type, std::vector<Type*> const & typeArguments) {
+            if (auto * parameter = type->as<Type::Parameter>()) {
+                return typeArguments[parameter->index()];
+            }
+            if (auto * pointer = type->as<Type::Pointer>()) {
+                auto * base = substitute(pointer->base(), typeArguments);
+                return base == pointer->base() ? type : getOrCreatePointerType(base);
+            }
+            return type;
+        }
+
+        /** Whether the type has no type parameters.
+         */
+        static bool IsConcrete(Type * type) {
+            while (auto * pointer = type->as<Type::Pointer>()) {
+                type = pointer->base();
+            }
+            return type->as<Type::Parameter>() == nullptr;
+        }
+
+        static std::string MakeGenericInstanceKey(ASTFunDecl * function, std::vector<Type*> const & typeArguments) {
+            std::stringstream key;
+            key << function->name->name();
+            for (auto * it : typeArguments) {
+                key << "|" << it->toString();
+            }
+            return key.str();
+        }
+
+        GenericInstance * findGenericInstance(ASTFunDecl * function, std::vector<Type*> const & typeArguments) const {
+            auto lock = guard();
+            auto it = genericInstanceIndex_.find(MakeGenericInstanceKey(function, typeArguments));
+            return it == genericInstanceIndex_.end() ? nullptr : it->second;
+        }
+
+        /** Returns the instance of the function for the concrete type arguments, creates it on the first use.
+         */
+        GenericInstance * getOrCreateGenericInstance(ASTFunDecl * function, std::vector<Type*> const & typeArguments, AST * declaration, size_t depth) {
+            auto lock = guard();
+            if (auto * existing = findGenericInstance(function, typeArguments)) {
+                return existing;
+            }
+            auto name = symbols::start()
+                .add(symbols::GenericInstancePrefix)
+                .add(STR(genericInstancesCounts_[function]++))
+                .add("_")
+                .add(function->name.value())
+                .end();
+            genericInstances_.push_back(std::unique_ptr<GenericInstance>{new GenericInstance{function, typeArguments, name, declaration, depth}});
+            auto * result = genericInstances_.back().get();
+            genericInstanceIndex_.insert(std::make_pair(MakeGenericInstanceKey(function, typeArguments), result));
+            return result;
+        }
+
+        /** Instances of the generic functions in the order of their creation.
+            Not guarded, the pipelined compilation reads them only once the whole program is checked.
+         */
+        std::vector<std::unique_ptr<GenericInstance>> const & genericInstances() const {
+            return genericInstances_;
+        }
+
         void addMethodToClass(ASTFunDecl * methodAst, Type::Class * classType) {
             auto methodName = methodAst->name.value();
             auto * functionType = methodAst->getType()->as<Type::Function>();
@@ -230,6 +376,8 @@ namespace tinycplus {
         public: // data
             Type * returnType;
             std::unordered_map<Symbol, Type *> entities = {};
+            std::unordered_set<Symbol> structOfArrays = {}; // array variables of soa classes
+            bool isFunction = false; // scope of the arguments of a function
             // hierarchy information
             Space * parent;
             std::vector<std::unique_ptr<Space>> children = {};
@@ -268,11 +416,18 @@ namespace tinycplus {
         };
         Space global_;
         Space * current_;
+        bool isReleasingScopes_ = false;
     public:
         NamesContext(Type * globalReturnType): global_{nullptr, globalReturnType} {
             current_ = &global_;
         }
 
+        /** Frees every scope when it is left instead of keeping it for print (--stream).
+         */
+        void setReleasingScopes(bool isReleasing) {
+            isReleasingScopes_ = isReleasing;
+        }
+
     private:
         void enterNewScope(Type * returnType) {
             auto * child = new Space{current_, returnType};
@@ -283,10 +438,18 @@ namespace tinycplus {
     public:
         void enterBlockScope() { enterNewScope(current_->returnType); }
 
-        void enterFunctionScope(Type * returnType) { enterNewScope(returnType); }
+        void enterFunctionScope(Type * returnType) {
+            enterNewScope(returnType);
+            current_->isFunction = true;
+        }
 
         void leaveCurrentScope() {
-            current_ = current_->parent;
+            auto * parent = current_->parent;
+            if (isReleasingScopes_) {
+                assert(parent->children.back().get() == current_);
+                parent->children.pop_back();
+            }
+            current_ = parent;
         }
 
         bool addVariable(Symbol name, Type * type) {
@@ -305,6 +468,23 @@ namespace tinycplus {
             return true;
         }
 
+        /** Marks the variable of the current scope as an array lowered to one array per field, see the soa class attribute.
+         */
+        void setStructOfArrays(Symbol name) {
+            current_->structOfArrays.insert(name);
+        }
+
+        /** Whether the visible variable of the name is a soa array.
+         */
+        bool isStructOfArrays(Symbol name) {
+            for (auto * it = current_; it != nullptr; it = it->parent) {
+                if (it->entities.find(name) != it->entities.end()) {
+                    return it->structOfArrays.find(name) != it->structOfArrays.end();
+                }
+            }
+            return false;
+        }
+
         /** Returns the type of variable.
          */
         Type * getVariable(Symbol name) {
@@ -317,6 +497,19 @@ namespace tinycplus {
             return nullptr;
         }
 
+        /** Whether the visible variable of the name is declared outside of functions, functions included.
+         */
+        bool isGlobalVariable(Symbol name) {
+            for (auto * it = current_; it != nullptr; it = it->parent) {
+                if (it->entities.find(name) == it->entities.end()) continue;
+                for (auto * scope = it; scope != nullptr; scope = scope->parent) {
+                    if (scope->isFunction) return false;
+                }
+                return true;
+            }
+            return false;
+        }
+
         Type * currentScopeReturnType() {
             return current_->returnType;
         }
@@ -0,0 +1,637 @@
+// standard
+#include <algorithm>
+
+// internal
+#include "cpp_emitter.h"
+
+namespace tinycplus {
+
+    void CppEmitter::visit(AST * ast) {
+        visitChild(ast);
+    }
+
+    void CppEmitter::visit(ASTInteger * ast) {
+        if (isPrintColorful_) printer_ << printer_.numberLiteral;
+        printer_ << ast->value;
+    }
+
+    void CppEmitter::visit(ASTDouble * ast) {
+        if (isPrintColorful_) printer_ << printer_.numberLiteral;
+        printer_ << ConstantEvaluator::FormatLiteral(ast->value);
+    }
+
+    void CppEmitter::visit(ASTChar * ast) {
+        if (isPrintColorful_) printer_ << printer_.charLiteral;
+        printer_ << STR('\'' << ast->value << '\'');
+    }
+
+    void CppEmitter::visit(ASTString * ast) {
+        if (isPrintColorful_) printer_ << printer_.stringLiteral;
+        printer_ << '\"' << ast->value << '\"';
+    }
+
+    void CppEmitter::visit(ASTIdentifier * ast) {
+        if (ast->name == symbols::KwBase) {
+            printKeyword(symbols::CppStaticCast);
+            printSymbol(Symbol::Lt);
+            printType(ast->getType()->unwrap<Type::Class>()->name);
+            printSymbol(Symbol::Mul);
+            printSymbol(Symbol::Gt);
+            printSymbol(Symbol::ParOpen);
+            printIdentifier(symbols::KwThis);
+            printSymbol(Symbol::ParClose);
+        } else if (ast->name == symbols::KwNull) {
+            // casts need the typed null, nullptr itself cannot be the subject of a dynamic_cast
+            if (peekAst()->as<ASTCast>()) {
+                printKeyword(symbols::CppStaticCast);
+                printSymbol(Symbol::Lt);
+                printType(symbols::KwObject);
+                printSymbol(Symbol::Mul);
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                printKeyword(symbols::CppNullptr);
+                printSymbol(Symbol::ParClose);
+            } else {
+                printKeyword(symbols::CppNullptr);
+            }
+        } else {
+            printIdentifier(ast->name);
+        }
+    }
+
+    void CppEmitter::visit(ASTType * ast) {
+        // unreachable
+    }
+
+    void CppEmitter::visit(ASTPointerType * ast) {
+        pushAst(ast);
+        visitChild(ast->base.get());
+        printSymbol(Symbol::Mul);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTArrayType * ast) {
+        pushAst(ast);
+        visitChild(ast->base.get());
+        printSymbol(Symbol::SquareOpen);
+        visitChild(ast->size.get());
+        printSymbol(Symbol::SquareClose);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTNamedType * ast) {
+        printType(ast->name);
+    }
+
+    void CppEmitter::visit(ASTSequence * ast) {
+        pushAst(ast);
+        for (size_t i = 0; i < ast->body.size(); i++) {
+            if (i > 0) {
+                printSymbol(Symbol::Comma);
+                printSpace();
+            }
+            visitChild(ast->body[i].get());
+        }
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTBlock * ast) {
+        pushAst(ast);
+        printSymbol(Symbol::CurlyOpen);
+        printer_.indent();
+        for (auto & i : ast->body) {
+            printNewline();
+            visitChild(i.get());
+            if (!i->as<ASTBlock>()
+                && !i->as<ASTIf>()
+                && !i->as<ASTSwitch>()
+                && !i->as<ASTWhile>()
+                && !i->as<ASTFor>()
+            ) {
+                printSymbol(Symbol::Semicolon);
+            }
+        }
+        printer_.dedent();
+        printNewline();
+        printSymbol(Symbol::CurlyClose);
+        printNewline();
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTProgram * ast) {
+        pushAst(ast);
+        collectHierarchyFacts(ast);
+        printComment(" --- Generated by tinycplus --emit=cpp --- ");
+        printer_ << "#include <typeinfo>";
+        printNewline();
+        printNewline();
+
+        // * root of every class hierarchy, makes every class polymorphic
+        printKeyword(Symbol::KwStruct);
+        printSpace();
+        printType(symbols::KwObject);
+        printSpace();
+        printScopeOpen();
+        printKeyword(symbols::KwVirtual);
+        printSpace();
+        printSymbol(Symbol::Neg);
+        printType(symbols::KwObject);
+        printSymbol(Symbol::ParOpen);
+        printSymbol(Symbol::ParClose);
+        printSpace();
+        printSymbol(Symbol::Assign);
+        printSpace();
+        printKeyword(Symbol::KwDefault);
+        printSymbol(Symbol::Semicolon);
+        printScopeClose(true);
+        printNewline();
+
+        // * downcast to a final class
+        printer_ << "template<typename T, typename S>";
+        printNewline();
+        printer_ << "T * " << symbols::CppExactCast.name() << "(S * subject) ";
+        printScopeOpen();
+        printer_ << "return subject != nullptr && typeid(*subject) == typeid(T) ? static_cast<T *>(subject) : nullptr;";
+        printScopeClose(false);
+        printNewline();
+
+        // * slab of the pooled classes
+        std::vector<Type::Class*> classTypes;
+        types_.findEachClassType(classTypes);
+        if (std::any_of(classTypes.begin(), classTypes.end(), [](Type::Class * classType) { return classType->isPooled(); })) {
+            printPoolTemplate();
+            printNewline();
+        }
+
+        // * forward declaration of all classes and interfaces, as the TinyC output does
+        printComment(" --- Classes and interfaces --- ");
+        for (auto & i : ast->body) {
+            auto * classAst = i->as<ASTClassDecl>();
+            auto * interfaceAst = i->as<ASTInterfaceDecl>();
+            if (classAst == nullptr && interfaceAst == nullptr) continue;
+            if (classAst != nullptr && !classAst->isDefinition) continue;
+            printKeyword(Symbol::KwStruct);
+            printSpace();
+            printType(classAst != nullptr ? classAst->name : interfaceAst->name);
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+        }
+
+        printComment(" --- User program starts --- ");
+        for (auto & i : ast->body) {
+            visitChild(i.get());
+            printNewline();
+            printNewline();
+        }
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTVarDecl * ast) {
+        auto parentAst = peekAst();
+        pushAst(ast);
+        validateName(ast->name->name);
+        if (ast->name->isStructOfArrays) {
+            printStructOfArraysDeclaration(ast);
+        } else if (auto arrayType = ast->type->as<ASTArrayType>()) {
+            visitChild(arrayType->base.get());
+            printSpace();
+            visitChild(ast->name.get());
+            printSymbol(Symbol::SquareOpen);
+            visitChild(arrayType->size.get());
+            printSymbol(Symbol::SquareClose);
+        } else {
+            visitChild(ast->type.get());
+            printSpace();
+            visitChild(ast->name.get());
+        }
+        if (ast->value.get() != nullptr) {
+            printSpace();
+            printSymbol(Symbol::Assign);
+            printSpace();
+            visitChild(ast->value.get());
+        }
+        if (parentAst->as<ASTProgram>()
+            || parentAst->as<ASTStructDecl>()
+            || parentAst->as<ASTClassDecl>())
+        {
+            printSymbol(Symbol::Semicolon);
+        }
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTFunDecl * ast) {
+        // methods and constructors are printed by their class
+        pushAst(ast);
+        auto name = ast->name.value();
+        validateName(name);
+        if (ast->isGeneric()) {
+            // * C++ infers the same type arguments and instantiates the template per call the way the transpiler does
+            printKeyword(symbols::KwTemplate);
+            printSymbol(Symbol::Lt);
+            for (size_t i = 0; i < ast->typeParameters.size(); ++i) {
+                if (i > 0) {
+                    printSymbol(Symbol::Comma);
+                    printSpace();
+                }
+                printKeyword(symbols::CppTypename);
+                printSpace();
+                printType(ast->typeParameters[i].name);
+            }
+            printSymbol(Symbol::Gt);
+            printNewline();
+        }
+        visitChild(ast->typeDecl.get());
+        printSpace();
+        printIdentifier(name);
+        printParameters(ast);
+        printBodyOrSemicolon(ast);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTFunPtrDecl * ast) {
+        pushAst(ast);
+        validateName(ast->name->name);
+        printKeyword(Symbol::KwTypedef);
+        printSpace();
+        visitChild(ast->returnType.get());
+        printSpace();
+        printSymbol(Symbol::ParOpen);
+        printSymbol(Symbol::Mul);
+        visitChild(ast->name.get());
+        printSymbol(Symbol::ParClose);
+        printSymbol(Symbol::ParOpen);
+        for (size_t i = 0; i < ast->args.size(); i++) {
+            if (i > 0) {
+                printSymbol(Symbol::Comma);
+                printSpace();
+            }
+            visitChild(ast->args[i].get());
+        }
+        printSymbol(Symbol::ParClose);
+        printSymbol(Symbol::Semicolon);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTStructDecl * ast) {
+        pushAst(ast);
+        validateName(ast->name);
+        printKeyword(Symbol::KwStruct);
+        printSpace();
+        printType(ast->name);
+        if (ast->isDefinition) {
+            printSpace();
+            printSymbol(Symbol::CurlyOpen);
+            printer_.indent();
+            for (auto & i : ast->fields) {
+                printNewline();
+                visitChild(i.get());
+            }
+            printer_.dedent();
+            printNewline();
+            printSymbol(Symbol::CurlyClose);
+        }
+        printSymbol(Symbol::Semicolon);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTInterfaceDecl * ast) {
+        pushAst(ast);
+        validateName(ast->name);
+        printKeyword(Symbol::KwStruct);
+        printSpace();
+        printType(ast->name);
+        printSpace();
+        printScopeOpen();
+        {
+            // * interfaces are deleted through, and cast from, so they are polymorphic on their own
+            printKeyword(symbols::KwVirtual);
+            printSpace();
+            printSymbol(Symbol::Neg);
+            printType(ast->name);
+            printSymbol(Symbol::ParOpen);
+            printSymbol(Symbol::ParClose);
+            printSpace();
+            printSymbol(Symbol::Assign);
+            printSpace();
+            printKeyword(Symbol::KwDefault);
+            printSymbol(Symbol::Semicolon);
+            // * pure virtual methods
+            for (auto & method : ast->methods) {
+                pushAst(method.get());
+                printNewline();
+                printKeyword(symbols::KwVirtual);
+                printSpace();
+                visitChild(method->typeDecl.get());
+                printSpace();
+                printIdentifier(method->name.value());
+                printParameters(method.get());
+                printSpace();
+                printSymbol(Symbol::Assign);
+                printSpace();
+                printer_ << 0;
+                printSymbol(Symbol::Semicolon);
+                popAst();
+            }
+        }
+        printScopeClose(true);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTClassDecl * ast) {
+        if (!ast->isDefinition) return; // forward declarations for all class types comes at the program start
+        pushAst(ast);
+        validateName(ast->name);
+        auto * classType = ast->getType()->as<Type::Class>();
+        printClassHead(ast, classType);
+        printScopeOpen();
+        {
+            // * own fields only, the inherited ones come with the base class
+            std::vector<FieldInfo> ownFields;
+            classType->collectOwnFieldsOrdered(ownFields);
+            for (auto & i : ownFields) {
+                visitChild(i.ast);
+                printNewline();
+            }
+            if (classType->isPooled()) {
+                printPoolOperators(classType);
+            }
+            // * constructors, a user constructor hides the implicit default one which arrays and uninitialized locals of the class need
+            bool hasDefaultConstructor = ast->constructors.empty();
+            for (auto & i : ast->constructors) {
+                printNewline();
+                printConstructor(i.get(), ast);
+                if (i->args.empty()) hasDefaultConstructor = true;
+            }
+            if (!hasDefaultConstructor) {
+                printNewline();
+                printType(ast->name);
+                printSymbol(Symbol::ParOpen);
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printSymbol(Symbol::Assign);
+                printSpace();
+                printKeyword(Symbol::KwDefault);
+                printSymbol(Symbol::Semicolon);
+            }
+            // * methods
+            for (auto & i : ast->methods) {
+                printNewline();
+                printMethod(i.get(), classType);
+            }
+            printInterfaceForwarders(ast, classType);
+        }
+        printScopeClose(true);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTIf * ast) {
+        // else-if chains are printed in a loop, so that their length is not limited by the stack
+        size_t chainLength = 0;
+        for (ASTIf * current = ast; current != nullptr; ++chainLength) {
+            pushAst(current);
+            printKeyword(Symbol::KwIf);
+            printSpace();
+            printSymbol(Symbol::ParOpen);
+            visitChild(current->cond.get());
+            printSymbol(Symbol::ParClose);
+            visitChild(current->trueCase.get());
+            ASTIf * next = nullptr;
+            if (current->falseCase.get() != nullptr) {
+                printKeyword(Symbol::KwElse);
+                printSpace();
+                next = current->falseCase->as<ASTIf>();
+                if (next == nullptr) visitChild(current->falseCase.get());
+            }
+            current = next;
+        }
+        for (size_t i = 0; i < chainLength; ++i) {
+            popAst();
+        }
+    }
+
+    void CppEmitter::visit(ASTSwitch * ast) {
+        pushAst(ast);
+        printKeyword(Symbol::KwSwitch);
+        printSpace();
+        printSymbol(Symbol::ParOpen);
+        visitChild(ast->cond.get());
+        printSymbol(Symbol::ParClose);
+        printSpace();
+        printSymbol(Symbol::CurlyOpen);
+        printer_.indent();
+        for (auto & i : ast->cases) {
+            printNewline();
+            printKeyword(Symbol::KwCase);
+            printSpace();
+            if (isPrintColorful_) printer_ << printer_.numberLiteral;
+            printer_ << i.first;
+            printSymbol(Symbol::Colon);
+            visitChild(i.second.get());
+        }
+        if (ast->defaultCase.get() != nullptr) {
+            printNewline();
+            printKeyword(Symbol::KwDefault);
+            printSymbol(Symbol::Colon);
+            visitChild(ast->defaultCase.get());
+        }
+        printer_.dedent();
+        printNewline();
+        printSymbol(Symbol::CurlyClose);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTWhile * ast) {
+        pushAst(ast);
+        printKeyword(Symbol::KwWhile);
+        printSpace();
+        printSymbol(Symbol::ParOpen);
+        visitChild(ast->cond.get());
+        printSymbol(Symbol::ParClose);
+        visitChild(ast->body.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTDoWhile * ast) {
+        pushAst(ast);
+        printKeyword(Symbol::KwDo);
+        visitChild(ast->body.get());
+        printKeyword(Symbol::KwWhile);
+        printSpace();
+        printSymbol(Symbol::ParOpen);
+        visitChild(ast->cond.get());
+        printSymbol(Symbol::ParClose);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTFor * ast) {
+        pushAst(ast);
+        printKeyword(Symbol::KwFor);
+        printSpace();
+        printSymbol(Symbol::ParOpen);
+        if (ast->init) visitChild(ast->init.get());
+        printSymbol(Symbol::Semicolon);
+        if (ast->cond) visitChild(ast->cond.get());
+        printSymbol(Symbol::Semicolon);
+        if (ast->increment) visitChild(ast->increment.get());
+        printSymbol(Symbol::ParClose);
+        visitChild(ast->body.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTBreak * ast) {
+        printKeyword(Symbol::KwBreak);
+    }
+
+    void CppEmitter::visit(ASTContinue * ast) {
+        printKeyword(Symbol::KwContinue);
+    }
+
+    void CppEmitter::visit(ASTReturn * ast) {
+        pushAst(ast);
+        printKeyword(Symbol::KwReturn);
+        if (ast->value) {
+            printSpace();
+            visitChild(ast->value.get());
+        }
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTBinaryOp * ast) {
+        pushAst(ast);
+        printOperand(ast->left.get(), Transpiler::GetPrecedence(ast->op));
+        printSpace();
+        printSymbol(ast->op);
+        printSpace();
+        // operators are left associative, an operand of the same precedence on the right was parenthesized in the source
+        printOperand(ast->right.get(), Transpiler::GetPrecedence(ast->op) + 1);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTAssignment * ast) {
+        pushAst(ast);
+        visitChild(ast->lvalue.get());
+        printSpace();
+        printSymbol(ast->op);
+        printSpace();
+        visitChild(ast->value.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTUnaryOp * ast) {
+        pushAst(ast);
+        printSymbol(ast->op);
+        printOperand(ast->arg.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTUnaryPostOp * ast) {
+        pushAst(ast);
+        printOperand(ast->arg.get());
+        printSymbol(ast->op);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTAddress * ast) {
+        pushAst(ast);
+        printSymbol(Symbol::BitAnd);
+        printOperand(ast->target.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTDeref * ast) {
+        pushAst(ast);
+        printSymbol(Symbol::Mul);
+        printOperand(ast->target.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTIndex * ast) {
+        pushAst(ast);
+        printOperand(ast->base.get());
+        printSymbol(Symbol::SquareOpen);
+        visitChild(ast->index.get());
+        printSymbol(Symbol::SquareClose);
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTMember * ast) {
+        if (auto * call = ast->member->as<ASTCall>()) {
+            pushAst(ast);
+            pushAst(call);
+            printMethodCall(ast, call);
+            popAst();
+            popAst();
+            return;
+        }
+        // field access chains (a->b->c) are printed from the innermost access in a loop, so that their length is not limited by the stack
+        std::vector<ASTMember *> chain{ast};
+        while (auto * inner = chain.back()->base->as<ASTMember>()) {
+            if (inner->member->as<ASTCall>()) break;
+            chain.push_back(inner);
+        }
+        for (auto * member : chain) {
+            pushAst(member);
+        }
+        auto it = chain.rbegin();
+        if (chain.back()->getStructOfArrays() != nullptr) {
+            printStructOfArraysField(chain.back());
+            popAst();
+            ++it;
+        } else {
+            printOperand(chain.back()->base.get());
+        }
+        for (; it != chain.rend(); ++it) {
+            printSymbol((*it)->op);
+            visitChild((*it)->member.get());
+            popAst();
+        }
+    }
+
+    void CppEmitter::visit(ASTCall * ast) {
+        // method calls are printed by their member access, constructor calls are plain C++ constructor calls
+        pushAst(ast);
+        if (auto value = ast->constexprFunction != nullptr ? evaluator_.evaluate(ast) : std::nullopt; value.has_value()) {
+            // * the same value the TinyC output is given, see ConstantEvaluator
+            printConstant(value.value());
+        } else {
+            visitChild(ast->function.get());
+            printArguments(ast->args);
+        }
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTNew * ast) {
+        pushAst(ast);
+        printKeyword(symbols::KwNew);
+        printSpace();
+        visitChild(ast->constructor.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTDelete * ast) {
+        pushAst(ast);
+        printKeyword(symbols::KwDelete);
+        printSpace();
+        visitChild(ast->target.get());
+        popAst();
+    }
+
+    void CppEmitter::visit(ASTCast * ast) {
+        pushAst(ast);
+        if (auto classCast = ast->as<ASTClassCast>()) {
+            printClassCast(classCast);
+        } else {
+            // TinyC+ cast reinterprets, a C style cast does the same but still adjusts pointers within a class hierarchy
+            printSymbol(Symbol::ParOpen);
+            printSymbol(Symbol::ParOpen);
+            visitChild(ast->type.get());
+            printSymbol(Symbol::ParClose);
+            printSymbol(Symbol::ParOpen);
+            visitChild(ast->value.get());
+            printSymbol(Symbol::ParClose);
+            printSymbol(Symbol::ParClose);
+        }
+        popAst();
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,536 @@
+#pragma once
+
+// standard
+#include <iostream>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include <cmath>
+
+// internal
+#include "ast.h"
+#include "types.h"
+#include "contexts.h"
+#include "transpiler.h"
+#include "evaluator.h"
+
+namespace tinycplus {
+
+    /** Emits C++ directly from the typechecked AST (--emit=cpp), the second backend next to the Transpiler.
+
+        Classes become C++ classes with real virtual methods, so the host compiler sees the whole object model and can devirtualize and inline through it:
+        - every root class derives from the polymorphic "object" struct, interfaces are abstract bases with pure virtual methods,
+        - classes no other class derives from are "final", so are the virtual methods no derived class overrides,
+        - "classcast" is a "static_cast" when the cast is statically known to succeed (upcasts, interfaces implemented by the static type), a check of the exact dynamic type for downcasts to final classes, otherwise a "dynamic_cast".
+        Access modifiers were already checked by the TypeChecker, hence all members are emitted as public.
+     */
+    class CppEmitter : public ASTVisitor {
+    private: // persistant data
+        NamesContext & names_;
+        TypesContext & types_;
+        ASTPrettyPrinter printer_;
+        bool isPrintColorful_ = false;
+        int poolCapacity_ = 1024;
+        ConstantEvaluator evaluator_;
+        std::vector<AST*> current_ast_hierarchy_;
+    private: // whole program facts, collected before the emission
+        /** Classes which are the base of at least one other class.
+         */
+        std::unordered_set<Type::Class*> baseClasses_;
+        /** Per class, names of its virtual methods overridden somewhere below it in the hierarchy.
+         */
+        std::unordered_map<Type::Class*, std::unordered_set<Symbol>> overriddenMethods_;
+    public:
+        CppEmitter(NamesContext & names, TypesContext & types, std::ostream & output, bool isColorful)
+            :names_{names}
+            ,types_{types}
+            ,printer_{output}
+            ,isPrintColorful_{isColorful}
+            ,evaluator_{types}
+        { }
+
+        /** Number of instances in the slab of every pooled class (--pool-capacity).
+         */
+        void setPoolCapacity(int capacity) {
+            poolCapacity_ = capacity;
+        }
+
+        /** Number of steps one evaluation of a constexpr call may take before the call is left to the runtime (--constexpr-steps).
+         */
+        void setConstexprSteps(size_t steps) {
+            evaluator_.setStepBudget(steps);
+        }
+    private:
+        void pushAst(AST * ast) {
+            current_ast_hierarchy_.push_back(ast);
+        }
+        // Used only with [pushAst] as a self-cleaning process
+        void popAst() {
+            current_ast_hierarchy_.pop_back();
+        }
+        AST * peekAst() {
+            assert(!current_ast_hierarchy_.empty());
+            return current_ast_hierarchy_.back();
+        }
+        void validateName(Symbol const & name) {
+            if (symbols::isReservedName(name)) {
+                throw std::runtime_error{STR("Name " << name << " is a reserved TinyC+ name!")};
+            }
+        }
+
+        #pragma region Printer Shortcuts
+        inline void print(Symbol const & symbol, tiny::color color) {
+            if (isPrintColorful_) printer_ << color;
+            printer_ << symbol.name();
+        }
+        inline void printSpace() {
+            printer_ << " ";
+        }
+        inline void printNewline() {
+            printer_.newline();
+        }
+        inline void printSymbol(Symbol const & name) {
+            print(name, printer_.symbol);
+        }
+        inline void printIdentifier(Symbol const & name) {
+            print(name, printer_.identifier);
+        }
+        inline void printType(Symbol const & name) {
+            print(name, printer_.type);
+        }
+        inline void printKeyword(Symbol const & name) {
+            print(name, printer_.keyword);
+        }
+        inline void printComment(std::string const & text, bool newline = true) {
+            if (isPrintColorful_) printer_ << printer_.comment;
+            printer_ << "// " << text;
+            if (newline) printNewline();
+        }
+        #pragma endregion
+
+        inline void printScopeOpen() {
+            printSymbol(Symbol::CurlyOpen);
+            printer_.indent();
+            printNewline();
+        }
+        inline void printScopeClose(bool isSemicolonTerminated) {
+            printer_.dedent();
+            printNewline();
+            printSymbol(Symbol::CurlyClose);
+            if (isSemicolonTerminated) {
+                printSymbol(Symbol::Semicolon);
+            }
+            printNewline();
+        }
+
+        /** Prints an operand of an operator, in parentheses if it binds weaker than the operator requires.
+            Casts are printed as primary expressions, so the precedence of the Transpiler applies as is.
+         */
+        void printOperand(AST * ast, int requiredPrecedence = Transpiler::PostfixPrecedence) {
+            bool isParenthesized = Transpiler::GetPrecedence(ast) < requiredPrecedence;
+            if (isParenthesized) printSymbol(Symbol::ParOpen);
+            visitChild(ast);
+            if (isParenthesized) printSymbol(Symbol::ParClose);
+        }
+
+        /** Slab shared by the pooled classes, the same arena and free list as Transpiler::printClassPool. A full slab yields null, which the non-throwing operator new turns into a null new expression.
+         */
+        void printPoolTemplate() {
+            printer_ << "template<typename T, int Capacity>";
+            printNewline();
+            printer_ << "struct " << symbols::CppPool.name() << " ";
+            printScopeOpen();
+            printer_ << "union Slot { Slot * next; alignas(T) unsigned char bytes[sizeof(T)]; };";
+            printNewline();
+            printer_ << "static inline Slot slots[Capacity];";
+            printNewline();
+            printer_ << "static inline int used = 0;";
+            printNewline();
+            printer_ << "static inline Slot * freed = nullptr;";
+            printNewline();
+            printer_ << "static void * allocate() ";
+            printScopeOpen();
+            printer_ << "if (freed != nullptr) { Slot * slot = freed; freed = slot->next; return slot; }";
+            printNewline();
+            printer_ << "return used == Capacity ? nullptr : &slots[used++];";
+            printScopeClose(false);
+            printer_ << "static void release(void * instance) ";
+            printScopeOpen();
+            printer_ << "if (instance == nullptr) return;";
+            printNewline();
+            printer_ << "Slot * slot = static_cast<Slot *>(instance);";
+            printNewline();
+            printer_ << "slot->next = freed;";
+            printNewline();
+            printer_ << "freed = slot;";
+            printScopeClose(false);
+            printScopeClose(true);
+        }
+
+        /** Class specific allocation of a pooled class, deletes through a base pointer reach it by the virtual destructor of "object".
+         */
+        void printPoolOperators(Type::Class * classType) {
+            auto slab = STR(symbols::CppPool.name() << "<" << classType->name.name() << ", " << poolCapacity_ << ">");
+            printer_ << "static void * operator new(decltype(sizeof(0))) noexcept { return " << slab << "::allocate(); }";
+            printNewline();
+            printer_ << "static void operator delete(void * instance) { " << slab << "::release(instance); }";
+            printNewline();
+        }
+
+        /** Same lowering as Transpiler::printStructOfArraysDeclaration.
+         */
+        void printStructOfArraysDeclaration(ASTVarDecl * ast) {
+            auto * arrayType = ast->type->as<ASTArrayType>();
+            auto * classType = ast->getType()->as<Type::Pointer>()->base()->as<Type::Class>();
+            std::vector<FieldInfo> fields;
+            classType->collectFieldsOrdered(fields);
+            for (size_t i = 0; i < fields.size(); ++i) {
+                if (i > 0) {
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                }
+                visitChild(fields[i].ast->as<ASTVarDecl>()->type.get());
+                printSpace();
+                printIdentifier(symbols::makeStructOfArraysField(ast->name->name, fields[i].name));
+                printSymbol(Symbol::SquareOpen);
+                visitChild(arrayType->size.get());
+                printSymbol(Symbol::SquareClose);
+            }
+        }
+
+        void printStructOfArraysField(ASTMember * ast) {
+            auto * index = ast->base->as<ASTIndex>();
+            pushAst(index);
+            printIdentifier(symbols::makeStructOfArraysField(ast->getStructOfArrays()->name, ast->member->as<ASTIdentifier>()->name));
+            printSymbol(Symbol::SquareOpen);
+            visitChild(index->index.get());
+            printSymbol(Symbol::SquareClose);
+            popAst();
+        }
+
+        /** Value of a constexpr call computed at compile time, chars other than printable ones as a cast of their code. Negative values and casts are parenthesized, as they replace an operand.
+         */
+        void printConstant(ConstantValue const & value) {
+            if (value.type == types_.getTypeChar() && ConstantEvaluator::IsPrintableChar(value.integer)) {
+                if (isPrintColorful_) printer_ << printer_.charLiteral;
+                printer_ << STR('\'' << static_cast<char>(value.integer) << '\'');
+                return;
+            }
+            bool isReal = value.type == types_.getTypeDouble();
+            bool isChar = value.type == types_.getTypeChar();
+            bool isParenthesized = isChar || (isReal ? std::signbit(value.real) : value.integer < 0);
+            if (isParenthesized) printSymbol(Symbol::ParOpen);
+            if (isChar) {
+                printSymbol(Symbol::ParOpen);
+                printType(Symbol::KwChar);
+                printSymbol(Symbol::ParClose);
+            }
+            if (isPrintColorful_) printer_ << printer_.numberLiteral;
+            if (isReal) {
+                printer_ << ConstantEvaluator::FormatReal(value.real).value();
+            } else {
+                printer_ << value.integer;
+            }
+            if (isParenthesized) printSymbol(Symbol::ParClose);
+        }
+
+        void printArguments(std::vector<std::unique_ptr<AST>> const & args) {
+            printSymbol(Symbol::ParOpen);
+            for (size_t i = 0; i < args.size(); i++) {
+                if (i > 0) {
+                    printSymbol(Symbol::Comma);
+                    printSpace();
+                }
+                visitChild(args[i].get());
+            }
+            printSymbol(Symbol::ParClose);
+        }
+
+        void printParameters(ASTFunDecl * ast) {
+            printSymbol(Symbol::ParOpen);
+            for (size_t i = 0; i < ast->args.size(); i++) {
+                if (i > 0) {
+                    printSymbol(Symbol::Comma);
+                    printSpace();
+                }
+                visitChild(ast->args[i].get());
+            }
+            printSymbol(Symbol::ParClose);
+        }
+
+        void printBodyOrSemicolon(ASTFunDecl * ast) {
+            if (ast->body) {
+                printSpace();
+                visitChild(ast->body.get());
+            } else {
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+            }
+        }
+
+        /** Collects the facts "final" is derived from: which classes are derived from and which virtual methods are overridden below a class.
+         */
+        void collectHierarchyFacts(ASTProgram * ast) {
+            for (auto & i : ast->body) {
+                auto * classAst = i->as<ASTClassDecl>();
+                if (classAst == nullptr || !classAst->isDefinition) continue;
+                auto * classType = classAst->getType()->as<Type::Class>();
+                auto * baseType = classType->getBase();
+                if (baseType != nullptr) baseClasses_.insert(baseType);
+                for (auto & method : classAst->methods) {
+                    if (!method->isOverride()) continue;
+                    for (auto * it = baseType; it != nullptr; it = it->getBase()) {
+                        overriddenMethods_[it].insert(method->name.value());
+                    }
+                }
+            }
+        }
+
+        bool isFinal(Type::Class * classType) const {
+            return baseClasses_.find(classType) == baseClasses_.end();
+        }
+
+        /** Virtual methods of a class other classes derive from are final when no derived class overrides them.
+         */
+        bool isFinalMethod(Type::Class * classType, Symbol name) const {
+            if (isFinal(classType)) return false; // already implied by the class
+            auto it = overriddenMethods_.find(classType);
+            return it == overriddenMethods_.end() || it->second.find(name) == it->second.end();
+        }
+
+        /** Interfaces the class adds to its C++ bases, the ones implemented by its base class are inherited with it.
+         */
+        std::vector<Type::Interface*> getOwnInterfaces(ASTClassDecl * ast, Type::Class * classType) {
+            std::vector<Type::Interface*> result;
+            auto * baseType = classType->getBase();
+            for (auto & it : ast->interfaces) {
+                auto * interfaceType = it->getType()->as<Type::Interface>();
+                if (baseType != nullptr && baseType->interfaces.find(interfaceType->name) != baseType->interfaces.end()) continue;
+                result.push_back(interfaceType);
+            }
+            return result;
+        }
+
+        void printClassHead(ASTClassDecl * ast, Type::Class * classType) {
+            printKeyword(Symbol::KwStruct);
+            printSpace();
+            printType(ast->name);
+            if (isFinal(classType)) {
+                printSpace();
+                printKeyword(symbols::CppFinal);
+            }
+            printSpace();
+            printSymbol(Symbol::Colon);
+            printSpace();
+            printType(classType->getBase()->name);
+            for (auto * interfaceType : getOwnInterfaces(ast, classType)) {
+                printSymbol(Symbol::Comma);
+                printSpace();
+                printType(interfaceType->name);
+            }
+            printSpace();
+        }
+
+        void printMethod(ASTFunDecl * ast, Type::Class * classType) {
+            pushAst(ast);
+            auto name = ast->name.value();
+            validateName(name);
+            bool isOverriding = ast->isOverride() || classType->isInterfaceMethod(name);
+            if (ast->isVirtualized() && !isOverriding) {
+                printKeyword(symbols::KwVirtual);
+                printSpace();
+            }
+            visitChild(ast->typeDecl.get());
+            printSpace();
+            printIdentifier(name);
+            printParameters(ast);
+            if (isOverriding) {
+                printSpace();
+                printKeyword(symbols::KwOverride);
+            }
+            if (ast->isAbstract()) {
+                printSpace();
+                printSymbol(Symbol::Assign);
+                printSpace();
+                printer_ << 0;
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+            } else {
+                // overriding the interface makes even a method which is not virtual in TinyC+ virtual, it cannot be overridden though
+                if ((ast->isVirtualized() || isOverriding) && isFinalMethod(classType, name)) {
+                    printSpace();
+                    printKeyword(symbols::CppFinal);
+                }
+                printBodyOrSemicolon(ast);
+            }
+            popAst();
+        }
+
+        void printConstructor(ASTFunDecl * ast, ASTClassDecl * classAst) {
+            pushAst(ast);
+            printType(classAst->name);
+            printParameters(ast);
+            if (ast->base.has_value()) {
+                auto & base = ast->base.value();
+                printSpace();
+                printSymbol(Symbol::Colon);
+                printSpace();
+                printType(base.getName());
+                printSymbol(Symbol::ParOpen);
+                for (size_t i = 0; i < base.args.size(); i++) {
+                    if (i > 0) {
+                        printSymbol(Symbol::Comma);
+                        printSpace();
+                    }
+                    printIdentifier(base.args[i]->name);
+                }
+                printSymbol(Symbol::ParClose);
+            }
+            printBodyOrSemicolon(ast);
+            popAst();
+        }
+
+        /** Interface methods the class inherits the implementation of are forwarded to it, a C++ base class does not implement interfaces of its derived classes.
+         */
+        void printInterfaceForwarders(ASTClassDecl * ast, Type::Class * classType) {
+            for (auto * interfaceType : getOwnInterfaces(ast, classType)) {
+                std::vector<FieldInfo> methods;
+                interfaceType->vtable->collectFieldsOrdered(methods);
+                for (auto & method : methods) {
+                    if (classType->hasMethod(method.name, false)) continue;
+                    auto info = classType->getMethodInfo(method.name);
+                    assert(info.has_value() && "the typechecker guarantees interface methods are implemented");
+                    auto * inherited = info.value().ast;
+                    if (inherited->isAbstract()) continue; // the class stays abstract
+                    pushAst(inherited);
+                    visitChild(inherited->typeDecl.get());
+                    printSpace();
+                    printIdentifier(method.name);
+                    printParameters(inherited);
+                    printSpace();
+                    printKeyword(symbols::KwOverride);
+                    if (isFinalMethod(classType, method.name)) {
+                        printSpace();
+                        printKeyword(symbols::CppFinal);
+                    }
+                    printSpace();
+                    printScopeOpen();
+                    if (inherited->typeDecl->getType() != types_.getTypeVoid()) {
+                        printKeyword(Symbol::KwReturn);
+                        printSpace();
+                    }
+                    printType(classType->getBase()->name);
+                    printSymbol(Symbol::Colon);
+                    printSymbol(Symbol::Colon);
+                    printIdentifier(method.name);
+                    printSymbol(Symbol::ParOpen);
+                    for (size_t i = 0; i < inherited->args.size(); i++) {
+                        if (i > 0) {
+                            printSymbol(Symbol::Comma);
+                            printSpace();
+                        }
+                        printIdentifier(inherited->args[i]->name->name);
+                    }
+                    printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::Semicolon);
+                    printScopeClose(false);
+                    popAst();
+                }
+            }
+        }
+
+        void printClassCast(ASTClassCast * ast) {
+            auto * targetClassType = ast->type->getType()->unwrap<Type::Class>();
+            auto * targetInterfaceType = ast->type->getType()->unwrap<Type::Interface>();
+            auto * subjectClassType = ast->value->getType()->unwrap<Type::Class>();
+            auto * subjectInterfaceType = ast->value->getType()->unwrap<Type::Interface>();
+            bool isProvablySafe = false;
+            bool isExact = false;
+            if (targetClassType != nullptr && subjectClassType != nullptr) {
+                // upcast
+                isProvablySafe = subjectClassType->inherits(targetClassType);
+                isExact = !isProvablySafe && isFinal(targetClassType) && targetClassType->inherits(subjectClassType);
+            } else if (targetInterfaceType != nullptr && subjectClassType != nullptr) {
+                // the static type implements the interface, inherited interfaces included
+                isProvablySafe = subjectClassType->interfaces.find(targetInterfaceType->name) != subjectClassType->interfaces.end();
+            } else if (targetInterfaceType != nullptr && subjectInterfaceType != nullptr) {
+                isProvablySafe = targetInterfaceType == subjectInterfaceType;
+            } else if (targetClassType != nullptr && subjectInterfaceType != nullptr) {
+                isExact = isFinal(targetClassType) && targetClassType->interfaces.find(subjectInterfaceType->name) != targetClassType->interfaces.end();
+            }
+            if (isExact) {
+                // a final class has no derived classes, comparing the dynamic type is enough and much cheaper than searching the hierarchy
+                printIdentifier(symbols::CppExactCast);
+                printSymbol(Symbol::Lt);
+                printType(targetClassType->name);
+                printSymbol(Symbol::Gt);
+            } else {
+                printKeyword(isProvablySafe ? symbols::CppStaticCast : symbols::CppDynamicCast);
+                printSymbol(Symbol::Lt);
+                visitChild(ast->type.get());
+                printSymbol(Symbol::Gt);
+            }
+            printSymbol(Symbol::ParOpen);
+            visitChild(ast->value.get());
+            printSymbol(Symbol::ParClose);
+        }
+
+        void printMethodCall(ASTMember * member, ASTCall * call) {
+            auto * baseAsIdent = member->base->as<ASTIdentifier>();
+            if (baseAsIdent != nullptr && baseAsIdent->name == symbols::KwBase) {
+                // calls the base implementation without the virtual dispatch
+                printIdentifier(symbols::KwThis);
+                printSymbol(Symbol::ArrowR);
+                printType(baseAsIdent->getType()->unwrap<Type::Class>()->name);
+                printSymbol(Symbol::Colon);
+                printSymbol(Symbol::Colon);
+            } else {
+                printOperand(member->base.get());
+                printSymbol(member->op);
+            }
+            visitChild(call->function.get());
+            printArguments(call->args);
+        }
+    public:
+        void visit(AST * ast) override;
+        void visit(ASTInteger * ast) override;
+        void visit(ASTDouble * ast) override;
+        void visit(ASTChar * ast) override;
+        void visit(ASTString * ast) override;
+        void visit(ASTIdentifier * ast) override;
+        void visit(ASTType * ast) override;
+        void visit(ASTPointerType * ast) override;
+        void visit(ASTArrayType * ast) override;
+        void visit(ASTNamedType * ast) override;
+        void visit(ASTSequence * ast) override;
+        void visit(ASTBlock * ast) override;
+        void visit(ASTProgram * ast) override;
+        void visit(ASTVarDecl * ast) override;
+        void visit(ASTFunDecl * ast) override;
+        void visit(ASTFunPtrDecl * ast) override;
+        void visit(ASTStructDecl * ast) override;
+        void visit(ASTInterfaceDecl * ast) override;
+        void visit(ASTClassDecl * ast) override;
+        void visit(ASTIf * ast) override;
+        void visit(ASTSwitch * ast) override;
+        void visit(ASTWhile * ast) override;
+        void visit(ASTDoWhile * ast) override;
+        void visit(ASTFor * ast) override;
+        void visit(ASTBreak * ast) override;
+        void visit(ASTContinue * ast) override;
+        void visit(ASTReturn * ast) override;
+        void visit(ASTBinaryOp * ast) override;
+        void visit(ASTAssignment * ast) override;
+        void visit(ASTUnaryOp * ast) override;
+        void visit(ASTUnaryPostOp * ast) override;
+        void visit(ASTAddress * ast) override;
+        void visit(ASTDeref * ast) override;
+        void visit(ASTIndex * ast) override;
+        void visit(ASTMember * ast) override;
+        void visit(ASTCall * ast) override;
+        void visit(ASTNew * ast) override;
+        void visit(ASTDelete * ast) override;
+        void visit(ASTCast * ast) override;
+    }; // class CppEmitter
+
+} // namespace tinycplus
@@ -0,0 +1,111 @@
+// standard
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+// external
+#include "common/helpers.h"
+
+// internal
+#include "dispatch_profile.h"
+
+namespace tinycplus {
+
+    namespace {
+        char const * const FunctionEntrySuffix = "/entry";
+
+        bool IsFunctionEntryKey(std::string const & key) {
+            auto suffixSize = std::char_traits<char>::length(FunctionEntrySuffix);
+            return key.size() > suffixSize && key.compare(key.size() - suffixSize, suffixSize, FunctionEntrySuffix) == 0;
+        }
+    } // anonymous namespace
+
+    DispatchProfile DispatchProfile::Load(std::string const & filepath) {
+        std::ifstream input{filepath};
+        if (!input) {
+            throw std::runtime_error(STR("PROFILE: cannot open file at path: " << filepath));
+        }
+        DispatchProfile result;
+        std::string line;
+        int lineNumber = 0;
+        while (std::getline(input, line)) {
+            ++lineNumber;
+            std::stringstream tokens{line};
+            std::string key;
+            if (!(tokens >> key) || key[0] == '#') continue;
+            DispatchSiteProfile site;
+            std::string entry;
+            while (tokens >> entry) {
+                auto separator = entry.find('=');
+                int64_t count = 0;
+                try {
+                    if (separator == std::string::npos || separator == 0) throw std::invalid_argument{entry};
+                    size_t parsed = 0;
+                    count = std::stoll(entry.substr(separator + 1), &parsed);
+                    if (parsed != entry.size() - separator - 1 || count < 0) throw std::invalid_argument{entry};
+                } catch (std::exception const &) {
+                    throw std::runtime_error(STR("PROFILE: malformed receiver \"" << entry << "\" at " << filepath << ":" << lineNumber));
+                }
+                auto name = entry.substr(0, separator);
+                if (name == "others") {
+                    site.others += count;
+                } else {
+                    site.receivers.emplace_back(name, count);
+                }
+            }
+            std::stable_sort(site.receivers.begin(), site.receivers.end(), [](auto const & a, auto const & b) {
+                return a.second > b.second;
+            });
+            if (IsFunctionEntryKey(key)) {
+                result.hasFunctionEntries_ = true;
+            } else {
+                result.hottestTotal_ = std::max(result.hottestTotal_, site.total());
+            }
+            if (!result.sites_.emplace(key, std::move(site)).second) {
+                throw std::runtime_error(STR("PROFILE: site " << key << " is listed twice at " << filepath << ":" << lineNumber));
+            }
+        }
+        return result;
+    }
+
+    DispatchSiteProfile const * DispatchProfile::find(std::string const & key) const {
+        auto it = sites_.find(key);
+        return it == sites_.end() ? nullptr : &it->second;
+    }
+
+    std::vector<std::string> DispatchProfile::dominantReceivers(std::string const & key) const {
+        std::vector<std::string> result;
+        auto * site = find(key);
+        if (site == nullptr || site->total() == 0) return result;
+        int64_t covered = 0;
+        for (auto & it : site->receivers) {
+            if (result.size() == MaxGuardedReceivers) break;
+            result.push_back(it.first);
+            covered += it.second;
+            if (covered >= DominanceShare * site->total()) return result;
+        }
+        result.clear();
+        return result;
+    }
+
+    bool DispatchProfile::isHot(std::string const & key) const {
+        auto * site = find(key);
+        return site != nullptr && site->total() > 0 && site->total() >= HotShare * hottestTotal_;
+    }
+
+    std::optional<int64_t> DispatchProfile::functionEntries(std::string const & function) const {
+        auto * site = find(function + FunctionEntrySuffix);
+        if (site == nullptr) return std::nullopt;
+        return site->total();
+    }
+
+    std::vector<std::string> DispatchProfile::keys() const {
+        std::vector<std::string> result;
+        result.reserve(sites_.size());
+        for (auto & it : sites_) result.push_back(it.first);
+        std::sort(result.begin(), result.end());
+        return result;
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,73 @@
+#pragma once
+
+// standard
+#include <optional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+namespace tinycplus {
+
+    /** Receiver classes observed by one dynamic dispatch site, with their counts.
+     */
+    struct DispatchSiteProfile {
+        std::vector<std::pair<std::string, int64_t>> receivers; // most frequent first
+        int64_t others = 0; // receivers which were only counted
+        int64_t total() const {
+            int64_t result = others;
+            for (auto & it : receivers) result += it.second;
+            return result;
+        }
+    };
+
+    /** Profile of a program run recorded by --instrument=dispatch,coverage, read by --profile-use.
+
+        The profile is a text file with one site per line, empty lines and lines starting with '#' are skipped:
+            <site key> <class>=<count> { <class>=<count> } [ others=<count> ]
+            <function>/entry calls=<count>
+        The site key is "<function>/<kind>/<static type>/<ordinal>", see Transpiler::makeDispatchSiteKey.
+        Function entries come from the "function" counters of the coverage instrumentation.
+     */
+    class DispatchProfile {
+    public:
+        /** Share of the site samples the guarded receivers must cover.
+         */
+        static constexpr double DominanceShare = 0.9;
+        /** Most receivers a guarded site checks before it falls back to dynamic dispatch.
+         */
+        static constexpr size_t MaxGuardedReceivers = 2;
+        /** Share of the samples of the hottest site a site needs to be hot.
+         */
+        static constexpr double HotShare = 0.01;
+    private:
+        std::unordered_map<std::string, DispatchSiteProfile> sites_;
+        int64_t hottestTotal_ = 0; // of dispatch sites
+        bool hasFunctionEntries_ = false;
+    public:
+        /** Throws on unreadable files and malformed lines.
+         */
+        static DispatchProfile Load(std::string const & filepath);
+
+        DispatchSiteProfile const * find(std::string const & key) const;
+
+        /** Receivers of the site covering DominanceShare of its samples, at most MaxGuardedReceivers of them; empty when no such receivers exist.
+         */
+        std::vector<std::string> dominantReceivers(std::string const & key) const;
+
+        bool isHot(std::string const & key) const;
+
+        bool hasFunctionEntries() const {
+            return hasFunctionEntries_;
+        }
+
+        /** Recorded entries of the function, see Transpiler::describeFunction for its name.
+         */
+        std::optional<int64_t> functionEntries(std::string const & function) const;
+
+        /** Keys of all profiled sites, sorted so that the output does not depend on the hashing.
+         */
+        std::vector<std::string> keys() const;
+    };
+
+} // namespace tinycplus
@@ -0,0 +1,187 @@
+// standard
+#include <sstream>
+
+// internal
+#include "driver.h"
+#include "shared.h"
+#include "parser.h"
+#include "transpiler.h"
+#include "cpp_emitter.h"
+#include "typechecker.h"
+#include "profiling.h"
+#include "tracing.h"
+#include "source_map.h"
+#include "stats.h"
+#include "bytecode_compiler.h"
+#include "vm.h"
+#include "pipeline.h"
+
+namespace tinycplus {
+
+    void compileFile(std::string const & inputFilepath, std::ostream & output, CompileOptions const & options) {
+        if (options.isPipelined || options.isStreaming) {
+            compileFileByDeclaration(inputFilepath, output, options);
+            return;
+        }
+        TypesContext typesContext{};
+        NamesContext namesContext{typesContext.getTypeVoid()};
+        TypeChecker typechecker{typesContext, namesContext};
+        typechecker.setTrace(options.trace);
+        ScopedPass totalPass{options.timings, "total"};
+        ScopedSpan totalSpan{options.trace, "file", options.trace != nullptr ? STR("compile " << inputFilepath) : ""};
+        std::vector<Token> tokens;
+        {
+            ScopedPass pass{options.timings, "lex"};
+            ScopedSpan span{options.trace, "pass", "lex"};
+            tokens = Lexer::TokenizeFile(inputFilepath);
+        }
+        std::unique_ptr<AST> program;
+        {
+            ScopedPass pass{options.timings, "parse"};
+            ScopedSpan span{options.trace, "pass", "parse"};
+            program = Parser::ParseTokens(std::move(tokens), options.trace);
+        }
+        if (options.isParseOnly) {
+            ASTPrettyPrinter printer {output};
+            program->print(printer);
+            return;
+        }
+        {
+            ScopedPass pass{options.timings, "typecheck"};
+            ScopedSpan span{options.trace, "pass", "typecheck"};
+            typechecker.visit(program.get());
+        }
+        {
+            ScopedPass pass{options.timings, "emit"};
+            ScopedSpan span{options.trace, "pass", "emit"};
+            if (options.backend == Backend::Cpp) {
+                if (options.isInstrumentingDispatch || options.isInstrumentingCoverage || !options.profileUsePath.empty()) {
+                    throw std::runtime_error("Dispatch instrumentation and profiles are only available for the TinyC output");
+                }
+                if (options.isEmittingLineMarkers || !options.sourceMapPath.empty() || options.stats != nullptr) {
+                    throw std::runtime_error("Line markers, source maps and stats are only available for the TinyC output");
+                }
+                CppEmitter emitter{namesContext, typesContext, output, options.isPrintColorful};
+                emitter.setPoolCapacity(options.poolCapacity);
+                emitter.setConstexprSteps(options.constexprSteps);
+                emitter.visit(program.get());
+            } else {
+                // * the output is only counted for the source map and the stats
+                bool isMappingSource = !options.sourceMapPath.empty();
+                bool isCountingOutput = isMappingSource || options.stats != nullptr;
+                OutputCountingBuffer outputCounter{output.rdbuf()};
+                std::ostream countedOutput{&outputCounter};
+                Transpiler transpiler{namesContext, typesContext, isCountingOutput ? countedOutput : output, options.isPrintColorful};
+                transpiler.setTimings(options.timings);
+                transpiler.setTrace(options.trace);
+                transpiler.setDispatchInstrumentation(options.isInstrumentingDispatch);
+                transpiler.setCoverageInstrumentation(options.isInstrumentingCoverage);
+                transpiler.setLineMarkers(options.isEmittingLineMarkers);
+                transpiler.setPoolCapacity(options.poolCapacity);
+                transpiler.setConstexprSteps(options.constexprSteps);
+                DispatchProfile profile;
+                if (!options.profileUsePath.empty()) {
+                    profile = DispatchProfile::Load(options.profileUsePath);
+                    transpiler.setProfile(&profile);
+                }
+                SourceMap sourceMap;
+                if (isCountingOutput) {
+                    transpiler.setOutputCounter(&outputCounter);
+                    transpiler.setSourceMap(isMappingSource ? &sourceMap : nullptr);
+                    transpiler.setStats(options.stats);
+                }
+                transpiler.visit(program.get());
+                transpiler.validateSelf();
+                if (isCountingOutput) {
+                    countedOutput.flush();
+                }
+                if (isMappingSource) {
+                    sourceMap.write(options.sourceMapPath);
+                }
+            }
+        }
+    }
+
+    int64_t runFile(std::string const & inputFilepath, CompileOptions const & options) {
+        if (options.backend == Backend::Cpp) {
+            throw std::runtime_error("--run does not emit an output, --emit is not available together with it");
+        }
+        if (options.isInstrumentingDispatch || options.isInstrumentingCoverage || !options.profileUsePath.empty()) {
+            throw std::runtime_error("Dispatch instrumentation and profiles are not available together with --run");
+        }
+        if (options.isEmittingLineMarkers || !options.sourceMapPath.empty() || options.stats != nullptr) {
+            throw std::runtime_error("Line markers, source maps and stats are not available together with --run");
+        }
+        TypesContext typesContext{};
+        NamesContext namesContext{typesContext.getTypeVoid()};
+        TypeChecker typechecker{typesContext, namesContext};
+        typechecker.setTrace(options.trace);
+        ScopedPass totalPass{options.timings, "total"};
+        ScopedSpan totalSpan{options.trace, "file", options.trace != nullptr ? STR("run " << inputFilepath) : ""};
+        std::vector<Token> tokens;
+        {
+            ScopedPass pass{options.timings, "lex"};
+            ScopedSpan span{options.trace, "pass", "lex"};
+            tokens = Lexer::TokenizeFile(inputFilepath);
+        }
+        std::unique_ptr<AST> program;
+        {
+            ScopedPass pass{options.timings, "parse"};
+            ScopedSpan span{options.trace, "pass", "parse"};
+            program = Parser::ParseTokens(std::move(tokens), options.trace);
+        }
+        {
+            ScopedPass pass{options.timings, "typecheck"};
+            ScopedSpan span{options.trace, "pass", "typecheck"};
+            typechecker.visit(program.get());
+        }
+        BytecodeProgram bytecode;
+        {
+            ScopedPass pass{options.timings, "lower"};
+            ScopedSpan span{options.trace, "pass", "lower"};
+            BytecodeCompiler compiler{typesContext};
+            compiler.setPoolCapacity(options.poolCapacity);
+            compiler.setConstexprSteps(options.constexprSteps);
+            bytecode = compiler.compile(program.get());
+        }
+        ScopedPass pass{options.timings, "run"};
+        ScopedSpan span{options.trace, "pass", "run"};
+        VirtualMachine machine{bytecode};
+        return machine.run();
+    }
+
+    bool parseInstrumentation(std::string const & modes, CompileOptions & options) {
+        options.isInstrumentingDispatch = false;
+        options.isInstrumentingCoverage = false;
+        std::stringstream list{modes};
+        std::string mode;
+        while (std::getline(list, mode, ',')) {
+            if (mode == "dispatch") {
+                options.isInstrumentingDispatch = true;
+            } else if (mode == "coverage") {
+                options.isInstrumentingCoverage = true;
+            } else if (mode != "none") {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    std::string describeInstrumentation(CompileOptions const & options) {
+        if (options.isInstrumentingDispatch && options.isInstrumentingCoverage) return "dispatch,coverage";
+        if (options.isInstrumentingDispatch) return "dispatch";
+        if (options.isInstrumentingCoverage) return "coverage";
+        return "none";
+    }
+
+    std::string describeError(std::exception const & error) {
+        if (auto * parseError = dynamic_cast<ParserError const *>(&error)) {
+            return STR("[error] " << parseError->what() << " in \"" << parseError->location().file() << "\""
+                << " at [" << parseError->location().line()
+                << ":" << parseError->location().col()
+                << "]");
+        }
+        return STR("[error] " << error.what());
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,91 @@
+#pragma once
+
+// standard
+#include <iostream>
+#include <string>
+#include <cstdint>
+#include <exception>
+
+namespace tinycplus {
+
+    class PassTimings;
+    class TraceRecorder;
+    class EmitStats;
+
+    /** What the typechecked program is emitted as (--emit).
+     */
+    enum class Backend {
+        TinyC, // classes lowered to TinyC structs and virtual tables, see Transpiler
+        Cpp,   // C++ with native classes and virtual methods, see CppEmitter
+    };
+
+    /** Options of a single TinyC+ compilation.
+        Shared by every mode of the program (single file, batch), so all of them produce the same output.
+     */
+    struct CompileOptions {
+        bool isParseOnly = false;
+        bool isPrintColorful = false;
+        Backend backend = Backend::TinyC;
+        /** Counts the receivers observed by every dynamic dispatch site of the output (--instrument=dispatch), TinyC backend only.
+         */
+        bool isInstrumentingDispatch = false;
+        /** Counts the entries of every function and the iterations of every loop of the output (--instrument=coverage), TinyC backend only.
+         */
+        bool isInstrumentingCoverage = false;
+        /** Receiver profile used to specialize the dispatch sites of the output (--profile-use), TinyC backend only.
+         */
+        std::string profileUsePath;
+        /** Precedes the functions and statements of the output by their TinyC+ lines (--line-markers), TinyC backend only.
+         */
+        bool isEmittingLineMarkers = false;
+        /** Number of instances in the arena of every pooled class (--pool-capacity).
+         */
+        int poolCapacity = 1024;
+        /** Number of steps one evaluation of a constexpr call may take before the call is left to the runtime (--constexpr-steps).
+         */
+        int constexprSteps = 100000;
+        /** Runs lexing and parsing, typechecking and emitting on threads of their own, passing the declarations on as they are done (--pipeline), see compileFileByDeclaration. The output stays the same.
+         */
+        bool isPipelined = false;
+        /** Releases the bodies of the declarations and their scopes once they are emitted, so that the memory grows with the declarations rather than with the code (--stream), see compileFileByDeclaration. The output stays the same.
+         */
+        bool isStreaming = false;
+        /** When set, the output lines of every function and their TinyC+ declarations are written into the file (--source-map), TinyC backend only.
+         */
+        std::string sourceMapPath;
+        /** When set, costs of the compiler passes are collected into it (--time-passes).
+         */
+        PassTimings * timings = nullptr;
+        /** When set, spans of the transpiler work are recorded into it (--trace).
+         */
+        TraceRecorder * trace = nullptr;
+        /** When set, the summary of the generated code is collected into it (--stats), TinyC backend only.
+         */
+        EmitStats * stats = nullptr;
+    };
+
+    /** Runs the whole TinyC+ pipeline (parse, typecheck, transpile) over one file and prints the result into the output.
+        Every call builds its own types and names contexts, thus calls are independent from each other.
+        Throws on any parse or type error.
+     */
+    void compileFile(std::string const & inputFilepath, std::ostream & output, CompileOptions const & options);
+
+    /** Compiles the file to bytecode and runs it (--run), returns the result of its entry.
+        Throws on any parse or type error, on programs the bytecode cannot express and on runtime traps, such as null accesses.
+     */
+    int64_t runFile(std::string const & inputFilepath, CompileOptions const & options);
+
+    /** Sets the instrumentation modes from a comma separated list (--instrument=dispatch,coverage), "none" clears them.
+        Returns false on unknown modes.
+     */
+    bool parseInstrumentation(std::string const & modes, CompileOptions & options);
+
+    /** Inverse of parseInstrumentation.
+     */
+    std::string describeInstrumentation(CompileOptions const & options);
+
+    /** Formats the error the same way for every mode of the program.
+     */
+    std::string describeError(std::exception const & error);
+
+} // namespace tinycplus
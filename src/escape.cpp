@@ -0,0 +1,436 @@
+// standard
+#include <algorithm>
+
+// internal
+#include "escape.h"
+#include "shared.h"
+
+namespace tinycplus {
+
+    namespace {
+        /** What a walk visits after the node, see ForEachNode.
+         */
+        enum class Next {
+            Children,
+            Arguments, // of the method called by the member only, its receiver is seen by the visitor
+            Nothing,
+        };
+
+        /** Appends the expressions and statements right under the node in the order they run, one virtual call per node.
+            Types, the names of declared variables and the names of fields and methods are not expressions and are skipped.
+         */
+        class ChildrenCollector : public ASTVisitor {
+        public:
+            ChildrenCollector(Next next, std::vector<AST *> & children):
+                next_{next},
+                children_{children} {
+            }
+
+            void collect(AST * ast) {
+                visitChild(ast);
+            }
+
+            void visit(AST * ast) override { }
+            void visit(ASTInteger * ast) override { }
+            void visit(ASTDouble * ast) override { }
+            void visit(ASTChar * ast) override { }
+            void visit(ASTString * ast) override { }
+            void visit(ASTIdentifier * ast) override { }
+            void visit(ASTType * ast) override { }
+            void visit(ASTPointerType * ast) override { }
+            void visit(ASTArrayType * ast) override { }
+            void visit(ASTNamedType * ast) override { }
+            void visit(ASTSequence * ast) override {
+                for (auto & it : ast->body) add(it);
+            }
+            void visit(ASTBlock * ast) override {
+                for (auto & it : ast->body) add(it);
+            }
+            void visit(ASTProgram * ast) override { }
+            void visit(ASTVarDecl * ast) override {
+                add(ast->value);
+            }
+            void visit(ASTFunDecl * ast) override { }
+            void visit(ASTFunPtrDecl * ast) override { }
+            void visit(ASTStructDecl * ast) override { }
+            void visit(ASTInterfaceDecl * ast) override { }
+            void visit(ASTClassDecl * ast) override { }
+            void visit(ASTIf * ast) override {
+                add(ast->cond);
+                add(ast->trueCase);
+                add(ast->falseCase);
+            }
+            void visit(ASTSwitch * ast) override {
+                add(ast->cond);
+                for (auto & it : ast->cases) add(it.second);
+                add(ast->defaultCase);
+            }
+            void visit(ASTWhile * ast) override {
+                add(ast->cond);
+                add(ast->body);
+            }
+            void visit(ASTDoWhile * ast) override {
+                add(ast->body);
+                add(ast->cond);
+            }
+            void visit(ASTFor * ast) override {
+                add(ast->init);
+                add(ast->cond);
+                add(ast->increment);
+                add(ast->body);
+            }
+            void visit(ASTBreak * ast) override { }
+            void visit(ASTContinue * ast) override { }
+            void visit(ASTReturn * ast) override {
+                add(ast->value);
+            }
+            void visit(ASTDelete * ast) override {
+                add(ast->target);
+            }
+            void visit(ASTBinaryOp * ast) override {
+                add(ast->left);
+                add(ast->right);
+            }
+            void visit(ASTAssignment * ast) override {
+                add(ast->lvalue);
+                add(ast->value);
+            }
+            void visit(ASTUnaryOp * ast) override {
+                add(ast->arg);
+            }
+            void visit(ASTUnaryPostOp * ast) override {
+                add(ast->arg);
+            }
+            void visit(ASTAddress * ast) override {
+                add(ast->target);
+            }
+            void visit(ASTDeref * ast) override {
+                add(ast->target);
+            }
+            void visit(ASTIndex * ast) override {
+                add(ast->base);
+                add(ast->index);
+            }
+            void visit(ASTMember * ast) override {
+                if (next_ != Next::Arguments) add(ast->base);
+                // * the method is named by the member, only its arguments are expressions
+                if (auto * call = ast->member->as<ASTCall>()) {
+                    for (auto & it : call->args) add(it);
+                }
+            }
+            void visit(ASTCall * ast) override {
+                if (ast->function->as<ASTNamedType>() == nullptr) add(ast->function);
+                for (auto & it : ast->args) add(it);
+            }
+            void visit(ASTNew * ast) override {
+                add(ast->constructor);
+            }
+            void visit(ASTCast * ast) override {
+                add(ast->value);
+            }
+
+        private:
+            template<typename T>
+            void add(std::unique_ptr<T> & child) {
+                if (child != nullptr) children_.push_back(child.get());
+            }
+
+            Next next_;
+            std::vector<AST *> & children_;
+        }; // tinycplus::ChildrenCollector
+
+        void CollectChildren(AST * ast, Next next, std::vector<AST *> & children) {
+            ChildrenCollector{next, children}.collect(ast);
+        }
+
+        /** Calls the visitor on the node and on those under it in the order they run, the visitor decides what is visited under each node.
+            The walk uses its own stack, nesting is not limited by the call stack.
+         */
+        template<typename VISITOR>
+        void ForEachNode(AST * ast, VISITOR && visitor) {
+            std::vector<AST *> pending{ast};
+            while (!pending.empty()) {
+                auto * node = pending.back();
+                pending.pop_back();
+                auto next = visitor(node);
+                if (next == Next::Nothing) continue;
+                auto size = pending.size();
+                CollectChildren(node, next, pending);
+                std::reverse(pending.begin() + size, pending.end());
+            }
+        }
+
+        bool Mentions(AST * ast, Symbol const & name) {
+            bool result = false;
+            ForEachNode(ast, [&](AST * node) {
+                auto * identifier = node->as<ASTIdentifier>();
+                if (identifier != nullptr && identifier->name == name) result = true;
+                return result ? Next::Nothing : Next::Children;
+            });
+            return result;
+        }
+
+        /** this or base, the receiver of the instance inside its methods.
+         */
+        bool IsInstanceReceiver(AST * ast) {
+            auto * identifier = ast->as<ASTIdentifier>();
+            return identifier != nullptr && (identifier->name == symbols::KwThis || identifier->name == symbols::KwBase);
+        }
+    } // anonymous namespace
+
+    void EscapeAnalysis::summarizeClass(ASTClassDecl * ast) {
+        auto * classType = ast->getType()->as<Type::Class>();
+        auto & constructors = constructors_[classType];
+        std::vector<ASTFunDecl *> functions;
+        for (auto & it : ast->constructors) {
+            constructors[it->getType()] = it.get();
+            if (it->body) functions.push_back(it.get());
+        }
+        for (auto & it : ast->methods) {
+            if (it->body) functions.push_back(it.get());
+        }
+        // * every function keeps "this" until its body shows otherwise, repeated until no summary changes, so that the methods calling each other are summarized too
+        for (auto * it : functions) {
+            keepsThis_[it] = true;
+        }
+        for (bool isChanged = true; isChanged; ) {
+            isChanged = false;
+            for (auto * it : functions) {
+                if (keepsThis_[it] && !isThisKept(it, classType)) {
+                    keepsThis_[it] = false;
+                    isChanged = true;
+                }
+            }
+        }
+        for (auto & it : ast->constructors) {
+            std::vector<ASTAssignment *> assignments;
+            if (isInlinable(it.get(), classType, assignments)) inlinable_.insert({it.get(), std::move(assignments)});
+        }
+    }
+
+    void EscapeAnalysis::analyzeFunction(ASTFunDecl * ast) {
+        forgetFunction();
+        if (ast == nullptr || ast->isGeneric() || !ast->body) return;
+        for (auto & it : ast->args) {
+            ++declarations_[it->name->name];
+        }
+        // * most functions declare no class instances and are not walked
+        if (!countDeclarations(ast->body.get())) return;
+        walk(ast->body.get());
+        for (auto & it : candidates_) {
+            auto & candidate = *it.second;
+            if (candidate.isEscaping) continue;
+            auto * constructor = candidate.instance.constructor;
+            candidate.instance.isScalarReplaced = !candidate.hasMethodCalls
+                && hasScalarFields(candidate.instance.classType)
+                && (constructor == nullptr || isInlined(constructor));
+            for (auto * use : candidate.uses) {
+                uses_[use] = &candidate.instance;
+            }
+        }
+    }
+
+    ASTFunDecl * EscapeAnalysis::findConstructor(Type::Class * classType, Type * constructorType) const {
+        auto constructors = constructors_.find(classType);
+        if (constructors == constructors_.end()) return nullptr;
+        auto it = constructors->second.find(constructorType);
+        return it != constructors->second.end() ? it->second : nullptr;
+    }
+
+    ASTFunDecl * EscapeAnalysis::findBaseConstructor(ASTFunDecl * constructor, Type::Class * classType) const {
+        if (!constructor->base.has_value() || classType->getBase() == nullptr) return nullptr;
+        return findConstructor(classType->getBase(), constructor->base->name->getType());
+    }
+
+    bool EscapeAnalysis::keepsThis(ASTFunDecl * function) const {
+        auto it = keepsThis_.find(function);
+        return it != keepsThis_.end() && it->second;
+    }
+
+    bool EscapeAnalysis::isThisKept(ASTFunDecl * function, Type::Class * classType) const {
+        if (function->isClassConstructor() && function->base.has_value()) {
+            auto * base = findBaseConstructor(function, classType);
+            if (base == nullptr || !keepsThis(base)) return false;
+        }
+        return isThisKeptIn(function->body.get());
+    }
+
+    bool EscapeAnalysis::isThisKeptIn(AST * ast) const {
+        bool result = true;
+        ForEachNode(ast, [&](AST * node) {
+            if (!result || IsInstanceReceiver(node)) {
+                result = false;
+                return Next::Nothing;
+            }
+            auto * member = node->as<ASTMember>();
+            if (member == nullptr || !IsInstanceReceiver(member->base.get())) return Next::Children;
+            auto * call = member->member->as<ASTCall>();
+            if (call == nullptr) return Next::Nothing; // field access
+            auto * receiverClass = member->base->getType()->unwrap<Type::Class>();
+            auto method = receiverClass != nullptr ? receiverClass->getMethodInfo(call->function->as<ASTIdentifier>()->name) : std::nullopt;
+            // * calls through this are dispatched by the vtable, those through base are bound statically
+            bool isDispatched = member->base->as<ASTIdentifier>()->name == symbols::KwThis && method.has_value() && method->ast->isVirtualized();
+            if (!method.has_value() || isDispatched || !keepsThis(method->ast)) result = false;
+            return result ? Next::Arguments : Next::Nothing;
+        });
+        return result;
+    }
+
+    bool EscapeAnalysis::isInlinable(ASTFunDecl * constructor, Type::Class * classType, std::vector<ASTAssignment *> & assignments) const {
+        if (!keepsThis(constructor)) return false;
+        if (constructor->base.has_value()) {
+            auto * base = findBaseConstructor(constructor, classType);
+            if (base == nullptr || !isInlined(base)) return false;
+            for (auto & it : constructor->base->args) {
+                if (!isArgumentExpression(it.get(), constructor)) return false;
+            }
+        }
+        return collectFieldAssignments(constructor->body.get(), constructor, assignments);
+    }
+
+    bool EscapeAnalysis::collectFieldAssignments(AST * ast, ASTFunDecl * constructor, std::vector<ASTAssignment *> & assignments) const {
+        // * blocks and the sequences of expression statements
+        if (auto * sequence = ast->as<ASTSequence>()) {
+            for (auto & it : sequence->body) {
+                if (!collectFieldAssignments(it.get(), constructor, assignments)) return false;
+            }
+            return true;
+        }
+        auto * assignment = ast->as<ASTAssignment>();
+        if (assignment == nullptr || assignment->op != Symbol::Assign) return false;
+        auto * field = assignment->lvalue->as<ASTMember>();
+        if (field == nullptr || !IsInstanceReceiver(field->base.get()) || field->member->as<ASTIdentifier>() == nullptr) return false;
+        if (!isArgumentExpression(assignment->value.get(), constructor)) return false;
+        assignments.push_back(assignment);
+        return true;
+    }
+
+    bool EscapeAnalysis::isArgumentExpression(AST * ast, ASTFunDecl * constructor) const {
+        bool result = true;
+        ForEachNode(ast, [&](AST * node) {
+            if (!result) return Next::Nothing;
+            if (node->as<ASTInteger>() || node->as<ASTDouble>() || node->as<ASTChar>() || node->as<ASTString>()) {
+                return Next::Nothing;
+            } else if (auto * identifier = node->as<ASTIdentifier>()) {
+                result = std::any_of(constructor->args.begin(), constructor->args.end(), [&](auto & it) {
+                    return it->name->name == identifier->name;
+                });
+                return Next::Nothing;
+            } else if (node->as<ASTBinaryOp>()) {
+                return Next::Children;
+            } else if (auto * unary = node->as<ASTUnaryOp>()) {
+                result = unary->op != Symbol::Inc && unary->op != Symbol::Dec;
+                return Next::Children;
+            } else if (node->as<ASTCast>() && !node->as<ASTClassCast>()) {
+                return Next::Children;
+            }
+            result = false;
+            return Next::Nothing;
+        });
+        return result;
+    }
+
+    bool EscapeAnalysis::hasScalarFields(Type::Class * classType) const {
+        std::vector<FieldInfo> fields;
+        classType->collectFieldsOrdered(fields);
+        if (fields.empty()) return false;
+        for (auto & it : fields) {
+            auto * varDecl = it.ast->as<ASTVarDecl>();
+            // * the variables are declared by the type of the field, views of interfaces are accessed through their own fields
+            if (varDecl == nullptr || varDecl->type->as<ASTArrayType>() != nullptr || it.type->unwrap<Type::Interface>() != nullptr) return false;
+        }
+        return true;
+    }
+
+    bool EscapeAnalysis::countDeclarations(AST * ast) {
+        bool hasInstances = false;
+        ForEachNode(ast, [&](AST * node) {
+            if (auto * varDecl = node->as<ASTVarDecl>()) {
+                ++declarations_[varDecl->name->name];
+                hasInstances = hasInstances || varDecl->getType()->as<Type::Class>() != nullptr;
+            }
+            return Next::Children;
+        });
+        return hasInstances;
+    }
+
+    void EscapeAnalysis::declare(ASTVarDecl * ast) {
+        auto name = ast->name->name;
+        // * names declared once in the function mean the instance wherever it is in scope
+        if (declarations_[name] != 1) return;
+        auto * classType = ast->getType()->as<Type::Class>();
+        auto * call = ast->value != nullptr ? ast->value->as<ASTCall>() : nullptr;
+        if (classType == nullptr || call == nullptr || call->function->as<ASTNamedType>() == nullptr || call->getType() != classType) return;
+        auto * constructorType = call->function->getType();
+        if (constructors_.find(classType) == constructors_.end()) return;
+        auto * constructor = findConstructor(classType, constructorType);
+        if (constructor == nullptr ? constructorType != classType->defaultConstructorFuncType : !keepsThis(constructor)) return;
+        if (Mentions(ast->value.get(), name)) return;
+        auto candidate = std::make_unique<Candidate>();
+        candidate->instance = LocalInstance{classType, call, constructor, false};
+        candidate->uses.push_back(ast->name.get());
+        candidates_[name] = std::move(candidate);
+    }
+
+    void EscapeAnalysis::walk(AST * ast) {
+        // * the statements of blocks are followed by the declaration of the variables they declare and the blocks by the end of their scope
+        enum class Step {
+            Visit,
+            Declare,
+            EndScope,
+        };
+        std::vector<std::pair<AST *, Step>> pending{{ast, Step::Visit}};
+        std::vector<AST *> children;
+        while (!pending.empty()) {
+            auto [node, step] = pending.back();
+            pending.pop_back();
+            if (step == Step::Declare) {
+                declare(node->as<ASTVarDecl>());
+                continue;
+            } else if (step == Step::EndScope) {
+                // * out of the block the names mean the globals again
+                for (auto & it : node->as<ASTBlock>()->body) {
+                    auto * varDecl = it->as<ASTVarDecl>();
+                    if (varDecl == nullptr) continue;
+                    if (auto candidate = candidates_.find(varDecl->name->name); candidate != candidates_.end()) candidate->second->isInScope = false;
+                }
+                continue;
+            }
+            auto next = Next::Children;
+            if (auto * block = node->as<ASTBlock>()) {
+                pending.emplace_back(block, Step::EndScope);
+                for (auto it = block->body.rbegin(); it != block->body.rend(); ++it) {
+                    if ((*it)->as<ASTVarDecl>()) pending.emplace_back(it->get(), Step::Declare);
+                    pending.emplace_back(it->get(), Step::Visit);
+                }
+                continue;
+            } else if (auto * identifier = node->as<ASTIdentifier>()) {
+                // * copied, assigned or its address taken
+                if (auto * candidate = findCandidate(identifier)) candidate->isEscaping = true;
+                continue;
+            } else if (auto * member = node->as<ASTMember>()) {
+                auto * receiver = member->base->as<ASTIdentifier>();
+                if (auto * candidate = receiver != nullptr ? findCandidate(receiver) : nullptr) {
+                    candidate->uses.push_back(receiver);
+                    auto * call = member->member->as<ASTCall>();
+                    if (call == nullptr) continue; // field access
+                    auto method = candidate->instance.classType->getMethodInfo(call->function->as<ASTIdentifier>()->name);
+                    candidate->hasMethodCalls = true;
+                    candidate->isEscaping |= !method.has_value() || !keepsThis(method->ast);
+                    next = Next::Arguments;
+                }
+            }
+            children.clear();
+            CollectChildren(node, next, children);
+            for (auto it = children.rbegin(); it != children.rend(); ++it) {
+                pending.emplace_back(*it, Step::Visit);
+            }
+        }
+    }
+
+    EscapeAnalysis::Candidate * EscapeAnalysis::findCandidate(ASTIdentifier * ast) {
+        auto it = candidates_.find(ast->name);
+        return it != candidates_.end() && it->second->isInScope ? it->second.get() : nullptr;
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,106 @@
+#pragma once
+
+// standard
+#include <memory>
+#include <vector>
+#include <unordered_map>
+
+// internal
+#include "ast.h"
+#include "types.h"
+
+namespace tinycplus {
+
+    /** Local class instance whose address never leaves the function, so that its class is known exactly.
+        It is declared in a block and made by a constructor of its own class, and its name is used only to access fields or call methods which keep "this" to themselves.
+     */
+    struct LocalInstance {
+        Type::Class * classType = nullptr;
+        ASTCall * constructorCall = nullptr;
+        ASTFunDecl * constructor = nullptr; // nullptr for the default constructor
+        /** Without method calls and with a constructor made of field assignments only, the fields become variables of their own and the instance does not exist at all.
+         */
+        bool isScalarReplaced = false;
+    };
+
+    /** Intraprocedural escape analysis of the local class instances, see LocalInstance.
+        Methods and constructors are summarized when their class is emitted: a method keeps "this" to itself when it uses it only to access fields and to call non-virtual methods which keep it to themselves as well. Such methods read neither the vtable nor the address of the instance, so the instances they are called on need no vtable pointer, and their virtual calls are bound to the methods of the known class.
+     */
+    class EscapeAnalysis {
+    public:
+        /** Summarizes the methods and constructors of the class. Must be called before their bodies are released (--stream), after the base class.
+         */
+        void summarizeClass(ASTClassDecl * ast);
+
+        /** Finds the non-escaping instances of the function and forgets those of the previous one. Nothing is found in generic functions.
+         */
+        void analyzeFunction(ASTFunDecl * ast);
+
+        /** Forgets the instances of the analyzed function once its body is printed, whose identifiers may be released (--stream).
+         */
+        void forgetFunction() {
+            declarations_.clear();
+            candidates_.clear();
+            uses_.clear();
+        }
+
+        /** The non-escaping instance declared or used by the identifier, nullptr for other identifiers.
+         */
+        LocalInstance const * find(ASTIdentifier * ast) const {
+            if (uses_.empty()) return nullptr;
+            auto it = uses_.find(ast);
+            return it != uses_.end() ? it->second : nullptr;
+        }
+
+        /** Whether the constructor is printed in place of the instances it makes, so that its body must be kept.
+         */
+        bool isInlined(ASTFunDecl * constructor) const {
+            return inlinable_.find(constructor) != inlinable_.end();
+        }
+
+        /** The field assignments making the body of the inlined constructor, in order.
+         */
+        std::vector<ASTAssignment *> const & getFieldAssignments(ASTFunDecl * constructor) const {
+            return inlinable_.at(constructor);
+        }
+
+        /** The constructor of the class called with the type, nullptr for the default constructor or one of a class not summarized.
+         */
+        ASTFunDecl * findConstructor(Type::Class * classType, Type * constructorType) const;
+
+        /** The constructor of the base class called by the constructor, nullptr when it calls none.
+         */
+        ASTFunDecl * findBaseConstructor(ASTFunDecl * constructor, Type::Class * classType) const;
+
+    private:
+        struct Candidate {
+            LocalInstance instance;
+            bool isInScope = true; // until the end of the block declaring it
+            bool isEscaping = false;
+            bool hasMethodCalls = false;
+            std::vector<ASTIdentifier *> uses;
+        };
+
+        bool keepsThis(ASTFunDecl * function) const;
+        bool isThisKept(ASTFunDecl * function, Type::Class * classType) const;
+        bool isThisKeptIn(AST * ast) const;
+        bool isInlinable(ASTFunDecl * constructor, Type::Class * classType, std::vector<ASTAssignment *> & assignments) const;
+        bool collectFieldAssignments(AST * ast, ASTFunDecl * constructor, std::vector<ASTAssignment *> & assignments) const;
+        bool isArgumentExpression(AST * ast, ASTFunDecl * constructor) const;
+        bool hasScalarFields(Type::Class * classType) const;
+
+        bool countDeclarations(AST * ast);
+        void declare(ASTVarDecl * ast);
+        void walk(AST * ast);
+        Candidate * findCandidate(ASTIdentifier * ast);
+
+        std::unordered_map<Type::Class *, std::unordered_map<Type *, ASTFunDecl *>> constructors_;
+        std::unordered_map<ASTFunDecl *, bool> keepsThis_; // summaries of methods and constructors
+        std::unordered_map<ASTFunDecl *, std::vector<ASTAssignment *>> inlinable_; // constructors made of field assignments only
+        // * of the analyzed function
+        std::unordered_map<Symbol, size_t> declarations_;
+        std::unordered_map<Symbol, std::unique_ptr<Candidate>> candidates_;
+        std::unordered_map<ASTIdentifier *, LocalInstance const *> uses_;
+    }; // tinycplus::EscapeAnalysis
+
+} // namespace tinycplus
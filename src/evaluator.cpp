@@ -0,0 +1,313 @@
+// standard
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+
+// internal
+#include "evaluator.h"
+
+namespace tinycplus {
+
+    namespace {
+        // * the output converts to C++ with 32-bit int and signed 8-bit char, see layout.h
+        constexpr int64_t IntMin = std::numeric_limits<int32_t>::min();
+        constexpr int64_t IntMax = std::numeric_limits<int32_t>::max();
+        constexpr int64_t CharMin = std::numeric_limits<int8_t>::min();
+        constexpr int64_t CharMax = std::numeric_limits<int8_t>::max();
+    } // anonymous namespace
+
+    std::optional<ConstantValue> ConstantEvaluator::evaluate(ASTCall * call) {
+        if (auto it = results_.find(call); it != results_.end()) {
+            return it->second;
+        }
+        std::optional<ConstantValue> result;
+        steps_ = 0;
+        try {
+            result = this->call(call);
+            if (isReal(result.value()) && !FormatReal(result->real).has_value()) {
+                result.reset();
+            }
+        } catch (GiveUp &) {
+            frames_.clear();
+        }
+        results_.insert({call, result});
+        return result;
+    }
+
+    std::optional<std::string> ConstantEvaluator::FormatReal(double value) {
+        if (!std::isfinite(value)) return std::nullopt;
+        std::string result;
+        for (int precision = 15; precision <= 17; ++precision) {
+            std::stringstream text;
+            text << std::setprecision(precision) << value;
+            result = text.str();
+            if (std::stod(result) == value) break;
+        }
+        if (result.find('e') != std::string::npos) return std::nullopt;
+        if (result.find('.') == std::string::npos) result += ".0";
+        return result;
+    }
+
+    std::string ConstantEvaluator::FormatLiteral(double value) {
+        auto shortest = FormatReal(value);
+        if (shortest.has_value() || !std::isfinite(value)) return shortest.value_or(STR(value));
+        // * as many decimals as the shortest significant digits which read back need
+        int exponent = static_cast<int>(std::floor(std::log10(std::abs(value))));
+        std::string result;
+        for (int precision = 15; precision <= 17; ++precision) {
+            std::stringstream text;
+            text << std::fixed << std::setprecision(std::max(1, precision - 1 - exponent)) << value;
+            result = text.str();
+            if (std::stod(result) == value) break;
+        }
+        result.erase(std::max(result.find_last_not_of('0'), result.find('.') + 1) + 1);
+        return result;
+    }
+
+    void ConstantEvaluator::step() {
+        if (++steps_ > stepBudget_) throw GiveUp{};
+    }
+
+    bool ConstantEvaluator::isReal(ConstantValue const & value) const {
+        return value.type == types_.getTypeDouble();
+    }
+
+    bool ConstantEvaluator::isTrue(ConstantValue const & value) const {
+        return isReal(value) ? value.real != 0 : value.integer != 0;
+    }
+
+    ConstantValue ConstantEvaluator::makeInteger(Type * type, int64_t value) const {
+        // * out of range results would wrap or be undefined at runtime
+        if (type == types_.getTypeChar() ? (value < CharMin || value > CharMax) : (value < IntMin || value > IntMax)) throw GiveUp{};
+        return ConstantValue{type, value, 0};
+    }
+
+    ConstantValue ConstantEvaluator::makeReal(double value) const {
+        if (!std::isfinite(value)) throw GiveUp{};
+        return ConstantValue{types_.getTypeDouble(), 0, value};
+    }
+
+    ConstantValue ConstantEvaluator::convert(ConstantValue const & value, Type * type) const {
+        if (type == types_.getTypeDouble()) {
+            return makeReal(isReal(value) ? value.real : static_cast<double>(value.integer));
+        }
+        if (type != types_.getTypeInt() && type != types_.getTypeChar()) throw GiveUp{};
+        if (isReal(value)) {
+            if (!(value.real > IntMin - 1.0 && value.real < IntMax + 1.0)) throw GiveUp{};
+            return makeInteger(type, static_cast<int64_t>(value.real));
+        }
+        return makeInteger(type, value.integer);
+    }
+
+    ConstantValue & ConstantEvaluator::variable(ASTIdentifier * ast) {
+        // * the arguments of the evaluated call are outside of any frame, so they cannot read variables
+        if (frames_.empty()) throw GiveUp{};
+        auto & scopes = frames_.back();
+        for (auto it = scopes.rbegin(); it != scopes.rend(); ++it) {
+            if (auto value = it->find(ast->name); value != it->end()) return value->second;
+        }
+        throw GiveUp{};
+    }
+
+    ConstantValue ConstantEvaluator::expression(AST * ast) {
+        step();
+        if (auto * integer = ast->as<ASTInteger>()) {
+            return makeInteger(types_.getTypeInt(), integer->value);
+        } else if (auto * real = ast->as<ASTDouble>()) {
+            return makeReal(real->value);
+        } else if (auto * character = ast->as<ASTChar>()) {
+            return makeInteger(types_.getTypeChar(), character->value);
+        } else if (auto * identifier = ast->as<ASTIdentifier>()) {
+            auto & value = variable(identifier);
+            if (value.type == nullptr) throw GiveUp{};
+            return value;
+        } else if (auto * binary = ast->as<ASTBinaryOp>()) {
+            return binaryOp(binary);
+        } else if (auto * unary = ast->as<ASTUnaryOp>()) {
+            return unaryOp(unary, unary->op, unary->arg.get(), false);
+        } else if (auto * postfix = ast->as<ASTUnaryPostOp>()) {
+            return unaryOp(postfix, postfix->op, postfix->arg.get(), true);
+        } else if (auto * assignment = ast->as<ASTAssignment>()) {
+            auto * target = assignment->lvalue->as<ASTIdentifier>();
+            if (target == nullptr) throw GiveUp{};
+            auto value = expression(assignment->value.get());
+            variable(target) = value;
+            return value;
+        } else if (auto * cast = ast->as<ASTCast>()) {
+            if (cast->as<ASTClassCast>() != nullptr) throw GiveUp{};
+            return convert(expression(cast->value.get()), cast->getType());
+        } else if (auto * call = ast->as<ASTCall>()) {
+            return this->call(call);
+        } else if (auto * sequence = ast->as<ASTSequence>()) {
+            ConstantValue result;
+            for (auto & it : sequence->body) {
+                result = expression(it.get());
+            }
+            if (result.type == nullptr) throw GiveUp{};
+            return result;
+        }
+        throw GiveUp{};
+    }
+
+    ConstantValue ConstantEvaluator::binaryOp(ASTBinaryOp * ast) {
+        auto & op = ast->op;
+        // * the logical operators do not evaluate their right operand when the left one decides
+        if (op == Symbol::And || op == Symbol::Or) {
+            bool left = isTrue(expression(ast->left.get()));
+            if (left == (op == Symbol::Or)) return makeInteger(types_.getTypeInt(), left);
+            return makeInteger(types_.getTypeInt(), isTrue(expression(ast->right.get())));
+        }
+        auto left = expression(ast->left.get());
+        auto right = expression(ast->right.get());
+        if (op == Symbol::Lt || op == Symbol::Lte || op == Symbol::Gt || op == Symbol::Gte || op == Symbol::Eq || op == Symbol::NEq) {
+            double l = isReal(left) ? left.real : static_cast<double>(left.integer);
+            double r = isReal(right) ? right.real : static_cast<double>(right.integer);
+            bool result = op == Symbol::Lt ? l < r
+                : op == Symbol::Lte ? l <= r
+                : op == Symbol::Gt ? l > r
+                : op == Symbol::Gte ? l >= r
+                : op == Symbol::Eq ? l == r
+                : l != r;
+            return makeInteger(types_.getTypeInt(), result);
+        }
+        auto * type = ast->getType();
+        if (type == types_.getTypeDouble()) {
+            double l = convert(left, type).real;
+            double r = convert(right, type).real;
+            if (op == Symbol::Add) return makeReal(l + r);
+            if (op == Symbol::Sub) return makeReal(l - r);
+            if (op == Symbol::Mul) return makeReal(l * r);
+            if (op == Symbol::Div && r != 0) return makeReal(l / r);
+            throw GiveUp{};
+        }
+        if (type != types_.getTypeInt() && type != types_.getTypeChar()) throw GiveUp{};
+        // * both operands fit 32 bits, so the 64-bit results are exact
+        int64_t l = left.integer;
+        int64_t r = right.integer;
+        if (op == Symbol::Add) return makeInteger(type, l + r);
+        if (op == Symbol::Sub) return makeInteger(type, l - r);
+        if (op == Symbol::Mul) return makeInteger(type, l * r);
+        if ((op == Symbol::Div || op == Symbol::Mod) && r != 0) return makeInteger(type, op == Symbol::Div ? l / r : l % r);
+        if ((op == Symbol::ShiftLeft || op == Symbol::ShiftRight) && l >= 0 && r >= 0 && r < 32) return makeInteger(type, op == Symbol::ShiftLeft ? l << r : l >> r);
+        if (op == Symbol::BitAnd) return makeInteger(type, l & r);
+        if (op == Symbol::BitOr) return makeInteger(type, l | r);
+        throw GiveUp{};
+    }
+
+    ConstantValue ConstantEvaluator::unaryOp(AST * ast, Symbol const & op, AST * arg, bool isPostfix) {
+        if (op == Symbol::Inc || op == Symbol::Dec) {
+            auto * target = arg->as<ASTIdentifier>();
+            if (target == nullptr) throw GiveUp{};
+            auto & value = variable(target);
+            if (value.type == nullptr) throw GiveUp{};
+            auto previous = value;
+            int delta = op == Symbol::Inc ? 1 : -1;
+            value = isReal(value) ? makeReal(value.real + delta) : makeInteger(value.type, value.integer + delta);
+            return isPostfix ? previous : value;
+        }
+        auto value = expression(arg);
+        if (op == Symbol::Add) return value;
+        if (op == Symbol::Sub) return isReal(value) ? makeReal(-value.real) : makeInteger(ast->getType(), -value.integer);
+        if (op == Symbol::Neg && !isReal(value)) return makeInteger(ast->getType(), ~value.integer);
+        if (op == Symbol::Not) return makeInteger(types_.getTypeInt(), !isTrue(value));
+        throw GiveUp{};
+    }
+
+    ConstantValue ConstantEvaluator::call(ASTCall * ast) {
+        auto * function = ast->constexprFunction;
+        if (function == nullptr || frames_.size() >= MaxCallDepth) throw GiveUp{};
+        // * the arguments are evaluated by the caller
+        Scope arguments;
+        for (size_t i = 0; i < ast->args.size(); ++i) {
+            arguments[function->args[i]->name->name] = expression(ast->args[i].get());
+        }
+        frames_.emplace_back();
+        frames_.back().push_back(std::move(arguments));
+        auto flow = statement(function->body.get());
+        frames_.pop_back();
+        // * falling off the end of a function returning a value is undefined
+        if (flow != Flow::Return) throw GiveUp{};
+        return convert(returned_, function->getType()->as<Type::Function>()->returnType());
+    }
+
+    ConstantEvaluator::Flow ConstantEvaluator::statement(AST * ast) {
+        step();
+        if (auto * sequence = ast->as<ASTBlock>()) {
+            return block(sequence);
+        } else if (auto * varDecl = ast->as<ASTVarDecl>()) {
+            if (varDecl->type->as<ASTArrayType>() != nullptr || !types_.isPOD(varDecl->getType())) throw GiveUp{};
+            ConstantValue value;
+            if (varDecl->value != nullptr) value = convert(expression(varDecl->value.get()), varDecl->getType());
+            frames_.back().back()[varDecl->name->name] = value;
+            return Flow::Next;
+        } else if (auto * ifStmt = ast->as<ASTIf>()) {
+            if (isTrue(expression(ifStmt->cond.get()))) return statement(ifStmt->trueCase.get());
+            if (ifStmt->falseCase != nullptr) return statement(ifStmt->falseCase.get());
+            return Flow::Next;
+        } else if (auto * switchStmt = ast->as<ASTSwitch>()) {
+            auto value = expression(switchStmt->cond.get());
+            auto matched = switchStmt->cases.find(static_cast<int>(value.integer));
+            auto * body = matched != switchStmt->cases.end() ? matched->second.get() : switchStmt->defaultCase.get();
+            if (body == nullptr) return Flow::Next;
+            auto flow = statement(body);
+            // * the cases are not kept in the source order, so falling through to the next one cannot be followed
+            if (flow == Flow::Next) throw GiveUp{};
+            return flow == Flow::Break ? Flow::Next : flow;
+        } else if (auto * whileStmt = ast->as<ASTWhile>()) {
+            while (isTrue(expression(whileStmt->cond.get()))) {
+                auto flow = loopBody(whileStmt->body.get());
+                if (flow == Flow::Break) break;
+                if (flow == Flow::Return) return flow;
+            }
+            return Flow::Next;
+        } else if (auto * doWhileStmt = ast->as<ASTDoWhile>()) {
+            do {
+                auto flow = loopBody(doWhileStmt->body.get());
+                if (flow == Flow::Break) break;
+                if (flow == Flow::Return) return flow;
+            } while (isTrue(expression(doWhileStmt->cond.get())));
+            return Flow::Next;
+        } else if (auto * forStmt = ast->as<ASTFor>()) {
+            frames_.back().emplace_back();
+            auto flow = Flow::Next;
+            if (forStmt->init != nullptr) statement(forStmt->init.get());
+            while (forStmt->cond == nullptr || isTrue(expression(forStmt->cond.get()))) {
+                flow = loopBody(forStmt->body.get());
+                if (flow == Flow::Break || flow == Flow::Return) break;
+                if (forStmt->increment != nullptr) expression(forStmt->increment.get());
+            }
+            frames_.back().pop_back();
+            return flow == Flow::Return ? flow : Flow::Next;
+        } else if (ast->as<ASTBreak>() != nullptr) {
+            return Flow::Break;
+        } else if (ast->as<ASTContinue>() != nullptr) {
+            return Flow::Continue;
+        } else if (auto * returnStmt = ast->as<ASTReturn>()) {
+            if (returnStmt->value == nullptr) throw GiveUp{};
+            returned_ = expression(returnStmt->value.get());
+            return Flow::Return;
+        }
+        expression(ast);
+        return Flow::Next;
+    }
+
+    ConstantEvaluator::Flow ConstantEvaluator::block(ASTSequence * ast) {
+        frames_.back().emplace_back();
+        auto flow = Flow::Next;
+        for (auto & it : ast->body) {
+            flow = statement(it.get());
+            if (flow != Flow::Next) break;
+        }
+        frames_.back().pop_back();
+        return flow;
+    }
+
+    ConstantEvaluator::Flow ConstantEvaluator::loopBody(AST * body) {
+        step();
+        auto flow = statement(body);
+        return flow == Flow::Continue ? Flow::Next : flow;
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,104 @@
+#pragma once
+
+// standard
+#include <optional>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+// internal
+#include "ast.h"
+#include "contexts.h"
+
+namespace tinycplus {
+
+    /** Value computed at compile time: int and char values are kept as integers, double values as reals.
+        Values without a type are variables declared without a value.
+     */
+    struct ConstantValue {
+        Type * type = nullptr;
+        int64_t integer = 0;
+        double real = 0;
+    };
+
+    /** Interprets the calls of constexpr functions with constant arguments, so that the backends print their results instead of the calls.
+        The arguments may be literals, operators on them and calls of constexpr functions. The evaluation gives up, and the call stays a call at runtime, on anything it cannot do at compile time exactly the way the output would do it at runtime: pointers, strings, division by zero, values out of the range of the C++ the output converts to, recursion deeper than MaxCallDepth or more steps than the budget.
+     */
+    class ConstantEvaluator {
+    public:
+        static constexpr size_t MaxCallDepth = 256;
+
+        ConstantEvaluator(TypesContext & types)
+            :types_{types}
+        { }
+
+        /** Number of expressions and statements one evaluation may go through (--constexpr-steps).
+         */
+        void setStepBudget(size_t budget) {
+            stepBudget_ = budget;
+        }
+
+        /** Value of the call, none when it cannot be computed at compile time. Every call has the whole budget and its result is remembered.
+         */
+        std::optional<ConstantValue> evaluate(ASTCall * call);
+
+        /** Forgets the remembered results, so that their calls can be released (--stream).
+         */
+        void forgetResults() {
+            results_.clear();
+        }
+
+        /** Shortest literal reading back as the value, none when it would need an exponent, which TinyC literals do not have.
+         */
+        static std::optional<std::string> FormatReal(double value);
+
+        /** Literal of a source double, in fixed notation when the shortest one would need an exponent, always with a decimal point so that it stays a double in the output.
+         */
+        static std::string FormatLiteral(double value);
+
+        /** Whether the char can be printed between quotes as it is, without an escape sequence.
+         */
+        static bool IsPrintableChar(int64_t value) {
+            return value >= ' ' && value <= '~' && value != '\'' && value != '\\';
+        }
+
+    private:
+        enum class Flow {
+            Next,
+            Break,
+            Continue,
+            Return,
+        };
+
+        /** Unwinds the evaluation which gave up.
+         */
+        struct GiveUp { };
+
+        using Scope = std::unordered_map<Symbol, ConstantValue>;
+
+        void step();
+        bool isReal(ConstantValue const & value) const;
+        bool isTrue(ConstantValue const & value) const;
+        ConstantValue makeInteger(Type * type, int64_t value) const;
+        ConstantValue makeReal(double value) const;
+        ConstantValue convert(ConstantValue const & value, Type * type) const;
+        ConstantValue & variable(ASTIdentifier * ast);
+
+        ConstantValue expression(AST * ast);
+        ConstantValue binaryOp(ASTBinaryOp * ast);
+        ConstantValue unaryOp(AST * ast, Symbol const & op, AST * arg, bool isPostfix);
+        ConstantValue call(ASTCall * ast);
+        Flow statement(AST * ast);
+        Flow block(ASTSequence * ast);
+        Flow loopBody(AST * body);
+
+        TypesContext & types_;
+        size_t stepBudget_ = 100000;
+        size_t steps_ = 0;
+        std::vector<std::vector<Scope>> frames_; // scopes of the constexpr functions being evaluated, innermost last
+        ConstantValue returned_; // value of the last return
+        std::unordered_map<ASTCall *, std::optional<ConstantValue>> results_;
+    }; // tinycplus::ConstantEvaluator
+
+} // namespace tinycplus
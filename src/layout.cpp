@@ -0,0 +1,131 @@
+// standard
+#include <algorithm>
+
+// internal
+#include "layout.h"
+
+namespace tinycplus {
+
+    namespace {
+        constexpr size_t PointerSize = 8;
+
+        size_t AlignUp(size_t offset, size_t align) {
+            return (offset + align - 1) / align * align;
+        }
+    } // anonymous namespace
+
+    TypeLayout computeTypeLayout(Type * type) {
+        if (type->isPointer() || type->as<Type::Function>() != nullptr) {
+            return TypeLayout{PointerSize, PointerSize};
+        }
+        if (auto * alias = type->as<Type::Alias>()) {
+            return computeTypeLayout(alias->base());
+        }
+        if (type->as<Type::Interface>() != nullptr) {
+            // interface values are views: the target and its impl
+            return TypeLayout{2 * PointerSize, PointerSize};
+        }
+        if (auto * classType = type->as<Type::Class>()) {
+            auto layout = computeClassLayout(classType);
+            return TypeLayout{layout.size, layout.align};
+        }
+        if (auto * complex = type->as<Type::Complex>()) {
+            std::vector<FieldInfo> fields;
+            complex->collectFieldsOrdered(fields);
+            auto layout = computeRecordLayout(fields, false);
+            return TypeLayout{layout.size, layout.align};
+        }
+        auto name = type->toString();
+        if (name == "char") return TypeLayout{1, 1};
+        if (name == "int") return TypeLayout{4, 4};
+        if (name == "double") return TypeLayout{8, 8};
+        return TypeLayout{};
+    }
+
+    TypeLayout computeFieldLayout(FieldInfo const & field) {
+        auto * varDecl = field.ast != nullptr ? field.ast->as<ASTVarDecl>() : nullptr;
+        auto * arrayType = varDecl != nullptr ? varDecl->type->as<ASTArrayType>() : nullptr;
+        auto * size = arrayType != nullptr ? arrayType->size->as<ASTInteger>() : nullptr;
+        if (size != nullptr) {
+            auto element = computeTypeLayout(field.type->as<Type::Pointer>()->base());
+            return TypeLayout{element.size * static_cast<size_t>(size->value), element.align};
+        }
+        return computeTypeLayout(field.type);
+    }
+
+    RecordLayout computeRecordLayout(std::vector<FieldInfo> const & fields, bool hasVTable) {
+        RecordLayout result;
+        size_t offset = 0;
+        size_t usedBytes = 0;
+        if (hasVTable) {
+            offset = usedBytes = PointerSize;
+            result.align = PointerSize;
+        }
+        for (auto & field : fields) {
+            auto layout = computeFieldLayout(field);
+            offset = AlignUp(offset, layout.align) + layout.size;
+            usedBytes += layout.size;
+            result.align = std::max(result.align, layout.align);
+        }
+        // C++ gives empty structs a byte
+        result.size = std::max<size_t>(AlignUp(offset, result.align), 1);
+        result.paddingBytes = result.size - usedBytes;
+        return result;
+    }
+
+    RecordLayout computeClassLayout(Type::Class * classType, bool asDeclared) {
+        std::vector<FieldInfo> fields;
+        if (asDeclared) {
+            classType->collectFieldsDeclared(fields);
+        } else {
+            classType->collectFieldsOrdered(fields);
+        }
+        return computeRecordLayout(fields, true);
+    }
+
+    std::vector<Symbol> computeCompactOrder(Type::Class * classType) {
+        // * own fields follow the last inherited field, not the rounded size of the base
+        std::vector<FieldInfo> inherited;
+        if (classType->getBase() != nullptr) {
+            classType->getBase()->collectFieldsOrdered(inherited);
+        }
+        size_t offset = PointerSize;
+        for (auto & field : inherited) {
+            auto layout = computeFieldLayout(field);
+            offset = AlignUp(offset, layout.align) + layout.size;
+        }
+        std::vector<FieldInfo> declared;
+        classType->Type::Complex::collectFieldsOrdered(declared);
+        std::vector<std::pair<FieldInfo, TypeLayout>> remaining;
+        for (auto & it : declared) {
+            remaining.emplace_back(it, computeFieldLayout(it));
+        }
+        // * greedy: the field which needs the least padding at the current offset, the most aligned one among those
+        std::vector<FieldInfo> compact;
+        while (!remaining.empty()) {
+            auto best = remaining.begin();
+            for (auto it = remaining.begin(); it != remaining.end(); ++it) {
+                auto padding = AlignUp(offset, it->second.align) - offset;
+                auto bestPadding = AlignUp(offset, best->second.align) - offset;
+                if (padding < bestPadding || (padding == bestPadding && it->second.align > best->second.align)) {
+                    best = it;
+                }
+            }
+            offset = AlignUp(offset, best->second.align) + best->second.size;
+            compact.push_back(best->first);
+            remaining.erase(best);
+        }
+        // * the declared order is kept unless the compact one is smaller
+        inherited.insert(inherited.end(), declared.begin(), declared.end());
+        auto declaredSize = computeRecordLayout(inherited, true).size;
+        inherited.resize(inherited.size() - declared.size());
+        inherited.insert(inherited.end(), compact.begin(), compact.end());
+        auto & result = computeRecordLayout(inherited, true).size < declaredSize ? compact : declared;
+        std::vector<Symbol> order;
+        for (auto & it : result) {
+            order.push_back(it.name);
+        }
+        return order;
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,47 @@
+#pragma once
+
+// standard
+#include <vector>
+#include <cstddef>
+
+// internal
+#include "types.h"
+
+namespace tinycplus {
+
+    /** Size and alignment of a type in the C++ the output converts to (--tinyc-to-cpp), assuming a 64-bit host: char 1, int 4, double 8 and pointers 8 bytes.
+     */
+    struct TypeLayout {
+        size_t size = 0;
+        size_t align = 1;
+    };
+
+    /** Layout of a struct or class instance.
+     */
+    struct RecordLayout {
+        size_t size = 0;
+        size_t align = 1;
+        size_t paddingBytes = 0; // between the fields and at the end
+    };
+
+    TypeLayout computeTypeLayout(Type * type);
+
+    /** Arrays take their statically known size from the declaration of the field, their type is a pointer.
+     */
+    TypeLayout computeFieldLayout(FieldInfo const & field);
+
+    /** Places the fields in the given order, classes start with their vtable pointer.
+     */
+    RecordLayout computeRecordLayout(std::vector<FieldInfo> const & fields, bool hasVTable);
+
+    /** Layout of the instance struct the transpiler emits for the class, see Type::Class::collectFieldsOrdered.
+        With asDeclared the fields keep the declaration order even in the compact classes.
+     */
+    RecordLayout computeClassLayout(Type::Class * classType, bool asDeclared = false);
+
+    /** Own fields of the class ordered for less padding after the inherited ones. Each next field is the one needing the least padding, the most aligned among those, ties keep the declaration order.
+        Returns the declaration order when the reordering does not shrink the instance.
+     */
+    std::vector<Symbol> computeCompactOrder(Type::Class * classType);
+
+} // namespace tinycplus
@@ -2,28 +2,58 @@
 #include <iostream>
 #include <string>
 #include <filesystem>
+#include <chrono>
+#include <thread>
+#include <fstream>
 
 // external
 #include "common/config.h"
 
 // internal
 #include "shared.h"
-#include "parser.h"
-#include "transpiler.h"
-#include "typechecker.h"
+#include "driver.h"
+#include "batch.h"
+#include "server.h"
+#include "profiling.h"
+#include "tracing.h"
+#include "stats.h"
 #include "tinyc_to_cpp_converter.h"
 
 namespace program_errors {
     const std::string no_input = "[E1] input filepath is not given";
+    const std::string no_batch_inputs = "[E2] batch mode was requested, but no inputs were given";
+    const std::string unknown_backend = "[E3] unknown --emit value, expected tinyc or cpp";
+    const std::string unknown_instrumentation = "[E4] unknown --instrument value, expected comma separated dispatch and coverage";
+    const std::string client_source_map = "[E5] --source-map is not available together with --client";
+    const std::string invalid_pool_capacity = "[E6] --pool-capacity expects a positive number of objects";
+    const std::string invalid_constexpr_steps = "[E7] --constexpr-steps expects a positive number of steps";
+    const std::string run_with_other_mode = "[E8] --run is not available together with --batch, --serve, --client, --tinyc-to-cpp or --parse-only";
+    const std::string pipeline_with_other_mode = "[E9] --pipeline and --stream are not available together with --run, --tinyc-to-cpp or --parse-only";
 }
 
-// declaration for extern Entry
-tiny::Symbol tinycplus::symbols::Entry = tinycplus::symbols::Main;
-
 const std::string keyColorful = "--colorful";
 const std::string keyEntry = "--entry";
 const std::string keyTinyCtoCpp = "--tinyc-to-cpp"; 
 const std::string keyParseOnly = "--parse-only";
+const std::string keyEmit = "--emit";
+const std::string keyInstrument = "--instrument";
+const std::string keyProfileUse = "--profile-use";
+const std::string keyLineMarkers = "--line-markers";
+const std::string keySourceMap = "--source-map";
+const std::string keyPoolCapacity = "--pool-capacity";
+const std::string keyConstexprSteps = "--constexpr-steps";
+const std::string keyBatch = "--batch";
+const std::string keyJobs = "--jobs";
+const std::string keyOutputDir = "--output-dir";
+const std::string keyServe = "--serve";
+const std::string keyClient = "--client";
+const std::string keyStopServer = "--stop-server";
+const std::string keyTimePasses = "--time-passes";
+const std::string keyTrace = "--trace";
+const std::string keyStats = "--stats";
+const std::string keyRun = "--run";
+const std::string keyPipeline = "--pipeline";
+const std::string keyStream = "--stream";
 
 void checkForHelpRequest(int argc, char** argv) {
     const std::string tab {"    "};
@@ -44,11 +74,137 @@ void checkForHelpRequest(int argc, char** argv) {
             std::cerr << tab << keyTinyCtoCpp << " -> "
                 << "asks program to treat input file as tinyC file and convert it to general C++ file."
                 << std::endl;
+            std::cerr << tab << keyEmit << " -> "
+                << "output of the program: [tinyc] (default) lowers classes to TinyC, [cpp] emits C++ with native classes and virtual methods."
+                << std::endl;
+            std::cerr << tab << keyInstrument << " -> "
+                << "comma separated: [dispatch] counts the receivers observed by each virtual call, interface call and dynamic classcast, [coverage] counts function entries and loop iterations of the TinyC output."
+                << std::endl;
+            std::cerr << tab << keyProfileUse << " -> "
+                << "receiver profile file: calls dominated by one or two classes call them directly behind a check, hot interface casts cache their impl, function entries order the emitted functions from hot to cold."
+                << std::endl;
+            std::cerr << tab << keyLineMarkers << " -> "
+                << "precedes every function and statement of the TinyC output by a \"// #line\" comment with its TinyC+ location, " << keyTinyCtoCpp << " turns them into #line directives."
+                << std::endl;
+            std::cerr << tab << keySourceMap << " -> "
+                << "writes the output lines of every emitted function with its symbol and TinyC+ location into the given file; batch mode writes \"<output>.map\" next to each output."
+                << std::endl;
+            std::cerr << tab << keyPoolCapacity << " -> "
+                << "number of instances in the arena of every pooled class (default: 1024), new of a class with a full arena yields null."
+                << std::endl;
+            std::cerr << tab << keyConstexprSteps << " -> "
+                << "number of expressions and statements the evaluation of one constexpr call may go through (default: 100000), calls over it are left to the runtime."
+                << std::endl;
+            std::cerr << tab << keyBatch << " -> "
+                << "transpiles many files in one process: comma separated filepaths or \"@file\" with one filepath per line."
+                << std::endl;
+            std::cerr << tab << keyJobs << " -> "
+                << "number of threads used by batch mode (default: number of hardware threads)."
+                << std::endl;
+            std::cerr << tab << keyOutputDir << " -> "
+                << "directory for outputs of batch mode (default: next to each input)."
+                << std::endl;
+            std::cerr << tab << keyServe << " -> "
+                << "starts a persistent transpiler listening on the given unix socket path."
+                << std::endl;
+            std::cerr << tab << keyClient << " -> "
+                << "sends the input to the transpiler listening on the given unix socket path and prints its output."
+                << std::endl;
+            std::cerr << tab << keyStopServer << " -> "
+                << "together with " << keyClient << " asks the listening transpiler to stop."
+                << std::endl;
+            std::cerr << tab << keyTimePasses << " -> "
+                << "reports wall and cpu time, allocations and peak memory of each compiler pass to stderr; [json] switches the report to JSON."
+                << std::endl;
+            std::cerr << tab << keyTrace << " -> "
+                << "writes Chrome trace events of the transpiler work (per declaration and per class) into the given file."
+                << std::endl;
+            std::cerr << tab << keyStats << " -> "
+                << "reports classes, vtable slots, interface tables, instance layouts, bytes per class and function, call sites and class casts of the TinyC output to stderr; [json] switches the report to JSON."
+                << std::endl;
+            std::cerr << tab << keyRun << " -> "
+                << "runs the program on the bytecode interpreter instead of printing its output, the exit code is the result of the entry; null accesses, division by zero and other undefined behaviour stop it with an error."
+                << std::endl;
+            std::cerr << tab << keyPipeline << " -> "
+                << "lexes and parses, typechecks and emits on three threads, each declaration moves on as soon as it is done; the output is the same. TinyC output only, without instrumentation, profiles, source maps and stats."
+                << std::endl;
+            std::cerr << tab << keyStream << " -> "
+                << "checks and emits each declaration as soon as it is parsed and releases the function bodies once they are emitted, so that the memory grows with the declarations rather than with the code; the output is the same. Combines with " << keyPipeline << ", same limits."
+                << std::endl;
             exit(EXIT_SUCCESS);
         }
     }
 }
 
+void runBatch(tinycplus::CompileOptions const & options) {
+    auto inputs = tinycplus::BatchCompiler::ParseInputList(tiny::config.get(keyBatch));
+    if (inputs.empty()) {
+        throw std::runtime_error(program_errors::no_batch_inputs);
+    }
+    tiny::config.setDefaultIfMissing(keyJobs, std::to_string(std::thread::hardware_concurrency()));
+    tiny::config.setDefaultIfMissing(keyOutputDir, "");
+    auto threadsCount = static_cast<size_t>(std::stoul(tiny::config.get(keyJobs)));
+    tinycplus::BatchCompiler compiler{options, threadsCount, tiny::config.get(keyOutputDir)};
+    auto start = std::chrono::steady_clock::now();
+    auto reports = compiler.run(inputs);
+    auto end = std::chrono::steady_clock::now();
+    tinycplus::BatchCompiler::PrintReports(std::cerr, reports, std::chrono::duration<double, std::milli>(end - start).count());
+    for (auto & report : reports) {
+        if (!report.isSuccess) exit(EXIT_FAILURE);
+    }
+}
+
+void runClient(tinycplus::CompileOptions const & options, bool isStopRequest) {
+    tinycplus::TranspileRequest request;
+    request.options = options;
+    request.entry = tiny::config.get(keyEntry);
+    if (isStopRequest) {
+        request.command = "stop";
+    } else {
+        auto inputFilepath = tiny::config.input();
+        if (!std::filesystem::exists(inputFilepath)) {
+            throw std::runtime_error(program_errors::no_input);
+        }
+        // the server may run in a different working directory
+        request.inputFilepath = std::filesystem::absolute(inputFilepath).string();
+        if (!options.profileUsePath.empty()) {
+            request.options.profileUsePath = std::filesystem::absolute(options.profileUsePath).string();
+        }
+    }
+    auto response = tinycplus::sendTranspileRequest(tiny::config.get(keyClient), request);
+    auto statusEnd = response.find('\n');
+    auto status = response.substr(0, statusEnd);
+    auto payload = statusEnd == std::string::npos ? std::string{} : response.substr(statusEnd + 1);
+    if (status.rfind("ok", 0) != 0) {
+        std::cerr << "\n" << payload;
+        exit(EXIT_FAILURE);
+    }
+    std::cout << payload;
+}
+
+void writeTrace(tinycplus::TraceRecorder & trace) {
+    std::ofstream output{tiny::config.get(keyTrace)};
+    if (!output) {
+        std::cerr << "[error] cannot write trace into " << tiny::config.get(keyTrace) << "\n";
+        return;
+    }
+    trace.writeJson(output);
+}
+
+int parsePositiveNumber(std::string const & value, std::string const & error) {
+    size_t end = 0;
+    int number = 0;
+    try {
+        number = std::stoi(value, &end);
+    } catch (std::exception &) {
+        throw std::runtime_error(error);
+    }
+    if (end != value.size() || number <= 0) {
+        throw std::runtime_error(error);
+    }
+    return number;
+}
+
 // #include <signal.h>
 // void handle_os_signal(int code) {
 //     std::cerr << "[OS] interrupt code: " << code << std::endl;
@@ -58,14 +214,85 @@ void main(int argc, char ** argv) {
     checkForHelpRequest(argc, argv);
     tiny::config.parse(argc, argv);
     // flags check
-    auto inputFilepath = tiny::config.input();
-    bool isParseOnly = !tiny::config.setDefaultIfMissing(keyParseOnly, "");
-    bool isPrintColorful = !tiny::config.setDefaultIfMissing(keyColorful, "");
+    tinycplus::CompileOptions options;
+    options.isParseOnly = !tiny::config.setDefaultIfMissing(keyParseOnly, "");
+    options.isPrintColorful = !tiny::config.setDefaultIfMissing(keyColorful, "");
+    tiny::config.setDefaultIfMissing(keyEmit, "tinyc");
+    if (tiny::config.get(keyEmit) == "cpp") {
+        options.backend = tinycplus::Backend::Cpp;
+    } else if (tiny::config.get(keyEmit) != "tinyc") {
+        throw std::runtime_error(program_errors::unknown_backend);
+    }
+    tiny::config.setDefaultIfMissing(keyInstrument, "none");
+    if (!tinycplus::parseInstrumentation(tiny::config.get(keyInstrument), options)) {
+        throw std::runtime_error(program_errors::unknown_instrumentation);
+    }
+    tiny::config.setDefaultIfMissing(keyProfileUse, "");
+    options.profileUsePath = tiny::config.get(keyProfileUse);
+    options.isEmittingLineMarkers = !tiny::config.setDefaultIfMissing(keyLineMarkers, "");
+    tiny::config.setDefaultIfMissing(keySourceMap, "");
+    options.sourceMapPath = tiny::config.get(keySourceMap);
+    tiny::config.setDefaultIfMissing(keyPoolCapacity, "1024");
+    options.poolCapacity = parsePositiveNumber(tiny::config.get(keyPoolCapacity), program_errors::invalid_pool_capacity);
+    tiny::config.setDefaultIfMissing(keyConstexprSteps, "100000");
+    options.constexprSteps = parsePositiveNumber(tiny::config.get(keyConstexprSteps), program_errors::invalid_constexpr_steps);
     bool isConvertingTinycToCPP = !tiny::config.setDefaultIfMissing(keyTinyCtoCpp, "");
+    bool isBatch = !tiny::config.setDefaultIfMissing(keyBatch, "");
+    bool isServe = !tiny::config.setDefaultIfMissing(keyServe, "");
+    bool isClient = !tiny::config.setDefaultIfMissing(keyClient, "");
+    bool isStopServer = !tiny::config.setDefaultIfMissing(keyStopServer, "");
+    bool isTracing = !tiny::config.setDefaultIfMissing(keyTrace, "");
+    bool isRunning = !tiny::config.setDefaultIfMissing(keyRun, "");
+    if (isRunning && (isBatch || isServe || isClient || isConvertingTinycToCPP || options.isParseOnly)) {
+        throw std::runtime_error(program_errors::run_with_other_mode);
+    }
+    options.isPipelined = !tiny::config.setDefaultIfMissing(keyPipeline, "");
+    options.isStreaming = !tiny::config.setDefaultIfMissing(keyStream, "");
+    if ((options.isPipelined || options.isStreaming) && (isRunning || isConvertingTinycToCPP || options.isParseOnly)) {
+        throw std::runtime_error(program_errors::pipeline_with_other_mode);
+    }
+    tinycplus::TraceRecorder trace;
+    if (isTracing) {
+        options.trace = &trace;
+    }
     // entry check
     tiny::config.setDefaultIfMissing(keyEntry, tinycplus::symbols::Main.name());
     tinycplus::symbols::Entry = tiny::Symbol{tiny::config.get(keyEntry)};
+    if (isServe) {
+        try {
+            tinycplus::TranspileServer server{tiny::config.get(keyServe)};
+            server.run();
+        } catch (std::exception & exception) {
+            std::cerr << "\n" << tinycplus::describeError(exception) << "\n";
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    if (isClient) {
+        try {
+            if (!options.sourceMapPath.empty()) {
+                throw std::runtime_error(program_errors::client_source_map);
+            }
+            runClient(options, isStopServer);
+        } catch (std::exception & exception) {
+            std::cerr << "\n" << tinycplus::describeError(exception) << "\n";
+            exit(EXIT_FAILURE);
+        }
+        return;
+    }
+    if (isBatch) {
+        try {
+            runBatch(options);
+        } catch (std::exception & exception) {
+            std::cerr << "\n" << tinycplus::describeError(exception) << "\n";
+            if (isTracing) writeTrace(trace);
+            exit(EXIT_FAILURE);
+        }
+        if (isTracing) writeTrace(trace);
+        return;
+    }
     // file check
+    auto inputFilepath = tiny::config.input();
     if (!std::filesystem::exists(inputFilepath)) {
         throw std::runtime_error(program_errors::no_input);
     }
@@ -74,26 +301,45 @@ void main(int argc, char ** argv) {
         tinycToCpp::execute(inputFilepath);
         return;
     }
+    bool isTimingPasses = !tiny::config.setDefaultIfMissing(keyTimePasses, "");
+    tinycplus::PassTimings timings;
+    if (isTimingPasses) {
+        options.timings = &timings;
+    }
+    bool isReportingStats = !tiny::config.setDefaultIfMissing(keyStats, "");
+    tinycplus::EmitStats stats;
+    if (isReportingStats) {
+        options.stats = &stats;
+    }
+    int exitCode = EXIT_SUCCESS;
     try {
-        tinycplus::TypesContext typesContext{};
-        tinycplus::NamesContext namesContext{typesContext.getTypeVoid()};
-        tinycplus::TypeChecker typechecker{typesContext, namesContext};
-        tinycplus::Transpiler transpiler{namesContext, typesContext, std::cout, isPrintColorful};
-        auto program = tinycplus::Parser::ParseFile(inputFilepath);
-        if (isParseOnly) {
-            tiny::ASTPrettyPrinter printer {std::cout};
-            program->print(printer);
-            return;
+        if (isRunning) {
+            exitCode = static_cast<int>(tinycplus::runFile(inputFilepath, options));
+        } else {
+            tinycplus::compileFile(inputFilepath, std::cout, options);
         }
-        typechecker.visit(program.get());
-        transpiler.visit(program.get());
-        transpiler.validateSelf();
-    } catch (tiny::ParserError & parseError) {
-        std::cerr << "\n[error] " << parseError.what() << " in \""<< parseError.location().file() << "\"" 
-            << " at [" << parseError.location().line() 
-            << ":" << parseError.location().col() 
-            << "]\n";
     } catch (std::exception & exception) {
-        std::cerr << "\n[error] " << exception.what() << "\n";
+        std::cerr << "\n" << tinycplus::describeError(exception) << "\n";
+        if (isRunning) exitCode = EXIT_FAILURE;
+    }
+    if (isTracing) {
+        writeTrace(trace);
+    }
+    if (isTimingPasses) {
+        if (tiny::config.get(keyTimePasses) == "json") {
+            timings.printJson(std::cerr);
+        } else {
+            timings.printText(std::cerr);
+        }
     }
-}
\ No newline at end of file
+    if (isReportingStats) {
+        if (tiny::config.get(keyStats) == "json") {
+            stats.printJson(std::cerr);
+        } else {
+            stats.printText(std::cerr);
+        }
+    }
+    if (exitCode != EXIT_SUCCESS) {
+        exit(exitCode);
+    }
+}
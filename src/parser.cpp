@@ -49,22 +49,36 @@ namespace tinycplus {
         }
     }
 
-    /* PROGRAM := { FUN_DECL | VAR_DECLS ';' | STRUCT_DECL | FUNPTR_DECL }
+    /* PROGRAM := { FUN_DECL | GENERIC_FUN_DECL | CONSTEXPR_FUN_DECL | VAR_DECLS ';' | STRUCT_DECL | FUNPTR_DECL }
         TODO the simple try & fail & try something else produces ugly error messages.
         */
     std::unique_ptr<AST> Parser::PROGRAM() {
         std::unique_ptr<ASTProgram> result{new ASTProgram{top()}};
         while (! eof()) {
-            if (top() == Symbol::KwStruct) {
-                result->body.push_back(STRUCT_DECL());
-            } else if (top() == symbols::KwClass) {
-                result->body.push_back(CLASS_DECL());
-            } else if (top() == symbols::KwInterface) {
-                result->body.push_back(INTERFACE_DECL());
-            } else if (top() == Symbol::KwTypedef) {
-                result->body.push_back(FUNPTR_DECL());
+            std::unique_ptr<AST> declaration;
+            {
+                ScopedSpan span{trace_, "parse"};
+                if (top() == Symbol::KwStruct) {
+                    declaration = STRUCT_DECL();
+                } else if (top() == symbols::KwClass) {
+                    declaration = CLASS_DECL();
+                } else if (top() == symbols::KwInterface) {
+                    declaration = INTERFACE_DECL();
+                } else if (top() == Symbol::KwTypedef) {
+                    declaration = FUNPTR_DECL();
+                } else if (top() == symbols::KwTemplate) {
+                    declaration = GENERIC_FUN_DECL();
+                } else if (top() == symbols::KwConstexpr) {
+                    declaration = CONSTEXPR_FUN_DECL();
+                } else {
+                    declaration = FUN_OR_VAR_DECL(std::nullopt);
+                }
+                if (span.isEnabled()) span.setName(tracing::describeDeclaration(declaration.get()));
+            }
+            if (onDeclaration_) {
+                onDeclaration_(std::move(declaration));
             } else {
-                result->body.push_back(FUN_OR_VAR_DECL(std::nullopt));
+                result->body.push_back(std::move(declaration));
             }
         }
         return result;
@@ -85,10 +99,10 @@ namespace tinycplus {
         }
         auto token = top();
         std::unique_ptr<ASTType> type{TYPE_FUN_RET()};
-        if (!isIdentifier(top())) {
-            throw ParserError(STR("PARSER: expected class type as constructor name, but " << top() << " found"), top().location(), eof());
-        }
         bool isConstructor = kind == FunctionKind::ClassConstructor;
+        if (!isConstructor && !isIdentifier(top())) {
+            throw ParserError(STR("PARSER: expected function name, but " << top() << " found"), top().location(), eof());
+        }
         if (isConstructor) {
             if (accessMod == AccessMod::Private) throw ParserError {
                 STR("PARSER: constructors are either protected or public!"),
@@ -100,7 +114,8 @@ namespace tinycplus {
         std::unique_ptr<ASTFunDecl> result{new ASTFunDecl{token, std::move(type)}};
         result->kind = kind;
         result->access = accessMod;
-        result->name = token.valueSymbol();
+        // constructor is named after its class, the class name is its return type
+        result->name = isConstructor ? className.value() : token.valueSymbol();
         pop(Symbol::ParOpen);
         if (top() != Symbol::ParClose) {
             do {
@@ -160,9 +175,63 @@ namespace tinycplus {
         return result;
     }
 
+    /* GENERIC_FUN_DECL := template '<' TYPE_PARAM { ',' TYPE_PARAM } '>' FUN_HEAD BLOCK_STMT
+        TYPE_PARAM := identifier [ ':' identifier ]
+        */
+    std::unique_ptr<AST> Parser::GENERIC_FUN_DECL() {
+        auto token = pop(symbols::KwTemplate);
+        pop(Symbol::Lt);
+        // * the type parameters are type names only within the function
+        auto typesSize = possibleTypesStack_.size();
+        std::vector<ASTFunDecl::TypeParameter> typeParameters;
+        do {
+            auto name = IDENT();
+            if (isTypeName(name->name)) throw ParserError(
+                STR("PARSER: type parameter " << name->name.name() << " hides the type of the same name"),
+                name->location(), false
+            );
+            ASTFunDecl::TypeParameter parameter{name->name, std::nullopt};
+            if (condPop(Symbol::Colon)) {
+                if (!isIdentifier(top()) || !isTypeName(top().valueSymbol())) {
+                    throw ParserError(STR("PARSER: expected interface, but " << top() << " found"), top().location(), eof());
+                }
+                parameter.bound = pop().valueSymbol();
+            }
+            addTypeName(parameter.name);
+            typeParameters.push_back(parameter);
+        } while (condPop(Symbol::Comma));
+        pop(Symbol::Gt);
+        auto result = FUN_DECL(FunctionKind::None);
+        while (possibleTypesStack_.size() > typesSize) {
+            possibleTypes_.erase(possibleTypesStack_.back());
+            possibleTypesStack_.pop_back();
+        }
+        auto * funDecl = result->as<ASTFunDecl>();
+        if (!funDecl->body) throw ParserError(
+            STR("PARSER: generic function " << funDecl->name->name() << " must be defined where it is declared"),
+            token.location(), false
+        );
+        funDecl->typeParameters = std::move(typeParameters);
+        return result;
+    }
+
+    /* CONSTEXPR_FUN_DECL := constexpr FUN_HEAD BLOCK_STMT
+        */
+    std::unique_ptr<AST> Parser::CONSTEXPR_FUN_DECL() {
+        auto token = pop(symbols::KwConstexpr);
+        auto result = FUN_DECL(FunctionKind::None);
+        auto * funDecl = result->as<ASTFunDecl>();
+        if (!funDecl->body) throw ParserError(
+            STR("PARSER: constexpr function " << funDecl->name->name() << " must be defined where it is declared"),
+            token.location(), false
+        );
+        funDecl->isConstexpr = true;
+        return result;
+    }
+
     // Statements -----------------------------------------------------------------------------------------------------
 
-    /* STATEMENT := BLOCK_STMT | IF_STMT | SWITCH_STMT | WHILE_STMT | DO_WHILE_STMT | FOR_STMT | BREAK_STMT | CONTINUE_STMT | RETURN_STMT | EXPR_STMT
+    /* STATEMENT := BLOCK_STMT | IF_STMT | SWITCH_STMT | WHILE_STMT | DO_WHILE_STMT | FOR_STMT | BREAK_STMT | CONTINUE_STMT | RETURN_STMT | DELETE_STMT | EXPR_STMT
         */
     std::unique_ptr<AST> Parser::STATEMENT() {
         if (top() == Symbol::CurlyOpen)
@@ -183,6 +252,8 @@ namespace tinycplus {
             return CONTINUE_STMT();
         else if (top() == Symbol::KwReturn)
             return RETURN_STMT();
+        else if (top() == symbols::KwDelete)
+            return DELETE_STMT();
         else
             // TODO this would produce not especially nice error as we are happy with statements too
             return EXPR_STMT();
@@ -200,17 +271,32 @@ namespace tinycplus {
     /* IF_STMT := if '(' EXPR ')' STATEMENT [ else STATEMENT ]
         */
     std::unique_ptr<ASTIf> Parser::IF_STMT() {
-        std::unique_ptr<ASTIf> result{new ASTIf{pop(Symbol::KwIf)}};
-        pop(Symbol::ParOpen);
-        result->cond = EXPR();
-        pop(Symbol::ParClose);
-        if (top() != Symbol::CurlyOpen) throw ParserError {
-            STR("If statement must start with curly braces!"),
-            top().location()
-        };
-        result->trueCase = STATEMENT();
-        if (condPop(Symbol::KwElse))
-            result->falseCase = STATEMENT();
+        std::unique_ptr<ASTIf> result;
+        // else-if chains are parsed in a loop, every if is linked as the false case of the previous one
+        ASTIf * last = nullptr;
+        while (true) {
+            std::unique_ptr<ASTIf> current{new ASTIf{pop(Symbol::KwIf)}};
+            pop(Symbol::ParOpen);
+            current->cond = EXPR();
+            pop(Symbol::ParClose);
+            if (top() != Symbol::CurlyOpen) throw ParserError {
+                STR("If statement must start with curly braces!"),
+                top().location()
+            };
+            current->trueCase = STATEMENT();
+            auto * currentPtr = current.get();
+            if (last == nullptr) {
+                result = std::move(current);
+            } else {
+                last->falseCase = std::move(current);
+            }
+            last = currentPtr;
+            if (!condPop(Symbol::KwElse)) break;
+            if (top() != Symbol::KwIf) {
+                last->falseCase = STATEMENT();
+                break;
+            }
+        }
         return result;
     }
 
@@ -337,6 +423,15 @@ namespace tinycplus {
         return result;
     }
 
+    /* DELETE_STMT := delete EXPR ';'
+        */
+    std::unique_ptr<AST> Parser::DELETE_STMT() {
+        Token const & op = pop(symbols::KwDelete);
+        std::unique_ptr<AST> result{new ASTDelete{op, EXPR()}};
+        pop(Symbol::Semicolon);
+        return result;
+    }
+
     /* EXPR_STMT := EXPR_OR_VAR_DECL ';'
 '         */
     std::unique_ptr<AST> Parser::EXPR_STMT() {
@@ -448,7 +543,7 @@ namespace tinycplus {
         return interfaceDecl;
     }
 
-    /* CLASS_DECL := 'class' identifier [ ':' identifier { ',' identifier } ] [ '{' { TYPE identifier ';' | FUN_DECL } '}' ] ';'
+    /* CLASS_DECL := 'class' identifier [ '[' identifier { ',' identifier } ']' ] [ ':' identifier { ',' identifier } ] [ '{' { TYPE identifier ';' | FUN_DECL } '}' ] ';'
         */
     std::unique_ptr<ASTClassDecl> Parser::CLASS_DECL() {
         auto const & start = pop(symbols::KwClass);
@@ -456,6 +551,13 @@ namespace tinycplus {
         this->className = className;
         std::unique_ptr<ASTClassDecl> classDecl{new ASTClassDecl{start, className}};
         addTypeName(className);
+        // Parses attributes, they are checked by the type checker
+        if (condPop(Symbol::SquareOpen)) {
+            do {
+                classDecl->attributes.push_back(pop(Token::Kind::Identifier).valueSymbol());
+            } while (condPop(Symbol::Comma));
+            pop(Symbol::SquareClose);
+        }
         // Parses base class
         if (condPop(Symbol::Colon)) {
             if (top() != Symbol::Colon) {
@@ -747,8 +849,9 @@ namespace tinycplus {
         return result;
     }
 
-    /* F := integer | double | char | string | identifier | '(' EXPR ')' | E_CAST
+    /* F := integer | double | char | string | identifier | '(' EXPR ')' | E_CAST | E_NEW
         E_CAST := cast '<' TYPE '>' '(' EXPR ')'
+        E_NEW := new TYPE '(' [ EXPR { ',' EXPR } ] ')'
         */
     std::unique_ptr<AST> Parser::F() {
         if (top() == Token::Kind::Integer) {
@@ -757,7 +860,7 @@ namespace tinycplus {
             return std::unique_ptr<AST>{new ASTDouble{pop()}};
         } else if (top() == Token::Kind::StringSingleQuoted) {
             return std::unique_ptr<AST>{new ASTChar{pop()}};
-        } else if (top() == Token::Kind::StringSingleQuoted) {
+        } else if (top() == Token::Kind::StringDoubleQuoted) {
             return std::unique_ptr<AST>{new ASTString{pop()}};
         } else if (top() == Symbol::KwCast) {
             Token op = pop();
@@ -777,11 +880,26 @@ namespace tinycplus {
             std::unique_ptr<AST> expr(EXPR());
             pop(Symbol::ParClose);
             return std::unique_ptr<AST>{new ASTClassCast{op, std::move(expr), std::move(type)}};
+        } else if (top() == symbols::KwNew) {
+            Token op = pop();
+            std::unique_ptr<AST> type{TYPE()};
+            if (top() != Symbol::ParOpen) {
+                throw ParserError(STR("PARSER: expected constructor arguments after new, but " << top() << " found"), top().location(), eof());
+            }
+            std::unique_ptr<ASTCall> constructor{E_CALL(type).release()->as<ASTCall>()};
+            return std::unique_ptr<AST>{new ASTNew{op, std::move(constructor)}};
         } else if (top() == Token::Kind::Identifier) {
             return IDENT();
-        } else if (condPop(Symbol::ParOpen)) {
-            return EXPR();
+        } else if (top() == Symbol::ParOpen) {
+            if (parenthesesDepth_ == MaxParenthesesDepth) {
+                throw ParserError(STR("PARSER: parentheses nested deeper than " << MaxParenthesesDepth << " levels"), top().location(), eof());
+            }
+            pop();
+            ++parenthesesDepth_;
+            std::unique_ptr<AST> result{EXPR()};
             pop(Symbol::ParClose);
+            --parenthesesDepth_;
+            return result;
         } else {
             throw ParserError(STR("PARSER: expected literal, (expr) or cast, but " << top() << " found"), top().location(), eof());
         }
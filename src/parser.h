@@ -3,17 +3,34 @@
 // standard
 #include <unordered_set>
 #include <optional>
+#include <functional>
 
 // internal
 #include "shared.h"
 #include "ast.h"
+#include "tracing.h"
 
 namespace tinycplus {
 
     class Parser : public ParserBase {
     public:
         static std::unique_ptr<AST> ParseFile(std::string const & filename) {
-            Parser p{Lexer::TokenizeFile(filename)};
+            return ParseTokens(Lexer::TokenizeFile(filename));
+        }
+
+        /** Parses already tokenized program, so lexing and parsing can be measured separately.
+         */
+        static std::unique_ptr<AST> ParseTokens(std::vector<Token> && tokens, TraceRecorder * trace = nullptr) {
+            return ParseTokens(std::move(tokens), trace, nullptr);
+        }
+
+        /** Hands every top-level declaration over to the function as soon as it is parsed, before the rest of the program is (--pipeline).
+            The returned program is left without declarations, thus the ones handed over outlive a parse error of a later one.
+         */
+        static std::unique_ptr<AST> ParseTokens(std::vector<Token> && tokens, TraceRecorder * trace, std::function<void(std::unique_ptr<AST>)> onDeclaration) {
+            Parser p{std::move(tokens)};
+            p.trace_ = trace;
+            p.onDeclaration_ = std::move(onDeclaration);
             std::unique_ptr<AST> result{p.PROGRAM()};
             p.pop(Token::Kind::EoF);
             return result;
@@ -22,6 +39,14 @@ namespace tinycplus {
     protected:
 
         std::optional<Symbol> className = std::nullopt;
+        TraceRecorder * trace_ = nullptr;
+        std::function<void(std::unique_ptr<AST>)> onDeclaration_;
+
+        /** Deepest allowed nesting of parenthesized expressions.
+            Every later pass walks the expression trees recursively, the limit keeps their stack use well below the default 8 MB stack (about 400 KB in optimized builds).
+         */
+        static constexpr size_t MaxParenthesesDepth = 256;
+        size_t parenthesesDepth_ = 0;
 
         Parser(std::vector<Token> && tokens): ParserBase{std::move(tokens)} { }
 
@@ -96,19 +121,22 @@ namespace tinycplus {
 
             ParserBase::Position position_;
             size_t possibleTypesSize_;
+            size_t parenthesesDepth_;
 
-            Position(ParserBase::Position position, size_t typesSize):
+            Position(ParserBase::Position position, size_t typesSize, size_t parenthesesDepth):
                 position_{position},
-                possibleTypesSize_{typesSize} {
+                possibleTypesSize_{typesSize},
+                parenthesesDepth_{parenthesesDepth} {
             }
         };
 
         Position position() {
-            return Position{ParserBase::position(), possibleTypesStack_.size()};
+            return Position{ParserBase::position(), possibleTypesStack_.size(), parenthesesDepth_};
         }
 
         void revertTo(Position const & p) {
             ParserBase::revertTo(p.position_);
+            parenthesesDepth_ = p.parenthesesDepth_;
             while (possibleTypesStack_.size() > p.possibleTypesSize_) {
                 possibleTypes_.erase(possibleTypesStack_.back());
                 possibleTypesStack_.pop_back();
@@ -122,6 +150,8 @@ namespace tinycplus {
         AccessMod ACCESS_MOD();
         std::unique_ptr<AST> PROGRAM();
         std::unique_ptr<AST> FUN_DECL(FunctionKind kind);
+        std::unique_ptr<AST> GENERIC_FUN_DECL();
+        std::unique_ptr<AST> CONSTEXPR_FUN_DECL();
         std::unique_ptr<AST> STATEMENT();
         std::unique_ptr<AST> BLOCK_STMT();
         std::unique_ptr<ASTIf> IF_STMT();
@@ -133,6 +163,7 @@ namespace tinycplus {
         std::unique_ptr<AST> BREAK_STMT();
         std::unique_ptr<AST> CONTINUE_STMT();
         std::unique_ptr<ASTReturn> RETURN_STMT();
+        std::unique_ptr<AST> DELETE_STMT();
         std::unique_ptr<AST> EXPR_STMT();
         std::unique_ptr<ASTType> TYPE(bool canBeVoid = false);
         std::unique_ptr<ASTType> TYPE_FUN_RET();
@@ -0,0 +1,278 @@
+// standard
+#include <cstdio>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <thread>
+
+// internal
+#include "pipeline.h"
+#include "shared.h"
+#include "parser.h"
+#include "transpiler.h"
+#include "typechecker.h"
+#include "profiling.h"
+#include "tracing.h"
+
+namespace tinycplus {
+
+    namespace {
+        /** Declarations in flight between two stages. The queues carry the program first, then its declarations and nullptr at the end.
+         */
+        constexpr size_t DeclarationsInFlight = 1024;
+
+        /** Chunk in which the spilled declarations are copied into the output.
+         */
+        constexpr size_t SpillChunk = 64 << 10;
+
+        /** One compilation split into its stages, each called by one thread.
+            parse passes the program and then its declarations on, check and emit take them in the same order. Errors are kept until finish, which reports the one of the earliest stage, like the compilation of the whole program would.
+         */
+        class StagedCompilation {
+        public:
+            StagedCompilation(std::string const & inputFilepath, CompileOptions const & options)
+                :inputFilepath_{inputFilepath}
+                ,options_{options}
+                ,names_{types_.getTypeVoid()}
+                ,typechecker_{types_, names_}
+                ,emitted_{nullptr}
+                ,transpiler_{names_, types_, emitted_, options.isPrintColorful}
+            {
+                types_.setShared(options.isPipelined);
+                names_.setReleasingScopes(options.isStreaming);
+                typechecker_.setTrace(options.trace);
+                emitted_.rdbuf(buffer_.rdbuf());
+                transpiler_.setTrace(options.trace);
+                transpiler_.setLineMarkers(options.isEmittingLineMarkers);
+                transpiler_.setPoolCapacity(options.poolCapacity);
+                transpiler_.setConstexprSteps(options.constexprSteps);
+                if (options.isStreaming) {
+                    spill_ = std::tmpfile();
+                    if (spill_ == nullptr) throw std::runtime_error("--stream could not create its temporary file");
+                }
+            }
+
+            ~StagedCompilation() {
+                if (spill_ != nullptr) std::fclose(spill_);
+            }
+
+            void parse(PassTimings * timings, std::function<void(AST *)> const & pass) {
+                try {
+                    std::vector<Token> tokens;
+                    {
+                        ScopedPass pass{timings, "lex"};
+                        ScopedSpan span{options_.trace, "pass", "lex"};
+                        tokens = Lexer::TokenizeFile(inputFilepath_);
+                    }
+                    ScopedPass scopedPass{timings, "parse"};
+                    ScopedSpan span{options_.trace, "pass", "parse"};
+                    // * the program node of the parser keeps no declarations, the emitting stage owns them
+                    program_.reset(new ASTProgram{tokens.front()});
+                    pass(program_.get());
+                    Parser::ParseTokens(std::move(tokens), options_.trace, [&](std::unique_ptr<AST> declaration) {
+                        pass(declaration.release());
+                    });
+                } catch (...) {
+                    parseError_ = std::current_exception();
+                }
+            }
+
+            void check(AST * ast) {
+                if (ast == program_.get()) {
+                    typechecker_.beginProgram(program_.get());
+                    return;
+                }
+                // * declarations which follow the failed one are passed on unchecked, only to be owned at the end
+                if (checkError_ != nullptr) return;
+                try {
+                    typechecker_.checkDeclaration(ast);
+                } catch (...) {
+                    checkError_ = std::current_exception();
+                    isCheckFailed_.store(true, std::memory_order_relaxed);
+                }
+            }
+
+            /** Checks what depends on all declarations, once the parser is done.
+             */
+            void finishCheck() {
+                if (program_ == nullptr || parseError_ != nullptr || checkError_ != nullptr) return;
+                try {
+                    typechecker_.finishProgram(program_.get());
+                } catch (...) {
+                    checkError_ = std::current_exception();
+                }
+            }
+
+            void emit(AST * ast) {
+                if (ast == program_.get()) {
+                    transpiler_.enterProgram(program_.get());
+                    return;
+                }
+                declarations_.emplace_back(ast);
+                isWaiting_.push_back(false);
+                if (emitError_ != nullptr || isCheckFailed_.load(std::memory_order_relaxed)) return;
+                try {
+                    if (transpiler_.needsWholeProgram(ast)) {
+                        isWaiting_.back() = true;
+                    } else {
+                        transpiler_.printDeclaration(ast);
+                        if (options_.isStreaming) transpiler_.releaseBodies(ast);
+                    }
+                    storePrinted();
+                } catch (...) {
+                    emitError_ = std::current_exception();
+                }
+            }
+
+            /** Prints the output: the preamble, the printed declarations with the prototypes of their generic instances in front of them, and the epilogue.
+             */
+            void finish(std::ostream & output) {
+                if (parseError_ != nullptr) std::rethrow_exception(parseError_);
+                if (checkError_ != nullptr) std::rethrow_exception(checkError_);
+                if (emitError_ != nullptr) std::rethrow_exception(emitError_);
+                ScopedPass pass{options_.timings, "emit.whole-program"};
+                emitted_.rdbuf(output.rdbuf());
+                transpiler_.printPreamble(program_.get());
+                if (spill_ != nullptr) std::rewind(spill_);
+                for (size_t i = 0; i < declarations_.size(); ++i) {
+                    transpiler_.printPrototypesOf(declarations_[i].get());
+                    if (isWaiting_[i]) {
+                        transpiler_.printDeclaration(declarations_[i].get());
+                    } else {
+                        writePrinted(i);
+                    }
+                }
+                transpiler_.printEpilogue();
+                transpiler_.leaveProgram();
+                transpiler_.validateSelf();
+            }
+
+        private:
+            /** Moves the printed declaration out of the buffer, into memory or, when streaming, into the temporary file.
+             */
+            void storePrinted() {
+                auto text = buffer_.str();
+                buffer_.str("");
+                if (spill_ == nullptr) {
+                    printed_.push_back(std::move(text));
+                    return;
+                }
+                if (std::fwrite(text.data(), 1, text.size(), spill_) != text.size()) {
+                    throw std::runtime_error("--stream could not write its temporary file");
+                }
+                spilledBytes_ += text.size();
+                spilledEnds_.push_back(spilledBytes_);
+            }
+
+            void writePrinted(size_t index) {
+                if (spill_ == nullptr) {
+                    emitted_ << printed_[index];
+                    return;
+                }
+                auto size = spilledEnds_[index] - (index == 0 ? 0 : spilledEnds_[index - 1]);
+                std::vector<char> chunk(std::min<uint64_t>(size, SpillChunk));
+                while (size > 0) {
+                    auto count = std::fread(chunk.data(), 1, std::min<uint64_t>(size, chunk.size()), spill_);
+                    if (count == 0) throw std::runtime_error("--stream could not read its temporary file");
+                    emitted_.write(chunk.data(), count);
+                    size -= count;
+                }
+            }
+
+            std::string const & inputFilepath_;
+            CompileOptions const & options_;
+            TypesContext types_;
+            NamesContext names_;
+            TypeChecker typechecker_;
+            std::stringstream buffer_;
+            std::ostream emitted_; // into the buffer of the declaration being printed, into the output at the end
+            Transpiler transpiler_;
+            std::unique_ptr<ASTProgram> program_;
+            std::vector<std::unique_ptr<AST>> declarations_; // owned by the emitting stage
+            std::vector<bool> isWaiting_; // declarations which need the whole program, printed at the end
+            std::vector<std::string> printed_;
+            std::FILE * spill_ = nullptr;
+            uint64_t spilledBytes_ = 0;
+            std::vector<uint64_t> spilledEnds_; // end of every declaration in the temporary file
+            std::exception_ptr parseError_;
+            std::exception_ptr checkError_;
+            std::exception_ptr emitError_;
+            std::atomic<bool> isCheckFailed_{false};
+        }; // StagedCompilation
+
+    } // anonymous namespace
+
+    void compileFileByDeclaration(std::string const & inputFilepath, std::ostream & output, CompileOptions const & options) {
+        std::string mode = options.isPipelined ? "--pipeline" : "--stream";
+        if (options.isParseOnly) {
+            throw std::runtime_error(STR("--parse-only neither checks nor emits the program, " << mode << " is not available together with it"));
+        }
+        if (options.backend == Backend::Cpp) {
+            throw std::runtime_error(STR(mode << " is only available for the TinyC output"));
+        }
+        if (options.isInstrumentingDispatch || options.isInstrumentingCoverage || !options.profileUsePath.empty()) {
+            throw std::runtime_error(STR("Dispatch instrumentation and profiles are not available together with " << mode));
+        }
+        if (!options.sourceMapPath.empty() || options.stats != nullptr) {
+            throw std::runtime_error(STR("Source maps and stats are not available together with " << mode));
+        }
+        ScopedPass totalPass{options.timings, "total"};
+        ScopedSpan totalSpan{options.trace, "file", options.trace != nullptr ? STR("compile " << inputFilepath) : ""};
+        StagedCompilation compilation{inputFilepath, options};
+        if (!options.isPipelined) {
+            // * every declaration is checked and emitted as soon as it is parsed
+            compilation.parse(options.timings, [&](AST * ast) {
+                {
+                    ScopedPass pass{options.timings, "typecheck"};
+                    compilation.check(ast);
+                }
+                ScopedPass pass{options.timings, "emit"};
+                compilation.emit(ast);
+            });
+            compilation.finishCheck();
+            compilation.finish(output);
+            return;
+        }
+        // * PassTimings belong to one thread, each stage measures itself
+        bool isTiming = options.timings != nullptr;
+        PassTimings parseTimings;
+        PassTimings checkTimings;
+        SpscQueue<AST *> parsed{DeclarationsInFlight};
+        SpscQueue<AST *> checked{DeclarationsInFlight};
+        std::thread parser{[&]() {
+            compilation.parse(isTiming ? &parseTimings : nullptr, [&](AST * ast) {
+                parsed.push(ast);
+            });
+            parsed.push(nullptr);
+        }};
+        std::thread checker{[&]() {
+            {
+                ScopedPass pass{isTiming ? &checkTimings : nullptr, "typecheck"};
+                ScopedSpan span{options.trace, "pass", "typecheck"};
+                for (auto * ast = parsed.pop(); ast != nullptr; ast = parsed.pop()) {
+                    compilation.check(ast);
+                    checked.push(ast);
+                }
+                // * the parser is done, a parse error is reported before the type errors
+                compilation.finishCheck();
+            }
+            checked.push(nullptr);
+        }};
+        {
+            ScopedPass pass{options.timings, "emit"};
+            ScopedSpan span{options.trace, "pass", "emit"};
+            for (auto * ast = checked.pop(); ast != nullptr; ast = checked.pop()) {
+                compilation.emit(ast);
+            }
+        }
+        parser.join();
+        checker.join();
+        if (isTiming) {
+            options.timings->merge(parseTimings);
+            options.timings->merge(checkTimings);
+        }
+        compilation.finish(output);
+    }
+
+} // namespace tinycplus
@@ -0,0 +1,103 @@
+#pragma once
+
+// standard
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// internal
+#include "driver.h"
+
+namespace tinycplus {
+
+    /** Bounded lock-free queue of one producer thread and one consumer thread.
+        The capacity is rounded up to a power of two, the positions only grow and are masked into the ring. Each position is written by one side only, so a release store publishes the slot to the acquire load of the other side.
+     */
+    template<typename T>
+    class SpscQueue {
+    private:
+        static constexpr size_t CacheLine = 64;
+
+        std::vector<T> slots_;
+        size_t mask_;
+        alignas(CacheLine) std::atomic<size_t> head_{0}; // next slot to pop, written by the consumer
+        alignas(CacheLine) std::atomic<size_t> tail_{0}; // next slot to push, written by the producer
+        alignas(CacheLine) size_t cachedHead_ = 0; // producer's last view of head_
+        alignas(CacheLine) size_t cachedTail_ = 0; // consumer's last view of tail_
+    public:
+        explicit SpscQueue(size_t capacity) {
+            size_t size = 1;
+            while (size < capacity) size <<= 1;
+            slots_.resize(size);
+            mask_ = size - 1;
+        }
+
+        SpscQueue(SpscQueue const &) = delete;
+        SpscQueue & operator=(SpscQueue const &) = delete;
+
+        /** Producer only, returns false when the queue is full.
+         */
+        bool tryPush(T value) {
+            auto tail = tail_.load(std::memory_order_relaxed);
+            if (tail - cachedHead_ == slots_.size()) {
+                cachedHead_ = head_.load(std::memory_order_acquire);
+                if (tail - cachedHead_ == slots_.size()) return false;
+            }
+            slots_[tail & mask_] = std::move(value);
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Consumer only, returns false when the queue is empty.
+         */
+        bool tryPop(T & value) {
+            auto head = head_.load(std::memory_order_relaxed);
+            if (head == cachedTail_) {
+                cachedTail_ = tail_.load(std::memory_order_acquire);
+                if (head == cachedTail_) return false;
+            }
+            value = std::move(slots_[head & mask_]);
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Waits until the value fits, spinning first and then backing off, so that a stage waiting for a slower one does not take its core.
+         */
+        void push(T value) {
+            for (size_t attempt = 0; !tryPush(value); ++attempt) {
+                Backoff(attempt);
+            }
+        }
+
+        T pop() {
+            T result;
+            for (size_t attempt = 0; !tryPop(result); ++attempt) {
+                Backoff(attempt);
+            }
+            return result;
+        }
+
+    private:
+        static void Backoff(size_t attempt) {
+            if (attempt < 64) return;
+            if (attempt < 256) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds{50});
+            }
+        }
+    }; // tinycplus::SpscQueue
+
+    /** Compiles the file like compileFile, but one top-level declaration at a time, each checked and emitted as soon as it is parsed. Only the preamble of the output, the entry function, whose body sets up the vtables of all classes, and the generic instances, which are known once every call is checked, wait for the whole program.
+        With --pipeline the stages run on their own threads: lexing and parsing on one, each declaration is passed to the typechecking thread and on to the emitting (calling) thread.
+        With --stream the bodies of functions, methods and constructors are released together with their scopes once they are emitted, and the printed declarations wait in a temporary file, so that the memory grows with the declarations and not with the code. Generic and constexpr functions keep their bodies, which are instantiated or evaluated later. The tokens of the file are kept until the parser is done.
+        The output and the errors are the same as of compileFile: parse errors are reported before type errors and those before emit errors.
+        TinyC backend only, without instrumentation, profiles, source maps and stats.
+     */
+    void compileFileByDeclaration(std::string const & inputFilepath, std::ostream & output, CompileOptions const & options);
+
+} // namespace tinycplus
@@ -0,0 +1,246 @@
+// standard
+#include <cstdlib>
+#include <new>
+#include <iomanip>
+#include <algorithm>
+
+// internal
+#include "profiling.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TINYCPLUS_HAS_RUSAGE
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+namespace {
+    // of the thread itself, so that neither the threads contend on the counters nor the passes of --pipeline stages count the allocations of the other stages
+    thread_local size_t threadAllocationsCount_ = 0;
+    thread_local size_t threadAllocatedBytes_ = 0;
+    // allocations are only counted while a pass is measured, the other ones only pay for the check
+    thread_local int countingDepth_ = 0;
+
+    inline void countAllocation(std::size_t size) {
+        if (countingDepth_ == 0) return;
+        ++threadAllocationsCount_;
+        threadAllocatedBytes_ += size;
+    }
+
+    void * allocateAligned(std::size_t size, std::align_val_t alignment) noexcept {
+        auto align = std::max(static_cast<std::size_t>(alignment), sizeof(void *));
+#ifdef _WIN32
+        return _aligned_malloc(size == 0 ? 1 : size, align);
+#else
+        // the size of aligned_alloc must be a multiple of the alignment
+        return std::aligned_alloc(align, (std::max<std::size_t>(size, 1) + align - 1) / align * align);
+#endif
+    }
+
+    void freeAligned(void * pointer) noexcept {
+#ifdef _WIN32
+        _aligned_free(pointer);
+#else
+        std::free(pointer);
+#endif
+    }
+}
+
+// the array forms call these, so they are counted too
+
+void * operator new(std::size_t size) {
+    countAllocation(size);
+    if (void * result = std::malloc(size == 0 ? 1 : size)) {
+        return result;
+    }
+    throw std::bad_alloc{};
+}
+
+void * operator new(std::size_t size, std::nothrow_t const &) noexcept {
+    countAllocation(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment) {
+    countAllocation(size);
+    if (void * result = allocateAligned(size, alignment)) {
+        return result;
+    }
+    throw std::bad_alloc{};
+}
+
+void * operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept {
+    countAllocation(size);
+    return allocateAligned(size, alignment);
+}
+
+void operator delete(void * pointer) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::nothrow_t const &) noexcept {
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::align_val_t) noexcept {
+    freeAligned(pointer);
+}
+
+void operator delete(void * pointer, std::size_t, std::align_val_t) noexcept {
+    freeAligned(pointer);
+}
+
+void operator delete(void * pointer, std::align_val_t, std::nothrow_t const &) noexcept {
+    freeAligned(pointer);
+}
+
+namespace tinycplus {
+
+    namespace profiling {
+
+        void beginAllocationCounting() {
+            ++countingDepth_;
+        }
+
+        void endAllocationCounting() {
+            --countingDepth_;
+        }
+
+        size_t threadAllocationsCount() {
+            return threadAllocationsCount_;
+        }
+
+        size_t threadAllocatedBytes() {
+            return threadAllocatedBytes_;
+        }
+
+        double threadCpuMilliseconds() {
+#if defined(TINYCPLUS_HAS_RUSAGE) && defined(CLOCK_THREAD_CPUTIME_ID)
+            timespec time{};
+            if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time) == 0) {
+                return 1000.0 * static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e6;
+            }
+#endif
+            return 1000.0 * static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+        }
+
+        size_t peakResidentKilobytes() {
+#ifdef TINYCPLUS_HAS_RUSAGE
+            rusage usage{};
+            if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+            return static_cast<size_t>(usage.ru_maxrss) / 1024; // reported in bytes
+#else
+            return static_cast<size_t>(usage.ru_maxrss); // reported in kilobytes
+#endif
+#else
+            return 0;
+#endif
+        }
+
+    } // namespace profiling
+
+    size_t PassTimings::enter(std::string const & name) {
+        auto it = indexes_.find(name);
+        if (it == indexes_.end()) {
+            it = indexes_.insert(std::make_pair(name, passes_.size())).first;
+            passes_.push_back(PassMeasurement{});
+            passes_.back().name = name;
+            passes_.back().depth = depth_;
+        }
+        ++depth_;
+        return it->second;
+    }
+
+    void PassTimings::merge(PassTimings const & other) {
+        for (auto & pass : other.passes_) {
+            auto & measurement = at(enter(pass.name));
+            leave();
+            measurement.depth = depth_ + pass.depth;
+            measurement.calls += pass.calls;
+            measurement.wallMilliseconds += pass.wallMilliseconds;
+            measurement.cpuMilliseconds += pass.cpuMilliseconds;
+            measurement.allocations += pass.allocations;
+            measurement.allocatedBytes += pass.allocatedBytes;
+            measurement.peakResidentKilobytes = std::max(measurement.peakResidentKilobytes, pass.peakResidentKilobytes);
+        }
+    }
+
+    void PassTimings::printText(std::ostream & output) const {
+        output << "[time-passes]"
+            << std::setw(34) << std::left << " pass"
+            << std::right
+            << std::setw(8) << "calls"
+            << std::setw(12) << "wall ms"
+            << std::setw(12) << "cpu ms"
+            << std::setw(12) << "allocs"
+            << std::setw(14) << "alloc bytes"
+            << std::setw(12) << "peak KB"
+            << "\n";
+        for (auto & pass : passes_) {
+            output << "[time-passes] "
+                << std::setw(33) << std::left << (std::string(pass.depth * 2, ' ') + pass.name)
+                << std::right << std::fixed << std::setprecision(3)
+                << std::setw(8) << pass.calls
+                << std::setw(12) << pass.wallMilliseconds
+                << std::setw(12) << pass.cpuMilliseconds
+                << std::setw(12) << pass.allocations
+                << std::setw(14) << pass.allocatedBytes
+                << std::setw(12) << pass.peakResidentKilobytes
+                << "\n";
+        }
+    }
+
+    void PassTimings::printJson(std::ostream & output) const {
+        output << "{\"passes\":[";
+        for (size_t i = 0; i < passes_.size(); ++i) {
+            auto & pass = passes_[i];
+            if (i > 0) output << ",";
+            output << "{\"name\":\"" << pass.name << "\""
+                << ",\"depth\":" << pass.depth
+                << ",\"calls\":" << pass.calls
+                << std::fixed << std::setprecision(3)
+                << ",\"wall_ms\":" << pass.wallMilliseconds
+                << ",\"cpu_ms\":" << pass.cpuMilliseconds
+                << ",\"allocations\":" << pass.allocations
+                << ",\"allocated_bytes\":" << pass.allocatedBytes
+                << ",\"peak_rss_kb\":" << pass.peakResidentKilobytes
+                << "}";
+        }
+        output << "]}\n";
+    }
+
+    ScopedPass::ScopedPass(PassTimings * timings, std::string const & name)
+        : timings_{timings} {
+        if (timings_ == nullptr) return;
+        index_ = timings_->enter(name);
+        profiling::beginAllocationCounting();
+        allocationsStart_ = profiling::threadAllocationsCount();
+        allocatedBytesStart_ = profiling::threadAllocatedBytes();
+        cpuStart_ = profiling::threadCpuMilliseconds();
+        wallStart_ = std::chrono::steady_clock::now();
+    }
+
+    ScopedPass::~ScopedPass() {
+        if (timings_ == nullptr) return;
+        auto wallEnd = std::chrono::steady_clock::now();
+        auto cpuEnd = profiling::threadCpuMilliseconds();
+        auto & measurement = timings_->at(index_);
+        measurement.calls += 1;
+        measurement.wallMilliseconds += std::chrono::duration<double, std::milli>(wallEnd - wallStart_).count();
+        measurement.cpuMilliseconds += cpuEnd - cpuStart_;
+        measurement.allocations += profiling::threadAllocationsCount() - allocationsStart_;
+        measurement.allocatedBytes += profiling::threadAllocatedBytes() - allocatedBytesStart_;
+        profiling::endAllocationCounting();
+        measurement.peakResidentKilobytes = profiling::peakResidentKilobytes();
+        timings_->leave();
+    }
+
+} // namespace tinycplus
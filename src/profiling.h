@@ -0,0 +1,94 @@
+#pragma once
+
+// standard
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <ctime>
+#include <cstddef>
+
+namespace tinycplus {
+
+    /** Accumulated cost of one compiler pass.
+        A pass may be entered many times (e.g. vtable emission once per class), its measurements are summed.
+        Cpu time and allocations are those of the thread which ran the pass, the peak resident size is of the whole process.
+     */
+    struct PassMeasurement {
+        std::string name;
+        int depth = 0;
+        size_t calls = 0;
+        double wallMilliseconds = 0;
+        double cpuMilliseconds = 0;
+        size_t allocations = 0;
+        size_t allocatedBytes = 0;
+        size_t peakResidentKilobytes = 0;
+    };
+
+    /** Collects costs of the compiler passes for the --time-passes report.
+        Single instance is meant to be used by a single compilation (thread).
+     */
+    class PassTimings {
+    private:
+        std::vector<PassMeasurement> passes_;
+        std::unordered_map<std::string, size_t> indexes_;
+        int depth_ = 0;
+    public:
+        /** Returns index of the pass measurement, indexes stay valid while nested passes are added.
+         */
+        size_t enter(std::string const & name);
+        PassMeasurement & at(size_t index) {
+            return passes_[index];
+        }
+        void leave() {
+            --depth_;
+        }
+        std::vector<PassMeasurement> const & passes() const {
+            return passes_;
+        }
+        /** Adds the passes measured by another thread, nested in the passes entered here (--pipeline).
+         */
+        void merge(PassTimings const & other);
+        void printText(std::ostream & output) const;
+        void printJson(std::ostream & output) const;
+    };
+
+    /** Measures the enclosing scope as a pass. Does nothing when no timings are given.
+     */
+    class ScopedPass {
+    private:
+        PassTimings * timings_;
+        size_t index_ = 0;
+        std::chrono::steady_clock::time_point wallStart_;
+        double cpuStart_ = 0;
+        size_t allocationsStart_ = 0;
+        size_t allocatedBytesStart_ = 0;
+    public:
+        ScopedPass(PassTimings * timings, std::string const & name);
+        ~ScopedPass();
+        ScopedPass(ScopedPass const &) = delete;
+        ScopedPass & operator=(ScopedPass const &) = delete;
+    };
+
+    namespace profiling {
+        /** Starts counting the allocations of the calling thread, until the matching endAllocationCounting. Nests.
+            Measured passes count their allocations, no other allocation is counted, so that the compilations without --time-passes do not pay for it.
+         */
+        void beginAllocationCounting();
+        void endAllocationCounting();
+        /** Number of allocations the calling thread did while counting them.
+         */
+        size_t threadAllocationsCount();
+        /** Number of bytes the calling thread requested while counting its allocations.
+         */
+        size_t threadAllocatedBytes();
+        /** Cpu time used by the calling thread, or by the whole process when the platform cannot tell the threads apart.
+         */
+        double threadCpuMilliseconds();
+        /** Peak resident set size of the process in kilobytes, or 0 when the platform does not report it.
+         */
+        size_t peakResidentKilobytes();
+    }
+
+} // namespace tinycplus
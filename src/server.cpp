@@ -0,0 +1,336 @@
+// standard
+#include <sstream>
+#include <fstream>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+
+// internal
+#include "server.h"
+#include "shared.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TINYCPLUS_HAS_UNIX_SOCKETS
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace tinycplus {
+
+    std::string TranspileRequest::serialize() const {
+        std::stringstream result;
+        result << "command=" << command << "\n";
+        result << "path=" << inputFilepath << "\n";
+        result << "entry=" << entry << "\n";
+        result << "colorful=" << (options.isPrintColorful ? 1 : 0) << "\n";
+        result << "parse-only=" << (options.isParseOnly ? 1 : 0) << "\n";
+        result << "emit=" << (options.backend == Backend::Cpp ? "cpp" : "tinyc") << "\n";
+        result << "instrument=" << describeInstrumentation(options) << "\n";
+        result << "profile-use=" << options.profileUsePath << "\n";
+        result << "line-markers=" << (options.isEmittingLineMarkers ? 1 : 0) << "\n";
+        result << "pool-capacity=" << options.poolCapacity << "\n";
+        result << "constexpr-steps=" << options.constexprSteps << "\n";
+        result << "pipeline=" << (options.isPipelined ? 1 : 0) << "\n";
+        result << "stream=" << (options.isStreaming ? 1 : 0) << "\n";
+        result << "\n";
+        return result.str();
+    }
+
+    TranspileRequest TranspileRequest::Deserialize(std::string const & text) {
+        TranspileRequest request;
+        std::stringstream lines{text};
+        std::string line;
+        while (std::getline(lines, line) && !line.empty()) {
+            auto separator = line.find('=');
+            if (separator == std::string::npos) {
+                throw std::runtime_error(STR("SERVER: malformed request line: " << line));
+            }
+            auto key = line.substr(0, separator);
+            auto value = line.substr(separator + 1);
+            if (key == "command") {
+                request.command = value;
+            } else if (key == "path") {
+                request.inputFilepath = value;
+            } else if (key == "entry") {
+                request.entry = value;
+            } else if (key == "colorful") {
+                request.options.isPrintColorful = value == "1";
+            } else if (key == "parse-only") {
+                request.options.isParseOnly = value == "1";
+            } else if (key == "emit") {
+                request.options.backend = value == "cpp" ? Backend::Cpp : Backend::TinyC;
+            } else if (key == "instrument") {
+                if (!parseInstrumentation(value, request.options)) {
+                    throw std::runtime_error(STR("SERVER: unknown instrumentation: " << value));
+                }
+            } else if (key == "profile-use") {
+                request.options.profileUsePath = value;
+            } else if (key == "line-markers") {
+                request.options.isEmittingLineMarkers = value == "1";
+            } else if (key == "pool-capacity") {
+                request.options.poolCapacity = std::stoi(value);
+            } else if (key == "constexpr-steps") {
+                request.options.constexprSteps = std::stoi(value);
+            } else if (key == "pipeline") {
+                request.options.isPipelined = value == "1";
+            } else if (key == "stream") {
+                request.options.isStreaming = value == "1";
+            } else {
+                throw std::runtime_error(STR("SERVER: unknown request key: " << key));
+            }
+        }
+        return request;
+    }
+
+    std::string OutputCache::MakeKey(TranspileRequest const & request) {
+        return STR(request.inputFilepath
+            << "|" << request.entry
+            << "|" << request.options.isPrintColorful
+            << "|" << request.options.isParseOnly
+            << "|" << (request.options.backend == Backend::Cpp ? "cpp" : "tinyc")
+            << "|" << describeInstrumentation(request.options)
+            << "|" << request.options.profileUsePath
+            << "|" << request.options.isEmittingLineMarkers
+            << "|" << request.options.poolCapacity
+            << "|" << request.options.constexprSteps);
+    }
+
+    std::optional<uint64_t> OutputCache::FileStamp::HashContents(std::string const & filepath) {
+        std::ifstream input{filepath, std::ios::binary};
+        if (!input) return std::nullopt;
+        // FNV-1a
+        uint64_t hash = 14695981039346656037ull;
+        char buffer[64 * 1024];
+        while (input.read(buffer, sizeof(buffer)) || input.gcount() > 0) {
+            for (std::streamsize i = 0, e = input.gcount(); i < e; ++i) {
+                hash = (hash ^ static_cast<unsigned char>(buffer[i])) * 1099511628211ull;
+            }
+        }
+        if (input.bad()) return std::nullopt;
+        return hash;
+    }
+
+    std::optional<OutputCache::FileStamp> OutputCache::FileStamp::Of(std::string const & filepath) {
+        FileStamp result;
+        std::error_code error;
+        result.modified = std::filesystem::last_write_time(filepath, error);
+        if (error) return std::nullopt;
+        result.size = std::filesystem::file_size(filepath, error);
+        if (error) return std::nullopt;
+        auto hash = HashContents(filepath);
+        if (!hash.has_value()) return std::nullopt;
+        result.hash = hash.value();
+        return result;
+    }
+
+    bool OutputCache::FileStamp::matches(std::string const & filepath) const {
+        std::error_code error;
+        if (std::filesystem::last_write_time(filepath, error) != modified || error) return false;
+        if (std::filesystem::file_size(filepath, error) != size || error) return false;
+        return HashContents(filepath) == hash;
+    }
+
+    std::string const * OutputCache::find(TranspileRequest const & request) {
+        auto it = entries_.find(MakeKey(request));
+        if (it == entries_.end()) return nullptr;
+        if (!it->second.input.matches(request.inputFilepath)) return nullptr;
+        // the profile path is a part of the key, so the entry has a profile stamp exactly when the request uses one
+        if (it->second.profile.has_value() && !it->second.profile->matches(request.options.profileUsePath)) return nullptr;
+        recent_.splice(recent_.begin(), recent_, it->second.recent);
+        return &it->second.output;
+    }
+
+    void OutputCache::store(TranspileRequest const & request, std::string output) {
+        auto input = FileStamp::Of(request.inputFilepath);
+        if (!input.has_value()) return;
+        std::optional<FileStamp> profile;
+        if (!request.options.profileUsePath.empty()) {
+            profile = FileStamp::Of(request.options.profileUsePath);
+            if (!profile.has_value()) return;
+        }
+        auto key = MakeKey(request);
+        if (auto it = entries_.find(key); it != entries_.end()) erase(it);
+        if (output.size() > capacity_) return;
+        while (bytes_ + output.size() > capacity_) {
+            erase(entries_.find(recent_.back()));
+        }
+        bytes_ += output.size();
+        recent_.push_front(key);
+        entries_.emplace(std::move(key), Entry{input.value(), profile, std::move(output), recent_.begin()});
+    }
+
+    void OutputCache::erase(std::unordered_map<std::string, Entry>::iterator it) {
+        bytes_ -= it->second.output.size();
+        recent_.erase(it->second.recent);
+        entries_.erase(it);
+    }
+
+    std::string TranspileServer::serve(TranspileRequest const & request, bool & isStopRequested) {
+        isStopRequested = false;
+        if (request.command == "stop") {
+            isStopRequested = true;
+            return "ok 0 stopped\n";
+        }
+        if (request.command != "transpile") {
+            return STR("error\n" << "[error] SERVER: unknown command: " << request.command << "\n");
+        }
+        auto start = std::chrono::steady_clock::now();
+        auto elapsed = [&start]() {
+            return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        };
+        if (auto * cached = cache_.find(request)) {
+            return STR("ok " << elapsed() << " cached\n" << *cached);
+        }
+        // the entry symbol is global, thus it is swapped for the duration of the request
+        auto previousEntry = symbols::Entry;
+        if (!request.entry.empty()) {
+            symbols::Entry = Symbol{request.entry};
+        }
+        std::stringstream output;
+        try {
+            compileFile(request.inputFilepath, output, request.options);
+        } catch (std::exception & exception) {
+            symbols::Entry = previousEntry;
+            return STR("error\n" << describeError(exception) << "\n");
+        }
+        symbols::Entry = previousEntry;
+        cache_.store(request, output.str());
+        return STR("ok " << elapsed() << " fresh\n" << output.str());
+    }
+
+#ifdef TINYCPLUS_HAS_UNIX_SOCKETS
+
+    namespace {
+
+        sockaddr_un makeSocketAddress(std::string const & socketPath) {
+            sockaddr_un address{};
+            address.sun_family = AF_UNIX;
+            if (socketPath.size() >= sizeof(address.sun_path)) {
+                throw std::runtime_error(STR("SERVER: socket path is too long: " << socketPath));
+            }
+            std::strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+            return address;
+        }
+
+        /** Limits how long reads and writes of the connection wait for the other side.
+         */
+        void setTimeout(int descriptor, int seconds) {
+            timeval timeout{};
+            timeout.tv_sec = seconds;
+            ::setsockopt(descriptor, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            ::setsockopt(descriptor, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        }
+
+        void writeAll(int descriptor, std::string const & data) {
+#ifdef MSG_NOSIGNAL
+            // a client which went away must not kill the server by SIGPIPE
+            int flags = MSG_NOSIGNAL;
+#else
+            int flags = 0;
+#endif
+            size_t written = 0;
+            while (written < data.size()) {
+                auto count = ::send(descriptor, data.data() + written, data.size() - written, flags);
+                if (count <= 0) {
+                    throw std::runtime_error("SERVER: failed to write into the socket");
+                }
+                written += static_cast<size_t>(count);
+            }
+        }
+
+        /** Reads until the request terminator (an empty line) or the end of the stream.
+            Throws when the connection times out before the request is complete.
+         */
+        std::string readRequest(int descriptor) {
+            std::string result;
+            char buffer[4096];
+            while (result.find("\n\n") == std::string::npos) {
+                auto count = ::read(descriptor, buffer, sizeof(buffer));
+                if (count < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                    throw std::runtime_error("SERVER: timed out waiting for the request");
+                }
+                if (count <= 0) break;
+                result.append(buffer, static_cast<size_t>(count));
+            }
+            return result;
+        }
+
+        std::string readAll(int descriptor) {
+            std::string result;
+            char buffer[4096];
+            while (true) {
+                auto count = ::read(descriptor, buffer, sizeof(buffer));
+                if (count <= 0) break;
+                result.append(buffer, static_cast<size_t>(count));
+            }
+            return result;
+        }
+
+    } // anonymous namespace
+
+    void TranspileServer::run() {
+        auto address = makeSocketAddress(socketPath_);
+        int listener = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listener < 0) {
+            throw std::runtime_error("SERVER: failed to create a socket");
+        }
+        // a socket file left by a previous (crashed) server would fail the bind
+        ::unlink(socketPath_.c_str());
+        if (::bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0
+            || ::listen(listener, 16) < 0) {
+            ::close(listener);
+            throw std::runtime_error(STR("SERVER: failed to listen on " << socketPath_));
+        }
+        bool isStopRequested = false;
+        while (!isStopRequested) {
+            int connection = ::accept(listener, nullptr, nullptr);
+            if (connection < 0) continue;
+            setTimeout(connection, ConnectionTimeoutSeconds);
+            std::string response;
+            try {
+                response = serve(TranspileRequest::Deserialize(readRequest(connection)), isStopRequested);
+            } catch (std::exception & exception) {
+                response = STR("error\n" << describeError(exception) << "\n");
+            }
+            try {
+                writeAll(connection, response);
+            } catch (std::exception &) {
+                // the client went away, nothing to report to
+            }
+            ::close(connection);
+        }
+        ::close(listener);
+        ::unlink(socketPath_.c_str());
+    }
+
+    std::string sendTranspileRequest(std::string const & socketPath, TranspileRequest const & request) {
+        auto address = makeSocketAddress(socketPath);
+        int connection = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (connection < 0) {
+            throw std::runtime_error("CLIENT: failed to create a socket");
+        }
+        if (::connect(connection, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0) {
+            ::close(connection);
+            throw std::runtime_error(STR("CLIENT: no server is listening on " << socketPath));
+        }
+        writeAll(connection, request.serialize());
+        auto response = readAll(connection);
+        ::close(connection);
+        return response;
+    }
+
+#else
+
+    void TranspileServer::run() {
+        throw std::runtime_error("SERVER: unix domain sockets are not supported on this platform");
+    }
+
+    std::string sendTranspileRequest(std::string const &, TranspileRequest const &) {
+        throw std::runtime_error("CLIENT: unix domain sockets are not supported on this platform");
+    }
+
+#endif
+
+} // namespace tinycplus
@@ -0,0 +1,109 @@
+#pragma once
+
+// standard
+#include <string>
+#include <cstdint>
+#include <list>
+#include <optional>
+#include <unordered_map>
+#include <filesystem>
+
+// internal
+#include "driver.h"
+
+namespace tinycplus {
+
+    /** Transpile request exchanged between the client and the server.
+
+        On the wire the request is a list of "key=value" lines terminated by an empty line:
+            path=<absolute input filepath>
+            entry=<entry function name>
+            colorful=0|1
+            parse-only=0|1
+            emit=tinyc|cpp
+            instrument=none|dispatch|coverage|dispatch,coverage
+            profile-use=<absolute profile filepath, empty for none>
+            command=transpile|stop
+        The response is a status line ("ok <milliseconds> <cached|fresh>" or "error") followed by the output (or the error message) until the connection is closed.
+     */
+    struct TranspileRequest {
+        std::string command = "transpile";
+        std::string inputFilepath;
+        std::string entry;
+        CompileOptions options;
+
+        std::string serialize() const;
+        static TranspileRequest Deserialize(std::string const & text);
+    };
+
+    /** Keeps outputs of already transpiled files.
+        An entry is valid as long as the file and the profile of the request (--profile-use) have the same contents, and the request has the same flags.
+        The outputs take at most the capacity in bytes, the least recently used entries are evicted first.
+     */
+    class OutputCache {
+    public:
+        static constexpr size_t DefaultCapacity = 64 * 1024 * 1024;
+    private:
+        /** Contents of a file as seen by the cache.
+            Modification time and size are compared first, as they are cheap, the hash of the bytes then catches edits which keep the size within the timestamp granularity of the filesystem.
+         */
+        struct FileStamp {
+            std::filesystem::file_time_type modified;
+            std::uintmax_t size = 0;
+            uint64_t hash = 0;
+
+            /** Returns the stamp of the file, none when it cannot be read.
+             */
+            static std::optional<FileStamp> Of(std::string const & filepath);
+            /** Whether the file still has the stamped contents.
+             */
+            bool matches(std::string const & filepath) const;
+        private:
+            static std::optional<uint64_t> HashContents(std::string const & filepath);
+        };
+        struct Entry {
+            FileStamp input;
+            std::optional<FileStamp> profile; // none when the request uses no profile
+            std::string output;
+            std::list<std::string>::iterator recent; // position in recent_
+        };
+        std::unordered_map<std::string, Entry> entries_;
+        std::list<std::string> recent_; // keys, the most recently used first
+        size_t capacity_;
+        size_t bytes_ = 0;
+    public:
+        OutputCache(size_t capacity = DefaultCapacity): capacity_{capacity} { }
+    public:
+        std::string const * find(TranspileRequest const & request);
+        void store(TranspileRequest const & request, std::string output);
+    private:
+        void erase(std::unordered_map<std::string, Entry>::iterator it);
+        static std::string MakeKey(TranspileRequest const & request);
+    };
+
+    /** Long living transpiler process listening on a local unix domain socket.
+        Requests are served one by one, so the process keeps its warm state (interned symbols, outputs cache) between them. A client which does not send its request or read its response within the timeout is disconnected, so that it cannot stall the others.
+     */
+    class TranspileServer {
+    public:
+        static constexpr int ConnectionTimeoutSeconds = 5;
+    private:
+        std::string socketPath_;
+        OutputCache cache_;
+    public:
+        TranspileServer(std::string socketPath): socketPath_{std::move(socketPath)} { }
+    public:
+        /** Serves requests until the "stop" command is received.
+         */
+        void run();
+    private:
+        /** Returns the whole response for the request and whether the server should stop.
+         */
+        std::string serve(TranspileRequest const & request, bool & isStopRequested);
+    };
+
+    /** Sends the request to the server and returns its response.
+     */
+    std::string sendTranspileRequest(std::string const & socketPath, TranspileRequest const & request);
+
+} // namespace tinycplus
@@ -0,0 +1,8 @@
+#include "shared.h"
+
+namespace tinycplus {
+
+    // declaration for extern Entry, lives next to the rest of the pipeline so tools other than the main executable link it too
+    Symbol symbols::Entry = symbols::Main;
+
+} // namespace tinycplus
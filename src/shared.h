@@ -80,6 +80,10 @@ namespace tinycplus {
         static Symbol KwAccessPublic {"public"};
         static Symbol KwAccessPrivate {"private"};
         static Symbol KwAccessProtected {"protected"};
+        static Symbol KwNew {"new"}; // allocates an instance of a pooled class
+        static Symbol KwDelete {"delete"}; // returns an instance to the pool of its class
+        static Symbol KwTemplate {"template"}; // declares the type parameters of a generic function
+        static Symbol KwConstexpr {"constexpr"}; // marks the function as evaluated at compile time when called with constants
 
         // RESERVED IDENTIFIERS
         static Symbol KwThis {"this"}; // compulsory first argument of any method, representing reference to the target.
@@ -89,6 +93,7 @@ namespace tinycplus {
 
         static Symbol ClassMakeConstructorPrefix {"_Cmake_"};
         static Symbol ClassInitConstructorPrefix {"_Cinit_"};
+        static Symbol ClassNewConstructorPrefix {"_Cnew_"}; // allocates from the pool and calls the init constructor
         static Symbol ClassCastToClassPrefix {"_Ccheck_"};
         static Symbol ClassCastToClassFuncType {"_Ccheckf_"};
         static Symbol ClassGetImplPrefix {"_Cgeti_"};
@@ -98,6 +103,15 @@ namespace tinycplus {
         static Symbol ClassInterfaceImplInstPrefix {"_Cimpl_"};
         static Symbol ClassCastToClassFunction {"_Ccast_"};
         static Symbol ClassSetupFunctionPrefix {"_Csetup_"};
+        static Symbol StructOfArraysPrefix {"_Csoa_"}; // array of one field of the elements of a soa array variable
+        static Symbol ScalarFieldPrefix {"_Csra_"}; // variable of one field of a scalar replaced local instance, see EscapeAnalysis
+        static Symbol ScalarArgumentPrefix {"_Csrarg_"}; // variable of one constructor argument of a scalar replaced local instance
+        static Symbol ClassPoolPrefix {"_Cpool_"}; // static arena of the instances of a pooled class
+        static Symbol ClassPoolUsedPrefix {"_Cpused_"}; // number of the arena slots ever allocated
+        static Symbol ClassPoolFreePrefix {"_Cpfree_"}; // head of the freed instances, linked through their vtable pointer
+        static Symbol ClassPoolAllocPrefix {"_Calloc_"};
+        static Symbol ClassDeletePrefix {"_Cdelete_"}; // returns the instance to the pool of its dynamic class
+        static Symbol GenericInstancePrefix {"_Gfun_"}; // generic function with its type parameters replaced by the type arguments of one instance
 
         static Symbol VirtualTableTypePrefix {"_VTtype_"};     // prefix of the virtual table struct
         static Symbol VirtualTableInstancePrefix {"_VTinst_"}; // prefix for global virtual table instance
@@ -110,6 +124,35 @@ namespace tinycplus {
         static Symbol InterfaceMethodFuncTypePrefix {"_IFtype_"};
         static Symbol InterfaceCastFuncPerfix {"_Icast_"};
 
+        // DISPATCH INSTRUMENTATION (--instrument=dispatch) AND PROFILE GUIDED DISPATCH (--profile-use)
+        static Symbol ProfileRecordFunction {"_Precord_"}; // records the receiver of a call site, returns it
+        static Symbol ProfileRecordObjectFunction {"_Precord_object_"}; // records the vtable of a cast subject, returns the subject
+        static Symbol ProfileReceiversArray {"_Preceivers_"};
+        static Symbol ProfileCountsArray {"_Pcounts_"};
+        static Symbol ProfileOthersArray {"_Pothers_"};
+        static Symbol ProfileSitesCount {"_Psites_count_"};
+        static Symbol ProfileSiteFunction {"_Psite_"}; // site id -> description
+        static Symbol ProfileReceiverClassFunction {"_Preceiver_class_"}; // recorded receiver -> class name
+        static Symbol ProfileGuardPrefix {"_Pguard_"}; // dispatch site specialized by --profile-use
+        static Symbol ProfileCastCacheSuffix {"cache_"}; // impl cache of a guarded interface cast
+        static Symbol ProfileCoverageArray {"_Pcoverage_"}; // entries of functions and iterations of loops (--instrument=coverage)
+        static Symbol ProfileCoverageCount {"_Pcoverage_count_"};
+        static Symbol ProfileCoverageFunction {"_Pcoverage_site_"}; // counter id -> description
+
+        // CLASS ATTRIBUTES (class Name [attribute, ...])
+        static Symbol AttributeCompact {"compact"}; // own fields are laid out by alignment instead of the declaration order
+        static Symbol AttributeStructOfArrays {"soa"}; // array variables of the class are lowered to one array per field
+        static Symbol AttributePooled {"pooled"}; // instances can be allocated by new from a per-class slab
+
+        // NATIVE C++ OUTPUT (see CppEmitter)
+        static Symbol CppFinal {"final"};
+        static Symbol CppStaticCast {"static_cast"};
+        static Symbol CppDynamicCast {"dynamic_cast"};
+        static Symbol CppNullptr {"nullptr"};
+        static Symbol CppExactCast {"_Cexact_cast_"}; // downcast to a final class, checks the exact dynamic type only
+        static Symbol CppPool {"_Cslab_"}; // slab of a pooled class, used by its operator new and delete
+        static Symbol CppTypename {"typename"};
+
         static Symbol Main {"main"}; // main function name
         static Symbol VirtualTableAsField {"_vt"}; // name for class field with vtable pointer type.
         static Symbol InterfaceImplAsField {"impl"};
@@ -131,6 +174,10 @@ namespace tinycplus {
                 || s == KwAccessPrivate
                 || s == KwAccessProtected
                 || s == KwClassCast
+                || s == KwNew
+                || s == KwDelete
+                || s == KwTemplate
+                || s == KwConstexpr
                 ;
         }
 
@@ -144,6 +191,13 @@ namespace tinycplus {
             return false;
         }
 
+        bool static isClassAttribute(Symbol const & s) {
+            return s == AttributeCompact
+                || s == AttributeStructOfArrays
+                || s == AttributePooled
+                ;
+        }
+
         static tinycplus::SymbolBuilder start() {
             return tinycplus::SymbolBuilder{};
         };
@@ -176,6 +230,20 @@ namespace tinycplus {
             return symbols::start().add(symbols::ClassMethodFuncTypePrefix).add(className).add("_").add(methodName).end();
         }
 
+        /** The length of the variable name keeps "a_b[i].c" and "a[i].b_c" apart.
+         */
+        static Symbol makeStructOfArraysField(Symbol arrayName, Symbol fieldName) {
+            return symbols::start().add(symbols::StructOfArraysPrefix).add(arrayName.name().size()).add("_").add(arrayName).add("_").add(fieldName).end();
+        }
+
+        static Symbol makeScalarField(Symbol variableName, Symbol fieldName) {
+            return symbols::start().add(symbols::ScalarFieldPrefix).add(variableName.name().size()).add("_").add(variableName).add("_").add(fieldName).end();
+        }
+
+        static Symbol makeScalarArgument(Symbol variableName, Symbol parameterName) {
+            return symbols::start().add(symbols::ScalarArgumentPrefix).add(variableName.name().size()).add("_").add(variableName).add("_").add(parameterName).end();
+        }
+
         // static Symbol makeImplInitFuncName(Symbol interfaceName, Symbol className) {
         //     return system()
         //         .add("Iinit_").add(interfaceName)
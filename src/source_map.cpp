@@ -0,0 +1,51 @@
+// standard
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+
+// external
+#include "common/helpers.h"
+
+// internal
+#include "source_map.h"
+
+namespace tinycplus {
+
+    OutputCountingBuffer::int_type OutputCountingBuffer::overflow(int_type c) {
+        if (traits_type::eq_int_type(c, traits_type::eof())) return traits_type::not_eof(c);
+        auto ch = traits_type::to_char_type(c);
+        if (ch == '\n') ++newlines_;
+        ++bytes_;
+        isAtLineStart_ = ch == '\n';
+        return target_->sputc(ch);
+    }
+
+    std::streamsize OutputCountingBuffer::xsputn(char const * s, std::streamsize n) {
+        if (n <= 0) return 0;
+        newlines_ += static_cast<size_t>(std::count(s, s + n, '\n'));
+        bytes_ += static_cast<size_t>(n);
+        isAtLineStart_ = s[n - 1] == '\n';
+        return target_->sputn(s, n);
+    }
+
+    int OutputCountingBuffer::sync() {
+        return target_->pubsync();
+    }
+
+    void SourceMap::write(std::ostream & output) const {
+        // entries are added as their functions are printed, thus in the output order
+        output << "# <output lines> <symbol> <source location>\n";
+        for (auto & it : entries_) {
+            output << it.firstLine << "-" << it.lastLine << " " << it.symbol << " " << it.location << "\n";
+        }
+    }
+
+    void SourceMap::write(std::string const & filepath) const {
+        std::ofstream output{filepath};
+        if (!output) {
+            throw std::runtime_error(STR("SOURCE MAP: cannot write file at path: " << filepath));
+        }
+        write(output);
+    }
+
+} // namespace tinycplus
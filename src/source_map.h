@@ -0,0 +1,79 @@
+#pragma once
+
+// standard
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+namespace tinycplus {
+
+    /** Stream buffer counting the lines and bytes written through it into the wrapped buffer, so that the transpiler knows where in the output it prints.
+     */
+    class OutputCountingBuffer : public std::streambuf {
+    private:
+        std::streambuf * target_;
+        size_t newlines_ = 0;
+        size_t bytes_ = 0;
+        bool isAtLineStart_ = true;
+    public:
+        explicit OutputCountingBuffer(std::streambuf * target)
+            :target_{target}
+        { }
+
+        /** Line the next character is written to, starting at 1.
+         */
+        size_t nextLine() const {
+            return newlines_ + 1;
+        }
+
+        /** Line of the last written character.
+         */
+        size_t lastLine() const {
+            return isAtLineStart_ && newlines_ > 0 ? newlines_ : newlines_ + 1;
+        }
+
+        size_t bytes() const {
+            return bytes_;
+        }
+    protected:
+        int_type overflow(int_type c) override;
+        std::streamsize xsputn(char const * s, std::streamsize n) override;
+        int sync() override;
+    };
+
+    /** Function of the output and the TinyC+ declaration it was generated from.
+     */
+    struct SourceMapEntry {
+        size_t firstLine;
+        size_t lastLine;
+        std::string symbol; // name of the function in the output
+        std::string location; // "<file>:<line>:<col>" of the declaration
+    };
+
+    /** Maps the output of the transpiler back to the TinyC+ source (--source-map).
+
+        The map is a text file with one emitted function per line, ordered by the output lines, lines starting with '#' are comments:
+            <first output line>-<last output line> <symbol> <file>:<line>:<col>
+        Symbols are the names of the output functions, e.g. "_CF_Shape_area" or "_Cinit_1_Shape", so a profile of the compiled output can be attributed to the source by either.
+     */
+    class SourceMap {
+    private:
+        std::vector<SourceMapEntry> entries_;
+    public:
+        void add(SourceMapEntry entry) {
+            entries_.push_back(std::move(entry));
+        }
+
+        std::vector<SourceMapEntry> const & entries() const {
+            return entries_;
+        }
+
+        void write(std::ostream & output) const;
+
+        /** Throws when the file cannot be written.
+         */
+        void write(std::string const & filepath) const;
+    };
+
+} // namespace tinycplus
@@ -0,0 +1,103 @@
+// standard
+#include <iomanip>
+
+// internal
+#include "stats.h"
+
+namespace tinycplus {
+
+    size_t EmitStats::interfaceTablesCount() const {
+        size_t result = 0;
+        for (auto & it : classes) result += it.interfaceTables.size();
+        return result;
+    }
+
+    void EmitStats::printText(std::ostream & output) const {
+        output << "=== Generated code ===\n";
+        output << "emitted bytes:          " << totalBytes << "\n";
+        output << "classes:                " << classes.size() << "\n";
+        output << "interface tables:       " << interfaceTablesCount() << "\n";
+        output << "functions:              " << functions.size() << "\n";
+        output << "virtual call sites:     " << virtualCalls << "\n";
+        output << "guarded call sites:     " << guardedCalls << "\n";
+        output << "interface call sites:   " << interfaceCalls << "\n";
+        output << "direct call sites:      " << directCalls << "\n";
+        output << "pointer call sites:     " << functionPointerCalls << "\n";
+        output << "folded call sites:      " << foldedCalls << "\n";
+        output << "runtime class casts:    " << runtimeClassCasts << "\n";
+        output << "static class casts:     " << staticClassCasts << "\n";
+        output << "interface casts:        " << interfaceCasts << "\n";
+        output << std::left << std::setw(30) << "class"
+            << std::right << std::setw(8) << "slots"
+            << std::setw(8) << "itables"
+            << std::setw(10) << "size"
+            << std::setw(10) << "padding"
+            << std::setw(8) << "saved"
+            << std::setw(12) << "bytes"
+            << std::setw(12) << "fn bytes" << "\n";
+        for (auto & it : classes) {
+            output << std::left << std::setw(30) << it.name
+                << std::right << std::setw(8) << it.vtableSlots
+                << std::setw(8) << it.interfaceTables.size()
+                << std::setw(10) << it.objectSize
+                << std::setw(10) << it.paddingBytes
+                << std::setw(8) << it.savedBytes
+                << std::setw(12) << it.emittedBytes
+                << std::setw(12) << it.functionBytes << "\n";
+        }
+        output << std::left << std::setw(40) << "function" << std::right << std::setw(12) << "bytes" << "\n";
+        for (auto & it : functions) {
+            output << std::left << std::setw(40) << it.symbol << std::right << std::setw(12) << it.emittedBytes << "\n";
+        }
+    }
+
+    void EmitStats::printJson(std::ostream & output) const {
+        output << "{\"emitted_bytes\":" << totalBytes
+            << ",\"call_sites\":{"
+                << "\"virtual\":" << virtualCalls
+                << ",\"guarded\":" << guardedCalls
+                << ",\"interface\":" << interfaceCalls
+                << ",\"direct\":" << directCalls
+                << ",\"function_pointer\":" << functionPointerCalls
+                << ",\"folded\":" << foldedCalls
+            << "}"
+            << ",\"casts\":{"
+                << "\"runtime_class\":" << runtimeClassCasts
+                << ",\"static_class\":" << staticClassCasts
+                << ",\"interface\":" << interfaceCasts
+            << "}"
+            << ",\"interface_tables\":" << interfaceTablesCount()
+            << ",\"classes\":[";
+        for (size_t i = 0; i < classes.size(); ++i) {
+            auto & it = classes[i];
+            if (i > 0) output << ",";
+            output << "{\"name\":\"" << it.name << "\""
+                << ",\"abstract\":" << (it.isAbstract ? "true" : "false")
+                << ",\"vtable_slots\":" << it.vtableSlots
+                << ",\"interface_tables\":[";
+            for (size_t j = 0; j < it.interfaceTables.size(); ++j) {
+                if (j > 0) output << ",";
+                output << "{\"interface\":\"" << it.interfaceTables[j].first << "\",\"slots\":" << it.interfaceTables[j].second << "}";
+            }
+            output << "]"
+                << ",\"object_size\":" << it.objectSize
+                << ",\"object_align\":" << it.objectAlign
+                << ",\"padding_bytes\":" << it.paddingBytes
+                << ",\"saved_bytes\":" << it.savedBytes
+                << ",\"emitted_bytes\":" << it.emittedBytes
+                << ",\"function_bytes\":" << it.functionBytes
+                << "}";
+        }
+        output << "],\"functions\":[";
+        for (size_t i = 0; i < functions.size(); ++i) {
+            auto & it = functions[i];
+            if (i > 0) output << ",";
+            output << "{\"symbol\":\"" << it.symbol << "\""
+                << ",\"class\":\"" << it.owner << "\""
+                << ",\"emitted_bytes\":" << it.emittedBytes
+                << "}";
+        }
+        output << "]}\n";
+    }
+
+} // namespace tinycplus
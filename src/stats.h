@@ -0,0 +1,57 @@
+#pragma once
+
+// standard
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace tinycplus {
+
+    /** What the transpiler emitted for one class.
+     */
+    struct ClassStats {
+        std::string name;
+        bool isAbstract = false;
+        size_t vtableSlots = 0; // virtual methods, inherited ones included
+        std::vector<std::pair<std::string, size_t>> interfaceTables; // implemented interface -> slots of its impl table
+        size_t emittedBytes = 0; // struct, vtable, dispatch helpers and setup, without the methods and constructors
+        size_t functionBytes = 0; // methods and constructors
+        size_t objectSize = 0; // instance layout, the vtable pointer included, see computeClassLayout
+        size_t objectAlign = 0;
+        size_t paddingBytes = 0;
+        size_t savedBytes = 0; // by the compact layout, against the declaration order
+    };
+
+    /** What the transpiler emitted for one function, method or constructor.
+     */
+    struct FunctionStats {
+        std::string symbol; // name of the function in the output
+        std::string owner; // class of methods and constructors
+        size_t emittedBytes = 0;
+    };
+
+    /** Summary of the generated code (--stats), collected by the transpiler as it emits.
+        Sites are counted as emitted, so the sites of a constructor body count twice, once for its make and once for its init function.
+     */
+    class EmitStats {
+    public:
+        std::vector<ClassStats> classes;
+        std::vector<FunctionStats> functions;
+        size_t totalBytes = 0;
+        size_t virtualCalls = 0; // through the vtable
+        size_t guardedCalls = 0; // specialized by the profile, see Transpiler::DispatchGuard
+        size_t interfaceCalls = 0; // through the impl of the view
+        size_t directCalls = 0; // functions, constructors and statically bound methods
+        size_t functionPointerCalls = 0;
+        size_t foldedCalls = 0; // constexpr calls replaced by their value
+        size_t runtimeClassCasts = 0; // lowered to the _Ccast_ check
+        size_t staticClassCasts = 0; // upcasts, lowered to a plain cast
+        size_t interfaceCasts = 0;
+    public:
+        size_t interfaceTablesCount() const;
+        void printText(std::ostream & output) const;
+        void printJson(std::ostream & output) const;
+    };
+
+} // namespace tinycplus
@@ -1,47 +1,194 @@
+#pragma once
+
+// standard
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <string_view>
+#include <algorithm>
+
+// external
+#include "common/helpers.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TINYCPLUS_HAS_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace tinycToCpp {
-    std::string read_file(const std::string & filename) {
-        std::ifstream input;
-        input.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-        input.open(filename);
-        if (!input) {
-            throw std::runtime_error(STR("Cannot open file at path: " << filename));
+
+    /** Read-only view of a whole file, memory mapped where the platform allows it.
+     */
+    class MappedFile {
+    private:
+        char const * data_ = nullptr;
+        size_t size_ = 0;
+        std::string fallback_;
+    public:
+        explicit MappedFile(std::string const & filename) {
+#ifdef TINYCPLUS_HAS_MMAP
+            int fd = ::open(filename.c_str(), O_RDONLY);
+            if (fd < 0) {
+                throw std::runtime_error(STR("Cannot open file at path: " << filename));
+            }
+            struct stat info;
+            if (::fstat(fd, &info) != 0) {
+                ::close(fd);
+                throw std::runtime_error(STR("Cannot read file at path: " << filename));
+            }
+            size_ = static_cast<size_t>(info.st_size);
+            if (size_ > 0) {
+                void * mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+                if (mapped == MAP_FAILED) {
+                    ::close(fd);
+                    throw std::runtime_error(STR("Cannot map file at path: " << filename));
+                }
+                data_ = static_cast<char const *>(mapped);
+            }
+            // the mapping stays valid after the descriptor is closed
+            ::close(fd);
+#else
+            std::ifstream input{filename, std::ios::binary};
+            if (!input) {
+                throw std::runtime_error(STR("Cannot open file at path: " << filename));
+            }
+            input.seekg(0, std::ios::end);
+            fallback_.resize(static_cast<size_t>(input.tellg()));
+            input.seekg(0, std::ios::beg);
+            if (!input.read(fallback_.data(), static_cast<std::streamsize>(fallback_.size()))) {
+                throw std::runtime_error(STR("Cannot read file at path: " << filename));
+            }
+            data_ = fallback_.data();
+            size_ = fallback_.size();
+#endif
         }
-        std::string content;
-        char c;
-        while (input.get(c)) {
-            content.push_back(c);
+
+        ~MappedFile() {
+#ifdef TINYCPLUS_HAS_MMAP
+            if (data_ != nullptr) ::munmap(const_cast<char *>(data_), size_);
+#endif
+        }
+
+        MappedFile(MappedFile const &) = delete;
+        MappedFile & operator=(MappedFile const &) = delete;
+
+        std::string_view view() const {
+            return std::string_view{data_, size_};
         }
-        return content;
+    };
+
+    inline bool is_identifier_char(char c) {
+        return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+    }
+
+    /** Whether the token gets an underscore prefix: "this" and "null", and their underscored forms which the transpiler uses for its own names ("_this" becomes "__this"), so that the renaming never merges two names.
+     */
+    inline bool is_prefixed_token(std::string_view token) {
+        auto name = token.substr(std::min(token.find_first_not_of('_'), token.size()));
+        return name == "this" || name == "null";
+    }
+
+    /** Copies a quoted literal starting at the given position, escapes included, returns the position after it.
+     */
+    inline size_t copy_literal(std::string_view input, size_t i, std::string & output) {
+        char quote = input[i];
+        size_t start = i++;
+        while (i < input.size() && input[i] != quote) {
+            i += input[i] == '\\' ? 2 : 1;
+        }
+        i = std::min(i + 1, input.size());
+        output.append(input.substr(start, i - start));
+        return i;
     }
 
-    void find_and_replace(std::string& content, const std::string& keyword, const std::string& replacement) {
-        auto index = content.find(keyword);
-        while (index != std::string::npos) {
-            content.replace(index, keyword.length(), replacement);
-            index = content.find(keyword, index);
+    /** Comment of the transpiler line markers (--line-markers), "// #line <line> \"<file>\"" or "// #line default".
+     */
+    constexpr std::string_view line_marker_prefix = "// #line ";
+    constexpr std::string_view line_marker_default = "default";
+
+    /** Rewrites tinyC into C++ in a single pass. Only whole identifier tokens outside of literals and comments are rewritten.
+        Line marker comments become #line directives, so the C++ compiler attributes the code to the TinyC+ source. The default marker returns to the lines of the given tinyC file, it is kept as a comment when no file is given.
+     */
+    inline void convert(std::string_view input, std::string & output, std::string_view filename = {}) {
+        // the few rewritten tokens only grow the output a little
+        output.reserve(output.size() + input.size() + input.size() / 8);
+        // lines of the input before the counted position, counted lazily for the default line markers only
+        size_t countedPosition = 0;
+        size_t countedLines = 0;
+        size_t i = 0;
+        while (i < input.size()) {
+            char c = input[i];
+            if (c == '"' || c == '\'') {
+                i = copy_literal(input, i, output);
+            } else if (c == '/' && i + 1 < input.size() && (input[i + 1] == '/' || input[i + 1] == '*')) {
+                bool isLine = input[i + 1] == '/';
+                auto end = input.find(isLine ? "\n" : "*/", i + 2);
+                end = end == std::string_view::npos ? input.size() : end + (isLine ? 0 : 2);
+                auto comment = input.substr(i, end - i);
+                if (isLine && comment.substr(0, line_marker_prefix.size()) == line_marker_prefix) {
+                    auto marker = comment.substr(line_marker_prefix.size());
+                    if (marker != line_marker_default) {
+                        output.append("#line ");
+                        output.append(marker);
+                    } else if (!filename.empty()) {
+                        countedLines += static_cast<size_t>(std::count(input.begin() + countedPosition, input.begin() + i, '\n'));
+                        countedPosition = i;
+                        // the directive names the line which follows it
+                        output.append("#line ");
+                        output.append(std::to_string(countedLines + 2));
+                        output.append(" \"");
+                        for (char ch : filename) {
+                            if (ch == '\\' || ch == '"') output.push_back('\\');
+                            output.push_back(ch);
+                        }
+                        output.push_back('"');
+                    } else {
+                        output.append(comment);
+                    }
+                } else {
+                    output.append(comment);
+                }
+                i = end;
+            } else if (is_identifier_char(c)) {
+                size_t start = i;
+                while (i < input.size() && is_identifier_char(input[i])) ++i;
+                auto token = input.substr(start, i - start);
+                // 1. tinyC+ extensively uses "this" keyword which means nothing in tinyC, but is a keword in C++.
+                //    Therefore, to resolve compile errors on using "this" keyword, we can prefix underscore to it turning it into a valid identifier
+                if (is_prefixed_token(token)) {
+                    output.push_back('_');
+                    output.append(token);
+                // 2. C++ does not have "cast" operator, but "reinterpret_cast" matches expectations of what "cast" does,
+                } else if (token == "cast" && i < input.size() && input[i] == '<') {
+                    output.append("reinterpret_cast");
+                } else {
+                    output.append(token);
+                }
+            } else {
+                output.push_back(c);
+                ++i;
+            }
         }
     }
 
-    void execute(const std::string & filename) {
-        auto content = read_file(filename);
-        // tinyC code can be a strict version of C++ if few changes to the outputed code applies:
-        // 1. tinyC+ extensively uses "this" keyword which means nothing in tinyC, but is a keword in C++.
-        //    Therefore, to resolve compile errors on using "this" keyword, we can prefix underscore to it turning it into a valid identifier 
-        find_and_replace(content, "this", "_this");
-        find_and_replace(content, "null", "_null");
-        // 2. C++ does not have "cast" operator, but "reinterpret_cast" matches expectations of what "cast" does,
-        find_and_replace(content, "cast<", "reinterpret_cast<");
+    inline void execute(const std::string & filename, std::ostream & output = std::cout) {
+        // tinyC code can be a strict version of C++ if few changes to the outputed code applies, see convert
+        MappedFile input{filename};
+        std::string content;
+        convert(input.view(), content, filename);
         // Now, out tinyC code is actually a very modest version of C++ program, which can be runned just fine.
         // [!] To debug the resulted C++ program, please setup project and debug code.
         //     Unfortunetly, there is no print function, and adding it to the language as weird preprocessor is pain in a** to do and explain in thesis.
-        std::cout << content << std::endl;
+        content.push_back('\n');
+        output.write(content.data(), static_cast<std::streamsize>(content.size()));
+        output.flush();
 
         // [funfact]:
         // it is actually easy to get C++ from tinyC than C, because of complex types
         // where C requires "struct" keyword being used in declarations.
         // Also, "cast" might be a problem to replace as I dont recall what analog C has for it.
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,87 @@
+// standard
+#include <iomanip>
+
+// internal
+#include "tracing.h"
+#include "ast.h"
+
+namespace tinycplus {
+
+    namespace {
+
+        /** Writes the text as a JSON string, quotes included, escaping quotes, backslashes and control characters.
+         */
+        void writeJsonString(std::ostream & output, std::string const & text) {
+            output << '"';
+            for (char c : text) {
+                switch (c) {
+                    case '"': output << "\\\""; break;
+                    case '\\': output << "\\\\"; break;
+                    case '\n': output << "\\n"; break;
+                    case '\r': output << "\\r"; break;
+                    case '\t': output << "\\t"; break;
+                    default:
+                        if (static_cast<unsigned char>(c) < 0x20) {
+                            output << "\\u" << std::hex << std::setw(4) << std::setfill('0') << static_cast<int>(c) << std::dec << std::setfill(' ');
+                        } else {
+                            output << c;
+                        }
+                }
+            }
+            output << '"';
+        }
+
+    } // anonymous namespace
+
+    void TraceRecorder::record(std::string name, char const * category, double startMicroseconds, double endMicroseconds) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        auto threadIt = threadIds_.find(std::this_thread::get_id());
+        if (threadIt == threadIds_.end()) {
+            threadIt = threadIds_.insert(std::make_pair(std::this_thread::get_id(), static_cast<int>(threadIds_.size()) + 1)).first;
+        }
+        events_.push_back(Event{std::move(name), category, startMicroseconds, endMicroseconds - startMicroseconds, threadIt->second});
+    }
+
+    void TraceRecorder::writeJson(std::ostream & output) {
+        std::lock_guard<std::mutex> lock{mutex_};
+        output << "{\"traceEvents\":[";
+        bool isFirst = true;
+        for (auto & event : events_) {
+            if (!isFirst) output << ",";
+            isFirst = false;
+            output << "\n{\"name\":";
+            writeJsonString(output, event.name);
+            output << ",\"cat\":";
+            writeJsonString(output, event.category);
+            output << ",\"ph\":\"X\",\"pid\":1"
+                << ",\"tid\":" << event.threadId
+                << std::fixed << std::setprecision(3)
+                << ",\"ts\":" << event.startMicroseconds
+                << ",\"dur\":" << event.durationMicroseconds
+                << "}";
+        }
+        output << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    }
+
+    namespace tracing {
+
+        std::string describeDeclaration(AST * ast) {
+            if (auto * decl = ast->as<ASTClassDecl>()) {
+                return STR("class " << decl->name.name());
+            } else if (auto * decl = ast->as<ASTInterfaceDecl>()) {
+                return STR("interface " << decl->name.name());
+            } else if (auto * decl = ast->as<ASTStructDecl>()) {
+                return STR("struct " << decl->name.name());
+            } else if (auto * decl = ast->as<ASTFunDecl>()) {
+                return STR("function " << (decl->name.has_value() ? decl->name.value().name() : std::string{"?"}));
+            } else if (auto * decl = ast->as<ASTFunPtrDecl>()) {
+                return STR("typedef " << decl->name->name.name());
+            } else if (auto * decl = ast->as<ASTVarDecl>()) {
+                return STR("var " << decl->name->name.name());
+            }
+            return "declaration";
+        }
+
+    } // namespace tracing
+
+} // namespace tinycplus
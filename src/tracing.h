@@ -0,0 +1,75 @@
+#pragma once
+
+// standard
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace tinycplus {
+
+    class AST;
+
+    /** Records spans of the transpiler work as Chrome trace events (--trace), viewable in Perfetto or chrome://tracing.
+        Safe to share between threads (batch mode), every span carries the id of the thread which recorded it.
+     */
+    class TraceRecorder {
+    private:
+        struct Event {
+            std::string name;
+            char const * category;
+            double startMicroseconds;
+            double durationMicroseconds;
+            int threadId;
+        };
+        std::mutex mutex_;
+        std::vector<Event> events_;
+        std::unordered_map<std::thread::id, int> threadIds_;
+        std::chrono::steady_clock::time_point origin_ = std::chrono::steady_clock::now();
+    public:
+        double now() const {
+            return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - origin_).count();
+        }
+        void record(std::string name, char const * category, double startMicroseconds, double endMicroseconds);
+        void writeJson(std::ostream & output);
+    };
+
+    /** Records the enclosing scope as a span. Does nothing when no recorder is given.
+        The name may be set later, e.g. when a declaration name is known only after it was parsed.
+     */
+    class ScopedSpan {
+    private:
+        TraceRecorder * recorder_;
+        std::string name_;
+        char const * category_;
+        double start_ = 0;
+    public:
+        ScopedSpan(TraceRecorder * recorder, char const * category, std::string name = "")
+            : recorder_{recorder}
+            , name_{std::move(name)}
+            , category_{category} {
+            if (recorder_ != nullptr) start_ = recorder_->now();
+        }
+        ~ScopedSpan() {
+            if (recorder_ != nullptr) recorder_->record(std::move(name_), category_, start_, recorder_->now());
+        }
+        ScopedSpan(ScopedSpan const &) = delete;
+        ScopedSpan & operator=(ScopedSpan const &) = delete;
+        bool isEnabled() const {
+            return recorder_ != nullptr;
+        }
+        void setName(std::string name) {
+            name_ = std::move(name);
+        }
+    };
+
+    namespace tracing {
+        /** Returns human readable name of a top-level declaration for its spans, e.g. "class Foo".
+         */
+        std::string describeDeclaration(AST * ast);
+    }
+
+} // namespace tinycplus
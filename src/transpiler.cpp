@@ -31,6 +31,14 @@ namespace tinycplus {
     }
 
     void Transpiler::visit(ASTIdentifier * ast) {
+        if (inlinedArguments_ != nullptr) {
+            // * the parameters of an inlined constructor are the variables of the instance's arguments
+            auto argument = inlinedArguments_->find(ast->name);
+            if (argument != inlinedArguments_->end()) {
+                printIdentifier(argument->second);
+                return;
+            }
+        }
         if (ast->name == symbols::KwBase) {
             // downcasts because method belongs to base class
             printKeyword(Symbol::KwCast);
@@ -89,6 +97,8 @@ namespace tinycplus {
         auto * type = ast->getType()->as<Type::Class>();
         if (type == types_.defaultClassType) {
             printType(Symbol::KwVoid);
+        } else if (ast->getType()->as<Type::Parameter>() != nullptr) {
+            printType(ast->getType());
         } else {
             printType(ast->name.name());
         }
@@ -112,6 +122,8 @@ namespace tinycplus {
     void Transpiler::visit(ASTBlock * ast) {
         auto * functionAst = peekAst()->as<ASTFunDecl>();
         auto * classAst = peekAst(1)->as<ASTClassDecl>();
+        // loop bodies are always blocks, see Parser
+        auto * loopAst = peekAst()->as<ASTWhile>() || peekAst()->as<ASTDoWhile>() || peekAst()->as<ASTFor>() ? peekAst() : nullptr;
         pushAst(ast);
         /// TODO: refactor code -> root is a special case that happens once - no need to check for it for all blocks
         printSymbol(Symbol::CurlyOpen);
@@ -169,13 +181,6 @@ namespace tinycplus {
                     printSymbol(Symbol::Semicolon);
                     printNewline();
                 }
-                if (!classConstructorIsIniting) {
-                    printNewline();
-                    printSymbol(Symbol::KwReturn);
-                    printSpace();
-                    printSymbol(symbols::HiddenThis);
-                    printSymbol(Symbol::Semicolon);
-                }
             } else if (functionAst->name == symbols::Entry) {
                 // Program Entry must be fully declared only after all class declarations and never earlier.
                 // Otherwise resulted TinyC code won't compile.
@@ -196,8 +201,13 @@ namespace tinycplus {
                 printComment(" === Running the rest of the program === ");
             }
         }  
+        if (isInstrumentingCoverage_ && (functionAst != nullptr || loopAst != nullptr)) {
+            printNewline();
+            printCoverageCounter(functionAst != nullptr ? functionAst : loopAst, functionAst != nullptr ? "function" : "loop");
+        }
         for (auto & i : ast->body) {
             printNewline();
+            printLineMarker(i.get());
             visitChild(i.get());
             /// TODO: check semicolon is set correctly when necessary
             if (!i->as<ASTBlock>()
@@ -209,6 +219,14 @@ namespace tinycplus {
                 printSymbol(Symbol::Semicolon);
             }
         }
+        // * the made instance is returned only after the constructor body has run
+        if (functionAst != nullptr && functionAst->isClassConstructor() && !classConstructorIsIniting) {
+            printNewline();
+            printSymbol(Symbol::KwReturn);
+            printSpace();
+            printSymbol(symbols::HiddenThis);
+            printSymbol(Symbol::Semicolon);
+        }
         printer_.dedent();
         printer_.newline();
         printSymbol(Symbol::CurlyClose);
@@ -218,6 +236,16 @@ namespace tinycplus {
 
     void Transpiler::visit(ASTProgram * ast) {
         pushAst(ast);
+        printPreamble(ast);
+        for (auto & i : ast->body) {
+            printGenericInstancePrototypes(i.get());
+            printDeclaration(i.get());
+        }
+        printEpilogue();
+        popAst();
+    }
+
+    void Transpiler::printPreamble(ASTProgram * ast) {
         printComment(" --- Generated program globals --- ");
 
         {
@@ -237,9 +265,6 @@ namespace tinycplus {
             printSymbol(Symbol::ParClose);
             printSymbol(Symbol::Semicolon);
             printNewline();
-
-            // * global class cast wrapper
-            printGlobalClassCastFunction();
         }
 
         // * default interface view struct
@@ -275,8 +300,13 @@ namespace tinycplus {
             }
             printScopeClose(true);
             printNewline();
+
+            // * global class cast wrapper, reads the default vtable
+            printGlobalClassCastFunction();
+            printNewline();
         }
 
+
         // Forward decalration of all class types
         std::vector<Type::Class*> classTypes;
         types_.findEachClassType(classTypes);
@@ -289,22 +319,72 @@ namespace tinycplus {
             printSymbol(Symbol::Semicolon);
             printNewline();
         }
+        collectDeletableClasses();
+        for (auto * classType : deletableClasses_) {
+            printDeleteHead(classType);
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+        }
+
+        if (isInstrumentingCoverage_) {
+            printCoverageDeclaration(ast);
+            printNewline();
+        }
+        if (isInstrumentingDispatch_) {
+            printDispatchRecordDeclarations();
+            printNewline();
+        } else if (profile_ != nullptr) {
+            prepareDispatchGuards();
+            printNewline();
+        }
 
         printComment(" --- User program starts --- ");
+    }
 
-        for (auto & i : ast->body) {
-            visitChild(i.get());
-            printer_.newline();
-            printer_.newline();
+    void Transpiler::printDeclaration(AST * declaration) {
+        ScopedSpan span{trace_, "emit", trace_ != nullptr ? tracing::describeDeclaration(declaration) : ""};
+        auto * funDecl = declaration->as<ASTFunDecl>();
+        if (funDecl != nullptr && funDecl->isGeneric()) {
+            // * printed once per instance, see printGenericInstances
+            return;
+        } else if (isOrderingFunctions() && funDecl != nullptr && funDecl->body) {
+            // * the definition follows the program, see printDeferredFunctions
+            printFunction(funDecl, true);
+            deferFunction(funDecl, nullptr, false);
+        } else {
+            visitChild(declaration);
+        }
+        printer_.newline();
+        printer_.newline();
+    }
+
+    void Transpiler::printEpilogue() {
+        printDeferredFunctions();
+        printGenericInstances();
+        printDeleteFunctions();
+        printDispatchGuards();
+        if (isInstrumentingDispatch_) {
+            printDispatchInstrumentation();
+            printNewline();
+        }
+        if (isInstrumentingCoverage_) {
+            printCoverageInstrumentation();
+            printNewline();
+        }
+        if (stats_ != nullptr) {
+            stats_->totalBytes = outputCounter_->bytes();
         }
-        popAst();
     }
 
     void Transpiler::visit(ASTVarDecl * ast) {
         auto parentAst = peekAst();
         pushAst(ast);
         validateName(ast->name->name);
-        if (auto arrayType = ast->type->as<ASTArrayType>()) {
+        if (auto * instance = escapes_.find(ast->name.get())) {
+            printLocalInstance(ast, instance);
+        } else if (ast->name->isStructOfArrays) {
+            printStructOfArraysDeclaration(ast);
+        } else if (auto arrayType = ast->type->as<ASTArrayType>()) {
             // base type part
             visitChild(arrayType->base.get());
             printSpace();
@@ -328,7 +408,7 @@ namespace tinycplus {
             visitChild(ast->name.get());
         }
         // immediate value assignment
-        if (ast->value.get() != nullptr) {
+        if (ast->value.get() != nullptr && escapes_.find(ast->name.get()) == nullptr) {
             printSpace();
             printSymbol(Symbol::Assign);
             printSpace();
@@ -405,7 +485,10 @@ namespace tinycplus {
         printFields(implFields);
         printScopeClose(true);
         // * cast to interface function
-        printCastToInterfaceFunction(type);
+        {
+            ScopedPass pass{timings_, "emit.interface-cast"};
+            printCastToInterfaceFunction(type);
+        }
         popAst();
     }
 
@@ -418,10 +501,14 @@ namespace tinycplus {
         validateName(ast->name);
         auto * classType = ast->getType()->as<Type::Class>();
         auto * vtableType = classType->getVirtualTable();
+        addClassStats(classType);
+        escapes_.summarizeClass(ast);
+        auto classOutputStart = beginFunctionOutput();
         printComment(STR(" --- class " << ast->name.name() << " --- id:" << classType->getId()));
         printer_.newline();
         // * virtual table declaration and definition
         if (classType->isFullyDefined()) {
+            ScopedPass pass{timings_, "emit.vtables"};
             std::vector<FieldInfo> vtableFields;
             vtableType->collectFieldsOrdered(vtableFields);
             for (auto & it : vtableFields) {
@@ -459,10 +546,17 @@ namespace tinycplus {
             printAllMethodsForwardDeclaration(ast, classType);
 
             // ** methods declaration
-            for (auto & i : ast->methods) {
-                if (i->isAbstract()) continue;
-                printer_.newline();
-                visitChild(i.get());
+            {
+                ScopedPass pass{timings_, "emit.methods"};
+                for (auto & i : ast->methods) {
+                    if (i->isAbstract()) continue;
+                    if (isOrderingFunctions()) {
+                        deferFunction(i.get(), ast, false);
+                        continue;
+                    }
+                    printer_.newline();
+                    visitChild(i.get());
+                }
             }
 
             // ** constructor instance make declarations
@@ -475,18 +569,27 @@ namespace tinycplus {
                 classConstructorIsIniting = false;
                 for (auto & i : ast->constructors) {
                     if (i->isAbstract()) continue;
+                    if (isOrderingFunctions()) {
+                        deferFunction(i.get(), ast, false);
+                        continue;
+                    }
                     printer_.newline();
                     visitChild(i.get());
                 }
                 classConstructorIsIniting = true;
                 // ** constructor instance init declarations
                 for (auto & i : ast->constructors) {
+                    if (isOrderingFunctions()) {
+                        deferFunction(i.get(), ast, true);
+                        continue;
+                    }
                     printer_.newline();
                     visitChild(i.get());
                 }
             }
 
             if (!classType->isAbstract()) {
+                ScopedPass pass{timings_, "emit.class-dispatch"};
                 // ** all implemented interface instances
                 for (auto & it : classType->interfaces) {
                     printField(it.second->implStructName, getClassImplInstanceName(it.second, classType));
@@ -498,8 +601,17 @@ namespace tinycplus {
                 // ** setup function declaration
                 printNewline();
                 printClassSetupFunction(classType);
+                if (classType->isPooled()) {
+                    printNewline();
+                    printClassPool(ast, classType);
+                }
             }
         }
+        if (stats_ != nullptr) {
+            // * the methods printed in place are already counted as functions
+            auto & classStats = stats_->classes[classStatsIndexes_.at(classType)];
+            classStats.emittedBytes = outputCounter_->bytes() - classOutputStart.bytes - classStats.functionBytes;
+        }
         popAst();
     }
 
@@ -538,24 +650,32 @@ namespace tinycplus {
     }
 
     void Transpiler::visit(ASTIf * ast) {
-        pushAst(ast);
-        {
+        // else-if chains are printed in a loop, so that their length is not limited by the stack
+        size_t chainLength = 0;
+        for (ASTIf * current = ast; current != nullptr; ++chainLength) {
+            pushAst(current);
             // keyword
             printKeyword(Symbol::KwIf);
             printSpace();
             // condition
             printSymbol(Symbol::ParOpen);
-            visitChild(ast->cond.get());
+            visitChild(current->cond.get());
             printSymbol(Symbol::ParClose);
             // true case body
-            visitChild(ast->trueCase.get());
+            visitChild(current->trueCase.get());
             // false case body
-            if (ast->falseCase.get() != nullptr) {
+            ASTIf * next = nullptr;
+            if (current->falseCase.get() != nullptr) {
                 printKeyword(Symbol::KwElse);
-                visitChild(ast->falseCase.get());
+                printSpace();
+                next = current->falseCase->as<ASTIf>();
+                if (next == nullptr) visitChild(current->falseCase.get());
             }
+            current = next;
+        }
+        for (size_t i = 0; i < chainLength; ++i) {
+            popAst();
         }
-        popAst();
     }
 
     void Transpiler::visit(ASTSwitch * ast) {
@@ -663,7 +783,7 @@ namespace tinycplus {
     void Transpiler::visit(ASTBinaryOp * ast) {
         pushAst(ast);
         {
-            visitChild(ast->left.get());
+            printOperand(ast->left.get(), GetPrecedence(ast->op));
             if (ast->left->getType()->unwrap<Type::Interface>() && !ast->left->as<ASTIdentifier>()) {
                 printSymbol(Symbol::Dot);
                 printIdentifier(symbols::InterfaceTargetAsField);
@@ -671,7 +791,8 @@ namespace tinycplus {
             printSpace();
             printSymbol(ast->op.name());
             printSpace();
-            visitChild(ast->right.get());
+            // operators are left associative, an operand of the same precedence on the right was parenthesized in the source
+            printOperand(ast->right.get(), GetPrecedence(ast->op) + 1);
             if (ast->right->getType()->unwrap<Type::Interface>() && !ast->right->as<ASTIdentifier>()) {
                 printSymbol(Symbol::Dot);
                 printIdentifier(symbols::InterfaceTargetAsField);
@@ -701,7 +822,7 @@ namespace tinycplus {
         pushAst(ast);
         {
             printSymbol(ast->op.name());
-            visitChild(ast->arg.get());
+            printOperand(ast->arg.get());
             if (ast->arg->getType()->unwrap<Type::Interface>() && !ast->arg->as<ASTIdentifier>()) {
                 printSymbol(Symbol::Dot);
                 printIdentifier(symbols::InterfaceTargetAsField);
@@ -716,7 +837,7 @@ namespace tinycplus {
     void Transpiler::visit(ASTUnaryPostOp * ast) {
         pushAst(ast);
         {
-            visitChild(ast->arg.get());
+            printOperand(ast->arg.get());
             if (ast->arg->getType()->unwrap<Type::Interface>() && !ast->arg->as<ASTIdentifier>()) {
                 printSymbol(Symbol::Dot);
                 printIdentifier(symbols::InterfaceTargetAsField);
@@ -734,7 +855,7 @@ namespace tinycplus {
         pushAst(ast);
         {
             printSymbol(Symbol::BitAnd);
-            visitChild(ast->target.get());
+            printOperand(ast->target.get());
         }
         popAst();
     }
@@ -747,7 +868,7 @@ namespace tinycplus {
         pushAst(ast);
         {
             printSymbol(Symbol::Mul);
-            visitChild(ast->target.get());
+            printOperand(ast->target.get());
         }
         popAst();
     }
@@ -758,7 +879,7 @@ namespace tinycplus {
             throw ParserError{STR("TRANS: cannot use indecies with interface!"), ast->location()};
         }
         pushAst(ast);
-        visitChild(ast->base.get());
+        printOperand(ast->base.get());
         printSymbol(Symbol::SquareOpen);
         visitChild(ast->index.get());
         printSymbol(Symbol::SquareClose);
@@ -766,22 +887,48 @@ namespace tinycplus {
     }
 
     void Transpiler::visit(ASTMember * ast) {
-        pushAst(ast);
         if (ast->member->as<ASTCall>()) {
+            pushAst(ast);
             visitChild(ast->member.get());
+            popAst();
+            return;
+        }
+        // field access chains (a->b->c) are printed from the innermost access in a loop, so that their length is not limited by the stack
+        std::vector<ASTMember *> chain{ast};
+        while (auto * inner = chain.back()->base->as<ASTMember>()) {
+            if (inner->member->as<ASTCall>()) break;
+            chain.push_back(inner);
+        }
+        for (auto * member : chain) {
+            pushAst(member);
+        }
+        auto it = chain.rbegin();
+        if (chain.back()->getStructOfArrays() != nullptr) {
+            printStructOfArraysField(chain.back());
+            popAst();
+            ++it;
+        } else if (findScalarReplaced(chain.back()) != nullptr) {
+            // * p.x of a scalar replaced instance p is the variable of the field: _Csra_1_p_x
+            printIdentifier(symbols::makeScalarField(chain.back()->base->as<ASTIdentifier>()->name, chain.back()->member->as<ASTIdentifier>()->name));
+            popAst();
+            ++it;
         } else {
-            visitChild(ast->base.get());
-            printSymbol(ast->op);
-            visitChild(ast->member.get());
+            printOperand(chain.back()->base.get());
+        }
+        for (; it != chain.rend(); ++it) {
+            printSymbol((*it)->op);
+            visitChild((*it)->member.get());
+            popAst();
         }
-        popAst();
     }
 
     void Transpiler::visit(ASTCall * ast) {
+        // * a call can also be the base of the member access, f()->x
         auto * member = peekAst()->as<ASTMember>();
+        if (member != nullptr && member->member.get() != ast) member = nullptr;
         pushAst(ast);
         if (member != nullptr) { // method call
-            auto baseType = member->base->getType();
+            auto baseType = resolveType(member->base->getType());
             // std::cout << "DEBUG: member base type is (" << baseType->toString() << ")" << std::endl;
             if (auto * classType = baseType->unwrap<Type::Class>()) {
                 printClassMethodCall(member, ast, classType);
@@ -790,7 +937,12 @@ namespace tinycplus {
             } else {
                 printFunctionPointerCall(member, ast);
             }
+        } else if (auto value = ast->constexprFunction != nullptr ? evaluator_.evaluate(ast) : std::nullopt; value.has_value()) {
+            // * the call is replaced by its value, the function stays for the calls which cannot be evaluated
+            countSite(&EmitStats::foldedCalls);
+            printConstant(value.value());
         } else { // function or global function pointer type variable call
+            countSite(ast->function->getType()->as<Type::Function>() != nullptr ? &EmitStats::directCalls : &EmitStats::functionPointerCalls);
             if (auto * classTypeAst = ast->function->as<ASTNamedType>()) {
                 if (auto * classType = types_.getType(classTypeAst->name)->as<Type::Class>()) {
                     auto constructorFuncType = ast->function->getType()->as<Type::Function>();
@@ -798,6 +950,8 @@ namespace tinycplus {
                     auto constructorName = classType->getConstructorMakeName(constructorFuncType);
                     printIdentifier(constructorName);
                 }
+            } else if (ast->generic != nullptr) {
+                printIdentifier(getGenericInstanceName(ast));
             } else {
                 visitChild(ast->function.get());
             }
@@ -816,6 +970,38 @@ namespace tinycplus {
         popAst();
     }
 
+    void Transpiler::visit(ASTNew * ast) {
+        pushAst(ast);
+        auto * call = ast->constructor.get();
+        auto * classType = ast->getType()->as<Type::Pointer>()->base()->as<Type::Class>();
+        countSite(&EmitStats::directCalls);
+        // * the new function of the constructor allocates from the pool of the class, see printClassPool
+        printIdentifier(classType->getConstructorNewName(call->function->getType()->as<Type::Function>()));
+        pushAst(call);
+        printSymbol(Symbol::ParOpen);
+        for (size_t i = 0; i < call->args.size(); ++i) {
+            if (i > 0) {
+                printSymbol(Symbol::Comma);
+                printSpace();
+            }
+            visitChild(call->args[i].get());
+        }
+        printSymbol(Symbol::ParClose);
+        popAst();
+        popAst();
+    }
+
+    void Transpiler::visit(ASTDelete * ast) {
+        pushAst(ast);
+        auto * classType = ast->target->getType()->as<Type::Pointer>()->base()->as<Type::Class>();
+        countSite(&EmitStats::directCalls);
+        printIdentifier(getClassPoolName(symbols::ClassDeletePrefix, classType));
+        printSymbol(Symbol::ParOpen);
+        visitChild(ast->target.get());
+        printSymbol(Symbol::ParClose);
+        popAst();
+    }
+
     void Transpiler::visit(ASTCast * ast) {
         pushAst(ast);
         if (auto classCast = ast->as<ASTClassCast>()) {
@@ -2,12 +2,23 @@
 
 // standard
 #include <iostream>
+#include <cmath>
 #include <vector>
+#include <algorithm>
+#include <functional>
 
 // internal
 #include "ast.h"
 #include "types.h"
 #include "contexts.h"
+#include "profiling.h"
+#include "tracing.h"
+#include "dispatch_profile.h"
+#include "source_map.h"
+#include "stats.h"
+#include "layout.h"
+#include "evaluator.h"
+#include "escape.h"
 
 namespace tinycplus {
 
@@ -19,23 +30,161 @@ namespace tinycplus {
         bool isPrintColorful_ = false;
         std::unordered_map<Symbol, int> definitions_;
         std::vector<AST*> current_ast_hierarchy_;
+        PassTimings * timings_ = nullptr;
+        TraceRecorder * trace_ = nullptr;
+        bool isInstrumentingDispatch_ = false;
+        DispatchProfile const * profile_ = nullptr;
+        bool isInstrumentingCoverage_ = false;
+        bool isEmittingLineMarkers_ = false;
+        SourceMap * sourceMap_ = nullptr;
+        EmitStats * stats_ = nullptr;
+        OutputCountingBuffer const * outputCounter_ = nullptr;
+        int poolCapacity_ = 1024;
+        ConstantEvaluator evaluator_;
+        EscapeAnalysis escapes_;
     private: // temporary data
+        std::unordered_map<Symbol, Symbol> const * inlinedArguments_ = nullptr; // parameter -> its variable, while an inlined constructor is printed
         bool programEntryWasDefined_ = false;
         std::vector<Type::VTable*> bufferVtableTypes_;
         std::vector<FieldInfo> bufferFields_;
+        std::vector<std::string> dispatchSites_; // descriptions of instrumented dispatch sites, indexed by site id
+        std::unordered_map<std::string, int> dispatchSiteOrdinals_; // key prefix -> sites seen so far
+        /** Dispatch site specialized by the profile (--profile-use), its helper function replaces the dynamic dispatch.
+         */
+        struct DispatchGuard {
+            Symbol name;
+            std::string kind;
+            Type::Class * staticClass; // virtual calls
+            Type::Interface * staticInterface; // interface calls and casts
+            Symbol method; // calls
+            Type::Function * methodType; // calls, "this" included
+            std::vector<Type::Class*> receivers; // calls, checked in order
+        };
+        std::vector<DispatchGuard> dispatchGuards_;
+        std::unordered_map<std::string, size_t> dispatchGuardIndexes_; // site key -> guard
+        std::vector<std::string> coverageCounters_; // descriptions of function and loop counters, indexed by counter id
+        size_t coverageCountersCapacity_ = 0;
+        std::unordered_map<Type::Class*, size_t> classStatsIndexes_; // class -> its entry in stats_->classes
+        std::vector<Type::Class*> deletableClasses_; // pooled classes and their bases, see collectDeletableClasses
+        GenericInstance const * currentGenericInstance_ = nullptr; // instance being printed, its type arguments replace the type parameters of the function
+        std::optional<std::vector<Type::Class*>> derivedClasses_; // classes with a base, see isOverridden
+        /** Function definition moved behind the program to be printed in the order of its profiled hotness (--profile-use).
+         */
+        struct DeferredFunction {
+            ASTFunDecl * ast;
+            ASTClassDecl * classAst; // methods and constructors
+            bool isIniting; // constructors
+            std::string name; // see describeFunction
+        };
+        std::vector<DeferredFunction> deferredFunctions_; // in the source order
     public:
+        /** Receivers remembered per instrumented dispatch site, the rest is only counted.
+         */
+        static constexpr int DispatchReceiverSlots = 4;
+
         Transpiler(NamesContext & names, TypesContext & types, std::ostream & output, bool isColorful)
             :names_{names}
             ,types_{types}
             ,printer_{output}
             ,isPrintColorful_{isColorful}
+            ,evaluator_{types}
         { }
     public:
+        void setTimings(PassTimings * timings) {
+            timings_ = timings;
+        }
+        void setTrace(TraceRecorder * trace) {
+            trace_ = trace;
+        }
+        /** Makes every dynamic dispatch site count the receivers it observes (--instrument=dispatch).
+         */
+        void setDispatchInstrumentation(bool isEnabled) {
+            isInstrumentingDispatch_ = isEnabled;
+        }
+        /** Makes every function entry and loop iteration increment its counter (--instrument=coverage).
+         */
+        void setCoverageInstrumentation(bool isEnabled) {
+            isInstrumentingCoverage_ = isEnabled;
+        }
+        /** Specializes the dispatch sites by their recorded receivers (--profile-use). Not applied together with the instrumentation.
+         */
+        void setProfile(DispatchProfile const * profile) {
+            profile_ = profile;
+        }
+        /** Precedes every function and statement by a "// #line <line> \"<file>\"" comment with its TinyC+ location (--line-markers), see tinycToCpp::convert.
+         */
+        void setLineMarkers(bool isEnabled) {
+            isEmittingLineMarkers_ = isEnabled;
+        }
+        /** Buffer of the output stream, it tells the source map and the stats where in the output the transpiler prints. Required by both.
+         */
+        void setOutputCounter(OutputCountingBuffer const * outputCounter) {
+            outputCounter_ = outputCounter;
+        }
+        /** Adds the output lines of every printed function into the map (--source-map).
+         */
+        void setSourceMap(SourceMap * sourceMap) {
+            sourceMap_ = sourceMap;
+        }
+        /** Collects the summary of the generated code into the stats (--stats).
+         */
+        void setStats(EmitStats * stats) {
+            stats_ = stats;
+        }
+        /** Number of instances in the arena of every pooled class (--pool-capacity).
+         */
+        void setPoolCapacity(int capacity) {
+            poolCapacity_ = capacity;
+        }
+        /** Number of steps one evaluation of a constexpr call may take before the call is left to the runtime (--constexpr-steps).
+         */
+        void setConstexprSteps(size_t steps) {
+            evaluator_.setStepBudget(steps);
+        }
         void validateSelf() {
             // if (!programEntryWasDefined_ && symbols::Entry != symbols::Main) {
             //     throw std::runtime_error(STR("Entry function " << symbols::Entry << " was not defined!"));
             // }
         }
+
+        /** \name Pipelined emission (--pipeline)
+            visit(ASTProgram) in pieces, so that declarations can be printed while the later ones are still being checked, see compileFileByDeclaration.
+            The preamble, the epilogue, the generic instance prototypes and the declarations for which needsWholeProgram holds must wait until the whole program is checked.
+         */
+        void enterProgram(ASTProgram * ast) {
+            pushAst(ast);
+        }
+        void leaveProgram() {
+            popAst();
+        }
+        void printPreamble(ASTProgram * ast);
+        void printDeclaration(AST * declaration);
+        void printEpilogue();
+        void printPrototypesOf(AST * declaration) {
+            printGenericInstancePrototypes(declaration);
+        }
+        /** The entry sets up the vtables of all classes, including those declared after it.
+         */
+        bool needsWholeProgram(AST * declaration) const {
+            auto * funDecl = declaration->as<ASTFunDecl>();
+            return funDecl != nullptr && funDecl->name == symbols::Entry && funDecl->body != nullptr;
+        }
+        /** Frees the bodies of the printed declaration's functions, methods and constructors (--stream).
+            The declarations themselves stay, types and later declarations refer to them. Bodies of generic functions are printed per instance at the end, those of constexpr functions are evaluated by later calls and inlined constructors are printed in place of later instances, so these stay too.
+         */
+        void releaseBodies(AST * declaration) {
+            auto release = [this](ASTFunDecl * funDecl) {
+                if (!funDecl->isGeneric() && !funDecl->isConstexpr && !escapes_.isInlined(funDecl)) funDecl->body.reset();
+            };
+            if (auto * funDecl = declaration->as<ASTFunDecl>()) {
+                release(funDecl);
+            } else if (auto * classDecl = declaration->as<ASTClassDecl>()) {
+                for (auto & it : classDecl->methods) release(it.get());
+                for (auto & it : classDecl->constructors) release(it.get());
+            }
+            // * results are remembered by their calls
+            evaluator_.forgetResults();
+        }
     private:
         void pushAst(AST * ast) {
             current_ast_hierarchy_.push_back(ast);
@@ -111,7 +260,7 @@ namespace tinycplus {
         }
         inline void printNumber(double value) {
             if (isPrintColorful_) printer_ << printer_.numberLiteral;
-            printer_ << value;
+            printer_ << ConstantEvaluator::FormatLiteral(value);
         }
         inline void printComment(std::string const & text, bool newline = true) {
             if (isPrintColorful_) printer_ << printer_.comment;
@@ -122,7 +271,44 @@ namespace tinycplus {
 
         inline void printType(Type * type) {
             if (isPrintColorful_) printer_ << printer_.type;
-            printer_ << type->toString();
+            printer_ << resolveType(type)->toString();
+        }
+
+    public:
+        // * The parser does not keep parentheses, operands are parenthesized when their precedence requires it.
+        static constexpr int AssignmentPrecedence = 1;
+        static constexpr int PrefixPrecedence = 11;
+        static constexpr int PostfixPrecedence = 12;
+
+        /** Precedence of a binary operator, following the E9 (lowest) to E1 (highest) levels of the parser.
+         */
+        static int GetPrecedence(Symbol const & op) {
+            if (op == Symbol::Mul || op == Symbol::Div || op == Symbol::Mod) return 10;
+            if (op == Symbol::Add || op == Symbol::Sub) return 9;
+            if (op == Symbol::ShiftLeft || op == Symbol::ShiftRight) return 8;
+            if (op == Symbol::Lt || op == Symbol::Lte || op == Symbol::Gt || op == Symbol::Gte) return 7;
+            if (op == Symbol::Eq || op == Symbol::NEq) return 6;
+            if (op == Symbol::BitAnd) return 5;
+            if (op == Symbol::BitOr) return 4;
+            if (op == Symbol::And) return 3;
+            return 2;
+        }
+
+        static int GetPrecedence(AST * ast) {
+            if (auto * binaryOp = ast->as<ASTBinaryOp>()) return GetPrecedence(binaryOp->op);
+            if (ast->as<ASTAssignment>()) return AssignmentPrecedence;
+            if (ast->as<ASTUnaryOp>() || ast->as<ASTDeref>() || ast->as<ASTAddress>() || ast->as<ASTNew>()) return PrefixPrecedence;
+            return PostfixPrecedence;
+        }
+    private:
+        /** Prints an operand of an operator, in parentheses if it binds weaker than the operator requires.
+            The default suits the operands of prefix and postfix operators.
+         */
+        void printOperand(AST * ast, int requiredPrecedence = PostfixPrecedence) {
+            bool isParenthesized = GetPrecedence(ast) < requiredPrecedence;
+            if (isParenthesized) printSymbol(Symbol::ParOpen);
+            visitChild(ast);
+            if (isParenthesized) printSymbol(Symbol::ParClose);
         }
         inline void printScopeOpen() {
             printSymbol(Symbol::CurlyOpen);
@@ -157,6 +343,146 @@ namespace tinycplus {
             }
         }
 
+        /** Declares one array per field of the element class instead of the array of instances, the last declaration is terminated by the caller.
+         */
+        void printStructOfArraysDeclaration(ASTVarDecl * ast) {
+            auto * arrayType = ast->type->as<ASTArrayType>();
+            auto * classType = ast->getType()->as<Type::Pointer>()->base()->as<Type::Class>();
+            std::vector<FieldInfo> fields;
+            classType->collectFieldsOrdered(fields);
+            for (size_t i = 0; i < fields.size(); ++i) {
+                if (i > 0) {
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                }
+                visitChild(fields[i].ast->as<ASTVarDecl>()->type.get());
+                printSpace();
+                printIdentifier(symbols::makeStructOfArraysField(ast->name->name, fields[i].name));
+                printSymbol(Symbol::SquareOpen);
+                visitChild(arrayType->size.get());
+                printSymbol(Symbol::SquareClose);
+            }
+        }
+
+        /** a[i].x of a soa array a is the element of the array of the field: _Csoa_1_a_x[i].
+         */
+        void printStructOfArraysField(ASTMember * ast) {
+            auto * index = ast->base->as<ASTIndex>();
+            pushAst(index);
+            printIdentifier(symbols::makeStructOfArraysField(ast->getStructOfArrays()->name, ast->member->as<ASTIdentifier>()->name));
+            printSymbol(Symbol::SquareOpen);
+            visitChild(index->index.get());
+            printSymbol(Symbol::SquareClose);
+            popAst();
+        }
+
+        /** Finds the non-escaping instances of the function before its body is printed, see EscapeAnalysis. Instrumented outputs keep every instance and dispatch site as they are.
+         */
+        void analyzeEscapes(ASTFunDecl * ast) {
+            bool isAnalyzing = !isInstrumentingDispatch_ && !isInstrumentingCoverage_ && currentGenericInstance_ == nullptr;
+            escapes_.analyzeFunction(isAnalyzing ? ast : nullptr);
+        }
+
+        /** Declares the non-escaping instance, the last statement is terminated by the caller.
+            Instances which are not scalar replaced are initialized by the init constructor, which does not store the vtable pointer. Scalar replaced instances are their constructor printed in place: the arguments and the fields become variables and the field assignments of the constructors run on them, those of the base first.
+         */
+        void printLocalInstance(ASTVarDecl * ast, LocalInstance const * instance) {
+            auto * call = instance->constructorCall;
+            auto name = ast->name->name;
+            if (!instance->isScalarReplaced) {
+                countSite(&EmitStats::directCalls);
+                visitChild(ast->type.get());
+                printSpace();
+                printIdentifier(name);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                pushAst(call);
+                printIdentifier(instance->classType->getConstructorInitName(call->function->getType()->as<Type::Function>()));
+                printSymbol(Symbol::ParOpen);
+                printSymbol(Symbol::BitAnd);
+                printIdentifier(name);
+                for (auto & it : call->args) {
+                    printSymbol(Symbol::Comma);
+                    printSpace();
+                    visitChild(it.get());
+                }
+                printSymbol(Symbol::ParClose);
+                popAst();
+                return;
+            }
+            bool isFirst = true;
+            auto nextStatement = [&]() {
+                if (!isFirst) {
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                }
+                isFirst = false;
+            };
+            // * arguments, each evaluated once and in order
+            std::unordered_map<Symbol, Symbol> arguments;
+            auto * constructor = instance->constructor;
+            pushAst(call);
+            for (size_t i = 0; constructor != nullptr && i < constructor->args.size(); ++i) {
+                auto * parameter = constructor->args[i].get();
+                auto variable = symbols::makeScalarArgument(name, parameter->name->name);
+                nextStatement();
+                visitChild(parameter->type.get());
+                printSpace();
+                printIdentifier(variable);
+                printSpace();
+                printSymbol(Symbol::Assign);
+                printSpace();
+                visitChild(call->args[i].get());
+                arguments.insert({parameter->name->name, variable});
+            }
+            popAst();
+            // * fields
+            std::vector<FieldInfo> fields;
+            instance->classType->collectFieldsOrdered(fields);
+            for (auto & it : fields) {
+                nextStatement();
+                visitChild(it.ast->as<ASTVarDecl>()->type.get());
+                printSpace();
+                printIdentifier(symbols::makeScalarField(name, it.name));
+            }
+            // * constructors from the instance's own to the base, each with the variables of its parameters
+            std::vector<std::pair<ASTFunDecl *, std::unordered_map<Symbol, Symbol>>> constructors;
+            auto * classType = instance->classType;
+            for (auto * it = constructor; it != nullptr; ) {
+                auto * base = escapes_.findBaseConstructor(it, classType);
+                std::unordered_map<Symbol, Symbol> baseArguments;
+                for (size_t i = 0; base != nullptr && i < base->args.size(); ++i) {
+                    baseArguments.insert({base->args[i]->name->name, arguments.at(it->base->args[i]->name)});
+                }
+                constructors.push_back({it, std::move(arguments)});
+                arguments = std::move(baseArguments);
+                classType = classType->getBase();
+                it = base;
+            }
+            for (auto it = constructors.rbegin(); it != constructors.rend(); ++it) {
+                inlinedArguments_ = &it->second;
+                for (auto * assignment : escapes_.getFieldAssignments(it->first)) {
+                    nextStatement();
+                    printIdentifier(symbols::makeScalarField(name, assignment->lvalue->as<ASTMember>()->member->as<ASTIdentifier>()->name));
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    pushAst(assignment);
+                    visitChild(assignment->value.get());
+                    popAst();
+                }
+                inlinedArguments_ = nullptr;
+            }
+        }
+
+        /** The scalar replaced instance whose field is accessed, nullptr when the access is not to one.
+         */
+        LocalInstance const * findScalarReplaced(ASTMember * ast) {
+            auto * receiver = ast->base->as<ASTIdentifier>();
+            auto * instance = receiver != nullptr ? escapes_.find(receiver) : nullptr;
+            return instance != nullptr && instance->isScalarReplaced && ast->member->as<ASTIdentifier>() != nullptr ? instance : nullptr;
+        }
+
         Symbol getClassImplInstanceName(Type::Interface * interfaceType, Type::Class * classType) {
             return symbols::start().add(symbols::ClassInterfaceImplInstPrefix)
                 .add(classType->name).add("_").add(interfaceType->name)
@@ -199,6 +525,7 @@ namespace tinycplus {
         }
 
         void printVTableStruct(Type::Class * classType) {
+            ScopedSpan span{trace_, "emit", trace_ != nullptr ? STR("printVTableStruct " << classType->name) : ""};
             std::vector<FieldInfo> vtableFields;
             auto * vtableType = classType->getVirtualTable();
             vtableType->collectFieldsOrdered(vtableFields);
@@ -224,29 +551,255 @@ namespace tinycplus {
             }
         }
 
+        bool isKeyingDispatchSites() const {
+            return isInstrumentingDispatch_ || profile_ != nullptr;
+        }
+
+        bool isOrderingFunctions() const {
+            return profile_ != nullptr && profile_->hasFunctionEntries() && !isInstrumentingDispatch_;
+        }
+
+        void deferFunction(ASTFunDecl * ast, ASTClassDecl * classAst, bool isIniting) {
+            auto * classType = classAst != nullptr ? classAst->getType()->as<Type::Class>() : nullptr;
+            deferredFunctions_.push_back(DeferredFunction{ast, classAst, isIniting, describeFunction(ast, classType, isIniting)});
+        }
+
+        /** Prints the deferred function definitions: the functions entered by the profiled run first, the most entered ones first, then the functions the profile does not know in the source order, and the functions which were never entered last.
+            All of them are forward declared where they were defined, so the order does not matter to their uses.
+         */
+        void printDeferredFunctions() {
+            if (deferredFunctions_.empty()) return;
+            ScopedPass pass{timings_, "emit.ordered-functions"};
+            std::vector<std::pair<DeferredFunction const *, int64_t>> hot, unknown, cold;
+            for (auto & it : deferredFunctions_) {
+                auto entries = profile_->functionEntries(it.name);
+                if (!entries.has_value()) {
+                    unknown.emplace_back(&it, 0);
+                } else if (entries.value() > 0) {
+                    hot.emplace_back(&it, entries.value());
+                } else {
+                    cold.emplace_back(&it, 0);
+                }
+            }
+            std::stable_sort(hot.begin(), hot.end(), [](auto const & a, auto const & b) {
+                return a.second > b.second;
+            });
+            auto printGroup = [this](char const * title, std::vector<std::pair<DeferredFunction const *, int64_t>> const & group) {
+                if (group.empty()) return;
+                printComment(title);
+                for (auto & it : group) {
+                    auto & function = *it.first;
+                    if (function.classAst != nullptr) pushAst(function.classAst);
+                    classConstructorIsIniting = function.isIniting;
+                    printer_.newline();
+                    visitChild(function.ast);
+                    if (function.classAst != nullptr) popAst();
+                    printer_.newline();
+                }
+                printer_.newline();
+            };
+            printGroup(" --- Hot functions --- ", hot);
+            printGroup(" --- Unprofiled functions --- ", unknown);
+            printGroup(" --- Cold functions --- ", cold);
+            classConstructorIsIniting = true;
+            deferredFunctions_.clear();
+        }
+
+        /** Name of the function: "<function>", "<class>.<method>", the name of the generated constructor function or of the generic instance.
+         */
+        std::string describeFunction(ASTFunDecl * funDecl, Type::Class * classType, bool isIniting) {
+            if (currentGenericInstance_ != nullptr && currentGenericInstance_->function == funDecl) {
+                return currentGenericInstance_->name.name();
+            }
+            if (funDecl->isClassConstructor()) {
+                auto * funcType = funDecl->getType()->as<Type::Function>();
+                return (isIniting
+                    ? classType->getConstructorInitName(funcType)
+                    : classType->getConstructorMakeName(funcType)).name();
+            } else if (classType != nullptr) {
+                return STR(classType->name.name() << "." << funDecl->name.value().name());
+            }
+            return funDecl->name.value().name();
+        }
+
+        /** Name of the function being printed, see describeFunction, "<global>" outside of functions.
+         */
+        std::string describeEnclosingFunction() {
+            for (auto it = current_ast_hierarchy_.rbegin(); it != current_ast_hierarchy_.rend(); ++it) {
+                auto * funDecl = (*it)->as<ASTFunDecl>();
+                if (funDecl == nullptr) continue;
+                auto * classType = std::next(it) != current_ast_hierarchy_.rend() && (*std::next(it))->as<ASTClassDecl>() != nullptr
+                    ? (*std::next(it))->getType()->as<Type::Class>()
+                    : nullptr;
+                return describeFunction(funDecl, classType, classConstructorIsIniting);
+            }
+            return "<global>";
+        }
+
+        /** Key of the next dispatch site: "<function>/<kind>/<static type>/<ordinal>".
+            Source locations are not part of the key, so the key survives edits outside of the enclosing function and of the sites with the same static type before it.
+         */
+        std::string makeDispatchSiteKey(char const * kind, std::string const & staticType) {
+            auto prefix = STR(describeEnclosingFunction() << "/" << kind << "/" << staticType);
+            return STR(prefix << "/" << dispatchSiteOrdinals_[prefix]++);
+        }
+
+        /** Guard of the site given by the profile, unless the dispatch is instrumented.
+         */
+        DispatchGuard const * findDispatchGuard(std::string const & key) const {
+            if (isInstrumentingDispatch_ || key.empty()) return nullptr;
+            auto it = dispatchGuardIndexes_.find(key);
+            return it == dispatchGuardIndexes_.end() ? nullptr : &dispatchGuards_[it->second];
+        }
+
+        /** "<file>:<line>:<col>" of the node, escaped for a string literal.
+         */
+        static std::string EscapeFilepath(std::string const & filepath) {
+            std::string result;
+            for (char c : filepath) {
+                if (c == '\\' || c == '"') result.push_back('\\');
+                result.push_back(c);
+            }
+            return result;
+        }
+
+        std::string describeLocation(AST * ast) {
+            auto & location = ast->location();
+            return STR(EscapeFilepath(location.file()) << ":" << location.line() << ":" << location.col());
+        }
+
+        void printLineMarker(AST * ast) {
+            if (!isEmittingLineMarkers_) return;
+            auto & location = ast->location();
+            printComment(STR("#line " << location.line() << " \"" << EscapeFilepath(location.file()) << "\""));
+        }
+
+        /** Ends the TinyC+ lines of the last function, the output which follows is generated.
+         */
+        void printLineMarkerReset() {
+            if (!isEmittingLineMarkers_) return;
+            printComment("#line default");
+        }
+
+        /** Where in the output a function starts, see endFunctionOutput.
+         */
+        struct FunctionOutputStart {
+            size_t line;
+            size_t bytes;
+        };
+
+        FunctionOutputStart beginFunctionOutput() {
+            if (outputCounter_ == nullptr) return FunctionOutputStart{0, 0};
+            return FunctionOutputStart{outputCounter_->nextLine(), outputCounter_->bytes()};
+        }
+
+        /** Adds the printed function into the source map and the stats. The class is given for methods and constructors.
+         */
+        void endFunctionOutput(FunctionOutputStart const & start, Symbol const & symbol, AST * ast, Type::Class * classType) {
+            if (sourceMap_ != nullptr) {
+                sourceMap_->add(SourceMapEntry{start.line, outputCounter_->lastLine(), symbol.name(), describeLocation(ast)});
+            }
+            if (stats_ != nullptr) {
+                auto bytes = outputCounter_->bytes() - start.bytes;
+                stats_->functions.push_back(FunctionStats{symbol.name(), classType != nullptr ? classType->name.name() : "", bytes});
+                if (classType != nullptr) {
+                    stats_->classes[classStatsIndexes_.at(classType)].functionBytes += bytes;
+                }
+            }
+        }
+
+        void countSite(size_t EmitStats::* counter) {
+            if (stats_ != nullptr) ++(stats_->*counter);
+        }
+
+        /** Adds the entry of the class into the stats, its bytes are added by visit(ASTClassDecl).
+         */
+        void addClassStats(Type::Class * classType) {
+            if (stats_ == nullptr) return;
+            ClassStats result;
+            result.name = classType->name.name();
+            result.isAbstract = classType->isAbstract();
+            std::vector<FieldInfo> slots;
+            classType->getVirtualTable()->collectFieldsOrdered(slots);
+            result.vtableSlots = slots.size();
+            for (auto & it : classType->interfaces) {
+                result.interfaceTables.emplace_back(it.first.name(), it.second->methods_.size());
+            }
+            // * the interfaces are hashed, their order must not depend on it
+            std::sort(result.interfaceTables.begin(), result.interfaceTables.end());
+            auto layout = computeClassLayout(classType);
+            result.objectSize = layout.size;
+            result.objectAlign = layout.align;
+            result.paddingBytes = layout.paddingBytes;
+            result.savedBytes = computeClassLayout(classType, true).size - layout.size;
+            classStatsIndexes_[classType] = stats_->classes.size();
+            stats_->classes.push_back(std::move(result));
+        }
+
+        /** Gives the dispatch site its counter slot and remembers its description for the site table.
+         */
+        int registerDispatchSite(AST * ast, std::string const & key) {
+            int site = static_cast<int>(dispatchSites_.size());
+            dispatchSites_.push_back(STR(site << " " << key << " " << describeLocation(ast)));
+            return site;
+        }
+
+        /** Prints the opening of the record call of an instrumented site, the caller prints the recorded value and closes it.
+         */
+        void printRecordOpen(Symbol const & recordFunction, int site) {
+            printIdentifier(recordFunction);
+            printSymbol(Symbol::ParOpen);
+            printNumber(site);
+            printSymbol(Symbol::Comma);
+            printSpace();
+        }
+
+        /** Prints the cast subject as void pointer, recorded by the given site unless it is negative.
+         */
+        void printCastSubject(ASTClassCast * ast, int site) {
+            if (site >= 0) {
+                printRecordOpen(symbols::ProfileRecordObjectFunction, site);
+            }
+            if (ast->value->getType()->unwrap<Type::Interface>() != nullptr) {
+                visitChild(ast->value.get());
+            } else {
+                printKeyword(Symbol::KwCast);
+                printSymbol(Symbol::Lt);
+                printType(types_.getTypeVoidPtr());
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                visitChild(ast->value.get());
+                printSymbol(Symbol::ParClose);
+            }
+            if (site >= 0) {
+                printSymbol(Symbol::ParClose);
+            }
+        }
+
         void printClassCast(ASTClassCast * ast) {
             auto * targetClassType = ast->type->getType()->unwrap<Type::Class>();
             auto * targetInterfaceType = ast->type->getType()->unwrap<Type::Interface>();
             auto * subjectClassType = ast->value->getType()->unwrap<Type::Class>();
             auto * subjectInterfaceType = ast->value->getType()->unwrap<Type::Interface>();
+            bool isDynamic = targetInterfaceType != nullptr
+                || (targetClassType != nullptr && (subjectClassType == nullptr || !subjectClassType->inherits(targetClassType)));
+            std::string key;
+            if (isDynamic && isKeyingDispatchSites()) {
+                key = makeDispatchSiteKey(targetInterfaceType != nullptr ? "interface-cast" : "class-cast",
+                    STR(ast->value->getType()->toString() << "->" << ast->type->getType()->toString()));
+            }
+            int site = isDynamic && isInstrumentingDispatch_ ? registerDispatchSite(ast, key) : -1;
+            countSite(targetInterfaceType != nullptr ? &EmitStats::interfaceCasts
+                : isDynamic ? &EmitStats::runtimeClassCasts
+                : &EmitStats::staticClassCasts);
             if (targetInterfaceType != nullptr) {
-                printIdentifier(targetInterfaceType->castName);
+                // "interface to interface" and "class to interface" cases, hot sites cache the impl of the last class
+                auto * guard = findDispatchGuard(key);
+                printIdentifier(guard != nullptr ? guard->name : targetInterfaceType->castName);
                 printSymbol(Symbol::ParOpen);
-                if (subjectInterfaceType != nullptr) {
-                    // "interface to interface" case
-                    visitChild(ast->value.get());
-                } else if (subjectClassType != nullptr) {
-                    // "class to interface" case
-                    printKeyword(Symbol::KwCast);
-                    printSymbol(Symbol::Lt);
-                    printType(types_.getTypeVoidPtr());
-                    printSymbol(Symbol::Gt);
-                    printSymbol(Symbol::ParOpen);
-                    visitChild(ast->value.get());
-                    printSymbol(Symbol::ParClose);
-                }
+                printCastSubject(ast, site);
                 printSymbol(Symbol::ParClose);
-            } else if (targetClassType != nullptr && (subjectClassType == nullptr || !subjectClassType->inherits(targetClassType))) {
+            } else if (isDynamic) {
                 printKeyword(Symbol::KwCast);
                 printSymbol(Symbol::Lt);
                 visitChild(ast->type.get());
@@ -255,17 +808,7 @@ namespace tinycplus {
                 {
                     printIdentifier(symbols::ClassCastToClassFunction);
                     printSymbol(Symbol::ParOpen);
-                    if (subjectInterfaceType != nullptr) {
-                        visitChild(ast->value.get());
-                    } else if (subjectClassType != nullptr) {
-                        printKeyword(Symbol::KwCast);
-                        printSymbol(Symbol::Lt);
-                        printType(types_.getTypeVoidPtr());
-                        printSymbol(Symbol::Gt);
-                        printSymbol(Symbol::ParOpen);
-                        visitChild(ast->value.get());
-                        printSymbol(Symbol::ParClose);
-                    }
+                    printCastSubject(ast, site);
                     printSymbol(Symbol::Comma);
                     printNumber(targetClassType->getId());
                     printSymbol(Symbol::ParClose);
@@ -396,6 +939,7 @@ namespace tinycplus {
         /* type: (void* class instance) -> interface view
         */
         void printCastToInterfaceFunction(Type::Interface * type) {
+            ScopedSpan span{trace_, "emit", trace_ != nullptr ? STR("printCastToInterfaceFunction " << type->name) : ""};
             auto argInstName = Symbol{"inst"};
             auto localVtableName = Symbol{"vtable"};
             auto localImplName = Symbol{"impl"};
@@ -463,7 +1007,7 @@ namespace tinycplus {
                 printScopeOpen(); // not null case
                 {
                     // * declares general vtable ptr
-                    // * casts instance to general vtable ptr (as they share the same memory position)
+                    // * reads the vtable ptr, which is the first field of every class instance
                     printType(symbols::VirtualTableGeneralStruct);
                     printType(Symbol::Mul);
                     printSpace();
@@ -475,10 +1019,14 @@ namespace tinycplus {
                     printSymbol(Symbol::Lt);
                     printType(symbols::VirtualTableGeneralStruct);
                     printType(Symbol::Mul);
+                    printType(Symbol::Mul);
                     printSymbol(Symbol::Gt);
                     printSymbol(Symbol::ParOpen);
                     printIdentifier(argInstName);
                     printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::SquareOpen);
+                    printNumber(0);
+                    printSymbol(Symbol::SquareClose);
                     printSymbol(Symbol::Semicolon);
                     printNewline();
                     // * stores result of "check impl" function call
@@ -614,16 +1162,21 @@ namespace tinycplus {
                 printKeyword(Symbol::KwElse);
                 printScopeOpen(); // not null case
                 {
+                    // * the vtable ptr is the first field of every class instance
                     printKeyword(Symbol::KwReturn);
                     printSpace();
                     printKeyword(Symbol::KwCast);
                     printSymbol(Symbol::Lt);
                     printType(symbols::VirtualTableGeneralStruct);
                     printType(Symbol::Mul);
+                    printType(Symbol::Mul);
                     printSymbol(Symbol::Gt);
                     printSymbol(Symbol::ParOpen);
                     printIdentifier(argInstName);
                     printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::SquareOpen);
+                    printNumber(0);
+                    printSymbol(Symbol::SquareClose);
                     printSymbol(Symbol::ArrowR);
                     printIdentifier(symbols::VirtualTableCastToClassField);
                     printSymbol(Symbol::ParOpen);
@@ -638,52 +1191,1282 @@ namespace tinycplus {
             printScopeClose(false);
         }
 
-        void printGetImplFunction(Type::Class * classType) {
-            auto argIdName = Symbol{"id"};
-            // * return type
-            printType(types_.getTypeVoid());
-            printSymbol(Symbol::Mul);
+        #pragma region Dispatch Instrumentation
+        void printDispatchRecordHead(Symbol const & recordFunction, Symbol const & argValueName) {
+            printType(types_.getTypeVoidPtr());
             printSpace();
-            // * name
-            printIdentifier(classType->getImplName);
-            // * arguments
+            printIdentifier(recordFunction);
             printSymbol(Symbol::ParOpen);
             printType(types_.getTypeInt());
             printSpace();
-            printIdentifier(argIdName);
-            printSymbol(Symbol::ParClose);
+            printIdentifier(Symbol{"site"});
+            printSymbol(Symbol::Comma);
             printSpace();
-            // * body start
+            printType(types_.getTypeVoidPtr());
+            printSpace();
+            printIdentifier(argValueName);
+            printSymbol(Symbol::ParClose);
+        }
+
+        /** Forward declarations of the record functions, their definitions follow the user program once the sites are known.
+         */
+        void printDispatchRecordDeclarations() {
+            printDispatchRecordHead(symbols::ProfileRecordFunction, Symbol{"receiver"});
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+            printDispatchRecordHead(symbols::ProfileRecordObjectFunction, Symbol{"instance"});
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+        }
+
+        void printIndexed(Symbol const & array, Symbol const & index) {
+            printIdentifier(array);
+            printSymbol(Symbol::SquareOpen);
+            printIdentifier(index);
+            printSymbol(Symbol::SquareClose);
+        }
+
+        /** Prints the counters of all registered dispatch sites, the record functions and the site table.
+            Each site owns DispatchReceiverSlots slots of receivers and their counts, the first receivers observed claim the slots, others are only counted.
+            The receivers are vtable instances (_VTinst_) for virtual calls and casts, and interface impl instances (_Cimpl_) for interface calls.
+         */
+        void printDispatchInstrumentation() {
+            auto argSiteName = Symbol{"site"};
+            auto argReceiverName = Symbol{"receiver"};
+            auto argObjectName = Symbol{"instance"};
+            auto localSlotName = Symbol{"slot"};
+            // the arrays must not be empty even if the program has no dynamic dispatch
+            int sitesCount = static_cast<int>(dispatchSites_.size());
+            int arraySize = std::max(sitesCount, 1);
+            printComment(" --- Dispatch instrumentation --- ");
+            // * counters
+            {
+                printType(types_.getTypeVoidPtr());
+                printSpace();
+                printIdentifier(symbols::ProfileReceiversArray);
+                printSymbol(Symbol::SquareOpen);
+                printNumber(arraySize * DispatchReceiverSlots);
+                printSymbol(Symbol::SquareClose);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                printType(types_.getTypeInt());
+                printSpace();
+                printIdentifier(symbols::ProfileCountsArray);
+                printSymbol(Symbol::SquareOpen);
+                printNumber(arraySize * DispatchReceiverSlots);
+                printSymbol(Symbol::SquareClose);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                printType(types_.getTypeInt());
+                printSpace();
+                printIdentifier(symbols::ProfileOthersArray);
+                printSymbol(Symbol::SquareOpen);
+                printNumber(arraySize);
+                printSymbol(Symbol::SquareClose);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                printType(types_.getTypeInt());
+                printSpace();
+                printIdentifier(symbols::ProfileSitesCount);
+                printSpace();
+                printSymbol(Symbol::Assign);
+                printSpace();
+                printNumber(sitesCount);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                printNewline();
+            }
+            // * records the receiver into the first free or matching slot of the site
+            printDispatchRecordHead(symbols::ProfileRecordFunction, argReceiverName);
             printScopeOpen();
             {
-                // ** switches between base class ids
-                printKeyword(Symbol::KwSwitch);
+                printType(types_.getTypeInt());
+                printSpace();
+                printIdentifier(localSlotName);
+                printSpace();
+                printSymbol(Symbol::Assign);
+                printSpace();
+                printIdentifier(argSiteName);
+                printSpace();
+                printSymbol(Symbol::Mul);
+                printSpace();
+                printNumber(DispatchReceiverSlots);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                printKeyword(Symbol::KwWhile);
+                printSpace();
                 printSymbol(Symbol::ParOpen);
-                printIdentifier(argIdName);
+                printIdentifier(localSlotName);
+                printSpace();
+                printSymbol(Symbol::Lt);
+                printSpace();
+                printIdentifier(argSiteName);
+                printSpace();
+                printSymbol(Symbol::Mul);
+                printSpace();
+                printNumber(DispatchReceiverSlots);
+                printSpace();
+                printSymbol(Symbol::Add);
+                printSpace();
+                printNumber(DispatchReceiverSlots);
                 printSymbol(Symbol::ParClose);
+                printSpace();
                 printScopeOpen();
-                for (auto & it : classType->interfaces) {
-                    // ** class index case
-                    printKeyword(Symbol::KwCase);
+                {
+                    // ** a slot without counts is free
+                    printKeyword(Symbol::KwIf);
                     printSpace();
-                    printNumber(it.second->getId());
-                    printSymbol(Symbol::Colon);
+                    printSymbol(Symbol::ParOpen);
+                    printIndexed(symbols::ProfileCountsArray, localSlotName);
                     printSpace();
-                    printKeyword(Symbol::KwReturn);
+                    printSymbol(Symbol::Eq);
+                    printSpace();
+                    printNumber(0);
+                    printSymbol(Symbol::ParClose);
+                    printSpace();
+                    printScopeOpen();
+                    {
+                        printIndexed(symbols::ProfileReceiversArray, localSlotName);
+                        printSpace();
+                        printSymbol(Symbol::Assign);
+                        printSpace();
+                        printIdentifier(argReceiverName);
+                        printSymbol(Symbol::Semicolon);
+                    }
+                    printScopeClose(false);
+                    printKeyword(Symbol::KwIf);
                     printSpace();
-                    printSymbol(Symbol::KwCast);
-                    printSymbol(Symbol::Lt);
-                    printType(types_.getTypeVoidPtr());
-                    printSymbol(Symbol::Gt);
                     printSymbol(Symbol::ParOpen);
-                    printSymbol(Symbol::BitAnd);
-                    printIdentifier(getClassImplInstanceName(it.second, classType));
+                    printIndexed(symbols::ProfileReceiversArray, localSlotName);
+                    printSpace();
+                    printSymbol(Symbol::Eq);
+                    printSpace();
+                    printIdentifier(argReceiverName);
                     printSymbol(Symbol::ParClose);
-                    printSymbol(Symbol::Semicolon);
-                    printNewline();
-                }
-                // ** default case
-                printKeyword(Symbol::KwDefault);
+                    printSpace();
+                    printScopeOpen();
+                    {
+                        printIndexed(symbols::ProfileCountsArray, localSlotName);
+                        printSymbol(Symbol::Inc);
+                        printSymbol(Symbol::Semicolon);
+                        printNewline();
+                        printKeyword(Symbol::KwReturn);
+                        printSpace();
+                        printIdentifier(argReceiverName);
+                        printSymbol(Symbol::Semicolon);
+                    }
+                    printScopeClose(false);
+                    printIdentifier(localSlotName);
+                    printSymbol(Symbol::Inc);
+                    printSymbol(Symbol::Semicolon);
+                }
+                printScopeClose(false);
+                // ** all slots are taken by other receivers
+                printIndexed(symbols::ProfileOthersArray, argSiteName);
+                printSymbol(Symbol::Inc);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                printKeyword(Symbol::KwReturn);
+                printSpace();
+                printIdentifier(argReceiverName);
+                printSymbol(Symbol::Semicolon);
+            }
+            printScopeClose(false);
+            printNewline();
+            // * records the vtable of a non null cast subject, the vtable ptr is the first field of every class instance
+            printDispatchRecordHead(symbols::ProfileRecordObjectFunction, argObjectName);
+            printScopeOpen();
+            {
+                printKeyword(Symbol::KwIf);
+                printSpace();
+                printSymbol(Symbol::ParOpen);
+                printIdentifier(argObjectName);
+                printSpace();
+                printSymbol(Symbol::NEq);
+                printSpace();
+                printIdentifier(symbols::KwNull);
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                {
+                    printIdentifier(symbols::ProfileRecordFunction);
+                    printSymbol(Symbol::ParOpen);
+                    printIdentifier(argSiteName);
+                    printSymbol(Symbol::Comma);
+                    printSpace();
+                    printKeyword(Symbol::KwCast);
+                    printSymbol(Symbol::Lt);
+                    printType(types_.getTypeVoidPtr());
+                    printType(Symbol::Mul);
+                    printSymbol(Symbol::Gt);
+                    printSymbol(Symbol::ParOpen);
+                    printIdentifier(argObjectName);
+                    printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::SquareOpen);
+                    printNumber(0);
+                    printSymbol(Symbol::SquareClose);
+                    printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::Semicolon);
+                }
+                printScopeClose(false);
+                printKeyword(Symbol::KwReturn);
+                printSpace();
+                printIdentifier(argObjectName);
+                printSymbol(Symbol::Semicolon);
+            }
+            printScopeClose(false);
+            printNewline();
+            // * site table
+            printDescriptionTable(symbols::ProfileSiteFunction, dispatchSites_);
+            printNewline();
+            // * receiver -> class name, the names are what --profile-use reads
+            std::vector<Type::Class*> classTypes;
+            types_.findEachClassType(classTypes);
+            printType(types_.getTypeChar());
+            printType(Symbol::Mul);
+            printSpace();
+            printIdentifier(symbols::ProfileReceiverClassFunction);
+            printSymbol(Symbol::ParOpen);
+            printType(types_.getTypeVoidPtr());
+            printSpace();
+            printIdentifier(argReceiverName);
+            printSymbol(Symbol::ParClose);
+            printScopeOpen();
+            {
+                for (auto * classType : classTypes) {
+                    if (classType == types_.defaultClassType || classType->isAbstract()) continue;
+                    std::vector<Symbol> receivers {classType->getVirtualTable()->instanceName};
+                    for (auto & it : classType->interfaces) {
+                        receivers.push_back(getClassImplInstanceName(it.second, classType));
+                    }
+                    for (auto & receiver : receivers) {
+                        printKeyword(Symbol::KwIf);
+                        printSpace();
+                        printSymbol(Symbol::ParOpen);
+                        printIdentifier(argReceiverName);
+                        printSpace();
+                        printSymbol(Symbol::Eq);
+                        printSpace();
+                        printKeyword(Symbol::KwCast);
+                        printSymbol(Symbol::Lt);
+                        printType(types_.getTypeVoidPtr());
+                        printSymbol(Symbol::Gt);
+                        printSymbol(Symbol::ParOpen);
+                        printSymbol(Symbol::BitAnd);
+                        printIdentifier(receiver);
+                        printSymbol(Symbol::ParClose);
+                        printSymbol(Symbol::ParClose);
+                        printSpace();
+                        printScopeOpen();
+                        printKeyword(Symbol::KwReturn);
+                        printSpace();
+                        if (isPrintColorful_) printer_ << printer_.stringLiteral;
+                        printer_ << '\"' << classType->name.name() << '\"';
+                        printSymbol(Symbol::Semicolon);
+                        printScopeClose(false);
+                    }
+                }
+                printKeyword(Symbol::KwReturn);
+                printSpace();
+                if (isPrintColorful_) printer_ << printer_.stringLiteral;
+                printer_ << "\"\"";
+                printSymbol(Symbol::Semicolon);
+            }
+            printScopeClose(false);
+        }
+        #pragma endregion
+
+        /** Prints "char* <function>(int id)" returning the description of the given id, empty for unknown ids.
+         */
+        void printDescriptionTable(Symbol const & function, std::vector<std::string> const & descriptions) {
+            auto argIdName = Symbol{"id"};
+            printType(types_.getTypeChar());
+            printType(Symbol::Mul);
+            printSpace();
+            printIdentifier(function);
+            printSymbol(Symbol::ParOpen);
+            printType(types_.getTypeInt());
+            printSpace();
+            printIdentifier(argIdName);
+            printSymbol(Symbol::ParClose);
+            printScopeOpen();
+            {
+                printKeyword(Symbol::KwSwitch);
+                printSpace();
+                printSymbol(Symbol::ParOpen);
+                printIdentifier(argIdName);
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                for (size_t id = 0; id < descriptions.size(); ++id) {
+                    printKeyword(Symbol::KwCase);
+                    printSpace();
+                    printNumber(static_cast<int>(id));
+                    printSymbol(Symbol::Colon);
+                    printSpace();
+                    printKeyword(Symbol::KwReturn);
+                    printSpace();
+                    if (isPrintColorful_) printer_ << printer_.stringLiteral;
+                    printer_ << '\"' << descriptions[id] << '\"';
+                    printSymbol(Symbol::Semicolon);
+                    if (id + 1 < descriptions.size()) printNewline();
+                }
+                printScopeClose(false);
+                printKeyword(Symbol::KwReturn);
+                printSpace();
+                if (isPrintColorful_) printer_ << printer_.stringLiteral;
+                printer_ << "\"\"";
+                printSymbol(Symbol::Semicolon);
+            }
+            printScopeClose(false);
+        }
+        #pragma endregion
+
+        #pragma region Coverage Instrumentation
+        /** Upper bound of the counters the program needs: one per function body and loop, twice within constructors, which are printed as the make and the init function, and once per instance within generic functions.
+            The counters are declared before the program, thus they are counted ahead. The walk uses its own stack, nesting is not limited by the call stack.
+         */
+        size_t countCoverageCounters(ASTProgram * program) {
+            std::unordered_map<ASTFunDecl*, size_t> instancesCount;
+            for (auto & it : types_.genericInstances()) ++instancesCount[it->function];
+            size_t result = 0;
+            std::vector<std::pair<AST*, size_t>> pending;
+            for (auto & it : program->body) pending.emplace_back(it.get(), 1);
+            while (!pending.empty()) {
+                auto [ast, copies] = pending.back();
+                pending.pop_back();
+                if (ast == nullptr) continue;
+                if (auto * funDecl = ast->as<ASTFunDecl>()) {
+                    if (funDecl->body == nullptr) continue;
+                    // the generic function itself is not printed, only its instances
+                    if (funDecl->isGeneric()) copies *= instancesCount[funDecl];
+                    result += copies;
+                    pending.emplace_back(funDecl->body.get(), copies);
+                } else if (auto * classDecl = ast->as<ASTClassDecl>()) {
+                    for (auto & it : classDecl->methods) pending.emplace_back(it.get(), copies);
+                    for (auto & it : classDecl->constructors) pending.emplace_back(it.get(), copies * 2);
+                } else if (auto * sequence = ast->as<ASTSequence>()) {
+                    for (auto & it : sequence->body) pending.emplace_back(it.get(), copies);
+                } else if (auto * ifAst = ast->as<ASTIf>()) {
+                    pending.emplace_back(ifAst->trueCase.get(), copies);
+                    pending.emplace_back(ifAst->falseCase.get(), copies);
+                } else if (auto * switchAst = ast->as<ASTSwitch>()) {
+                    for (auto & it : switchAst->cases) pending.emplace_back(it.second.get(), copies);
+                    pending.emplace_back(switchAst->defaultCase.get(), copies);
+                } else if (auto * whileAst = ast->as<ASTWhile>()) {
+                    result += copies;
+                    pending.emplace_back(whileAst->body.get(), copies);
+                } else if (auto * doWhileAst = ast->as<ASTDoWhile>()) {
+                    result += copies;
+                    pending.emplace_back(doWhileAst->body.get(), copies);
+                } else if (auto * forAst = ast->as<ASTFor>()) {
+                    result += copies;
+                    pending.emplace_back(forAst->body.get(), copies);
+                }
+            }
+            return result;
+        }
+
+        /** Prints the increment of a new counter of the given kind ("function" or "loop"), a single add per event.
+         */
+        void printCoverageCounter(AST * ast, char const * kind) {
+            if (coverageCounters_.size() >= coverageCountersCapacity_) {
+                throw std::runtime_error{STR("Coverage counter of " << describeEnclosingFunction() << " was not counted ahead")};
+            }
+            int counter = static_cast<int>(coverageCounters_.size());
+            coverageCounters_.push_back(STR(counter << " " << kind << " " << describeEnclosingFunction() << " " << describeLocation(ast)));
+            printIdentifier(symbols::ProfileCoverageArray);
+            printSymbol(Symbol::SquareOpen);
+            printNumber(counter);
+            printSymbol(Symbol::SquareClose);
+            printSymbol(Symbol::Inc);
+            printSymbol(Symbol::Semicolon);
+        }
+
+        void printCoverageDeclaration(ASTProgram * program) {
+            coverageCountersCapacity_ = countCoverageCounters(program);
+            printType(types_.getTypeInt());
+            printSpace();
+            printIdentifier(symbols::ProfileCoverageArray);
+            printSymbol(Symbol::SquareOpen);
+            // the array must not be empty even if the program has no functions
+            printNumber(static_cast<int>(std::max<size_t>(coverageCountersCapacity_, 1)));
+            printSymbol(Symbol::SquareClose);
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+        }
+
+        /** Number of the used counters and the counter table: "<id> <kind> <function> <file>:<line>:<col>".
+         */
+        void printCoverageInstrumentation() {
+            printComment(" --- Coverage instrumentation --- ");
+            printType(types_.getTypeInt());
+            printSpace();
+            printIdentifier(symbols::ProfileCoverageCount);
+            printSpace();
+            printSymbol(Symbol::Assign);
+            printSpace();
+            printNumber(static_cast<int>(coverageCounters_.size()));
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+            printNewline();
+            printDescriptionTable(symbols::ProfileCoverageFunction, coverageCounters_);
+        }
+        #pragma endregion
+
+        #pragma region Pooled Classes
+        Symbol getClassPoolName(Symbol const & prefix, Type::Class * classType) {
+            return symbols::start().add(prefix).add(classType->name).end();
+        }
+
+        /** Pooled classes and their bases can be deleted, their delete functions are declared before the program and defined after it.
+         */
+        void collectDeletableClasses() {
+            std::vector<Type::Class*> classTypes;
+            types_.findEachClassType(classTypes);
+            std::unordered_set<Type::Class*> deletable;
+            for (auto * classType : classTypes) {
+                if (!classType->isPooled()) continue;
+                for (auto * it = classType; it != nullptr && it != types_.defaultClassType; it = it->getBase()) {
+                    deletable.insert(it);
+                }
+            }
+            deletableClasses_.assign(deletable.begin(), deletable.end());
+            std::sort(deletableClasses_.begin(), deletableClasses_.end(), [](Type::Class * a, Type::Class * b) { return a->getId() < b->getId(); });
+        }
+
+        void printDeleteHead(Type::Class * classType) {
+            printType(Symbol::KwVoid);
+            printSpace();
+            printIdentifier(getClassPoolName(symbols::ClassDeletePrefix, classType));
+            printSymbol(Symbol::ParOpen);
+            printType(classType->name);
+            printSpace();
+            printSymbol(Symbol::Mul);
+            printSpace();
+            printIdentifier(symbols::KwThis);
+            printSymbol(Symbol::ParClose);
+        }
+
+        /** Prints "cast<void*>(a) <op> <b>".
+         */
+        void printPointerComparison(std::function<void()> const & printLeft, Symbol const & op, std::function<void()> const & printRight) {
+            printCastTo(Symbol::KwVoid, printLeft);
+            printSpace();
+            printSymbol(op);
+            printSpace();
+            printRight();
+        }
+
+        /** Arena, allocation and one new function per constructor of the pooled class, printed right after the class.
+            The arena is bumped until full, freed instances are linked through their vtable pointer and reused first. Allocations from a full arena yield null.
+         */
+        void printClassPool(ASTClassDecl * ast, Type::Class * classType) {
+            auto poolName = getClassPoolName(symbols::ClassPoolPrefix, classType);
+            auto usedName = getClassPoolName(symbols::ClassPoolUsedPrefix, classType);
+            auto freeName = getClassPoolName(symbols::ClassPoolFreePrefix, classType);
+            auto allocName = getClassPoolName(symbols::ClassPoolAllocPrefix, classType);
+            auto printNullInstance = [&]() { printCastTo(classType->name, [&]() { printNumber(0); }); };
+            printComment(STR(" --- pool of " << classType->name.name() << " --- "));
+            // * arena and its state
+            printType(classType->name);
+            printSpace();
+            printIdentifier(poolName);
+            printSymbol(Symbol::SquareOpen);
+            printNumber(poolCapacity_);
+            printSymbol(Symbol::SquareClose);
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+            printType(types_.getTypeInt());
+            printSpace();
+            printIdentifier(usedName);
+            printSpace();
+            printSymbol(Symbol::Assign);
+            printSpace();
+            printNumber(0);
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+            printType(classType);
+            printSpace();
+            printSymbol(Symbol::Mul);
+            printSpace();
+            printIdentifier(freeName);
+            printSpace();
+            printSymbol(Symbol::Assign);
+            printSpace();
+            printNullInstance();
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+            // * allocation
+            printType(classType);
+            printSpace();
+            printSymbol(Symbol::Mul);
+            printSpace();
+            printIdentifier(allocName);
+            printSymbol(Symbol::ParOpen);
+            printSymbol(Symbol::ParClose);
+            printSpace();
+            printScopeOpen();
+            {
+                printType(classType);
+                printSpace();
+                printSymbol(Symbol::Mul);
+                printSpace();
+                printIdentifier(symbols::KwThis);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                // ** the most recently freed instance
+                printKeyword(Symbol::KwIf);
+                printSpace();
+                printSymbol(Symbol::ParOpen);
+                printPointerComparison([&]() { printIdentifier(freeName); }, Symbol::NEq, [&]() { printIdentifier(symbols::KwNull); });
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                {
+                    printIdentifier(symbols::KwThis);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printIdentifier(freeName);
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                    printIdentifier(freeName);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printCastTo(classType->name, [&]() {
+                        printIdentifier(symbols::KwThis);
+                        printSymbol(Symbol::ArrowR);
+                        printIdentifier(symbols::VirtualTableAsField);
+                    });
+                    printSymbol(Symbol::Semicolon);
+                }
+                printScopeClose(false);
+                printKeyword(Symbol::KwElse);
+                printSpace();
+                printScopeOpen();
+                {
+                    // ** the next never used slot of the arena
+                    printKeyword(Symbol::KwIf);
+                    printSpace();
+                    printSymbol(Symbol::ParOpen);
+                    printIdentifier(usedName);
+                    printSpace();
+                    printSymbol(Symbol::Eq);
+                    printSpace();
+                    printNumber(poolCapacity_);
+                    printSymbol(Symbol::ParClose);
+                    printSpace();
+                    printScopeOpen();
+                    printKeyword(Symbol::KwReturn);
+                    printSpace();
+                    printNullInstance();
+                    printSymbol(Symbol::Semicolon);
+                    printScopeClose(false);
+                    printIdentifier(symbols::KwThis);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printSymbol(Symbol::BitAnd);
+                    printIdentifier(poolName);
+                    printSymbol(Symbol::SquareOpen);
+                    printIdentifier(usedName);
+                    printSymbol(Symbol::SquareClose);
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                    printIdentifier(usedName);
+                    printSymbol(Symbol::Inc);
+                    printSymbol(Symbol::Semicolon);
+                }
+                printScopeClose(false);
+                printVTableInstanceAssignment(classType, true);
+                printKeyword(Symbol::KwReturn);
+                printSpace();
+                printIdentifier(symbols::KwThis);
+                printSymbol(Symbol::Semicolon);
+            }
+            printScopeClose(false);
+            printNewline();
+            // * new functions, the init constructors run on the allocated instance
+            std::vector<ASTFunDecl*> constructors;
+            for (auto & it : ast->constructors) {
+                if (!it->isAbstract()) constructors.push_back(it.get());
+            }
+            if (ast->constructors.empty()) {
+                constructors.push_back(nullptr); // the default constructor
+            }
+            for (auto * constructor : constructors) {
+                auto * funcType = constructor != nullptr ? constructor->getType()->as<Type::Function>() : classType->defaultConstructorFuncType;
+                if (constructor != nullptr) pushAst(constructor);
+                printType(classType);
+                printSpace();
+                printSymbol(Symbol::Mul);
+                printSpace();
+                printIdentifier(classType->getConstructorNewName(funcType));
+                printSymbol(Symbol::ParOpen);
+                if (constructor != nullptr) {
+                    for (size_t i = 0; i < constructor->args.size(); ++i) {
+                        if (i > 0) {
+                            printSymbol(Symbol::Comma);
+                            printSpace();
+                        }
+                        visitChild(constructor->args[i].get());
+                    }
+                }
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                {
+                    printType(classType);
+                    printSpace();
+                    printSymbol(Symbol::Mul);
+                    printSpace();
+                    printIdentifier(symbols::KwThis);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printIdentifier(allocName);
+                    printSymbol(Symbol::ParOpen);
+                    printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                    printKeyword(Symbol::KwIf);
+                    printSpace();
+                    printSymbol(Symbol::ParOpen);
+                    printPointerComparison([&]() { printIdentifier(symbols::KwThis); }, Symbol::NEq, [&]() { printIdentifier(symbols::KwNull); });
+                    printSymbol(Symbol::ParClose);
+                    printSpace();
+                    printScopeOpen();
+                    printIdentifier(classType->getConstructorInitName(funcType));
+                    printSymbol(Symbol::ParOpen);
+                    printIdentifier(symbols::KwThis);
+                    if (constructor != nullptr) {
+                        for (auto & arg : constructor->args) {
+                            printSymbol(Symbol::Comma);
+                            printSpace();
+                            printIdentifier(arg->name->name);
+                        }
+                    }
+                    printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::Semicolon);
+                    printScopeClose(false);
+                    printKeyword(Symbol::KwReturn);
+                    printSpace();
+                    printIdentifier(symbols::KwThis);
+                    printSymbol(Symbol::Semicolon);
+                }
+                printScopeClose(false);
+                printNewline();
+                if (constructor != nullptr) popAst();
+            }
+        }
+
+        /** Definitions of the delete functions declared before the program, every pooled class and its vtable instance are defined at this point.
+            The instance returns to the pool of its dynamic class, told by its vtable pointer, instances of a class which is not pooled are left as they are.
+         */
+        void printDeleteFunctions() {
+            if (deletableClasses_.empty()) return;
+            printComment(" --- Pooled classes --- ");
+            for (auto * classType : deletableClasses_) {
+                printDeleteHead(classType);
+                printSpace();
+                printScopeOpen();
+                printKeyword(Symbol::KwIf);
+                printSpace();
+                printSymbol(Symbol::ParOpen);
+                printPointerComparison([&]() { printIdentifier(symbols::KwThis); }, Symbol::Eq, [&]() { printIdentifier(symbols::KwNull); });
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                printKeyword(Symbol::KwReturn);
+                printSymbol(Symbol::Semicolon);
+                printScopeClose(false);
+                // * the instance of the class itself is the last case, without a check
+                auto pooledTypes = types_.findPooledClasses(classType);
+                std::stable_partition(pooledTypes.begin(), pooledTypes.end(), [&](Type::Class * it) { return it != classType; });
+                for (auto * pooledType : pooledTypes) {
+                    bool isChecked = pooledType != classType;
+                    if (isChecked) {
+                        printKeyword(Symbol::KwIf);
+                        printSpace();
+                        printSymbol(Symbol::ParOpen);
+                        printPointerComparison([&]() {
+                            printIdentifier(symbols::KwThis);
+                            printSymbol(Symbol::ArrowR);
+                            printIdentifier(symbols::VirtualTableAsField);
+                        }, Symbol::Eq, [&]() {
+                            printCastTo(Symbol::KwVoid, [&]() {
+                                printSymbol(Symbol::BitAnd);
+                                printIdentifier(pooledType->getVirtualTable()->instanceName);
+                            });
+                        });
+                        printSymbol(Symbol::ParClose);
+                        printSpace();
+                        printScopeOpen();
+                    }
+                    auto freeName = getClassPoolName(symbols::ClassPoolFreePrefix, pooledType);
+                    auto printInstance = [&]() { printCastTo(pooledType->name, [&]() { printIdentifier(symbols::KwThis); }); };
+                    printInstance();
+                    printSymbol(Symbol::ArrowR);
+                    printIdentifier(symbols::VirtualTableAsField);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printCastTo(pooledType->getVirtualTable()->typeName, [&]() { printIdentifier(freeName); });
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                    printIdentifier(freeName);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printInstance();
+                    printSymbol(Symbol::Semicolon);
+                    if (isChecked) {
+                        printNewline();
+                        printKeyword(Symbol::KwReturn);
+                        printSymbol(Symbol::Semicolon);
+                        printScopeClose(false);
+                    } else {
+                        printNewline();
+                    }
+                }
+                printScopeClose(false);
+                printNewline();
+            }
+        }
+        #pragma endregion
+
+        /** Value of a constexpr call computed at compile time. Negative values are parenthesized, as they replace an operand, chars other than printable ones are casts of their code.
+         */
+        void printConstant(ConstantValue const & value) {
+            if (value.type == types_.getTypeChar() && ConstantEvaluator::IsPrintableChar(value.integer)) {
+                if (isPrintColorful_) printer_ << printer_.charLiteral;
+                printer_ << STR('\'' << static_cast<char>(value.integer) << '\'');
+                return;
+            }
+            if (value.type == types_.getTypeChar()) {
+                printKeyword(Symbol::KwCast);
+                printSymbol(Symbol::Lt);
+                printType(value.type);
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                printNumber(value.integer);
+                printSymbol(Symbol::ParClose);
+                return;
+            }
+            bool isReal = value.type == types_.getTypeDouble();
+            bool isNegative = isReal ? std::signbit(value.real) : value.integer < 0;
+            if (isNegative) printSymbol(Symbol::ParOpen);
+            if (isReal) {
+                if (isPrintColorful_) printer_ << printer_.numberLiteral;
+                printer_ << ConstantEvaluator::FormatReal(value.real).value();
+            } else {
+                printNumber(value.integer);
+            }
+            if (isNegative) printSymbol(Symbol::ParClose);
+        }
+
+        #pragma region Generic Functions
+        Type * resolveType(Type * type) {
+            if (currentGenericInstance_ == nullptr) return type;
+            return types_.substitute(type, currentGenericInstance_->typeArguments);
+        }
+
+        /** Name of the instance called, the type arguments of calls in generic functions depend on the instance being printed.
+         */
+        Symbol getGenericInstanceName(ASTCall * call) {
+            std::vector<Type*> typeArguments;
+            for (auto * it : call->typeArguments) {
+                typeArguments.push_back(resolveType(it));
+            }
+            auto * instance = types_.findGenericInstance(call->generic, typeArguments);
+            assert(instance != nullptr && "instances are created by the typechecker");
+            return instance->name;
+        }
+
+        /** Whether a class derived from the class overrides its method.
+            Receivers typed by a type parameter are of the type argument exactly, unless a derived class was cast to it, so calls of methods not overridden anywhere do not need the vtable.
+         */
+        bool isOverridden(Type::Class * classType, Symbol const & methodName) {
+            if (!derivedClasses_.has_value()) {
+                std::vector<Type::Class*> classTypes;
+                types_.findEachClassType(classTypes);
+                derivedClasses_.emplace();
+                for (auto * it : classTypes) {
+                    if (it->getBase() != nullptr) derivedClasses_->push_back(it);
+                }
+            }
+            for (auto * it : derivedClasses_.value()) {
+                if (it != classType && it->inherits(classType) && it->hasMethod(methodName, false)) return true;
+            }
+            return false;
+        }
+
+        void printGenericInstance(GenericInstance const & instance, bool asForwardDeclaration) {
+            currentGenericInstance_ = &instance;
+            printFunction(instance.function->as<ASTFunDecl>(), asForwardDeclaration);
+            currentGenericInstance_ = nullptr;
+            printNewline();
+        }
+
+        /** Instances called by the declaration are declared before it, the rest are called by other instances only.
+         */
+        void printGenericInstancePrototypes(AST * declaration) {
+            for (auto & it : types_.genericInstances()) {
+                if (it->declaration == declaration) printGenericInstance(*it, true);
+            }
+        }
+
+        void printGenericInstances() {
+            if (types_.genericInstances().empty()) return;
+            printComment(" --- Generic instances --- ");
+            printGenericInstancePrototypes(nullptr);
+            for (auto & it : types_.genericInstances()) {
+                printNewline();
+                printGenericInstance(*it, false);
+            }
+            printNewline();
+        }
+        #pragma endregion
+
+        #pragma region Profile Guided Dispatch
+        /** Whether the type can be named before the user program, where the guard declarations are printed.
+            Classes are forward declared and interfaces are passed as views, other user types are declared by the program itself.
+         */
+        bool isDeclaredBeforeProgram(Type * type) {
+            bool isPointer = false;
+            while (auto * pointer = type->as<Type::Pointer>()) {
+                type = pointer->base();
+                isPointer = true;
+            }
+            return type->as<Type::POD>() != nullptr
+                || type->as<Type::Class>() != nullptr
+                || (type->as<Type::Interface>() != nullptr && !isPointer);
+        }
+
+        void printGuardType(Type * type) {
+            if (type->as<Type::Interface>() != nullptr) {
+                printType(symbols::InterfaceViewStruct);
+            } else {
+                printType(type);
+            }
+        }
+
+        /** Builds the guard of a profiled call site, returns false when the site or its receivers do not match this program anymore.
+         */
+        bool makeCallGuard(DispatchGuard & guard, std::string const & staticType, std::vector<std::string> const & receivers) {
+            auto separator = staticType.find('.');
+            if (separator == std::string::npos) return false;
+            auto * type = types_.getType(Symbol{staticType.substr(0, separator)});
+            guard.method = Symbol{staticType.substr(separator + 1)};
+            if (type == nullptr) return false;
+            guard.staticClass = guard.kind == "virtual-call" ? type->as<Type::Class>() : nullptr;
+            guard.staticInterface = guard.kind == "interface-call" ? type->as<Type::Interface>() : nullptr;
+            if (guard.staticClass != nullptr) {
+                auto info = guard.staticClass->getMethodInfo(guard.method);
+                if (!info.has_value() || !info->ast->isVirtualized()) return false;
+                guard.methodType = info->type;
+            } else if (guard.staticInterface == nullptr || guard.staticInterface->methods_.count(guard.method) == 0) {
+                return false;
+            }
+            for (auto & name : receivers) {
+                auto * receiverType = types_.getType(Symbol{name});
+                auto * receiverClass = receiverType != nullptr ? receiverType->as<Type::Class>() : nullptr;
+                if (receiverClass == nullptr || receiverClass->isAbstract()) return false;
+                if (guard.staticClass != nullptr && !receiverClass->inherits(guard.staticClass)) return false;
+                if (guard.staticInterface != nullptr && receiverClass->interfaces.count(guard.staticInterface->name) == 0) return false;
+                if (guard.methodType == nullptr) {
+                    guard.methodType = receiverClass->getMethodInfo(guard.method).value().type;
+                }
+                guard.receivers.push_back(receiverClass);
+            }
+            if (!isDeclaredBeforeProgram(guard.methodType->returnType())) return false;
+            for (size_t i = 1; i < guard.methodType->numArgs(); ++i) {
+                if (!isDeclaredBeforeProgram(guard.methodType->argType(i))) return false;
+            }
+            return true;
+        }
+
+        /** Picks the profiled sites worth specializing and declares their guards:
+            calls dominated by one or two receiver classes check for them and call their methods directly, hot interface casts cache the impl of the last class.
+         */
+        void prepareDispatchGuards() {
+            for (auto & key : profile_->keys()) {
+                // * "<function>/<kind>/<static type>/<ordinal>"
+                auto kindStart = key.find('/');
+                auto typeStart = kindStart == std::string::npos ? kindStart : key.find('/', kindStart + 1);
+                auto typeEnd = key.rfind('/');
+                if (typeStart == std::string::npos || typeEnd <= typeStart) continue;
+                auto staticType = key.substr(typeStart + 1, typeEnd - typeStart - 1);
+                auto name = symbols::start().add(symbols::ProfileGuardPrefix).add(dispatchGuards_.size()).add("_").end();
+                DispatchGuard guard{name, key.substr(kindStart + 1, typeStart - kindStart - 1), nullptr, nullptr, Symbol{""}, nullptr, {}};
+                if (guard.kind == "interface-cast") {
+                    auto arrow = staticType.find("->");
+                    auto target = arrow != std::string::npos ? staticType.substr(arrow + 2) : std::string{};
+                    target.erase(std::min(target.find('*'), target.size()));
+                    auto * type = target.empty() ? nullptr : types_.getType(Symbol{target});
+                    guard.staticInterface = type != nullptr ? type->as<Type::Interface>() : nullptr;
+                    if (guard.staticInterface == nullptr || !profile_->isHot(key)) continue;
+                } else if (guard.kind == "virtual-call" || guard.kind == "interface-call") {
+                    auto receivers = profile_->dominantReceivers(key);
+                    if (receivers.empty() || !makeCallGuard(guard, staticType, receivers)) continue;
+                } else {
+                    continue;
+                }
+                dispatchGuardIndexes_.emplace(key, dispatchGuards_.size());
+                dispatchGuards_.push_back(std::move(guard));
+            }
+            if (dispatchGuards_.empty()) return;
+            printComment(" --- Profile guided dispatch --- ");
+            for (auto & guard : dispatchGuards_) {
+                printDispatchGuardHead(guard);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+            }
+        }
+
+        void printDispatchGuardHead(DispatchGuard const & guard) {
+            bool isCast = guard.kind == "interface-cast";
+            if (isCast) {
+                printType(symbols::InterfaceViewStruct);
+            } else {
+                printGuardType(guard.methodType->returnType());
+            }
+            printSpace();
+            printIdentifier(guard.name);
+            printSymbol(Symbol::ParOpen);
+            if (isCast) {
+                printType(types_.getTypeVoidPtr());
+            } else if (guard.staticClass != nullptr) {
+                printType(guard.staticClass->name);
+                printType(Symbol::Mul);
+            } else {
+                printType(symbols::InterfaceViewStruct);
+            }
+            printSpace();
+            printIdentifier(Symbol{"receiver"});
+            for (size_t i = 1; !isCast && i < guard.methodType->numArgs(); ++i) {
+                printSymbol(Symbol::Comma);
+                printSpace();
+                printGuardType(guard.methodType->argType(i));
+                printSpace();
+                printIdentifier(Symbol{STR("arg" << i)});
+            }
+            printSymbol(Symbol::ParClose);
+        }
+
+        /** Prints "[return] <function>(<receiver>, arg1, ...);" of a guarded call, with a plain return after calls of void methods.
+         */
+        void printGuardedCall(DispatchGuard const & guard, std::function<void()> const & printFunction, std::function<void()> const & printReceiver, bool isLast) {
+            bool isVoid = guard.methodType->returnType() == types_.getTypeVoid();
+            if (!isVoid) {
+                printKeyword(Symbol::KwReturn);
+                printSpace();
+            }
+            printFunction();
+            printSymbol(Symbol::ParOpen);
+            printReceiver();
+            for (size_t i = 1; i < guard.methodType->numArgs(); ++i) {
+                printSymbol(Symbol::Comma);
+                printSpace();
+                printIdentifier(Symbol{STR("arg" << i)});
+            }
+            printSymbol(Symbol::ParClose);
+            printSymbol(Symbol::Semicolon);
+            if (isVoid && !isLast) {
+                printNewline();
+                printKeyword(Symbol::KwReturn);
+                printSymbol(Symbol::Semicolon);
+            }
+        }
+
+        void printCastTo(Symbol const & type, std::function<void()> const & printValue) {
+            printKeyword(Symbol::KwCast);
+            printSymbol(Symbol::Lt);
+            printType(type);
+            printType(Symbol::Mul);
+            printSymbol(Symbol::Gt);
+            printSymbol(Symbol::ParOpen);
+            printValue();
+            printSymbol(Symbol::ParClose);
+        }
+
+        void printCallGuard(DispatchGuard const & guard) {
+            auto receiverName = Symbol{"receiver"};
+            bool isVirtual = guard.staticClass != nullptr;
+            // * the object of the receiver
+            auto printObject = [&]() {
+                printIdentifier(receiverName);
+                if (!isVirtual) {
+                    printSymbol(Symbol::Dot);
+                    printIdentifier(symbols::InterfaceTargetAsField);
+                }
+            };
+            // * what identifies the class of the receiver: the vtable or the interface impl
+            auto printDispatcher = [&]() {
+                printIdentifier(receiverName);
+                printSymbol(isVirtual ? Symbol::ArrowR : Symbol::Dot);
+                printIdentifier(isVirtual ? symbols::VirtualTableAsField : symbols::InterfaceImplAsField);
+            };
+            printDispatchGuardHead(guard);
+            printSpace();
+            printScopeOpen();
+            for (auto * receiverClass : guard.receivers) {
+                auto info = receiverClass->getMethodInfo(guard.method).value();
+                auto * ownerClass = info.type->argType(0)->unwrap<Type::Class>();
+                printKeyword(Symbol::KwIf);
+                printSpace();
+                printSymbol(Symbol::ParOpen);
+                printKeyword(Symbol::KwCast);
+                printSymbol(Symbol::Lt);
+                printType(types_.getTypeVoidPtr());
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                printDispatcher();
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printSymbol(Symbol::Eq);
+                printSpace();
+                printKeyword(Symbol::KwCast);
+                printSymbol(Symbol::Lt);
+                printType(types_.getTypeVoidPtr());
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                printSymbol(Symbol::BitAnd);
+                printIdentifier(isVirtual
+                    ? receiverClass->getVirtualTable()->instanceName
+                    : getClassImplInstanceName(guard.staticInterface, receiverClass));
+                printSymbol(Symbol::ParClose);
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                printGuardedCall(guard,
+                    [&]() { printIdentifier(info.fullName); },
+                    [&]() { printCastTo(ownerClass->name, printObject); },
+                    false);
+                printScopeClose(false);
+            }
+            // * any other receiver goes through the dynamic dispatch
+            if (isVirtual) {
+                auto * targetClass = guard.methodType->argType(0)->unwrap<Type::Class>();
+                printGuardedCall(guard,
+                    [&]() {
+                        printCastTo(guard.staticClass->getVirtualTable()->typeName, printDispatcher);
+                        printSymbol(Symbol::ArrowR);
+                        printIdentifier(guard.method);
+                    },
+                    [&]() { printCastTo(targetClass->name, printObject); },
+                    true);
+            } else {
+                printGuardedCall(guard,
+                    [&]() {
+                        printCastTo(guard.staticInterface->implStructName, printDispatcher);
+                        printSymbol(Symbol::ArrowR);
+                        printIdentifier(guard.method);
+                    },
+                    printObject,
+                    true);
+            }
+            printScopeClose(false);
+        }
+
+        void printCastGuard(DispatchGuard const & guard) {
+            auto receiverName = Symbol{"receiver"};
+            auto localViewName = Symbol{"view"};
+            auto cacheName = symbols::start().add(guard.name).add(symbols::ProfileCastCacheSuffix).end();
+            // * [vtable, impl] of the last class cast
+            printType(types_.getTypeVoidPtr());
+            printSpace();
+            printIdentifier(cacheName);
+            printSymbol(Symbol::SquareOpen);
+            printNumber(2);
+            printSymbol(Symbol::SquareClose);
+            printSymbol(Symbol::Semicolon);
+            printNewline();
+            auto printVtable = [&]() {
+                printKeyword(Symbol::KwCast);
+                printSymbol(Symbol::Lt);
+                printType(types_.getTypeVoidPtr());
+                printType(Symbol::Mul);
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                printIdentifier(receiverName);
+                printSymbol(Symbol::ParClose);
+                printSymbol(Symbol::SquareOpen);
+                printNumber(0);
+                printSymbol(Symbol::SquareClose);
+            };
+            auto printCacheSlot = [&](int slot) {
+                printIdentifier(cacheName);
+                printSymbol(Symbol::SquareOpen);
+                printNumber(slot);
+                printSymbol(Symbol::SquareClose);
+            };
+            auto printViewField = [&](Symbol const & field) {
+                printIdentifier(localViewName);
+                printSymbol(Symbol::Dot);
+                printIdentifier(field);
+            };
+            printDispatchGuardHead(guard);
+            printSpace();
+            printScopeOpen();
+            {
+                printType(symbols::InterfaceViewStruct);
+                printSpace();
+                printIdentifier(localViewName);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                // * hit: the same class as the last time
+                printKeyword(Symbol::KwIf);
+                printSpace();
+                printSymbol(Symbol::ParOpen);
+                printIdentifier(receiverName);
+                printSpace();
+                printSymbol(Symbol::NEq);
+                printSpace();
+                printIdentifier(symbols::KwNull);
+                printSpace();
+                printSymbol(Symbol::And);
+                printSpace();
+                printVtable();
+                printSpace();
+                printSymbol(Symbol::Eq);
+                printSpace();
+                printCacheSlot(0);
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                {
+                    printViewField(symbols::InterfaceTargetAsField);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printIdentifier(receiverName);
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                    printViewField(symbols::InterfaceImplAsField);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printCacheSlot(1);
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                    printKeyword(Symbol::KwReturn);
+                    printSpace();
+                    printIdentifier(localViewName);
+                    printSymbol(Symbol::Semicolon);
+                }
+                printScopeClose(false);
+                // * miss: the regular cast, remembered when it succeeds
+                printIdentifier(localViewName);
+                printSpace();
+                printSymbol(Symbol::Assign);
+                printSpace();
+                printIdentifier(guard.staticInterface->castName);
+                printSymbol(Symbol::ParOpen);
+                printIdentifier(receiverName);
+                printSymbol(Symbol::ParClose);
+                printSymbol(Symbol::Semicolon);
+                printNewline();
+                printKeyword(Symbol::KwIf);
+                printSpace();
+                printSymbol(Symbol::ParOpen);
+                printViewField(symbols::InterfaceImplAsField);
+                printSpace();
+                printSymbol(Symbol::NEq);
+                printSpace();
+                printIdentifier(symbols::KwNull);
+                printSymbol(Symbol::ParClose);
+                printSpace();
+                printScopeOpen();
+                {
+                    printCacheSlot(0);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printVtable();
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                    printCacheSlot(1);
+                    printSpace();
+                    printSymbol(Symbol::Assign);
+                    printSpace();
+                    printViewField(symbols::InterfaceImplAsField);
+                    printSymbol(Symbol::Semicolon);
+                }
+                printScopeClose(false);
+                printKeyword(Symbol::KwReturn);
+                printSpace();
+                printIdentifier(localViewName);
+                printSymbol(Symbol::Semicolon);
+            }
+            printScopeClose(false);
+        }
+
+        /** Definitions of the guards declared by prepareDispatchGuards, every class and interface is defined at this point.
+         */
+        void printDispatchGuards() {
+            if (dispatchGuards_.empty()) return;
+            printComment(" --- Profile guided dispatch --- ");
+            for (auto & guard : dispatchGuards_) {
+                if (guard.kind == "interface-cast") {
+                    printCastGuard(guard);
+                } else {
+                    printCallGuard(guard);
+                }
+                printNewline();
+            }
+        }
+        #pragma endregion
+
+        void printGetImplFunction(Type::Class * classType) {
+            ScopedSpan span{trace_, "emit", trace_ != nullptr ? STR("printGetImplFunction " << classType->name) : ""};
+            auto argIdName = Symbol{"id"};
+            // * return type
+            printType(types_.getTypeVoid());
+            printSymbol(Symbol::Mul);
+            printSpace();
+            // * name
+            printIdentifier(classType->getImplName);
+            // * arguments
+            printSymbol(Symbol::ParOpen);
+            printType(types_.getTypeInt());
+            printSpace();
+            printIdentifier(argIdName);
+            printSymbol(Symbol::ParClose);
+            printSpace();
+            // * body start
+            printScopeOpen();
+            {
+                // ** switches between base class ids
+                printKeyword(Symbol::KwSwitch);
+                printSymbol(Symbol::ParOpen);
+                printIdentifier(argIdName);
+                printSymbol(Symbol::ParClose);
+                printScopeOpen();
+                for (auto & it : classType->interfaces) {
+                    // ** class index case
+                    printKeyword(Symbol::KwCase);
+                    printSpace();
+                    printNumber(it.second->getId());
+                    printSymbol(Symbol::Colon);
+                    printSpace();
+                    printKeyword(Symbol::KwReturn);
+                    printSpace();
+                    printSymbol(Symbol::KwCast);
+                    printSymbol(Symbol::Lt);
+                    printType(types_.getTypeVoidPtr());
+                    printSymbol(Symbol::Gt);
+                    printSymbol(Symbol::ParOpen);
+                    printSymbol(Symbol::BitAnd);
+                    printIdentifier(getClassImplInstanceName(it.second, classType));
+                    printSymbol(Symbol::ParClose);
+                    printSymbol(Symbol::Semicolon);
+                    printNewline();
+                }
+                // ** default case
+                printKeyword(Symbol::KwDefault);
                 printSymbol(Symbol::Colon);
                 printSpace();
                 printKeyword(Symbol::KwReturn);
@@ -819,6 +2602,8 @@ namespace tinycplus {
         void printConstructor(ASTFunDecl * ast, bool asForwardDeclaration) {
             auto * classType = peekAst()->getType()->as<Type::Class>();
             auto * funcType = ast->getType()->as<Type::Function>();
+            if (!asForwardDeclaration) printLineMarker(ast);
+            auto start = beginFunctionOutput();
             pushAst(ast);
             // * function return type
             if (classConstructorIsIniting) {
@@ -860,21 +2645,36 @@ namespace tinycplus {
                 printNewline();
             } else {
                 printSpace();
+                analyzeEscapes(ast);
                 visitChild(ast->body.get());
+                escapes_.forgetFunction();
+                endFunctionOutput(start, classConstructorIsIniting
+                    ? classType->getConstructorInitName(funcType)
+                    : classType->getConstructorMakeName(funcType), ast, classType);
+                printLineMarkerReset();
             }
             popAst();
         }
 
-        void printFunction(ASTFunDecl * ast) {
+        void printFunction(ASTFunDecl * ast, bool asForwardDeclaration = false) {
+            bool isDefinition = ast->body && !asForwardDeclaration;
+            if (isDefinition) printLineMarker(ast);
+            auto start = beginFunctionOutput();
             pushAst(ast);
             auto name = ast->name.value();
-            validateName(name);
+            if (currentGenericInstance_ != nullptr) {
+                name = currentGenericInstance_->name;
+            } else {
+                validateName(name);
+            }
             // * function return type
             visitChild(ast->typeDecl.get());
             printSpace();
             // * function name
             printIdentifier(name.name());
-            registerDeclaration(name.name(), name.name(), 1);
+            if (!asForwardDeclaration) {
+                registerDeclaration(name.name(), name.name(), 1);
+            }
             // * function arguments
             printSymbol(Symbol::ParOpen);
             auto arg = ast->args.begin();
@@ -888,9 +2688,13 @@ namespace tinycplus {
             }
             printSymbol(Symbol::ParClose);
             // * function body
-            if (ast->body) {
+            if (isDefinition) {
                 printSpace();
+                analyzeEscapes(ast);
                 visitChild(ast->body.get());
+                escapes_.forgetFunction();
+                endFunctionOutput(start, name, ast, nullptr);
+                printLineMarkerReset();
             } else {
                 printSymbol(Symbol::Semicolon);
             }
@@ -900,6 +2704,8 @@ namespace tinycplus {
         void printMethod(ASTFunDecl * ast) {
             auto * classParent = peekAst()->as<ASTClassDecl>();
             assert(classParent && "must have an ast class decl as parent ast");
+            if (ast->body) printLineMarker(ast);
+            auto start = beginFunctionOutput();
             pushAst(ast);
             auto name = ast->name.value();
             validateName(name);
@@ -935,7 +2741,11 @@ namespace tinycplus {
             // * method body
             if (ast->body) {
                 printSpace();
+                analyzeEscapes(ast);
                 visitChild(ast->body.get());
+                escapes_.forgetFunction();
+                endFunctionOutput(start, info.fullName, ast, classType);
+                printLineMarkerReset();
             } else {
                 printSymbol(Symbol::Semicolon);
             }
@@ -943,6 +2753,7 @@ namespace tinycplus {
         }
 
         void printFunctionPointerCall(ASTMember * member, ASTCall * call) {
+            countSite(&EmitStats::functionPointerCalls);
             visitChild(member->base.get());
             printSymbol(member->op);
             visitChild(call);
@@ -950,23 +2761,52 @@ namespace tinycplus {
 
         void printInterfaceMethodCall(ASTMember * member, ASTCall * call, Type::Interface * interfaceType) {
             auto methodName = call->function->as<ASTIdentifier>();
-            auto baseAsIdent = member->base->as<ASTIdentifier>();
+            std::string key;
+            if (isKeyingDispatchSites()) {
+                key = makeDispatchSiteKey("interface-call", STR(interfaceType->toString() << "." << methodName->name));
+            }
+            if (auto * guard = findDispatchGuard(key)) {
+                // * the view is passed as is, the guard checks its impl
+                countSite(&EmitStats::guardedCalls);
+                printIdentifier(guard->name);
+                printSymbol(Symbol::ParOpen);
+                visitChild(member->base.get());
+                for(auto & arg : call->args) {
+                    printSymbol(Symbol::Comma);
+                    printSpace();
+                    visitChild(arg.get());
+                }
+                printSymbol(Symbol::ParClose);
+                return;
+            }
+            countSite(&EmitStats::interfaceCalls);
             printKeyword(Symbol::KwCast);
             printSymbol(Symbol::Lt);
             printType(interfaceType->implStructName);
             printType(Symbol::Mul);
             printSymbol(Symbol::Gt);
             printSymbol(Symbol::ParOpen);
-            printIdentifier(baseAsIdent->name);
+            if (isInstrumentingDispatch_) {
+                // * the impl instance identifies the class of the receiver
+                int site = registerDispatchSite(member, key);
+                printRecordOpen(symbols::ProfileRecordFunction, site);
+            }
+            visitChild(member->base.get());
             printSymbol(Symbol::Dot);
             printIdentifier(symbols::InterfaceImplAsField);
+            if (isInstrumentingDispatch_) {
+                printSymbol(Symbol::ParClose);
+            }
             printSymbol(Symbol::ParClose);
             printSymbol(Symbol::ArrowR);
             printIdentifier(methodName->name);
             // * arguments
             printSymbol(Symbol::ParOpen);
             {
+                // * the target instance of the view
                 visitChild(member->base.get());
+                printSymbol(Symbol::Dot);
+                printIdentifier(symbols::InterfaceTargetAsField);
                 // * the rest of arguments
                 for(auto & arg : call->args) {
                     printSymbol(Symbol::Comma);
@@ -983,9 +2823,58 @@ namespace tinycplus {
             auto methodInfo = classType->getMethodInfo(methodName->name).value();
             auto * targetClassType = methodInfo.type->argType(0)->unwrap<Type::Class>();
             auto baseAsIdent = member->base->as<ASTIdentifier>();
-            bool isBaseCall = baseAsIdent != nullptr && baseAsIdent->name != symbols::KwBase;
-            bool methodIsVirtual = methodInfo.ast->isVirtualized();
-            if (methodIsVirtual && isBaseCall) {
+            // * calls through "base" are calls of the base method itself, fields, array elements and returned values of class types are instances of their static class, other receivers are dispatched
+            bool isStaticReceiver = baseAsIdent != nullptr ? baseAsIdent->name == symbols::KwBase : !isPointerAccess;
+            // * the receiver of a type parameter is an instance of the type argument, see isOverridden
+            bool isStatic = member->base->getType()->unwrap<Type::Parameter>() != nullptr && !isOverridden(classType, methodName->name);
+            bool methodIsVirtual = methodInfo.ast->isVirtualized() && !isStatic;
+            // * the class of a non-escaping instance is known exactly, its site is still keyed so that the ordinals of the other sites stay
+            bool isExact = !isStaticReceiver && baseAsIdent != nullptr && escapes_.find(baseAsIdent) != nullptr;
+            std::string key;
+            if (methodIsVirtual && !isStaticReceiver && isKeyingDispatchSites()) {
+                key = makeDispatchSiteKey("virtual-call", STR(classType->toString() << "." << methodName->name));
+            }
+            auto * guard = isPointerAccess ? findDispatchGuard(key) : nullptr;
+            if (guard != nullptr) {
+                // * the receiver is passed as is, the guard checks its vtable
+                countSite(&EmitStats::guardedCalls);
+                printIdentifier(guard->name);
+                printSymbol(Symbol::ParOpen);
+                visitChild(member->base.get());
+                for(auto & arg : call->args) {
+                    printSymbol(Symbol::Comma);
+                    printSpace();
+                    visitChild(arg.get());
+                }
+                printSymbol(Symbol::ParClose);
+                return;
+            }
+            bool isDispatched = methodIsVirtual && !isStaticReceiver && !isExact;
+            countSite(isDispatched ? &EmitStats::virtualCalls : &EmitStats::directCalls);
+            if (isDispatched && isInstrumentingDispatch_) {
+                // * the vtable pointer identifies the class of the receiver
+                int site = registerDispatchSite(member, key);
+                printKeyword(Symbol::KwCast);
+                printSymbol(Symbol::Lt);
+                printType(classType->getVirtualTable()->typeName);
+                printType(Symbol::Mul);
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                printRecordOpen(symbols::ProfileRecordFunction, site);
+                printKeyword(Symbol::KwCast);
+                printSymbol(Symbol::Lt);
+                printType(types_.getTypeVoidPtr());
+                printSymbol(Symbol::Gt);
+                printSymbol(Symbol::ParOpen);
+                visitChild(member->base.get());
+                printSymbol(isPointerAccess ? Symbol::ArrowR : Symbol::Dot);
+                printIdentifier(symbols::VirtualTableAsField);
+                printSymbol(Symbol::ParClose);
+                printSymbol(Symbol::ParClose);
+                printSymbol(Symbol::ParClose);
+                printSymbol(Symbol::ArrowR);
+                printIdentifier(methodName->name);
+            } else if (isDispatched) {
                 visitChild(member->base.get());
                 printSymbol(isPointerAccess ? Symbol::ArrowR : Symbol::Dot);
                 printIdentifier(symbols::VirtualTableAsField);
@@ -1065,6 +2954,8 @@ namespace tinycplus {
         void visit(ASTIndex * ast) override;
         void visit(ASTMember * ast) override;
         void visit(ASTCall * ast) override;
+        void visit(ASTNew * ast) override;
+        void visit(ASTDelete * ast) override;
         void visit(ASTCast * ast) override;
     }; // class Transpiler
 
@@ -1,6 +1,7 @@
 // internal
 #include "typechecker.h"
 #include "shared.h"
+#include "layout.h"
 
 namespace tinycplus {
 
@@ -60,6 +61,24 @@ namespace tinycplus {
             if (t == nullptr) {
                 throw ParserError(STR("Unknown variable " << ast->name.name()), ast->location());
             }
+            if (names_.isStructOfArrays(ast->name)) {
+                // elements of soa arrays do not exist as values, only their fields do
+                if (ast != structOfArraysAccess_) throw ParserError{
+                    STR("TYPECHECK: soa array " << ast->name.name() << " can only be used to access fields of its elements: " << ast->name.name() << "[i].field"),
+                    ast->location()
+                };
+                ast->isStructOfArrays = true;
+            }
+            // * constexpr functions are pure, the calls of other constexpr functions are their only use of globals
+            if (currentConstexpr_ != nullptr && names_.isGlobalVariable(ast->name) && constexprFunctions_.find(ast->name) == constexprFunctions_.end()) throw ParserError{
+                STR("TYPECHECK: constexpr function " << currentConstexpr_->name.value().name() << " cannot use global " << ast->name.name()),
+                ast->location()
+            };
+            // generic functions have no address, each of their calls may call a different instance
+            if (genericFunctions_.find(t) != genericFunctions_.end() && ast != genericCallee_) throw ParserError{
+                STR("TYPECHECK: generic function " << ast->name.name() << " can only be called"),
+                ast->location()
+            };
             return ast->setType(t);
         }
     }
@@ -80,6 +99,12 @@ namespace tinycplus {
         isProcessingPointerType = true;
         auto * baseType = visitChild(ast->base);
         isProcessingPointerType = false;
+        // * sizes computed by constexpr calls are printed as their value
+        auto * sizeType = visitChild(ast->size);
+        if (sizeType != types_.getTypeInt() && sizeType != types_.getTypeChar()) throw ParserError{
+            STR("TYPECHECK: array size must be int or char, but " << (sizeType != nullptr ? sizeType->toString() : "unknown type") << " found"),
+            ast->size->location()
+        };
         return ast->setType(types_.getOrCreatePointerType(baseType));
     }
 
@@ -120,11 +145,30 @@ namespace tinycplus {
     }
 
     void TypeChecker::visit(ASTProgram * ast) {
+        beginProgram(ast);
+        for (auto & i : ast->body) {
+            checkDeclaration(i.get());
+        }
+        finishProgram(ast);
+    }
+
+    void TypeChecker::beginProgram(ASTProgram * ast) {
         names_.enterBlockScope();
         names_.addGlobalVariable(symbols::KwNull, types_.getTypeDefaultClassPtr());
-        // Sets default result type of a block as void if non other type has been set
-        for (auto & i : ast->body) {
-            auto * statementResultType = visitChild(i);
+    }
+
+    void TypeChecker::checkDeclaration(AST * declaration) {
+        ScopedSpan span{trace_, "check", trace_ != nullptr ? tracing::describeDeclaration(declaration) : ""};
+        currentDeclaration_ = declaration;
+        visitChild(declaration);
+        currentDeclaration_ = nullptr;
+    }
+
+    void TypeChecker::finishProgram(ASTProgram * ast) {
+        instantiateGenericCalls();
+        // * classes derived from the deleted one can be declared after the delete
+        for (auto & it : deletes_) {
+            if (types_.findPooledClasses(it.first).empty()) throw it.second;
         }
         ast->setType(types_.getTypeVoid());
         names_.leaveCurrentScope();
@@ -133,6 +177,10 @@ namespace tinycplus {
     void TypeChecker::visit(ASTVarDecl * ast) {
         auto * t = visitChild(ast->type);
         checkTypeCompletion(t, ast);
+        if (currentConstexpr_ != nullptr && (!types_.isPOD(t) || ast->type->as<ASTArrayType>() != nullptr)) throw ParserError{
+            STR("TYPECHECK: constexpr function " << currentConstexpr_->name.value().name() << " can only declare int, char or double variables"),
+            ast->location()
+        };
         auto tAsClassType = t->as<Type::Class>();
         if (tAsClassType != nullptr && tAsClassType->isAbstract()) throw ParserError {
             STR("TYPECHECK: Cannot declare value type abstract class instance."),
@@ -147,6 +195,12 @@ namespace tinycplus {
             context.value().complexType->registerField(ast->name->name, t, ast);
         } else {
             addVariable(ast, ast->name->name, t);
+            // fields keep arrays of soa classes as they are, only variables are split
+            auto * elementType = ast->type->as<ASTArrayType>() != nullptr ? t->as<Type::Pointer>()->base()->as<Type::Class>() : nullptr;
+            if (elementType != nullptr && elementType->isStructOfArrays()) {
+                names_.setStructOfArrays(ast->name->name);
+                ast->name->isStructOfArrays = true;
+            }
         }
         return ast->setType(t);
     }
@@ -208,8 +262,18 @@ namespace tinycplus {
             STR("TYPECHECK: object class does not need forward declaration and cannot be redefined."),
             ast->location(),
         };
+        for (auto & it : ast->attributes) {
+            if (!symbols::isClassAttribute(it)) throw ParserError {
+                STR("TYPECHECK: unknown class attribute " << it.name()),
+                ast->location()
+            };
+        }
         auto * type = types_.getOrCreateClassType(ast->name);
         currentClassType = type;
+        if (ast->hasAttribute(symbols::AttributePooled)) {
+            // before the methods, so that they can allocate instances of their class
+            type->setPooled();
+        }
         // adding default constructor function type
         types_.getOrCreateFunctionType(std::unique_ptr<Type::Function>{new Type::Function{type}});
         updatePartialDecl(type, ast);
@@ -223,6 +287,10 @@ namespace tinycplus {
                 ast->location()
             };
             type->setBase(baseType);
+            // interfaces implemented by the base are implemented by the derived class as well, its own impl instances dispatch to its overrides
+            for (auto & it : baseType->interfaces) {
+                type->addInterfaceType(it.second);
+            }
         } else {
             type->setBase(types_.defaultClassType);
         }
@@ -242,6 +310,12 @@ namespace tinycplus {
                 visitChild(i);
                 wipeContext(position);
             }
+            if (ast->hasAttribute(symbols::AttributeCompact)) {
+                type->setLayoutOrder(computeCompactOrder(type));
+            }
+            if (ast->hasAttribute(symbols::AttributeStructOfArrays)) {
+                checkStructOfArraysFields(ast, type);
+            }
             isProcessingMethodDeclarationOnly = true;
             for (auto & i : ast->methods) {
                 auto position = push<Context::Complex>({type});
@@ -284,6 +358,14 @@ namespace tinycplus {
                 }
             }
             isProcessingMethodDeclarationOnly = false;
+            if (ast->hasAttribute(symbols::AttributeStructOfArrays)) {
+                checkStructOfArraysDispatch(ast, type);
+                type->setStructOfArrays();
+            }
+            if (type->isPooled() && type->isAbstract()) throw ParserError{
+                STR("TYPECHECK: abstract class " << ast->name.name() << " cannot be pooled"),
+                ast->location()
+            };
             for (auto & i : ast->methods) {
                 auto position = push<Context::Complex>({type});
                 visitChild(i);
@@ -373,12 +455,17 @@ namespace tinycplus {
     }
 
     void TypeChecker::visit(ASTIf * ast) { 
-        if (! types_.convertsToBool(visitChild(ast->cond)))
-            throw ParserError{STR("Condition must convert to bool, but " << ast->cond->getType()->toString() << " found"), ast->cond->location()};
-        visitChild(ast->trueCase);
-        if (ast->falseCase != nullptr) 
-            visitChild(ast->falseCase);
-        return ast->setType(types_.getTypeVoid());
+        // else-if chains are checked in a loop, so that their length is not limited by the stack
+        for (ASTIf * current = ast; current != nullptr; ) {
+            if (! types_.convertsToBool(visitChild(current->cond)))
+                throw ParserError{STR("Condition must convert to bool, but " << current->cond->getType()->toString() << " found"), current->cond->location()};
+            visitChild(current->trueCase);
+            current->setType(types_.getTypeVoid());
+            ASTIf * next = current->falseCase != nullptr ? current->falseCase->as<ASTIf>() : nullptr;
+            if (next == nullptr && current->falseCase != nullptr)
+                visitChild(current->falseCase);
+            current = next;
+        }
     }
 
     void TypeChecker::visit(ASTSwitch * ast) { 
@@ -422,6 +509,21 @@ namespace tinycplus {
         return ast->setType(types_.getTypeVoid());
     }
 
+    void TypeChecker::visit(ASTDelete * ast) {
+        auto * t = visitChild(ast->target);
+        auto * pointer = t->as<Type::Pointer>();
+        auto * classType = pointer != nullptr ? pointer->base()->as<Type::Class>() : nullptr;
+        if (classType == nullptr || classType == types_.defaultClassType) throw ParserError{
+            STR("TYPECHECK: delete expects a pointer to a class, but " << t->toString() << " found"),
+            ast->location()
+        };
+        deletes_.emplace_back(classType, ParserError{
+            STR("TYPECHECK: cannot delete " << classType->toString() << ", neither it nor a class derived from it is pooled"),
+            ast->location()
+        });
+        return ast->setType(types_.getTypeVoid());
+    }
+
     void TypeChecker::visit(ASTReturn * ast) {
         Type * type = nullptr;
         if (ast->value == nullptr)
@@ -557,8 +659,216 @@ namespace tinycplus {
     }
 
     void TypeChecker::visit(ASTMember * ast) {
-        auto * baseType = visitChild(ast->base);
-        auto position = push<Context::Member>({baseType->unwrap<Type::Complex>()});
+        // member chains (a->b->c) are checked from the innermost access in a loop, so that their length is not limited by the stack
+        std::vector<ASTMember *> chain{ast};
+        while (auto * inner = chain.back()->base->as<ASTMember>()) {
+            chain.push_back(inner);
+        }
+        // * a[i].field is the only allowed use of a soa array a, see visit(ASTIdentifier)
+        if (auto * index = chain.back()->base->as<ASTIndex>(); index != nullptr && chain.back()->member->as<ASTIdentifier>() != nullptr) {
+            structOfArraysAccess_ = index->base->as<ASTIdentifier>();
+        }
+        auto * baseType = visitChild(chain.back()->base);
+        structOfArraysAccess_ = nullptr;
+        for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+            checkMember(*it, baseType);
+            baseType = (*it)->getType();
+        }
+    }
+
+    void TypeChecker::checkStructOfArraysFields(ASTClassDecl * ast, Type::Class * type) {
+        std::vector<FieldInfo> fields;
+        type->collectFieldsOrdered(fields);
+        if (fields.empty()) throw ParserError{
+            STR("TYPECHECK: soa class " << ast->name.name() << " has no fields to split its arrays into"),
+            ast->location()
+        };
+        for (auto & it : fields) {
+            auto * varDecl = it.ast->as<ASTVarDecl>();
+            if ((varDecl != nullptr && varDecl->type->as<ASTArrayType>() != nullptr) || it.type->unwrap<Type::Interface>() != nullptr) throw ParserError{
+                STR("TYPECHECK: soa class " << ast->name.name() << " cannot have array or interface field " << it.name.name()),
+                it.ast->location()
+            };
+        }
+    }
+
+    void TypeChecker::checkStructOfArraysDispatch(ASTClassDecl * ast, Type::Class * type) {
+        // elements of soa arrays have no vtable pointer and no address to be viewed through
+        std::vector<FieldInfo> slots;
+        type->getVirtualTable()->collectFieldsOrdered(slots);
+        if (!slots.empty() || !type->interfaces.empty()) throw ParserError{
+            STR("TYPECHECK: soa class " << ast->name.name() << " cannot have virtual methods or implement interfaces"),
+            ast->location()
+        };
+    }
+
+    void TypeChecker::enterGenericFunction(ASTFunDecl * ast) {
+        if (ast->name.value() == symbols::Entry) throw ParserError{
+            STR("TYPECHECK: " << symbols::Entry.name() << " cannot be generic"),
+            ast->location()
+        };
+        // * instances are named after the function, a second generic function of the name would share them
+        checkNewFunctionName(ast);
+        for (auto & it : ast->typeParameters) {
+            if (auto * type = types_.getType(it.name); type != nullptr && type->as<Type::Parameter>() != nullptr) throw ParserError{
+                STR("TYPECHECK: type parameter " << it.name.name() << " of " << ast->name.value().name() << " declared twice"),
+                ast->location()
+            };
+            Type::Interface * bound = nullptr;
+            if (it.bound.has_value()) {
+                auto * type = types_.getType(it.bound.value());
+                bound = type != nullptr ? type->as<Type::Interface>() : nullptr;
+                if (bound == nullptr) throw ParserError{
+                    STR("TYPECHECK: bound " << it.bound.value().name() << " of type parameter " << it.name.name() << " is not an interface"),
+                    ast->location()
+                };
+            }
+            types_.addTypeParameter(ast, it.name, bound);
+        }
+        currentGeneric_ = ast;
+    }
+
+    void TypeChecker::leaveGenericFunction() {
+        types_.clearTypeParameters();
+        currentGeneric_ = nullptr;
+    }
+
+    void TypeChecker::checkNewFunctionName(ASTFunDecl * ast) {
+        if (names_.getVariable(ast->name.value()) != nullptr) throw ParserError{
+            STR("TYPECHECK: name " << ast->name.value().name() << " already used"),
+            ast->location()
+        };
+    }
+
+    void TypeChecker::enterConstexprFunction(ASTFunDecl * ast, Type::Function * type) {
+        bool isPOD = types_.isPOD(type->returnType());
+        for (size_t i = 0; i < type->numArgs(); ++i) {
+            isPOD = isPOD && types_.isPOD(type->argType(i));
+        }
+        if (!isPOD) throw ParserError{
+            STR("TYPECHECK: constexpr function " << ast->name.value().name() << " can only take and return int, char or double"),
+            ast->location()
+        };
+        constexprFunctions_.insert({ast->name.value(), ast});
+        currentConstexpr_ = ast;
+    }
+
+    void TypeChecker::checkGenericCall(ASTCall * ast, ASTFunDecl * generic) {
+        auto * f = generic->getType()->as<Type::Function>();
+        if (ast->args.size() != f->numArgs()) throw ParserError {
+            STR("TYPECHECK: function of type " << f->toString() << " requires "
+                << f->numArgs()
+                << " arguments, but " << ast->args.size() << " given"),
+            ast->location()
+        };
+        std::vector<Type*> typeArguments(generic->typeParameters.size(), nullptr);
+        for (size_t i = 0; i < ast->args.size(); ++i) {
+            auto * argType = visitChild(ast->args[i]);
+            // * T is inferred from C, T* from C*, everything else must match exactly
+            auto * expected = f->argType(i);
+            auto * actual = argType;
+            while (true) {
+                if (auto * parameter = expected->as<Type::Parameter>()) {
+                    auto & typeArgument = typeArguments[parameter->index()];
+                    if (typeArgument == nullptr) {
+                        checkTypeArgument(generic, parameter, actual, ast->args[i].get());
+                        typeArgument = actual;
+                    } else if (typeArgument != actual) throw ParserError{
+                        STR("TYPECHECK: type parameter " << generic->typeParameters[parameter->index()].name.name() << " of " << generic->name.value().name()
+                            << " inferred as " << typeArgument->toString() << ", but " << actual->toString() << " found for argument " << (i + 1)),
+                        ast->args[i]->location()
+                    };
+                    break;
+                }
+                auto * expectedPointer = expected->as<Type::Pointer>();
+                auto * actualPointer = actual->as<Type::Pointer>();
+                if (expectedPointer != nullptr && actualPointer != nullptr && !TypesContext::IsConcrete(expected)) {
+                    expected = expectedPointer->base();
+                    actual = actualPointer->base();
+                    continue;
+                }
+                if (expected != actual) throw ParserError{
+                    STR("TYPECHECK: type " << f->argType(i)->toString() << " expected for argument " << (i + 1)
+                        << ", but " << argType->toString() << " found"),
+                    ast->args[i]->location()
+                };
+                break;
+            }
+        }
+        bool isConcrete = true;
+        for (size_t i = 0; i < typeArguments.size(); ++i) {
+            if (typeArguments[i] == nullptr) throw ParserError{
+                STR("TYPECHECK: type parameter " << generic->typeParameters[i].name.name() << " of " << generic->name.value().name() << " cannot be inferred from the arguments"),
+                ast->location()
+            };
+            isConcrete = isConcrete && TypesContext::IsConcrete(typeArguments[i]);
+        }
+        ast->generic = generic;
+        ast->typeArguments = typeArguments;
+        // * calls in generic bodies depend on the instance they are in, see instantiateGenericCalls()
+        if (isConcrete) types_.getOrCreateGenericInstance(generic, typeArguments, currentDeclaration_, 0);
+        else genericCalls_[currentGeneric_].push_back(ast);
+        return ast->setType(types_.substitute(f->returnType(), typeArguments));
+    }
+
+    void TypeChecker::checkTypeArgument(ASTFunDecl * generic, Type::Parameter * parameter, Type * type, AST * ast) {
+        auto & name = generic->typeParameters[parameter->index()].name;
+        if (type->as<Type::Interface>() != nullptr || type->as<Type::Function>() != nullptr || type == types_.defaultClassType) throw ParserError{
+            STR("TYPECHECK: " << type->toString() << " cannot be the type argument of " << name.name() << " of " << generic->name.value().name()),
+            ast->location()
+        };
+        auto * bound = parameter->bound();
+        if (bound == nullptr) return;
+        if (auto * typeParameter = type->as<Type::Parameter>()) {
+            if (typeParameter->bound() != bound) throw ParserError{
+                STR("TYPECHECK: type parameter " << typeParameter->toString() << " does not guarantee interface " << bound->toString()
+                    << " required by " << name.name() << " of " << generic->name.value().name()),
+                ast->location()
+            };
+            return;
+        }
+        auto * classType = type->as<Type::Class>();
+        bool implements = false;
+        if (classType != nullptr) {
+            auto implemented = classType->interfaces.find(bound->name);
+            implements = implemented != classType->interfaces.end() && implemented->second == bound;
+        }
+        if (!implements) throw ParserError{
+            STR("TYPECHECK: " << type->toString() << " does not implement interface " << bound->toString()
+                << " required by " << name.name() << " of " << generic->name.value().name()),
+            ast->location()
+        };
+    }
+
+    void TypeChecker::instantiateGenericCalls() {
+        // * the list of instances grows while it is walked, until no instance uses a new one
+        auto & instances = types_.genericInstances();
+        for (size_t i = 0; i < instances.size(); ++i) {
+            auto * instance = instances[i].get();
+            auto calls = genericCalls_.find(instance->function);
+            if (calls == genericCalls_.end()) continue;
+            for (auto * call : calls->second) {
+                std::vector<Type*> typeArguments;
+                for (auto * it : call->typeArguments) {
+                    typeArguments.push_back(types_.substitute(it, instance->typeArguments));
+                }
+                if (instance->depth >= MaxGenericInstanceDepth && types_.findGenericInstance(call->generic, typeArguments) == nullptr) throw ParserError{
+                    STR("TYPECHECK: instances of " << call->generic->name.value().name() << " keep instantiating one another with new type arguments"),
+                    call->location()
+                };
+                types_.getOrCreateGenericInstance(call->generic, typeArguments, nullptr, instance->depth + 1);
+            }
+        }
+    }
+
+    void TypeChecker::checkMember(ASTMember * ast, Type * baseType) {
+        // * members of type parameters are the methods of their bound, dispatched statically in each instance
+        auto * parameter = baseType->unwrap<Type::Parameter>();
+        if (parameter != nullptr && (parameter->bound() == nullptr || ast->member->as<ASTCall>() == nullptr)) throw ParserError{
+            STR("TYPECHECK: values of type parameter " << parameter->toString() << " have no members but the methods of its bound"),
+            ast->location()
+        };
+        auto position = push<Context::Member>({parameter != nullptr ? parameter->bound() : baseType->unwrap<Type::Complex>()});
         auto memberType = visitChild(ast->member);
         if (memberType == nullptr) {
             throw ParserError{
@@ -579,7 +889,7 @@ namespace tinycplus {
         if (auto * memberAsIdent = ast->member->as<ASTIdentifier>()) {
             auto memberName = memberAsIdent->name;
             if (auto * classType = baseType->unwrap<Type::Class>()) {
-                if (auto baseAsIdent = ast->base->as<ASTIdentifier>(); baseAsIdent->name == symbols::KwBase && classType->getBase()->hasMethod(memberName, false)) {
+                if (auto baseAsIdent = ast->base->as<ASTIdentifier>(); baseAsIdent != nullptr && baseAsIdent->name == symbols::KwBase && classType->getBase()->hasMethod(memberName, false)) {
                     auto methodInfo = classType->getBase()->getMethodInfo(memberName);
                     if (methodInfo->ast->isAbstract()) throw ParserError {
                         STR("TYPECHECK: base cannot call its abstract method: " << memberName),
@@ -610,6 +920,18 @@ namespace tinycplus {
         wipeContext(position);
     }
 
+    void TypeChecker::visit(ASTNew * ast) {
+        auto * namedType = ast->constructor->function->as<ASTNamedType>();
+        auto * type = namedType != nullptr ? types_.getType(namedType->name) : nullptr;
+        auto * classType = type != nullptr ? type->as<Type::Class>() : nullptr;
+        if (classType == nullptr || !classType->isPooled()) throw ParserError{
+            STR("TYPECHECK: new expects a constructor of a pooled class"),
+            ast->location()
+        };
+        visitChild(ast->constructor);
+        return ast->setType(types_.getOrCreatePointerType(classType));
+    }
+
     void TypeChecker::visit(ASTCall * ast) {
         // std::cout << "DEBUG: typechicking call " << std::endl;
         int methodOffset = 0;
@@ -693,7 +1015,17 @@ namespace tinycplus {
                 return ast->setType(classType);
             }
 
+            genericCallee_ = ast->function.get();
             visitChild(ast->function);
+            genericCallee_ = nullptr;
+            if (auto generic = genericFunctions_.find(ast->function->getType()); generic != genericFunctions_.end()) {
+                return checkGenericCall(ast, generic->second);
+            }
+            if (auto * ident = ast->function->as<ASTIdentifier>(); ident != nullptr && names_.isGlobalVariable(ident->name)) {
+                if (auto constexprFunction = constexprFunctions_.find(ident->name); constexprFunction != constexprFunctions_.end()) {
+                    ast->constexprFunction = constexprFunction->second;
+                }
+            }
         }
 
         Type::Function const * f = asFunctionType(ast->function->getType());
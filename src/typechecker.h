@@ -8,6 +8,7 @@
 #include "ast.h"
 #include "types.h"
 #include "contexts.h"
+#include "tracing.h"
 
 namespace tinycplus {
 
@@ -19,6 +20,16 @@ namespace tinycplus {
         Type::Class * currentClassType = nullptr;
         std::unordered_map<Symbol, AST*> undefinedMethodCalls;
         bool isProcessingPointerType = false;
+        ASTIdentifier * structOfArraysAccess_ = nullptr; // the only place a soa array may be used: the array of a[i].field being checked
+        std::vector<std::pair<Type::Class *, ParserError>> deletes_; // deleted classes with their errors, checked once all classes are known, see finishProgram
+        std::unordered_map<Type*, ASTFunDecl*> genericFunctions_; // function type -> generic function of the type
+        std::unordered_map<ASTFunDecl*, std::vector<ASTCall*>> genericCalls_; // generic function -> its calls of generic functions depending on its type parameters
+        ASTFunDecl * currentGeneric_ = nullptr;
+        AST * currentDeclaration_ = nullptr; // top level declaration being checked
+        AST * genericCallee_ = nullptr; // the only place a generic function may be used: the function of the call being checked
+        std::unordered_map<Symbol, ASTFunDecl*> constexprFunctions_;
+        ASTFunDecl * currentConstexpr_ = nullptr;
+        TraceRecorder * trace_ = nullptr;
 
     private: // transpiler case configurations
         struct Context {
@@ -58,9 +69,24 @@ namespace tinycplus {
             contextStack_.erase(contextStack_.begin() + position, contextStack_.end());
         }
 
+        /** Instances using one another with ever new type arguments, f<T> calling f<T*>, would never end.
+         */
+        static constexpr size_t MaxGenericInstanceDepth = 64;
+
     public: // constructor
         TypeChecker(TypesContext & types, NamesContext & names);
 
+        void setTrace(TraceRecorder * trace) {
+            trace_ = trace;
+        }
+
+        /** visit(ASTProgram) in pieces, so that declarations can be checked as soon as they are parsed (--pipeline).
+            Declarations must be checked in the order of the program, finishProgram checks what depends on all of them.
+         */
+        void beginProgram(ASTProgram * ast);
+        void checkDeclaration(AST * declaration);
+        void finishProgram(ASTProgram * ast);
+
     public: // helper methods
         Type * getArithmeticResult(Type * lhs, Type * rhs) const;
 
@@ -143,6 +169,7 @@ namespace tinycplus {
         void visit(ASTBreak * ast) override;
         void visit(ASTContinue * ast) override;
         void visit(ASTReturn * ast) override;
+        void visit(ASTDelete * ast) override;
         void visit(ASTBinaryOp * ast) override;
         void visit(ASTAssignment * ast) override;
         void visit(ASTUnaryOp * ast) override;
@@ -152,6 +179,7 @@ namespace tinycplus {
         void visit(ASTIndex * ast) override;
         void visit(ASTMember * ast) override;
         void visit(ASTCall * ast) override;
+        void visit(ASTNew * ast) override;
         void visit(ASTCast * ast) override;
 
     protected: // shortcuts
@@ -165,7 +193,47 @@ namespace tinycplus {
             return visitChild(ptr.get());
         }
 
+        /** Checks a single member access whose base is already checked.
+         */
+        void checkMember(ASTMember * ast, Type * baseType);
+
+        /** Fields of a soa class become arrays of their own, they can be neither arrays nor interface views.
+         */
+        void checkStructOfArraysFields(ASTClassDecl * ast, Type::Class * type);
+
+        /** A soa class has no virtual methods nor interfaces, its methods are declared already.
+         */
+        void checkStructOfArraysDispatch(ASTClassDecl * ast, Type::Class * type);
+
+        /** Brings the type parameters of the generic function into scope, its body is checked once for all of its instances.
+         */
+        void enterGenericFunction(ASTFunDecl * ast);
+
+        void leaveGenericFunction();
+
+        /** Generic and constexpr functions are defined where they are declared, so a function of the same name cannot exist yet.
+         */
+        void checkNewFunctionName(ASTFunDecl * ast);
+
+        /** Constexpr functions take and return int, char or double, see ConstantEvaluator.
+         */
+        void enterConstexprFunction(ASTFunDecl * ast, Type::Function * type);
+
+        /** Infers the type arguments of the call from its arguments and instantiates the function when they are concrete.
+         */
+        void checkGenericCall(ASTCall * ast, ASTFunDecl * generic);
+
+        /** The type argument of a bounded parameter implements the interface of its bound, or is a type parameter with the same bound.
+         */
+        void checkTypeArgument(ASTFunDecl * generic, Type::Parameter * parameter, Type * type, AST * ast);
+
+        /** Instances used by the bodies of other instances, see genericCalls_.
+         */
+        void instantiateGenericCalls();
+
         void processFunction(ASTFunDecl * ast) {
+            if (ast->isGeneric()) enterGenericFunction(ast);
+            if (ast->isConstexpr) checkNewFunctionName(ast);
             // creates function type from ast
             std::unique_ptr<Type::Function> ftype{new Type::Function{visitChild(ast->typeDecl)}};
             checkTypeCompletion(ftype->returnType(), ast->typeDecl);
@@ -188,6 +256,8 @@ namespace tinycplus {
                 // do nothing
             }
             ast->setType(t);
+            if (ast->isGeneric()) genericFunctions_.insert({t, ast});
+            if (ast->isConstexpr) enterConstexprFunction(ast, t);
             // enters the context and add all arguments as local variables
             if (ast->body) {
                 names_.enterFunctionScope(t->returnType());
@@ -202,6 +272,8 @@ namespace tinycplus {
                 // leaves the function context
                 names_.leaveCurrentScope();
             }
+            if (ast->isGeneric()) leaveGenericFunction();
+            currentConstexpr_ = nullptr;
         }
 
         void processConstructor(ASTFunDecl * ast) {
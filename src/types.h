@@ -24,6 +24,7 @@ namespace tinycplus {
         class Interface;
         class Class;
         class VTable;
+        class Parameter;
     public:
         virtual ~Type() = default;
     public:
@@ -179,6 +180,39 @@ namespace tinycplus {
 
 
 
+    /** Type parameter of a generic function, replaced by a type argument in each instance of the function, see GenericInstance.
+        Types are told apart by their names, hence the name is qualified by the function: "<function>.<parameter>".
+     */
+    class Type::Parameter : public Type {
+    private:
+        Symbol name_;
+        size_t index_;
+        Type::Interface * bound_;
+    public:
+        Parameter(Symbol name, size_t index, Type::Interface * bound):
+            name_{name},
+            index_{index},
+            bound_{bound} {
+        }
+        /** Position among the type parameters of the function, and of the type arguments of its instances.
+         */
+        size_t index() const {
+            return index_;
+        }
+        /** Interface the type arguments implement, nullptr when any type can be the argument.
+         */
+        Type::Interface * bound() const {
+            return bound_;
+        }
+    private:
+        void toStream(std::ostream & s) const override {
+            s << name_.name();
+        }
+    }; // tinycplus::Type::Parameter
+
+
+
+
     class FieldInfo {
     public:
         Symbol name;
@@ -351,16 +385,15 @@ namespace tinycplus {
     private:
         int id_;
     public:
-        Interface(Symbol name, Type::VTable * vtable)
+        /** The id must be unique among interfaces of one program, see TypesContext.
+         */
+        Interface(Symbol name, Type::VTable * vtable, int id)
             :name{name}
             ,vtable{vtable}
             ,implStructName{symbols::makeImplStructName(name)}
             ,castName{symbols::start().add(symbols::InterfaceCastFuncPerfix).add(name).end()}
-        {
-            static int id = 0;
-            id_ = id;
-            id++;
-        }
+            ,id_{id}
+        { }
     public:
         int getId() const { return id_; }
         void addMethod(Symbol name, Type::Function * type, Type::Alias * ptrType) {
@@ -390,6 +423,7 @@ namespace tinycplus {
         struct ConstructorInfo {
             Symbol makeName;
             Symbol initName;
+            Symbol newName;
             AccessMod access;
         };
     public:
@@ -408,29 +442,32 @@ namespace tinycplus {
         std::unordered_map<Symbol, MethodInfo> functions_;
         bool isAbstract_ = false;
         int defaultConstructorSetCount = 0;
+        std::vector<Symbol> layoutOrder_; // own fields in the instance struct, empty when declared order is kept
+        bool isStructOfArrays_ = false;
+        bool isPooled_ = false;
     public:
-        Class(Symbol name, Type::VTable * vtable)
+        /** The id must be unique among classes of one program, see TypesContext.
+         */
+        Class(Symbol name, Type::VTable * vtable, int id)
             :name{name}
             ,vtable_{vtable}
             ,setupName{symbols::start().add(symbols::ClassSetupFunctionPrefix).add(name).end()}
             ,classCastName{symbols::start().add(symbols::ClassCastToClassPrefix).add(name).end()}
             ,getImplName{symbols::start().add(symbols::ClassGetImplPrefix).add(name).end()}
-        {
-            static int id = 0;
-            id_ = id;
-            id++;
-        }
+            ,id_{id}
+        { }
     public:
         void addConstructorFunction(Type::Function * funcType, AccessMod accessMod) {
             auto makeName = symbols::start().add(symbols::ClassMakeConstructorPrefix).add(STR(constructorId_)).add("_").add(name).end();
             auto initName = symbols::start().add(symbols::ClassInitConstructorPrefix).add(STR(constructorId_)).add("_").add(name).end();
+            auto newName = symbols::start().add(symbols::ClassNewConstructorPrefix).add(STR(constructorId_)).add("_").add(name).end();
             constructorId_++;
             if (funcType->numArgs() == 0 && defaultConstructorSetCount < 2) {
                 defaultConstructorFuncType = funcType;
                 defaultConstructorSetCount++;
-                constructors.insert_or_assign(funcType, ConstructorInfo{makeName, initName, accessMod});
+                constructors.insert_or_assign(funcType, ConstructorInfo{makeName, initName, newName, accessMod});
             } else if (!hasConstructor(funcType)) {
-                constructors.insert({funcType, ConstructorInfo{makeName, initName, accessMod}});
+                constructors.insert({funcType, ConstructorInfo{makeName, initName, newName, accessMod}});
             } else {
                 throw std::runtime_error(STR("TYPES: Class (" << name.name() << ") already has constructor of type: " << funcType->toString()));
             }
@@ -459,6 +496,13 @@ namespace tinycplus {
             }
             return it->second.initName;
         }
+        Symbol getConstructorNewName(Type::Function * funcType) {
+            auto it = constructors.find(funcType);
+            if (it == constructors.end()) {
+                throw std::runtime_error(STR("TYPES: Class (" << name.name() << ") does not have constructor of type: " << funcType->toString()));
+            }
+            return it->second.newName;
+        }
         AccessMod getConstructorAccess(Type::Function * funcType) {
             auto it = constructors.find(funcType);
             if (it == constructors.end()) {
@@ -494,14 +538,11 @@ namespace tinycplus {
             return vtable_ != nullptr && (base_ == nullptr || base_->vtable_ != vtable_);
         }
         bool hasMethod(Symbol name, bool includeBaseInSearch) const {
-            for (auto & method : functions_) {
-                if (method.first == name) {
+            for (auto * it = this; it != nullptr; it = includeBaseInSearch ? it->base_ : nullptr) {
+                if (it->functions_.find(name) != it->functions_.end()) {
                     return true;
                 }
             }
-            if (includeBaseInSearch && base_ != nullptr) {
-                return base_->hasMethod(name, true);
-            }
             return false;
         }
         bool isInterfaceMethod(Symbol name) {
@@ -513,32 +554,26 @@ namespace tinycplus {
             return false;
         }
         AccessMod getMemberAccessMod(Symbol name, Type::Class ** resultMemberClass) {
-            *resultMemberClass = this;
-            for (auto & method : functions_) {
-                if (method.first == name) {
-                    return method.second.ast->access;
+            for (auto * it = this; it != nullptr; it = it->base_) {
+                *resultMemberClass = it;
+                if (auto method = it->functions_.find(name); method != it->functions_.end()) {
+                    return method->second.ast->access;
                 }
-            }
-            for (auto & field : fields_) {
-                if (auto * vardecl = field.second.ast->as<ASTVarDecl>(); vardecl != nullptr && field.first == name) {
-                    return vardecl->access;
+                if (auto field = it->fields_.find(name); field != it->fields_.end()) {
+                    if (auto * vardecl = field->second.ast->as<ASTVarDecl>()) {
+                        return vardecl->access;
+                    }
                 }
             }
-            if (base_ != nullptr) {
-                return base_->getMemberAccessMod(name, resultMemberClass);
-            }
             *resultMemberClass = nullptr;
             return AccessMod::None;
         }
         std::optional<MethodInfo> getMethodInfo(Symbol name, bool searchInBase = true) const {
-            for (auto & method : functions_) {
-                if (method.first == name) {
-                    return method.second;
+            for (auto * it = this; it != nullptr; it = searchInBase ? it->base_ : nullptr) {
+                if (auto method = it->functions_.find(name); method != it->functions_.end()) {
+                    return method->second;
                 }
             }
-            if (base_ != nullptr) {
-                return base_->getMethodInfo(name);
-            }
             return std::nullopt;
             // throw ParserError {
             //     STR("There is no method with name: " << name.name()),
@@ -599,10 +634,9 @@ namespace tinycplus {
         // }
 
         std::optional<FieldInfo> getFieldInfo(Symbol name) const override {
-            auto fieldInfo = Complex::getFieldInfo(name);
-            if (fieldInfo.has_value()) return fieldInfo.value();
-            if (base_ != nullptr) {
-                return base_->getFieldInfo(name);
+            for (auto * it = this; it != nullptr; it = it->base_) {
+                auto fieldInfo = it->Complex::getFieldInfo(name);
+                if (fieldInfo.has_value()) return fieldInfo.value();
             }
             return std::nullopt;
         }
@@ -620,20 +654,82 @@ namespace tinycplus {
             return nullptr;
         }
 
+        /** Fields of the root class come first. The hierarchy is walked without recursion, it can be arbitrarily deep.
+            Each class keeps its own fields in its layout order, so a base is always a prefix of the derived instance.
+         */
         void collectFieldsOrdered(std::vector<FieldInfo> & result) const override {
-            if (base_ != nullptr) {
-                base_->collectFieldsOrdered(result);
+            auto hierarchy = getHierarchy();
+            for (auto it = hierarchy.rbegin(); it != hierarchy.rend(); ++it) {
+                (*it)->collectOwnFieldsOrdered(result);
+            }
+        }
+
+        /** Same as collectFieldsOrdered, but ignores the layout orders.
+         */
+        void collectFieldsDeclared(std::vector<FieldInfo> & result) const {
+            auto hierarchy = getHierarchy();
+            for (auto it = hierarchy.rbegin(); it != hierarchy.rend(); ++it) {
+                (*it)->Type::Complex::collectFieldsOrdered(result);
             }
-            Type::Complex::collectFieldsOrdered(result);
+        }
+
+        void collectOwnFieldsOrdered(std::vector<FieldInfo> & result) const {
+            if (layoutOrder_.empty()) {
+                Type::Complex::collectFieldsOrdered(result);
+                return;
+            }
+            for (auto & name : layoutOrder_) {
+                result.push_back(fields_.at(name));
+            }
+        }
+
+        bool hasLayoutOrder() const {
+            return !layoutOrder_.empty();
+        }
+
+        /** Replaces the declared order of the own fields in the instance struct, see the compact class attribute.
+         */
+        void setLayoutOrder(std::vector<Symbol> order) {
+            assert(order.size() == fieldsOrder_.size() && "the layout order must list every own field");
+            layoutOrder_ = std::move(order);
+        }
+
+        /** Array variables of the class are lowered to one array per field, see the soa class attribute.
+         */
+        bool isStructOfArrays() const {
+            return isStructOfArrays_;
+        }
+
+        void setStructOfArrays() {
+            isStructOfArrays_ = true;
+        }
+
+        /** Instances can be allocated by new from the slab of the class, see the pooled class attribute.
+         */
+        bool isPooled() const {
+            return isPooled_;
+        }
+
+        void setPooled() {
+            isPooled_ = true;
         }
 
         void collectVirtualTables(std::vector<Type::VTable*> & result) const {
-            // ! Assuming that class hierarchy is always finite, then...
-            if (base_ != nullptr) {
-                assert(base_->vtable_ != nullptr && "oh no, vtable is assumed to be unique, therefor -> not null");
-                base_->collectVirtualTables(result);
+            auto hierarchy = getHierarchy();
+            for (auto it = hierarchy.rbegin(); it != hierarchy.rend(); ++it) {
+                assert((*it)->vtable_ != nullptr && "oh no, vtable is assumed to be unique, therefor -> not null");
+                result.push_back((*it)->vtable_);
+            }
+        }
+
+        /** The class followed by its bases up to the root of the hierarchy.
+         */
+        std::vector<Type::Class const *> getHierarchy() const {
+            std::vector<Type::Class const *> result;
+            for (auto * it = this; it != nullptr; it = it->base_) {
+                result.push_back(it);
             }
-            result.push_back(vtable_);
+            return result;
         }
     private:
         friend class TypeChecker;
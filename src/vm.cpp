@@ -0,0 +1,416 @@
+// standard
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+// internal
+#include "vm.h"
+
+namespace tinycplus {
+
+    namespace {
+        constexpr uint64_t TargetMask = (uint64_t{1} << 48) - 1;
+        // * written over the header of deleted instances, so that their use and a second delete trap
+        constexpr uint64_t DeletedHeader = ~uint64_t{0};
+
+        int64_t WrapInt(int64_t value) {
+            return static_cast<int32_t>(static_cast<uint32_t>(value));
+        }
+
+        template<typename T>
+        int64_t Read(uint8_t const * memory) {
+            T value;
+            std::memcpy(&value, memory, sizeof(T));
+            return static_cast<int64_t>(value);
+        }
+
+        template<typename T>
+        void Write(uint8_t * memory, int64_t value) {
+            T narrowed = static_cast<T>(value);
+            std::memcpy(memory, &narrowed, sizeof(T));
+        }
+    } // anonymous namespace
+
+    VirtualMachine::VirtualMachine(BytecodeProgram const & program)
+        :program_{program}
+    {
+        stackStart_ = (program.staticBytes + 7) / 8 * 8;
+        memory_.assign(stackStart_ + StackBytes, 0);
+        std::memcpy(memory_.data(), program.data.data(), program.data.size());
+        registers_.resize(MaxRegisters);
+        pools_.resize(program.classes.size());
+        for (size_t i = 0; i < program.classes.size(); ++i) {
+            if (program.classes[i].isPooled) pools_[i].isLive.assign(program.poolCapacity, false);
+        }
+    }
+
+    int64_t VirtualMachine::run() {
+        execute(program_.initializer);
+        return execute(program_.entry);
+    }
+
+    void VirtualMachine::trap(std::string const & message, uint32_t function, Instruction const * ip) const {
+        auto const & info = program_.functions[function];
+        AST * site = info.sites[ip - info.code.data()];
+        if (site == nullptr) throw std::runtime_error(STR("RUN: " << message));
+        throw ParserError{STR("RUN: " << message), site->location()};
+    }
+
+    /** The dispatch uses the computed goto when the compiler has it, every instruction then jumps to the next one through its own indirect branch, which predicts far better than the single one of a switch.
+     */
+    int64_t VirtualMachine::execute(uint32_t entry) {
+        uint8_t * const memory = memory_.data();
+        uint64_t const memorySize = memory_.size();
+        auto const & classes = program_.classes;
+        uint32_t function = entry;
+        Instruction const * code = program_.functions[function].code.data();
+        Instruction const * ip = code;
+        size_t base = 0;
+        Value * r = registers_.data();
+        uint64_t fp = stackStart_;
+        uint64_t sp = stackStart_ + program_.functions[function].frameBytes;
+        frames_.clear();
+
+        #define R(operand) r[ip->operand]
+        #define VM_TRAP(message) trap(message, function, ip)
+        #define VM_CHECK(address, bytes) \
+            if ((address) < BytecodeProgram::NullGuard || (address) > memorySize - (bytes)) VM_TRAP(STR("invalid memory access at address " << (address)))
+        // * class index of the instance, traps on null, deleted instances and addresses without one
+        #define VM_CLASS_OF(address, result) \
+            VM_CHECK(address, 8); \
+            uint64_t result = static_cast<uint64_t>(Read<int64_t>(memory + (address))); \
+            if (result >= classes.size()) VM_TRAP(STR("no live class instance at address " << (address)))
+        #define VM_HEADERS(address, list) \
+            for (auto & header : program_.headerLists[list]) { \
+                VM_CHECK((address) + header.offset, 8); \
+                Write<uint64_t>(memory + (address) + header.offset, header.classIndex); \
+            }
+
+        #if TINYCPLUS_HAS_COMPUTED_GOTO
+            #define VM_LABEL(name) &&L_##name,
+            static void * const labels[] = { TINYCPLUS_BYTECODE_OPCODES(VM_LABEL) };
+            #undef VM_LABEL
+            #define VM_CASE(name) L_##name:
+            #define VM_JUMP() goto *labels[static_cast<size_t>(ip->op)]
+            #define VM_DISPATCH() VM_JUMP();
+        #else
+            #define VM_CASE(name) case Opcode::name:
+            #define VM_JUMP() goto dispatch
+            #define VM_DISPATCH() dispatch: switch (ip->op)
+        #endif
+        #define VM_NEXT() do { ++ip; VM_JUMP(); } while (false)
+        #define VM_GOTO(target) do { ip = code + (target); VM_JUMP(); } while (false)
+        #define VM_ENTER(callee, argBase) do { \
+                uint32_t const vmCallee = (callee); \
+                auto const & vmFunction = program_.functions[vmCallee]; \
+                if (!vmFunction.isDefined()) VM_TRAP(STR("function " << vmFunction.name << " is not defined")); \
+                size_t const vmBase = base + (argBase); \
+                uint64_t const vmFp = (sp + 7) / 8 * 8; \
+                if (frames_.size() >= MaxCallDepth || vmBase + vmFunction.registers > MaxRegisters || vmFp + vmFunction.frameBytes > memorySize) { \
+                    VM_TRAP("stack overflow"); \
+                } \
+                frames_.push_back(Frame{function, ip, base, fp, sp}); \
+                function = vmCallee; \
+                base = vmBase; \
+                r = registers_.data() + base; \
+                fp = vmFp; \
+                sp = vmFp + vmFunction.frameBytes; \
+                code = vmFunction.code.data(); \
+                ip = code; \
+                VM_JUMP(); \
+            } while (false)
+        // * the frame of the caller is restored and the call instruction gives the register of the result
+        #define VM_LEAVE(result) do { \
+                Value const vmResult = (result); \
+                if (frames_.empty()) return vmResult.i; \
+                Frame const & vmCaller = frames_.back(); \
+                function = vmCaller.function; \
+                ip = vmCaller.ip; \
+                base = vmCaller.registers; \
+                fp = vmCaller.fp; \
+                sp = vmCaller.sp; \
+                frames_.pop_back(); \
+                code = program_.functions[function].code.data(); \
+                r = registers_.data() + base; \
+                R(a) = vmResult; \
+                VM_NEXT(); \
+            } while (false)
+
+        VM_DISPATCH() {
+            VM_CASE(LoadInt) R(a).i = ip->b; VM_NEXT();
+            VM_CASE(LoadConst) R(a) = program_.constants[ip->b]; VM_NEXT();
+            VM_CASE(Move) R(a) = R(b); VM_NEXT();
+
+            VM_CASE(AddI) R(a).i = WrapInt(R(b).i + R(c).i); VM_NEXT();
+            VM_CASE(SubI) R(a).i = WrapInt(R(b).i - R(c).i); VM_NEXT();
+            VM_CASE(MulI) R(a).i = WrapInt(R(b).i * R(c).i); VM_NEXT();
+            VM_CASE(DivI) {
+                if (R(c).i == 0) VM_TRAP("division by zero");
+                R(a).i = WrapInt(R(b).i / R(c).i);
+                VM_NEXT();
+            }
+            VM_CASE(ModI) {
+                if (R(c).i == 0) VM_TRAP("division by zero");
+                R(a).i = WrapInt(R(b).i % R(c).i);
+                VM_NEXT();
+            }
+            VM_CASE(ShlI) R(a).i = static_cast<int32_t>(static_cast<uint32_t>(R(b).i) << (R(c).i & 31)); VM_NEXT();
+            VM_CASE(ShrI) R(a).i = static_cast<int32_t>(R(b).i) >> (R(c).i & 31); VM_NEXT();
+            VM_CASE(BitAndI) R(a).i = R(b).i & R(c).i; VM_NEXT();
+            VM_CASE(BitOrI) R(a).i = R(b).i | R(c).i; VM_NEXT();
+            VM_CASE(BitXorI) R(a).i = R(b).i ^ R(c).i; VM_NEXT();
+            VM_CASE(AddIImm) R(a).i = WrapInt(R(b).i + ip->c); VM_NEXT();
+            VM_CASE(NegI) R(a).i = WrapInt(-R(b).i); VM_NEXT();
+            VM_CASE(BitNotI) R(a).i = ~R(b).i; VM_NEXT();
+
+            VM_CASE(AddL) R(a).i = R(b).i + R(c).i; VM_NEXT();
+            VM_CASE(SubL) R(a).i = R(b).i - R(c).i; VM_NEXT();
+            VM_CASE(MulLImm) R(a).i = R(b).i * ip->c; VM_NEXT();
+            VM_CASE(AddLImm) R(a).i = R(b).i + ip->c; VM_NEXT();
+
+            VM_CASE(AddD) R(a).d = R(b).d + R(c).d; VM_NEXT();
+            VM_CASE(SubD) R(a).d = R(b).d - R(c).d; VM_NEXT();
+            VM_CASE(MulD) R(a).d = R(b).d * R(c).d; VM_NEXT();
+            VM_CASE(DivD) R(a).d = R(b).d / R(c).d; VM_NEXT();
+            VM_CASE(NegD) R(a).d = -R(b).d; VM_NEXT();
+
+            VM_CASE(EqI) R(a).i = R(b).i == R(c).i; VM_NEXT();
+            VM_CASE(NeI) R(a).i = R(b).i != R(c).i; VM_NEXT();
+            VM_CASE(LtI) R(a).i = R(b).i < R(c).i; VM_NEXT();
+            VM_CASE(LeI) R(a).i = R(b).i <= R(c).i; VM_NEXT();
+            VM_CASE(GtI) R(a).i = R(b).i > R(c).i; VM_NEXT();
+            VM_CASE(GeI) R(a).i = R(b).i >= R(c).i; VM_NEXT();
+            VM_CASE(EqD) R(a).i = R(b).d == R(c).d; VM_NEXT();
+            VM_CASE(NeD) R(a).i = R(b).d != R(c).d; VM_NEXT();
+            VM_CASE(LtD) R(a).i = R(b).d < R(c).d; VM_NEXT();
+            VM_CASE(LeD) R(a).i = R(b).d <= R(c).d; VM_NEXT();
+            VM_CASE(GtD) R(a).i = R(b).d > R(c).d; VM_NEXT();
+            VM_CASE(GeD) R(a).i = R(b).d >= R(c).d; VM_NEXT();
+
+            VM_CASE(NotI) R(a).i = R(b).i == 0; VM_NEXT();
+            VM_CASE(NotD) R(a).i = R(b).d == 0.0; VM_NEXT();
+            VM_CASE(TestI) R(a).i = R(b).i != 0; VM_NEXT();
+            VM_CASE(TestD) R(a).i = R(b).d != 0.0; VM_NEXT();
+            VM_CASE(IntToDouble) R(a).d = static_cast<double>(R(b).i); VM_NEXT();
+            VM_CASE(DoubleToInt) {
+                double value = R(b).d;
+                // * negated, so that NaN traps too
+                if (!(value > -2147483649.0 && value < 2147483648.0)) VM_TRAP(STR("double " << value << " is out of the range of int"));
+                R(a).i = static_cast<int32_t>(value);
+                VM_NEXT();
+            }
+            VM_CASE(TruncChar) R(a).i = static_cast<signed char>(R(b).i); VM_NEXT();
+            VM_CASE(TruncInt) R(a).i = WrapInt(R(b).i); VM_NEXT();
+            VM_CASE(ViewTarget) R(a).i = static_cast<int64_t>(static_cast<uint64_t>(R(b).i) & TargetMask); VM_NEXT();
+
+            VM_CASE(Load8) {
+                uint64_t address = R(b).i + ip->c;
+                VM_CHECK(address, 1);
+                R(a).i = Read<signed char>(memory + address);
+                VM_NEXT();
+            }
+            VM_CASE(Load32) {
+                uint64_t address = R(b).i + ip->c;
+                VM_CHECK(address, 4);
+                R(a).i = Read<int32_t>(memory + address);
+                VM_NEXT();
+            }
+            VM_CASE(Load64) {
+                uint64_t address = R(b).i + ip->c;
+                VM_CHECK(address, 8);
+                R(a).i = Read<int64_t>(memory + address);
+                VM_NEXT();
+            }
+            VM_CASE(Store8) {
+                uint64_t address = R(b).i + ip->c;
+                VM_CHECK(address, 1);
+                Write<signed char>(memory + address, R(a).i);
+                VM_NEXT();
+            }
+            VM_CASE(Store32) {
+                uint64_t address = R(b).i + ip->c;
+                VM_CHECK(address, 4);
+                Write<int32_t>(memory + address, R(a).i);
+                VM_NEXT();
+            }
+            VM_CASE(Store64) {
+                uint64_t address = R(b).i + ip->c;
+                VM_CHECK(address, 8);
+                Write<int64_t>(memory + address, R(a).i);
+                VM_NEXT();
+            }
+            // * frames and globals are laid out by the compiler, their accesses are always in range
+            VM_CASE(LoadFrame8) R(a).i = Read<signed char>(memory + fp + ip->b); VM_NEXT();
+            VM_CASE(LoadFrame32) R(a).i = Read<int32_t>(memory + fp + ip->b); VM_NEXT();
+            VM_CASE(LoadFrame64) R(a).i = Read<int64_t>(memory + fp + ip->b); VM_NEXT();
+            VM_CASE(StoreFrame8) Write<signed char>(memory + fp + ip->b, R(a).i); VM_NEXT();
+            VM_CASE(StoreFrame32) Write<int32_t>(memory + fp + ip->b, R(a).i); VM_NEXT();
+            VM_CASE(StoreFrame64) Write<int64_t>(memory + fp + ip->b, R(a).i); VM_NEXT();
+            VM_CASE(LoadGlobal8) R(a).i = Read<signed char>(memory + ip->b); VM_NEXT();
+            VM_CASE(LoadGlobal32) R(a).i = Read<int32_t>(memory + ip->b); VM_NEXT();
+            VM_CASE(LoadGlobal64) R(a).i = Read<int64_t>(memory + ip->b); VM_NEXT();
+            VM_CASE(StoreGlobal8) Write<signed char>(memory + ip->b, R(a).i); VM_NEXT();
+            VM_CASE(StoreGlobal32) Write<int32_t>(memory + ip->b, R(a).i); VM_NEXT();
+            VM_CASE(StoreGlobal64) Write<int64_t>(memory + ip->b, R(a).i); VM_NEXT();
+
+            VM_CASE(FrameAddr) R(a).i = static_cast<int64_t>(fp + ip->b); VM_NEXT();
+            VM_CASE(Copy) {
+                uint64_t target = R(a).i;
+                uint64_t source = R(b).i;
+                uint64_t bytes = static_cast<uint32_t>(ip->c);
+                VM_CHECK(target, bytes);
+                VM_CHECK(source, bytes);
+                std::memmove(memory + target, memory + source, bytes);
+                VM_NEXT();
+            }
+            VM_CASE(Zero) {
+                uint64_t address = R(a).i;
+                uint64_t bytes = static_cast<uint32_t>(ip->b);
+                VM_CHECK(address, bytes);
+                std::memset(memory + address, 0, bytes);
+                VM_NEXT();
+            }
+            VM_CASE(InitHeaders) {
+                uint64_t address = R(a).i;
+                VM_HEADERS(address, ip->b);
+                VM_NEXT();
+            }
+
+            VM_CASE(Jump) VM_GOTO(ip->a);
+            VM_CASE(JumpIfZero) if (R(a).i == 0) VM_GOTO(ip->b); VM_NEXT();
+            VM_CASE(JumpIfNotZero) if (R(a).i != 0) VM_GOTO(ip->b); VM_NEXT();
+            VM_CASE(JumpIfEq) if (R(a).i == R(b).i) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfNe) if (R(a).i != R(b).i) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfLt) if (R(a).i < R(b).i) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfLe) if (R(a).i <= R(b).i) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfGt) if (R(a).i > R(b).i) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfGe) if (R(a).i >= R(b).i) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfEqImm) if (R(a).i == ip->b) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfNeImm) if (R(a).i != ip->b) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfLtImm) if (R(a).i < ip->b) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfLeImm) if (R(a).i <= ip->b) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfGtImm) if (R(a).i > ip->b) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(JumpIfGeImm) if (R(a).i >= ip->b) VM_GOTO(ip->c); VM_NEXT();
+            VM_CASE(Switch) {
+                auto const & table = program_.switches[ip->b];
+                int64_t value = R(a).i;
+                int32_t target = table.defaultTarget;
+                if (table.isDense) {
+                    uint64_t index = static_cast<uint64_t>(value - table.low);
+                    if (index < table.targets.size() && table.targets[index] >= 0) target = table.targets[index];
+                } else {
+                    auto it = std::lower_bound(table.cases.begin(), table.cases.end(), std::make_pair(value, std::numeric_limits<int32_t>::min()));
+                    if (it != table.cases.end() && it->first == value) target = it->second;
+                }
+                VM_GOTO(target);
+            }
+
+            VM_CASE(Call) VM_ENTER(static_cast<uint32_t>(ip->b), ip->c);
+            VM_CASE(CallIndirect) {
+                int64_t value = R(b).i;
+                if (value < 1 || value > static_cast<int64_t>(program_.functions.size())) VM_TRAP(STR("call of invalid function value " << value));
+                VM_ENTER(static_cast<uint32_t>(value - 1), ip->c);
+            }
+            VM_CASE(CallVirtual) {
+                uint64_t receiver = r[ip->c].i;
+                if (receiver == 0) VM_TRAP("method called on null");
+                VM_CLASS_OF(receiver, classIndex);
+                int32_t callee = program_.vtableSlots[classes[classIndex].vtable + ip->b];
+                if (callee < 0) VM_TRAP(STR("abstract method called on an instance of " << classes[classIndex].name));
+                VM_ENTER(static_cast<uint32_t>(callee), ip->c);
+            }
+            VM_CASE(CallInterface) {
+                uint64_t view = r[ip->c].i;
+                uint64_t impl = view >> 48;
+                if (impl == 0) VM_TRAP("method called on null");
+                int32_t callee = program_.implSlots[program_.implOffsets[impl] + ip->b];
+                if (callee < 0) VM_TRAP("abstract method called through an interface");
+                r[ip->c].i = static_cast<int64_t>(view & TargetMask);
+                VM_ENTER(static_cast<uint32_t>(callee), ip->c);
+            }
+            VM_CASE(Return) VM_LEAVE(R(a));
+            VM_CASE(ReturnVoid) VM_LEAVE(Value{0});
+            VM_CASE(MissingReturn) VM_TRAP(STR("function " << program_.functions[function].name << " ended without returning a value"));
+
+            VM_CASE(CastToClass) {
+                uint64_t address = R(b).i;
+                int64_t result = 0;
+                if (address != 0) {
+                    VM_CLASS_OF(address, classIndex);
+                    auto const & from = classes[classIndex];
+                    uint32_t depth = classes[ip->c].depth;
+                    if (from.depth >= depth && program_.ancestors[from.ancestors + depth] == static_cast<uint32_t>(ip->c)) result = static_cast<int64_t>(address);
+                }
+                R(a).i = result;
+                VM_NEXT();
+            }
+            VM_CASE(CastToInterface) {
+                uint64_t address = R(b).i;
+                int64_t result = 0;
+                if (address != 0) {
+                    VM_CLASS_OF(address, classIndex);
+                    uint64_t impl = program_.implTable[classIndex * program_.interfacesCount + ip->c];
+                    if (impl != 0) result = static_cast<int64_t>(address | impl << 48);
+                }
+                R(a).i = result;
+                VM_NEXT();
+            }
+            VM_CASE(New) {
+                auto const & info = classes[ip->b];
+                Pool & pool = pools_[ip->b];
+                int64_t result = 0;
+                uint32_t slot = 0;
+                bool isAllocated = true;
+                if (!pool.free.empty()) {
+                    slot = pool.free.back();
+                    pool.free.pop_back();
+                } else if (pool.used < program_.poolCapacity) {
+                    slot = pool.used++;
+                } else {
+                    isAllocated = false;
+                }
+                if (isAllocated) {
+                    uint64_t address = info.arena + static_cast<uint64_t>(slot) * info.size;
+                    pool.isLive[slot] = true;
+                    std::memset(memory + address, 0, info.size);
+                    VM_HEADERS(address, info.headers);
+                    result = static_cast<int64_t>(address);
+                }
+                R(a).i = result;
+                VM_NEXT();
+            }
+            VM_CASE(Delete) {
+                uint64_t address = R(a).i;
+                if (address != 0) {
+                    VM_CLASS_OF(address, classIndex);
+                    auto const & info = classes[classIndex];
+                    uint64_t slot = info.size == 0 ? 0 : (address - info.arena) / info.size;
+                    if (!info.isPooled || address < info.arena || (address - info.arena) % info.size != 0 || slot >= program_.poolCapacity
+                        || !pools_[classIndex].isLive[slot]) {
+                        VM_TRAP(STR("delete of an instance of " << info.name << " not allocated by new"));
+                    }
+                    pools_[classIndex].isLive[slot] = false;
+                    pools_[classIndex].free.push_back(static_cast<uint32_t>(slot));
+                    Write<int64_t>(memory + address, static_cast<int64_t>(DeletedHeader));
+                }
+                VM_NEXT();
+            }
+        }
+
+        #undef R
+        #undef VM_TRAP
+        #undef VM_CHECK
+        #undef VM_CLASS_OF
+        #undef VM_HEADERS
+        #undef VM_CASE
+        #undef VM_JUMP
+        #undef VM_DISPATCH
+        #undef VM_NEXT
+        #undef VM_GOTO
+        #undef VM_ENTER
+        #undef VM_LEAVE
+        // * every instruction continues or returns, the switch never ends
+        return 0;
+    }
+
+} // namespace tinycplus
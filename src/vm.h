@@ -0,0 +1,63 @@
+#pragma once
+
+// standard
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// internal
+#include "bytecode.h"
+
+#if defined(__GNUC__) || defined(__clang__)
+#define TINYCPLUS_HAS_COMPUTED_GOTO 1
+#endif
+
+namespace tinycplus {
+
+    /** Runs the bytecode of a TinyC+ program (--run), see BytecodeCompiler.
+        The memory is one byte array: the null guard, the globals and string literals, the pools of the pooled classes and the stack of the frames. Registers of all frames share one array too, the frame of a callee starts at the registers of its arguments.
+        Behaviour undefined in the C++ the program converts to traps instead: null and out of range accesses, division by zero, calls of abstract methods and invalid function values, deletes of instances not allocated by new and overflows of the stack.
+        Traps throw ParserError "RUN: ..." located at the TinyC+ expression of the instruction.
+     */
+    class VirtualMachine {
+    public:
+        static constexpr uint64_t StackBytes = 64 << 20;
+        static constexpr uint32_t MaxRegisters = 1 << 20;
+        static constexpr uint32_t MaxCallDepth = 100000;
+
+        VirtualMachine(BytecodeProgram const & program);
+
+        /** Initializes the globals and calls the entry, returns its result, 0 when it returns void.
+         */
+        int64_t run();
+
+    private:
+        struct Frame {
+            uint32_t function;
+            Instruction const * ip; // of the call
+            size_t registers; // first register of the frame
+            uint64_t fp;
+            uint64_t sp;
+        };
+
+        /** Pool of the instances of a pooled class, freed instances are reused first, the most recently freed one first.
+         */
+        struct Pool {
+            uint32_t used = 0; // instances allocated from the arena so far
+            std::vector<uint32_t> free;
+            std::vector<bool> isLive;
+        };
+
+        int64_t execute(uint32_t function);
+
+        [[noreturn]] void trap(std::string const & message, uint32_t function, Instruction const * ip) const;
+
+        BytecodeProgram const & program_;
+        std::vector<uint8_t> memory_;
+        std::vector<Value> registers_;
+        std::vector<Frame> frames_;
+        std::vector<Pool> pools_; // per class
+        uint64_t stackStart_ = 0;
+    }; // tinycplus::VirtualMachine
+
+} // namespace tinycplus
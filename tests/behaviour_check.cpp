@@ -0,0 +1,203 @@
+// standard
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+// internal
+#include "driver.h"
+#include "tinyc_to_cpp_converter.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define TINYCPLUS_HAS_WAIT_STATUS
+#include <sys/wait.h>
+#endif
+
+/** Behaviour tests of the transpiled programs, registered as the behaviour-check test.
+
+    Every TinyC+ program in the programs directory declares the exit code of its entry in the first line ("// expect: N", 0 to 255) and may list compiler flags in the next one ("// flags: --instrument=coverage"). The program is transpiled, converted to C++ by the tinycToCpp converter, compiled by the host C++ compiler and run. Unless it is instrumented, which only the TinyC backend supports, it is also emitted as C++ (--emit=cpp), compiled and run, and run by the bytecode VM (--run). All runs must exit with the expected code.
+
+    Usage: behaviour-check [--programs=<dir>] [--cxx=<compiler>] [--program=<name>]
+        --program    runs only the program of the given name (without the .tcp extension)
+
+    Supported flags are --instrument=, --pool-capacity= and --constexpr-steps=.
+ */
+
+#ifndef TINYCPLUS_BEHAVIOUR_PROGRAMS_DIR
+#define TINYCPLUS_BEHAVIOUR_PROGRAMS_DIR "tests/programs"
+#endif
+
+#ifndef TINYCPLUS_HOST_CXX
+#define TINYCPLUS_HOST_CXX "c++"
+#endif
+
+namespace {
+
+    namespace fs = std::filesystem;
+
+    struct Program {
+        std::string name;
+        fs::path source;
+        int expected = 0;
+        tinycplus::CompileOptions options;
+    };
+
+    Program readProgram(fs::path const & source) {
+        Program result{source.stem().string(), source};
+        std::ifstream input{source};
+        std::string line;
+        std::getline(input, line);
+        auto expectPrefix = std::string{"// expect:"};
+        if (line.rfind(expectPrefix, 0) != 0) {
+            throw std::runtime_error(STR("program " << source << " does not declare its exit code"));
+        }
+        result.expected = std::stoi(line.substr(expectPrefix.size()));
+        if (result.expected < 0 || result.expected > 255) {
+            throw std::runtime_error(STR("program " << source << " expects an exit code out of 0 to 255"));
+        }
+        std::getline(input, line);
+        auto flagsPrefix = std::string{"// flags:"};
+        if (line.rfind(flagsPrefix, 0) != 0) return result;
+        std::stringstream flags{line.substr(flagsPrefix.size())};
+        std::string flag;
+        while (flags >> flag) {
+            auto value = flag.substr(flag.find('=') + 1);
+            if (flag.rfind("--instrument=", 0) == 0) {
+                if (!tinycplus::parseInstrumentation(value, result.options)) {
+                    throw std::runtime_error(STR("program " << source << " has unknown instrumentation " << value));
+                }
+            } else if (flag.rfind("--pool-capacity=", 0) == 0) {
+                result.options.poolCapacity = std::stoi(value);
+            } else if (flag.rfind("--constexpr-steps=", 0) == 0) {
+                result.options.constexprSteps = std::stoi(value);
+            } else {
+                throw std::runtime_error(STR("program " << source << " has unsupported flag " << flag));
+            }
+        }
+        return result;
+    }
+
+    /** Runs the command, returns its exit code, or -1 if it did not exit normally.
+     */
+    int runCommand(std::string const & command) {
+        int status = std::system(command.c_str());
+#ifdef TINYCPLUS_HAS_WAIT_STATUS
+        return status != -1 && WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+#else
+        return status;
+#endif
+    }
+
+    std::string quote(fs::path const & path) {
+        return "\"" + path.string() + "\"";
+    }
+
+    /** Compiles the C++ file by the host compiler and runs it, returns the description of the failure, empty when it exits with the expected code.
+     */
+    std::string compileAndRun(Program const & program, fs::path const & cppPath, std::string const & cxx, std::string const & what) {
+        auto binaryPath = fs::path{cppPath}.replace_extension("");
+        auto compileCommand = cxx + " -std=c++17 -w " + quote(cppPath) + " -o " + quote(binaryPath);
+        if (runCommand(compileCommand) != 0) {
+            return "compile failed: " + compileCommand;
+        }
+        int exitCode = runCommand(quote(binaryPath));
+        if (exitCode != program.expected) {
+            return STR(what << " exited with " << exitCode << ", expected " << program.expected);
+        }
+        return "";
+    }
+
+    /** Returns the description of the failure, empty when the program behaves as expected.
+     */
+    std::string check(Program const & program, fs::path const & workDirectory, std::string const & cxx) {
+        auto tinycPath = workDirectory / (program.name + ".tc");
+        auto cppPath = workDirectory / (program.name + ".cpp");
+        // * TinyC+ -> TinyC -> C++
+        try {
+            {
+                std::ofstream output{tinycPath};
+                tinycplus::compileFile(program.source.string(), output, program.options);
+            }
+            std::ofstream cpp{cppPath};
+            tinycToCpp::execute(tinycPath.string(), cpp);
+        } catch (std::exception & exception) {
+            return "transpile " + tinycplus::describeError(exception);
+        }
+        auto error = compileAndRun(program, cppPath, cxx, "compiled output");
+        if (!error.empty()) return error;
+        if (program.options.isInstrumentingDispatch || program.options.isInstrumentingCoverage) return "";
+        // * TinyC+ -> C++ (--emit=cpp)
+        auto nativePath = workDirectory / (program.name + "_native.cpp");
+        try {
+            auto options = program.options;
+            options.backend = tinycplus::Backend::Cpp;
+            std::ofstream output{nativePath};
+            tinycplus::compileFile(program.source.string(), output, options);
+        } catch (std::exception & exception) {
+            return "--emit=cpp " + tinycplus::describeError(exception);
+        }
+        error = compileAndRun(program, nativePath, cxx, "--emit=cpp output");
+        if (!error.empty()) return error;
+        // * bytecode VM
+        try {
+            auto result = tinycplus::runFile(program.source.string(), program.options);
+            if (result != program.expected) {
+                return STR("--run returned " << result << ", expected " << program.expected);
+            }
+        } catch (std::exception & exception) {
+            return "--run " + tinycplus::describeError(exception);
+        }
+        return "";
+    }
+
+} // anonymous namespace
+
+int main(int argc, char ** argv) {
+    fs::path programsDirectory{TINYCPLUS_BEHAVIOUR_PROGRAMS_DIR};
+    std::string cxx{TINYCPLUS_HOST_CXX};
+    std::string only;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg{argv[i]};
+        auto value = arg.substr(arg.find('=') + 1);
+        if (arg.rfind("--programs=", 0) == 0) {
+            programsDirectory = value;
+        } else if (arg.rfind("--cxx=", 0) == 0) {
+            cxx = value;
+        } else if (arg.rfind("--program=", 0) == 0) {
+            only = value;
+        } else {
+            std::cerr << "[behaviour] unknown argument " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Program> programs;
+    try {
+        for (auto & entry : fs::directory_iterator{programsDirectory}) {
+            if (entry.path().extension() != ".tcp") continue;
+            if (!only.empty() && entry.path().stem() != only) continue;
+            programs.push_back(readProgram(entry.path()));
+        }
+    } catch (std::exception & exception) {
+        std::cerr << "[behaviour] " << exception.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::sort(programs.begin(), programs.end(), [](Program const & a, Program const & b) { return a.name < b.name; });
+
+    auto workDirectory = fs::temp_directory_path() / "tinycplus_behaviour";
+    fs::create_directories(workDirectory);
+
+    size_t failedCount = 0;
+    for (auto & program : programs) {
+        auto error = check(program, workDirectory, cxx);
+        std::cout << std::left << std::setw(32) << program.name << (error.empty() ? "ok" : error) << std::endl;
+        if (!error.empty()) ++failedCount;
+    }
+    std::cout << "[behaviour] " << programs.size() - failedCount << " of " << programs.size() << " programs passed" << std::endl;
+    return failedCount == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}